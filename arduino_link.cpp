@@ -0,0 +1,714 @@
+#include "arduino_link.h"
+#include "game_utils.h"
+#include "link_protocol.h"
+#include "link_rx.h"
+#include "baud_negotiator.h"
+#include "link_stats.h"
+#include "arm_state.h"
+#include "driver/uart.h"
+
+#define LINK_UART UART_NUM_2
+#define LINK_UART_RX_BUFFER 1024
+#define LINK_UART_TX_BUFFER 512
+#define LINK_EVENT_QUEUE_SIZE 20
+#define LINK_LINE_QUEUE_SIZE 4
+#define LINK_RX_TASK_STACK 4096
+#define LINK_RX_TASK_PRIORITY 5
+
+struct LinkLine
+{
+  char text[LINK_MAX_LINE];
+};
+
+// ASCII commands queued for one ticket, sent one line per "OK"
+struct AsciiJob
+{
+  bool active;
+  LinkTicket ticket;
+  uint8_t count;
+  uint8_t next;
+  unsigned long timeoutMs;
+  unsigned long sentAt;
+  unsigned long sentAtUs;
+  char lines[LINK_POSE_MAX_STEPS][LINK_MAX_LINE];
+  int8_t motor[LINK_POSE_MAX_STEPS]; // -1 for lines that do not move a single servo
+};
+
+// A command on the wire: start time for the round-trip histograms and the
+// joint angles to record once it is acknowledged
+struct PendingCommand
+{
+  bool used;
+  LinkTicket ticket;
+  LinkCommandKind kind;
+  int8_t motor; // -1 unless the command moves a single servo
+  unsigned long startUs;
+  bool moves;
+  LinkPose pose;
+};
+
+static volatile bool linkBinaryMode = ARDUINO_LINK_BINARY;
+
+// Receive side, filled by linkRxTask
+static QueueHandle_t uartEventQueue = NULL;
+static QueueHandle_t lineQueue = NULL;
+static SemaphoreHandle_t rxSignal = NULL;
+static ByteRing frameBytes;
+static LineAssembler lineAssembler;
+static uint32_t droppedLines = 0;
+static uint32_t uartOverflows = 0;
+
+static AsciiJob asciiJob;
+static ArmTimingModel armTiming;
+static ArmStateCache armState;
+static PendingCommand pendingCommands[LINK_WINDOW_SIZE];
+static void (*armMotionHook)() = nullptr;
+
+static uint32_t linkErrors = 0;
+static uint8_t consecutiveErrors = 0;
+
+static void uartWrite(const uint8_t *buf, size_t len, void *ctx)
+{
+  uart_write_bytes(LINK_UART, buf, len);
+}
+
+static int ringRead(void *ctx)
+{
+  return frameBytes.pop();
+}
+
+static unsigned long linkNow(void *ctx)
+{
+  return millis();
+}
+
+static void uartSetBaud(uint32_t baud, void *ctx)
+{
+  uart_wait_tx_done(LINK_UART, pdMS_TO_TICKS(100));
+  uart_set_baudrate(LINK_UART, baud);
+  // Whatever arrived around the switch is garbage at the new rate
+  frameBytes.clear();
+}
+
+static const uint32_t negotiatedRates[] = {115200, 250000, 500000};
+
+static const LinkTransport uartTransport = {uartWrite, ringRead, linkNow, nullptr};
+static LinkWindow linkWindow(uartTransport, TIMEOUT_MS_SERVO, LINK_MAX_RETRIES);
+static BaudNegotiator baudNegotiator(uartTransport, uartSetBaud, negotiatedRates,
+                                     sizeof(negotiatedRates) / sizeof(negotiatedRates[0]));
+
+static void handleRxBytes(const uint8_t *data, int len)
+{
+  for (int i = 0; i < len; i++)
+  {
+    if (linkBinaryMode)
+    {
+      frameBytes.push(data[i]);
+    }
+    else if (lineAssembler.feed(data[i]))
+    {
+      LinkLine line;
+      strncpy(line.text, lineAssembler.line(), sizeof(line.text));
+      line.text[sizeof(line.text) - 1] = '\0';
+      if (xQueueSend(lineQueue, &line, 0) != pdTRUE)
+        droppedLines++;
+    }
+  }
+  xSemaphoreGive(rxSignal);
+}
+
+// Waits on the UART driver's event queue so nothing polls the port
+static void linkRxTask(void *arg)
+{
+  uart_event_t event;
+  uint8_t chunk[64];
+
+  while (true)
+  {
+    if (xQueueReceive(uartEventQueue, &event, portMAX_DELAY) != pdTRUE)
+      continue;
+
+    switch (event.type)
+    {
+    case UART_DATA:
+    {
+      size_t remaining = event.size;
+      while (remaining > 0)
+      {
+        int n = uart_read_bytes(LINK_UART, chunk, min(remaining, sizeof(chunk)), 0);
+        if (n <= 0)
+          break;
+        remaining -= n;
+        handleRxBytes(chunk, n);
+      }
+      break;
+    }
+    case UART_FIFO_OVF:
+    case UART_BUFFER_FULL:
+      uartOverflows++;
+      uart_flush_input(LINK_UART);
+      xQueueReset(uartEventQueue);
+      lineAssembler.reset();
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+void initArduinoLink()
+{
+  uart_config_t config = {};
+  config.baud_rate = ARDUINO_LINK_BAUD;
+  config.data_bits = UART_DATA_8_BITS;
+  config.parity = UART_PARITY_DISABLE;
+  config.stop_bits = UART_STOP_BITS_1;
+  config.flow_ctrl = UART_HW_FLOWCTRL_DISABLE;
+  config.source_clk = UART_SCLK_APB;
+
+  uart_driver_install(LINK_UART, LINK_UART_RX_BUFFER, LINK_UART_TX_BUFFER, LINK_EVENT_QUEUE_SIZE, &uartEventQueue, 0);
+  uart_param_config(LINK_UART, &config);
+  uart_set_pin(LINK_UART, TXD2, RXD2, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE);
+
+  lineQueue = xQueueCreate(LINK_LINE_QUEUE_SIZE, sizeof(LinkLine));
+  rxSignal = xSemaphoreCreateBinary();
+  asciiJob.active = false;
+
+  xTaskCreate(linkRxTask, "linkRx", LINK_RX_TASK_STACK, NULL, LINK_RX_TASK_PRIORITY, NULL);
+
+#if ENABLE_LINK_BAUD_NEGOTIATION
+  if (linkBinaryMode)
+  {
+    baudNegotiator.start(ARDUINO_LINK_BAUD);
+    while (baudNegotiator.poll())
+      xSemaphoreTake(rxSignal, pdMS_TO_TICKS(10));
+
+    Serial.print("Arduino link baud rate: ");
+    Serial.println(baudNegotiator.baud());
+  }
+#endif
+}
+
+void getArduinoLinkStatus(ArduinoLinkStatus &status)
+{
+  status.binary = linkBinaryMode;
+  status.negotiating = baudNegotiator.busy();
+  status.baud = baudNegotiator.negotiations > 0 ? baudNegotiator.baud() : ARDUINO_LINK_BAUD;
+  status.negotiations = baudNegotiator.negotiations;
+  status.probes = baudNegotiator.probes;
+  status.rejected = baudNegotiator.rejected;
+  status.baudFailures = baudNegotiator.failures;
+  status.linkErrors = linkErrors;
+  status.retransmits = linkWindow.retransmits;
+  status.windowFailures = linkWindow.failures;
+  status.windowTimeouts = linkWindow.timeouts;
+  status.naks = linkWindow.naks;
+  status.elidedSteps = armState.elidedSteps;
+  status.elidedCommands = armState.elidedCommands;
+  status.armStateResets = armState.invalidations;
+  status.uartOverflows = uartOverflows;
+  status.droppedLines = droppedLines;
+}
+
+static LinkTicket trackCommand(LinkTicket ticket, LinkCommandKind kind, int motor, const LinkPose *pose)
+{
+  if (ticket == LINK_TICKET_INVALID)
+    return ticket;
+  if (armMotionHook)
+    armMotionHook();
+
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+  {
+    PendingCommand &command = pendingCommands[i];
+    if (command.used)
+      continue;
+
+    command.used = true;
+    command.ticket = ticket;
+    command.kind = kind;
+    command.motor = motor;
+    command.startUs = micros();
+    command.moves = pose != nullptr;
+    if (pose)
+      command.pose = *pose;
+    break;
+  }
+  return ticket;
+}
+
+// Records the round trip and the new joint angles of a finished ticket
+static void finishCommand(LinkTicket ticket, LinkTicketStatus status)
+{
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+  {
+    PendingCommand &command = pendingCommands[i];
+    if (!command.used || command.ticket != ticket)
+      continue;
+
+    command.used = false;
+    if (status == LINK_TICKET_ACKED)
+    {
+      uint32_t rtt = micros() - command.startUs;
+      linkStats.commandRtt[command.kind].record(rtt);
+      // The ASCII job already records each line against its motor
+      if (linkBinaryMode)
+        linkStatsRecordMotor(command.motor, rtt);
+      if (command.moves)
+        armState.acknowledge(command.pose);
+    }
+    else if (command.moves)
+    {
+      // Failed or abandoned halfway, the arm may have stopped anywhere
+      armState.invalidate();
+    }
+    return;
+  }
+}
+
+static void clearPending()
+{
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+    pendingCommands[i].used = false;
+}
+
+// A ticket for a command that had nothing left to do after elision, a full window does not fail it
+static LinkTicket completedTicket()
+{
+  return LINK_TICKET_DONE;
+}
+
+void setArmMotionHook(void (*hook)())
+{
+  armMotionHook = hook;
+}
+
+void invalidateArmState()
+{
+  armState.invalidate();
+}
+
+// Binary commands are held back while the baud rate is being negotiated
+static bool linkReady()
+{
+  if (!baudNegotiator.busy())
+    return true;
+
+  baudNegotiator.poll();
+  return !baudNegotiator.busy();
+}
+
+static void trackTicketResult(LinkTicketStatus status)
+{
+  if (status == LINK_TICKET_ACKED)
+  {
+    consecutiveErrors = 0;
+    return;
+  }
+  if (status != LINK_TICKET_FAILED)
+    return;
+
+  linkErrors++;
+  consecutiveErrors++;
+
+#if ENABLE_LINK_BAUD_NEGOTIATION
+  if (linkBinaryMode && consecutiveErrors >= LINK_RENEGOTIATE_AFTER)
+  {
+    Serial.println("Link errors, renegotiating baud rate");
+    consecutiveErrors = 0;
+    linkWindow.reset();
+    clearPending();
+    armState.invalidate();
+    baudNegotiator.start(ARDUINO_LINK_BAUD);
+  }
+#endif
+}
+
+// ASCII fallback: one command line in flight, replies are plain "OK" lines
+static void sendAsciiLine()
+{
+  xQueueReset(lineQueue);
+
+  const char *line = asciiJob.lines[asciiJob.next];
+  uart_write_bytes(LINK_UART, line, strlen(line));
+  asciiJob.sentAt = millis();
+  asciiJob.sentAtUs = micros();
+}
+
+static LinkTicket startAsciiJob(unsigned long timeoutMs)
+{
+  asciiJob.ticket = linkWindow.reserve();
+  if (asciiJob.ticket == LINK_TICKET_INVALID)
+    return LINK_TICKET_INVALID;
+
+  asciiJob.active = true;
+  asciiJob.next = 0;
+  asciiJob.timeoutMs = timeoutMs;
+  sendAsciiLine();
+  return asciiJob.ticket;
+}
+
+static void finishAsciiJob(bool ok)
+{
+  asciiJob.active = false;
+  linkWindow.finish(asciiJob.ticket, ok);
+}
+
+static void pumpAsciiJob()
+{
+  if (!asciiJob.active)
+    return;
+
+  LinkLine line;
+  if (xQueueReceive(lineQueue, &line, 0) == pdTRUE)
+  {
+    Serial.print("Received: ");
+    Serial.println(line.text);
+
+    if (strcmp(line.text, "OK") != 0)
+    {
+      linkStats.nonOkReplies++;
+      finishAsciiJob(false);
+      return;
+    }
+    linkStatsRecordMotor(asciiJob.motor[asciiJob.next], micros() - asciiJob.sentAtUs);
+
+    if (++asciiJob.next >= asciiJob.count)
+      finishAsciiJob(true);
+    else
+      sendAsciiLine();
+    return;
+  }
+
+  if (millis() - asciiJob.sentAt >= asciiJob.timeoutMs)
+  {
+    Serial.println("No reply received");
+    linkStats.timeouts++;
+    finishAsciiJob(false);
+  }
+}
+
+static bool asciiBusy()
+{
+  if (!asciiJob.active)
+    return false;
+
+  // Callers poll this every loop while a job runs, count it rather than print it
+  linkStats.busy++;
+  return true;
+}
+
+// Block the calling task until a ticket is acked, failed or dropped
+static bool waitForTicket(LinkTicket ticket)
+{
+  if (ticket == LINK_TICKET_INVALID)
+  {
+    Serial.println("Link window full");
+    return false;
+  }
+
+  while (true)
+  {
+    LinkTicketStatus status = pollLinkCommand(ticket);
+    if (status == LINK_TICKET_PENDING)
+    {
+      // Woken by the receive task, the timeout keeps retransmit timers running
+      xSemaphoreTake(rxSignal, pdMS_TO_TICKS(10));
+      continue;
+    }
+
+    if (status != LINK_TICKET_ACKED)
+      Serial.println("No ACK received");
+    return status == LINK_TICKET_ACKED;
+  }
+}
+
+bool sendServoCommand(int a1, int a2, int a3)
+{
+  return waitForTicket(submitServoCommand(a1, a2, a3));
+}
+
+static void formatDenseStepperLine(char *line, const int cmds[STEPPER_COUNT])
+{
+  int pos = snprintf(line, LINK_MAX_LINE, "S");
+  for (int i = 0; i < STEPPER_COUNT; i++)
+    pos += snprintf(line + pos, LINK_MAX_LINE - pos, ",%d", cmds[i]);
+  snprintf(line + pos, LINK_MAX_LINE - pos, "\r\n");
+}
+
+bool sendStepperCommand(const int cmds[STEPPER_COUNT])
+{
+  if (linkBinaryMode)
+  {
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    uint8_t len = linkPackStepper(payload, cmds);
+    if (len == 0)
+    {
+      Serial.println("Invalid stepper command");
+      return false;
+    }
+    if (!linkReady())
+      return waitForTicket(LINK_TICKET_INVALID);
+    return waitForTicket(trackCommand(linkWindow.submit(LINK_OP_STEPPER, payload, len), LINK_CMD_STEPPER, -1, nullptr));
+  }
+
+  if (asciiBusy())
+    return false;
+
+  formatDenseStepperLine(asciiJob.lines[0], cmds);
+  asciiJob.motor[0] = -1;
+  asciiJob.count = 1;
+
+  return waitForTicket(trackCommand(startAsciiJob(TIMEOUT_MS_STEPPER), LINK_CMD_STEPPER, -1, nullptr));
+}
+
+// Sparse stepper helpers
+void stepperBegin(StepperMove &move)
+{
+  move.count = 0;
+}
+
+bool stepperAdd(StepperMove &move, uint8_t stepper, int angle, int direction)
+{
+  if (move.count >= LINK_STEPPER_MOTORS || stepper >= LINK_STEPPER_MOTORS || angle < 0 || angle >= LINK_STEPPER_DIR_BIT)
+  {
+    Serial.println("Invalid stepper move");
+    return false;
+  }
+
+  move.motor[move.count] = stepper;
+  move.angle[move.count] = angle;
+  move.direction[move.count] = direction ? 1 : 0;
+  move.count++;
+  return true;
+}
+
+bool sendStepperMove(const StepperMove &move)
+{
+  return waitForTicket(submitStepperMove(move));
+}
+
+// Multi-joint pose helpers
+void poseBegin(ArmPose &pose, uint16_t staggerMs)
+{
+  pose.count = 0;
+  pose.staggerMs = staggerMs;
+}
+
+bool poseAdd(ArmPose &pose, ArmMotor motor, int angle, int overShoot)
+{
+  if (pose.count >= LINK_POSE_MAX_STEPS)
+  {
+    Serial.println("Pose has too many steps");
+    return false;
+  }
+
+  pose.motor[pose.count] = motor;
+  pose.angle[pose.count] = angle;
+  pose.overShoot[pose.count] = overShoot;
+  pose.count++;
+  return true;
+}
+
+bool sendPoseCommand(const ArmPose &pose)
+{
+  return waitForTicket(submitPoseCommand(pose));
+}
+
+void getArmAngles(int angles[ARM_TIMING_JOINTS])
+{
+  for (int i = 0; i < ARM_TIMING_JOINTS; i++)
+    angles[i] = armState.angle(i);
+}
+
+bool planPose(ArmPose &pose, const ArmGoal &goal, const ArmConstraint *constraints, uint8_t count)
+{
+#if ENABLE_ARM_PLANNER
+  int start[ARM_TIMING_JOINTS];
+  getArmAngles(start);
+
+  ArmPlan plan;
+  if (!armPlan(armTiming, start, goal, constraints, count, plan) || !armPlanToPose(plan, pose))
+  {
+    Serial.println("Arm planner failed, using the fixed order");
+    return false;
+  }
+
+  Serial.print("Planned ");
+  Serial.print(plan.count);
+  Serial.print(" steps in ");
+  Serial.print(plan.phases);
+  Serial.print(" phases, ");
+  Serial.print(plan.durationMs);
+  Serial.println(" ms");
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Non-blocking pose command, the result is collected with pollLinkCommand()
+LinkTicket submitPoseCommand(const ArmPose &requested)
+{
+  // Only send the steps that move something
+  ArmPose pose = requested;
+  if (armState.elide(pose) > 0 && pose.count == 0)
+    return completedTicket();
+
+  if (!linkBinaryMode)
+  {
+    // The ASCII firmware has no pose command, send the steps one by one
+    if (asciiBusy() || pose.count == 0)
+      return LINK_TICKET_INVALID;
+
+    for (int i = 0; i < pose.count; i++)
+    {
+      snprintf(asciiJob.lines[i], LINK_MAX_LINE, "A,%d,%d,%d\r\n", pose.motor[i], pose.angle[i], pose.overShoot[i]);
+      asciiJob.motor[i] = pose.motor[i];
+    }
+    asciiJob.count = pose.count;
+    return trackCommand(startAsciiJob(TIMEOUT_MS_SERVO), LINK_CMD_POSE, -1, &pose);
+  }
+
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  uint8_t len = linkPackPose(payload, pose);
+  if (len == 0)
+  {
+    Serial.println("Invalid pose command");
+    return LINK_TICKET_INVALID;
+  }
+  if (!linkReady())
+    return LINK_TICKET_INVALID;
+  LinkTicket ticket = linkWindow.submit(LINK_OP_POSE, payload, len, (unsigned long)TIMEOUT_MS_SERVO * pose.count);
+  return trackCommand(ticket, LINK_CMD_POSE, pose.count == 1 ? pose.motor[0] : -1, &pose);
+}
+
+// Non-blocking servo command, the result is collected with pollLinkCommand()
+LinkTicket submitServoCommand(int a1, int a2, int a3)
+{
+  ArmPose pose;
+  poseBegin(pose);
+  poseAdd(pose, (ArmMotor)a1, a2, a3);
+  if (armState.elide(pose) > 0)
+    return completedTicket();
+
+  if (!linkBinaryMode)
+  {
+    if (asciiBusy())
+      return LINK_TICKET_INVALID;
+
+    snprintf(asciiJob.lines[0], LINK_MAX_LINE, "A,%d,%d,%d\r\n", a1, a2, a3);
+    asciiJob.motor[0] = a1;
+    asciiJob.count = 1;
+    return trackCommand(startAsciiJob(TIMEOUT_MS_SERVO), LINK_CMD_SERVO, a1, &pose);
+  }
+
+  if (!linkReady())
+    return LINK_TICKET_INVALID;
+
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  uint8_t len = linkPackServo(payload, (uint8_t)a1, (int16_t)a2, (int8_t)a3);
+  return trackCommand(linkWindow.submit(LINK_OP_SERVO, payload, len), LINK_CMD_SERVO, a1, &pose);
+}
+
+// Non-blocking stepper command, the result is collected with pollLinkCommand()
+LinkTicket submitStepperMove(const StepperMove &move)
+{
+  if (linkBinaryMode)
+  {
+    uint8_t payload[LINK_MAX_PAYLOAD];
+    uint8_t len = linkPackStepperMove(payload, move);
+    if (len == 0)
+    {
+      Serial.println("Invalid stepper command");
+      return LINK_TICKET_INVALID;
+    }
+    if (!linkReady())
+      return LINK_TICKET_INVALID;
+    return trackCommand(linkWindow.submit(LINK_OP_STEPPER_SPARSE, payload, len), LINK_CMD_STEPPER, -1, nullptr);
+  }
+
+  if (asciiBusy() || move.count == 0)
+    return LINK_TICKET_INVALID;
+
+#if ARDUINO_LINK_SPARSE_STEPPER
+  int pos = snprintf(asciiJob.lines[0], LINK_MAX_LINE, "T");
+  for (int i = 0; i < move.count; i++)
+    pos += snprintf(asciiJob.lines[0] + pos, LINK_MAX_LINE - pos, ",%d,%d,%d", move.motor[i], move.angle[i], move.direction[i]);
+  snprintf(asciiJob.lines[0] + pos, LINK_MAX_LINE - pos, "\r\n");
+#else
+  int cmds[STEPPER_COUNT] = {0};
+  for (int i = 0; i < move.count; i++)
+  {
+    cmds[move.motor[i] * 2] = move.angle[i];
+    cmds[move.motor[i] * 2 + 1] = move.direction[i];
+  }
+  formatDenseStepperLine(asciiJob.lines[0], cmds);
+#endif
+  asciiJob.motor[0] = -1;
+  asciiJob.count = 1;
+  return trackCommand(startAsciiJob(TIMEOUT_MS_STEPPER), LINK_CMD_STEPPER, -1, nullptr);
+}
+
+LinkTicketStatus pollLinkCommand(LinkTicket ticket)
+{
+  pumpAsciiJob();
+
+  // The negotiator owns the receive ring until it is done
+  if (baudNegotiator.busy())
+    baudNegotiator.poll();
+  else
+    linkWindow.poll();
+
+  LinkTicketStatus status = linkWindow.check(ticket);
+  if (status == LINK_TICKET_ACKED || status == LINK_TICKET_FAILED)
+    finishCommand(ticket, status);
+  trackTicketResult(status);
+  return status;
+}
+
+void cancelLinkCommand(LinkTicket ticket)
+{
+  if (asciiJob.active && asciiJob.ticket == ticket)
+    asciiJob.active = false;
+  finishCommand(ticket, LINK_TICKET_UNKNOWN);
+  linkWindow.release(ticket);
+}
+
+bool executePose(const ArmPose &pose, LinkTicket &ticket, RetryPolicy &retry)
+{
+  if (ticket == LINK_TICKET_INVALID)
+  {
+    unsigned long now = millis();
+    if (!retry.ready(now))
+      return false; // Backing off, or gave up until the game restarts
+
+    ticket = submitPoseCommand(pose);
+    if (ticket == LINK_TICKET_INVALID)
+    {
+      retry.defer(now);
+      return false;
+    }
+  }
+
+  LinkTicketStatus status = pollLinkCommand(ticket);
+  if (status == LINK_TICKET_PENDING)
+    return false;
+
+  ticket = LINK_TICKET_INVALID;
+  if (status == LINK_TICKET_ACKED)
+  {
+    retry.success(millis());
+    return true;
+  }
+
+  if (retry.failure(millis()))
+  {
+    Serial.println("Pose command failed, will retry...");
+  }
+  else
+  {
+    Serial.println("Pose command failed, giving up");
+    printOnLCD("Arm not responding");
+  }
+  return false;
+}
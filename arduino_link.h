@@ -0,0 +1,58 @@
+#ifndef ARDUINO_LINK_H
+#define ARDUINO_LINK_H
+
+#include <Arduino.h>
+#include "link_window.h"
+
+// Serial2 Pins (comm with Arduino)
+#define RXD2 13
+#define TXD2 12
+#define STEPPER_COUNT 10
+#define TIMEOUT_MS_SERVO 5000
+#define TIMEOUT_MS_STEPPER 5000
+
+// Arduino link protocol: 0 = ASCII lines ("A,1,105,10"), 1 = binary frames (see link_protocol.h)
+#ifndef ARDUINO_LINK_BINARY
+#define ARDUINO_LINK_BINARY 0
+#endif
+#define LINK_MAX_RETRIES 2
+#define ARDUINO_LINK_BAUD 9600
+// ASCII only: 1 = the firmware understands sparse "T,motor,angle,dir,..." stepper lines,
+// 0 = sparse stepper moves are expanded to the dense "S,..." line
+#define ARDUINO_LINK_SPARSE_STEPPER 0
+
+// Binary mode only: rates probed above ARDUINO_LINK_BAUD (see baud_negotiator.h).
+// The Arduino is expected to drop back to ARDUINO_LINK_BAUD when it resets or
+// stops receiving valid frames, so repeated link errors restart from the base rate.
+#define ENABLE_LINK_BAUD_NEGOTIATION 1
+#define LINK_RENEGOTIATE_AFTER 3 // consecutive failed commands
+
+// Called from the game loop for every command that moves the arm or the steppers
+void setArmMotionHook(void (*hook)());
+
+struct ArduinoLinkStatus
+{
+  bool binary;
+  bool negotiating;
+  uint32_t baud;
+  uint32_t negotiations;
+  uint32_t probes;
+  uint32_t rejected;
+  uint32_t baudFailures;
+  uint32_t linkErrors;
+  uint32_t retransmits;
+  uint32_t windowFailures;
+  uint32_t windowTimeouts;
+  uint32_t naks;
+  uint32_t elidedSteps;    // pose steps dropped because the joint was already there
+  uint32_t elidedCommands; // commands that never went on the wire
+  uint32_t armStateResets;
+  uint32_t uartOverflows;
+  uint32_t droppedLines;
+};
+
+// Installs the UART driver, starts the receive task and negotiates the baud rate
+void initArduinoLink();
+void getArduinoLinkStatus(ArduinoLinkStatus &status);
+
+#endif
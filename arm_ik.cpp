@@ -0,0 +1,162 @@
+#include "arm_ik.h"
+#include <math.h>
+
+#define DEG_PER_RAD 57.29578f
+
+static float jointAngle(const ArmGeometry &geometry, uint8_t joint, int servo)
+{
+  return (servo - geometry.offset[joint]) * geometry.direction[joint];
+}
+
+static int servoAngle(const ArmGeometry &geometry, uint8_t joint, float angle)
+{
+  return (int)lroundf(geometry.offset[joint] + angle * geometry.direction[joint]);
+}
+
+void armIkForward(const ArmGeometry &geometry, const int angles[ARM_IK_JOINTS], ArmPoint &point)
+{
+  float base = jointAngle(geometry, 0, angles[0]) / DEG_PER_RAD;
+  float shoulder = jointAngle(geometry, 1, angles[1]) / DEG_PER_RAD;
+  float elbow = shoulder + jointAngle(geometry, 2, angles[2]) / DEG_PER_RAD;
+  float wrist = elbow + jointAngle(geometry, 3, angles[3]) / DEG_PER_RAD;
+
+  float reach = geometry.upperArm * cosf(shoulder) + geometry.forearm * cosf(elbow) + geometry.hand * cosf(wrist);
+  point.x = reach * cosf(base);
+  point.y = reach * sinf(base);
+  point.z = geometry.baseHeight + geometry.upperArm * sinf(shoulder) + geometry.forearm * sinf(elbow) +
+            geometry.hand * sinf(wrist);
+  point.pitch = wrist * DEG_PER_RAD;
+}
+
+bool armIkSolve(const ArmGeometry &geometry, const ArmPoint &point, int angles[ARM_IK_JOINTS])
+{
+  float pitch = point.pitch / DEG_PER_RAD;
+  float reach = sqrtf(point.x * point.x + point.y * point.y);
+
+  // Wrist centre in the arm plane
+  float r = reach - geometry.hand * cosf(pitch);
+  float z = point.z - geometry.baseHeight - geometry.hand * sinf(pitch);
+  float l1 = geometry.upperArm;
+  float l2 = geometry.forearm;
+
+  float c = (r * r + z * z - l1 * l1 - l2 * l2) / (2 * l1 * l2);
+  if (c < -1 || c > 1)
+    return false;
+
+  float elbow = geometry.elbowSign * acosf(c);
+  float shoulder = atan2f(z, r) - atan2f(l2 * sinf(elbow), l1 + l2 * cosf(elbow));
+  float wrist = pitch - shoulder - elbow;
+  float base = atan2f(point.y, point.x);
+
+  float joints[ARM_IK_JOINTS] = {base, shoulder, elbow, wrist};
+  for (uint8_t i = 0; i < ARM_IK_JOINTS; i++)
+  {
+    int servo = servoAngle(geometry, i, joints[i] * DEG_PER_RAD);
+    if (servo < 0 || servo > 180)
+      return false;
+    angles[i] = servo;
+  }
+  return true;
+}
+
+static ArmPoint difference(const ArmPoint &a, const ArmPoint &b, float div)
+{
+  ArmPoint d;
+  d.x = (a.x - b.x) / div;
+  d.y = (a.y - b.y) / div;
+  d.z = (a.z - b.z) / div;
+  d.pitch = (a.pitch - b.pitch) / div;
+  return d;
+}
+
+void armBoardFromTable(const ArmGeometry &geometry, const int (*table)[ARM_IK_JOINTS], uint8_t rows, uint8_t cols,
+                       ArmBoard &board)
+{
+  ArmPoint lastRow;
+  ArmPoint lastCol;
+  armIkForward(geometry, table[0], board.origin);
+  armIkForward(geometry, table[(rows - 1) * cols], lastRow);
+  armIkForward(geometry, table[cols - 1], lastCol);
+
+  board.rowStep = difference(lastRow, board.origin, rows > 1 ? rows - 1 : 1);
+  board.colStep = difference(lastCol, board.origin, cols > 1 ? cols - 1 : 1);
+}
+
+ArmPoint armBoardPoint(const ArmBoard &board, uint8_t row, uint8_t col)
+{
+  ArmPoint p;
+  p.x = board.origin.x + row * board.rowStep.x + col * board.colStep.x;
+  p.y = board.origin.y + row * board.rowStep.y + col * board.colStep.y;
+  p.z = board.origin.z + row * board.rowStep.z + col * board.colStep.z;
+  p.pitch = board.origin.pitch + row * board.rowStep.pitch + col * board.colStep.pitch;
+  return p;
+}
+
+uint8_t armIkTable(const ArmGeometry &geometry, const ArmBoard &board, uint8_t rows, uint8_t cols,
+                   int (*table)[ARM_IK_JOINTS])
+{
+  uint8_t unreachable = 0;
+  for (uint8_t row = 0; row < rows; row++)
+  {
+    for (uint8_t col = 0; col < cols; col++)
+    {
+      int angles[ARM_IK_JOINTS];
+      if (!armIkSolve(geometry, armBoardPoint(board, row, col), angles))
+      {
+        unreachable++;
+        continue;
+      }
+      for (uint8_t i = 0; i < ARM_IK_JOINTS; i++)
+        table[row * cols + col][i] = angles[i];
+    }
+  }
+  return unreachable;
+}
+
+void armIkCompare(const ArmGeometry &geometry, const ArmBoard &board, uint8_t rows, uint8_t cols,
+                  const int (*table)[ARM_IK_JOINTS], ArmIkReport &report)
+{
+  report.cells = 0;
+  report.unreachable = 0;
+  report.worstCell = 0;
+  report.worstError = 0;
+  for (uint8_t i = 0; i < ARM_IK_JOINTS; i++)
+  {
+    report.maxError[i] = 0;
+    report.meanError[i] = 0;
+  }
+
+  for (uint8_t row = 0; row < rows; row++)
+  {
+    for (uint8_t col = 0; col < cols; col++)
+    {
+      uint8_t cell = row * cols + col;
+      int angles[ARM_IK_JOINTS];
+      if (!armIkSolve(geometry, armBoardPoint(board, row, col), angles))
+      {
+        report.unreachable++;
+        continue;
+      }
+
+      report.cells++;
+      for (uint8_t i = 0; i < ARM_IK_JOINTS; i++)
+      {
+        float error = fabsf((float)(angles[i] - table[cell][i]));
+        report.meanError[i] += error;
+        if (error > report.maxError[i])
+          report.maxError[i] = error;
+        if (error > report.worstError)
+        {
+          report.worstError = error;
+          report.worstCell = cell;
+        }
+      }
+    }
+  }
+
+  if (report.cells > 0)
+  {
+    for (uint8_t i = 0; i < ARM_IK_JOINTS; i++)
+      report.meanError[i] /= report.cells;
+  }
+}
@@ -0,0 +1,77 @@
+#ifndef ARM_IK_H
+#define ARM_IK_H
+
+#include <stdint.h>
+
+/**
+ * Inverse kinematics of the 4-DOF arm (base yaw, shoulder, elbow and wrist
+ * pitch) and generation of the per-game angle tables.
+ *
+ * A board is described by three measured reference cells: the first cell,
+ * the first cell of the last row and the last cell of the first row. The
+ * other cells are interpolated in board space and solved back to servo
+ * angles, so a bumped rig is recalibrated by re-teaching three cells. The
+ * tables stay plain arrays, lookup is unchanged. No Arduino dependencies so
+ * it also builds on a host.
+ */
+
+#define ARM_IK_JOINTS 4 // BASE..WRIST, the grip does not move the hand
+
+// Link lengths in mm, servo angle at joint angle 0 and turning direction per joint.
+// elbowSign picks the elbow-up (-1) or elbow-down (1) solution. Fitted to the
+// hand-tuned tables of the games, measure the rig and update after a rebuild.
+#define ARM_GEOMETRY_DEFAULTS {70, 120, 140, 100, {0, 0, 45, 135}, {1, 1, -1, 1}, -1}
+
+struct ArmGeometry
+{
+  float baseHeight;
+  float upperArm;
+  float forearm;
+  float hand;
+  float offset[ARM_IK_JOINTS];
+  int8_t direction[ARM_IK_JOINTS];
+  int8_t elbowSign;
+};
+
+// Hand tip in mm around the base axis, pitch of the hand in degrees from horizontal
+struct ArmPoint
+{
+  float x;
+  float y;
+  float z;
+  float pitch;
+};
+
+struct ArmBoard
+{
+  ArmPoint origin;
+  ArmPoint rowStep;
+  ArmPoint colStep;
+};
+
+struct ArmIkReport
+{
+  uint8_t cells;
+  uint8_t unreachable;
+  float maxError[ARM_IK_JOINTS]; // degrees
+  float meanError[ARM_IK_JOINTS];
+  uint8_t worstCell;
+  float worstError;
+};
+
+void armIkForward(const ArmGeometry &geometry, const int angles[ARM_IK_JOINTS], ArmPoint &point);
+// Returns false when the point is out of reach or a servo would leave 0..180
+bool armIkSolve(const ArmGeometry &geometry, const ArmPoint &point, int angles[ARM_IK_JOINTS]);
+
+// Tables are row-major, one entry of ARM_IK_JOINTS angles per cell
+void armBoardFromTable(const ArmGeometry &geometry, const int (*table)[ARM_IK_JOINTS], uint8_t rows, uint8_t cols,
+                       ArmBoard &board);
+ArmPoint armBoardPoint(const ArmBoard &board, uint8_t row, uint8_t col);
+// Overwrites every reachable cell, returns how many were out of reach and left as they were
+uint8_t armIkTable(const ArmGeometry &geometry, const ArmBoard &board, uint8_t rows, uint8_t cols,
+                   int (*table)[ARM_IK_JOINTS]);
+// Difference between the generated angles and `table`
+void armIkCompare(const ArmGeometry &geometry, const ArmBoard &board, uint8_t rows, uint8_t cols,
+                  const int (*table)[ARM_IK_JOINTS], ArmIkReport &report);
+
+#endif
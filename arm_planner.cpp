@@ -0,0 +1,207 @@
+#include "arm_planner.h"
+#include <stdlib.h>
+
+// Node i < ARM_TIMING_JOINTS is the interim move of joint i, the rest are the final moves
+#define PLAN_NODES (ARM_TIMING_JOINTS * 2)
+#define INTERIM(joint) (joint)
+#define FINAL(joint) (ARM_TIMING_JOINTS + (joint))
+
+void armGoalBegin(ArmGoal &goal)
+{
+  for (int i = 0; i < ARM_TIMING_JOINTS; i++)
+  {
+    goal.angle[i] = ARM_PLAN_KEEP;
+    goal.overShoot[i] = 0;
+  }
+}
+
+void armGoalSet(ArmGoal &goal, uint8_t joint, int angle, int8_t overShoot)
+{
+  if (joint >= ARM_TIMING_JOINTS)
+    return;
+  goal.angle[joint] = angle;
+  goal.overShoot[joint] = overShoot;
+}
+
+static bool satisfies(ArmConstraintType type, int angle, int value)
+{
+  if (angle == ARM_TIMING_UNKNOWN_ANGLE)
+    return false;
+  return type == ARM_REQUIRE_MIN ? angle >= value : angle <= value;
+}
+
+bool armPlan(const ArmTimingModel &model, const int start[ARM_TIMING_JOINTS], const ArmGoal &goal,
+             const ArmConstraint *constraints, uint8_t constraintCount, ArmPlan &plan)
+{
+  bool used[PLAN_NODES] = {false};
+  int target[PLAN_NODES];
+  int8_t overShoot[PLAN_NODES];
+  uint16_t deps[PLAN_NODES] = {0};
+
+  for (int j = 0; j < ARM_TIMING_JOINTS; j++)
+  {
+    int angle = goal.angle[j];
+    if (angle == ARM_PLAN_KEEP || angle == start[j])
+      continue;
+    used[FINAL(j)] = true;
+    target[FINAL(j)] = angle;
+    overShoot[FINAL(j)] = goal.overShoot[j];
+  }
+
+  // An interim move can add a final move that other rules depend on, repeat until nothing is added
+  bool grew = true;
+  while (grew)
+  {
+    grew = false;
+    for (int c = 0; c < constraintCount; c++)
+    {
+      const ArmConstraint &rule = constraints[c];
+      uint8_t a = rule.joint;
+      uint8_t b = rule.other;
+      if (a >= ARM_TIMING_JOINTS || b >= ARM_TIMING_JOINTS || !used[FINAL(b)])
+        continue;
+
+      if (rule.type == ARM_ORDER)
+      {
+        if (used[FINAL(a)])
+          deps[FINAL(b)] |= 1 << FINAL(a);
+        continue;
+      }
+
+      // Only a real move of the other joint needs protecting
+      if (start[b] != ARM_TIMING_UNKNOWN_ANGLE && abs(target[FINAL(b)] - start[b]) <= rule.threshold)
+        continue;
+
+      bool startOk = satisfies(rule.type, start[a], rule.value);
+      bool goalOk = used[FINAL(a)] ? satisfies(rule.type, target[FINAL(a)], rule.value) : startOk;
+
+      if (startOk && goalOk)
+        continue;
+      if (startOk)
+      {
+        deps[FINAL(a)] |= 1 << FINAL(b); // Leave only once the other joint is done
+        continue;
+      }
+      if (goalOk)
+      {
+        deps[FINAL(b)] |= 1 << FINAL(a); // Get there first
+        continue;
+      }
+
+      // Go through an interim angle, then on to the goal once the other joint is done
+      if (!used[INTERIM(a)])
+      {
+        used[INTERIM(a)] = true;
+        target[INTERIM(a)] = rule.value;
+        overShoot[INTERIM(a)] = rule.overShoot;
+      }
+      else if (rule.type == ARM_REQUIRE_MIN ? rule.value > target[INTERIM(a)] : rule.value < target[INTERIM(a)])
+      {
+        target[INTERIM(a)] = rule.value;
+      }
+      if (!used[FINAL(a)] && goal.angle[a] != ARM_PLAN_KEEP)
+      {
+        // Already at the goal, but it has to come back after the interim move
+        used[FINAL(a)] = true;
+        target[FINAL(a)] = goal.angle[a];
+        overShoot[FINAL(a)] = goal.overShoot[a];
+        grew = true;
+      }
+      deps[FINAL(b)] |= 1 << INTERIM(a);
+      if (used[FINAL(a)])
+        deps[FINAL(a)] |= 1 << FINAL(b);
+    }
+  }
+
+  for (int j = 0; j < ARM_TIMING_JOINTS; j++)
+  {
+    if (used[INTERIM(j)] && used[FINAL(j)])
+      deps[FINAL(j)] |= 1 << INTERIM(j);
+  }
+
+  // Earliest phase of every node, a cycle never settles
+  int phase[PLAN_NODES];
+  int count = 0;
+  for (int n = 0; n < PLAN_NODES; n++)
+  {
+    phase[n] = 0;
+    if (used[n])
+      count++;
+  }
+  if (count > ARM_PLAN_MAX_STEPS)
+    return false;
+
+  bool changed = true;
+  for (int pass = 0; changed; pass++)
+  {
+    if (pass > PLAN_NODES)
+      return false;
+
+    changed = false;
+    for (int n = 0; n < PLAN_NODES; n++)
+    {
+      if (!used[n])
+        continue;
+      for (int d = 0; d < PLAN_NODES; d++)
+      {
+        if ((deps[n] & (1 << d)) && used[d] && phase[n] <= phase[d])
+        {
+          phase[n] = phase[d] + 1;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // Emit phase by phase, a phase lasts as long as its slowest joint
+  int position[ARM_TIMING_JOINTS];
+  for (int j = 0; j < ARM_TIMING_JOINTS; j++)
+    position[j] = start[j];
+
+  plan.count = 0;
+  plan.phases = 0;
+  plan.durationMs = 0;
+  for (int p = 0; plan.count < count; p++)
+  {
+    uint32_t longest = 0;
+    for (int n = 0; n < PLAN_NODES; n++)
+    {
+      if (!used[n] || phase[n] != p)
+        continue;
+
+      uint8_t joint = n % ARM_TIMING_JOINTS;
+      uint32_t ms = model.servoTravelMs(joint, position[joint], target[n], overShoot[n]);
+      if (ms > longest)
+        longest = ms;
+      position[joint] = target[n];
+
+      plan.motor[plan.count] = joint;
+      plan.angle[plan.count] = target[n];
+      plan.overShoot[plan.count] = overShoot[n];
+      plan.phase[plan.count] = p;
+      plan.count++;
+    }
+    plan.durationMs += longest;
+    plan.phases = p + 1;
+  }
+  return true;
+}
+
+bool armPlanToPose(const ArmPlan &plan, LinkPose &pose)
+{
+  if (plan.count == 0 || plan.count > LINK_POSE_MAX_STEPS)
+    return false;
+
+  uint16_t joined = 0;
+  for (int i = 0; i < plan.count; i++)
+  {
+    pose.motor[i] = plan.motor[i];
+    pose.angle[i] = plan.angle[i];
+    pose.overShoot[i] = plan.overShoot[i];
+    if (i > 0 && plan.phase[i] == plan.phase[i - 1])
+      joined |= 1 << i;
+  }
+  pose.count = plan.count;
+  pose.staggerMs = LINK_POSE_GROUPED | joined;
+  return true;
+}
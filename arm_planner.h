@@ -0,0 +1,70 @@
+#ifndef ARM_PLANNER_H
+#define ARM_PLANNER_H
+
+#include <stdint.h>
+#include "arm_timing.h"
+#include "link_protocol.h"
+
+/**
+ * Arm motion planner.
+ *
+ * Takes the current joint angles, a goal and a list of safety constraints
+ * and orders the joint moves into phases: every move starts in the earliest
+ * phase its constraints allow, and moves in the same phase run together.
+ * Interim moves (e.g. lifting the shoulder before the base swings) are only
+ * inserted when the start angles actually violate a constraint. Phase
+ * durations come from ArmTimingModel. No Arduino dependencies so it also
+ * builds on a host.
+ */
+
+#define ARM_PLAN_MAX_STEPS LINK_POSE_MAX_STEPS
+#define ARM_PLAN_KEEP -1 // goal angle of a joint that does not need to move
+
+enum ArmConstraintType
+{
+  // `joint` must be >= (MIN) or <= (MAX) `value` while `other` makes its move,
+  // unless `other` travels `threshold` degrees or less
+  ARM_REQUIRE_MIN,
+  ARM_REQUIRE_MAX,
+  // `joint` reaches its goal before `other` makes its final move
+  ARM_ORDER
+};
+
+struct ArmConstraint
+{
+  ArmConstraintType type;
+  uint8_t joint;
+  uint8_t other;
+  int16_t value;
+  int16_t threshold;
+  int8_t overShoot; // used for the interim move of `joint`
+};
+
+struct ArmGoal
+{
+  int angle[ARM_TIMING_JOINTS];
+  int8_t overShoot[ARM_TIMING_JOINTS];
+};
+
+struct ArmPlan
+{
+  uint8_t count;
+  uint8_t phases;
+  uint8_t motor[ARM_PLAN_MAX_STEPS];
+  int16_t angle[ARM_PLAN_MAX_STEPS];
+  int8_t overShoot[ARM_PLAN_MAX_STEPS];
+  uint8_t phase[ARM_PLAN_MAX_STEPS];
+  uint32_t durationMs;
+};
+
+void armGoalBegin(ArmGoal &goal);
+void armGoalSet(ArmGoal &goal, uint8_t joint, int angle, int8_t overShoot = 0);
+
+// start holds ARM_TIMING_UNKNOWN_ANGLE for joints whose position is not known.
+// Returns false if the constraints form a cycle or the plan needs too many steps.
+bool armPlan(const ArmTimingModel &model, const int start[ARM_TIMING_JOINTS], const ArmGoal &goal,
+             const ArmConstraint *constraints, uint8_t constraintCount, ArmPlan &plan);
+// Grouped pose: steps of one phase start together, each phase waits for the previous one
+bool armPlanToPose(const ArmPlan &plan, LinkPose &pose);
+
+#endif
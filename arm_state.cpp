@@ -0,0 +1,89 @@
+#include "arm_state.h"
+#include <stdlib.h>
+
+ArmStateCache::ArmStateCache()
+{
+  elidedSteps = 0;
+  elidedCommands = 0;
+  invalidations = 0;
+  for (int i = 0; i < ARM_STATE_JOINTS; i++)
+    angles[i] = ARM_STATE_UNKNOWN;
+}
+
+void ArmStateCache::invalidate()
+{
+  invalidations++;
+  for (int i = 0; i < ARM_STATE_JOINTS; i++)
+    angles[i] = ARM_STATE_UNKNOWN;
+}
+
+int ArmStateCache::angle(uint8_t joint) const
+{
+  return joint < ARM_STATE_JOINTS ? angles[joint] : ARM_STATE_UNKNOWN;
+}
+
+bool ArmStateCache::redundant(uint8_t joint, int angle) const
+{
+  int current = this->angle(joint);
+  return current != ARM_STATE_UNKNOWN && abs(current - angle) <= ARM_STATE_TOLERANCE;
+}
+
+void ArmStateCache::acknowledge(uint8_t joint, int angle)
+{
+  if (joint < ARM_STATE_JOINTS)
+    angles[joint] = angle;
+}
+
+void ArmStateCache::acknowledge(const LinkPose &pose)
+{
+  for (int i = 0; i < pose.count; i++)
+    acknowledge(pose.motor[i], pose.angle[i]);
+}
+
+uint8_t ArmStateCache::elide(LinkPose &pose)
+{
+  bool grouped = pose.staggerMs != LINK_POSE_SEQUENTIAL && (pose.staggerMs & LINK_POSE_GROUPED);
+
+  // Follow the joints through the pose, earlier steps move them
+  int position[ARM_STATE_JOINTS];
+  for (int i = 0; i < ARM_STATE_JOINTS; i++)
+    position[i] = angles[i];
+
+  uint8_t kept = 0;
+  uint8_t group = 0;
+  uint8_t lastKeptGroup = 0;
+  uint16_t joined = 0;
+  for (int i = 0; i < pose.count; i++)
+  {
+    if (i > 0 && !(grouped && (pose.staggerMs & (1 << i))))
+      group++;
+
+    uint8_t joint = pose.motor[i];
+    bool skip = joint < ARM_STATE_JOINTS && position[joint] != ARM_STATE_UNKNOWN &&
+                abs(position[joint] - pose.angle[i]) <= ARM_STATE_TOLERANCE;
+    if (joint < ARM_STATE_JOINTS)
+      position[joint] = pose.angle[i];
+    if (skip)
+      continue;
+
+    // A kept step stays joined only to a kept step of its own group
+    if (kept > 0 && group == lastKeptGroup)
+      joined |= 1 << kept;
+    lastKeptGroup = group;
+
+    pose.motor[kept] = pose.motor[i];
+    pose.angle[kept] = pose.angle[i];
+    pose.overShoot[kept] = pose.overShoot[i];
+    kept++;
+  }
+
+  uint8_t dropped = pose.count - kept;
+  pose.count = kept;
+  if (grouped)
+    pose.staggerMs = LINK_POSE_GROUPED | joined;
+
+  elidedSteps += dropped;
+  if (kept == 0 && dropped > 0)
+    elidedCommands++;
+  return dropped;
+}
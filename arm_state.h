@@ -0,0 +1,43 @@
+#ifndef ARM_STATE_H
+#define ARM_STATE_H
+
+#include <stdint.h>
+#include "link_protocol.h"
+
+/**
+ * Cache of the last acknowledged angle of every arm joint.
+ *
+ * Steps that would move a joint to where it already is (within
+ * ARM_STATE_TOLERANCE degrees) are dropped before a command is sent. The
+ * cache only learns from acknowledged commands and forgets everything on
+ * a link error or a game switch, since the arm may have been left anywhere.
+ * No Arduino dependencies so it also builds on a host.
+ */
+
+#define ARM_STATE_JOINTS 5 // ArmMotor BASE..GRIP
+#define ARM_STATE_UNKNOWN -1
+#define ARM_STATE_TOLERANCE 1
+
+class ArmStateCache
+{
+public:
+  ArmStateCache();
+
+  void invalidate();
+  int angle(uint8_t joint) const;
+  bool redundant(uint8_t joint, int angle) const;
+
+  void acknowledge(uint8_t joint, int angle);
+  void acknowledge(const LinkPose &pose);
+  // Drop the steps of `pose` that would not move anything, returns how many were dropped
+  uint8_t elide(LinkPose &pose);
+
+  uint32_t elidedSteps;
+  uint32_t elidedCommands; // whole commands that never went on the wire
+  uint32_t invalidations;
+
+private:
+  int angles[ARM_STATE_JOINTS];
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include "arm_timing.h"
+#include <stdlib.h>
+
+// Loaded MG996R class servos on the big joints, a smaller one on the wrist and grip
+const ArmTimingParams ARM_TIMING_DEFAULTS = {
+    {170, 200, 170, 120, 100}, // base, shoulder, elbow, wrist, grip
+    150,                       // settle
+    300,                       // stepper per 90 degrees
+    5,                         // command overhead
+    9600};
+
+ArmTimingModel::ArmTimingModel(const ArmTimingParams &params)
+{
+  this->params = params;
+  forget();
+}
+
+void ArmTimingModel::setBaud(uint32_t baud)
+{
+  if (baud > 0)
+    params.baud = baud;
+}
+
+void ArmTimingModel::forget()
+{
+  for (int i = 0; i < ARM_TIMING_JOINTS; i++)
+    angles[i] = ARM_TIMING_UNKNOWN_ANGLE;
+}
+
+void ArmTimingModel::setJointAngle(uint8_t joint, int angle)
+{
+  if (joint < ARM_TIMING_JOINTS)
+    angles[joint] = angle;
+}
+
+int ArmTimingModel::jointAngle(uint8_t joint) const
+{
+  return joint < ARM_TIMING_JOINTS ? angles[joint] : ARM_TIMING_UNKNOWN_ANGLE;
+}
+
+uint32_t ArmTimingModel::roundTripMs(size_t requestBytes, size_t replyBytes) const
+{
+  // 8N1: 10 bit times per byte, rounded up
+  uint64_t bits = (uint64_t)(requestBytes + replyBytes) * 10;
+  return (uint32_t)((bits * 1000 + params.baud - 1) / params.baud) + params.commandOverheadMs;
+}
+
+uint32_t ArmTimingModel::servoTravelMs(uint8_t joint, int from, int to, int overShoot) const
+{
+  if (joint >= ARM_TIMING_JOINTS)
+    return 0;
+
+  int travel = from == ARM_TIMING_UNKNOWN_ANGLE ? ARM_TIMING_UNKNOWN_TRAVEL : abs(to - from);
+  // The overshoot is driven past the target and back
+  travel += 2 * abs(overShoot);
+  if (travel == 0)
+    return 0;
+
+  return (uint32_t)travel * params.servoMsPer60Deg[joint] / 60 + params.servoSettleMs;
+}
+
+uint32_t ArmTimingModel::servoMs(uint8_t joint, int angle, int overShoot)
+{
+  uint32_t ms = servoTravelMs(joint, jointAngle(joint), angle, overShoot);
+  setJointAngle(joint, angle);
+  return ms;
+}
+
+uint32_t ArmTimingModel::poseMs(const LinkPose &pose)
+{
+  bool grouped = pose.staggerMs != LINK_POSE_SEQUENTIAL && (pose.staggerMs & LINK_POSE_GROUPED);
+  uint32_t elapsed = 0;
+  uint32_t finish = 0;
+
+  for (int i = 0; i < pose.count; i++)
+  {
+    uint32_t ms = servoMs(pose.motor[i], pose.angle[i], pose.overShoot[i]);
+    if (pose.staggerMs == LINK_POSE_SEQUENTIAL)
+    {
+      elapsed += ms;
+      finish = elapsed;
+    }
+    else if (grouped)
+    {
+      // elapsed is the start of the current group
+      if (i > 0 && !(pose.staggerMs & (1 << i)))
+        elapsed = finish;
+      if (elapsed + ms > finish)
+        finish = elapsed + ms;
+    }
+    else
+    {
+      uint32_t start = (uint32_t)i * pose.staggerMs;
+      if (start + ms > finish)
+        finish = start + ms;
+    }
+  }
+  return finish;
+}
+
+uint32_t ArmTimingModel::stepperMs(const int cmds[ARM_TIMING_STEPPERS * 2]) const
+{
+  int longest = 0;
+  for (int i = 0; i < ARM_TIMING_STEPPERS; i++)
+  {
+    int angle = abs(cmds[i * 2]);
+    if (angle > longest)
+      longest = angle;
+  }
+  return (uint32_t)longest * params.stepperMsPer90Deg / 90;
+}
+
+uint32_t ArmTimingModel::stepperMs(const LinkStepperMove &move) const
+{
+  uint16_t longest = 0;
+  for (int i = 0; i < move.count; i++)
+  {
+    if (move.angle[i] > longest)
+      longest = move.angle[i];
+  }
+  return (uint32_t)longest * params.stepperMsPer90Deg / 90;
+}
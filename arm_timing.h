@@ -0,0 +1,64 @@
+#ifndef ARM_TIMING_H
+#define ARM_TIMING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "link_protocol.h"
+
+/**
+ * Timing model of the arm and the Arduino link.
+ *
+ * Estimates how long a command keeps the rig busy without the hardware:
+ * servo travel is linear in the angle change (plus the overshoot and a
+ * settle time), steppers take a fixed time per 90 degrees and every byte
+ * on the wire costs 10 bit times at the link baud rate. The model tracks
+ * the last commanded angle of each joint so consecutive moves are costed
+ * from where the arm actually is. No Arduino dependencies so it also
+ * builds on a host.
+ */
+
+#define ARM_TIMING_JOINTS 5         // ArmMotor BASE..GRIP
+#define ARM_TIMING_UNKNOWN_ANGLE -1 // joint position not known yet
+#define ARM_TIMING_UNKNOWN_TRAVEL 90 // degrees assumed when the start angle is unknown
+#define ARM_TIMING_STEPPERS 5
+
+struct ArmTimingParams
+{
+  uint16_t servoMsPer60Deg[ARM_TIMING_JOINTS];
+  uint16_t servoSettleMs;
+  uint16_t stepperMsPer90Deg;
+  uint16_t commandOverheadMs; // Arduino parse and reply time per round trip
+  uint32_t baud;
+};
+
+extern const ArmTimingParams ARM_TIMING_DEFAULTS;
+
+class ArmTimingModel
+{
+public:
+  ArmTimingModel(const ArmTimingParams &params = ARM_TIMING_DEFAULTS);
+
+  void setBaud(uint32_t baud);
+  // Forget every joint position, e.g. after a reset of the Arduino
+  void forget();
+  void setJointAngle(uint8_t joint, int angle);
+  int jointAngle(uint8_t joint) const;
+
+  // Time for one request/reply exchange on the link
+  uint32_t roundTripMs(size_t requestBytes, size_t replyBytes) const;
+  // Travel time of one joint, does not change the tracked angles
+  uint32_t servoTravelMs(uint8_t joint, int from, int to, int overShoot = 0) const;
+
+  // Motion time of a command, the tracked angles move to the commanded ones
+  uint32_t servoMs(uint8_t joint, int angle, int overShoot = 0);
+  uint32_t poseMs(const LinkPose &pose);
+  // Dense stepper command: (angle, direction) pairs, motors in one command turn together
+  uint32_t stepperMs(const int cmds[ARM_TIMING_STEPPERS * 2]) const;
+  uint32_t stepperMs(const LinkStepperMove &move) const;
+
+private:
+  ArmTimingParams params;
+  int angles[ARM_TIMING_JOINTS];
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "baud_negotiator.h"
+#include <string.h>
+
+BaudNegotiator::BaudNegotiator(const LinkTransport &transport, void (*setBaud)(uint32_t baud, void *ctx),
+                               const uint32_t *rates, uint8_t rateCount)
+{
+  this->transport = transport;
+  this->setBaud = setBaud;
+  this->rateCount = rateCount > BAUD_MAX_RATES ? BAUD_MAX_RATES : rateCount;
+  for (int i = 0; i < this->rateCount; i++)
+    this->rates[i] = rates[i];
+
+  current = BAUD_IDLE;
+  rateIndex = 0;
+  goodBaud = 0;
+  seq = 0;
+  enteredAt = 0;
+  negotiations = 0;
+  probes = 0;
+  rejected = 0;
+  failures = 0;
+}
+
+void BaudNegotiator::start(uint32_t baseBaud)
+{
+  goodBaud = baseBaud;
+  setBaud(baseBaud, transport.ctx);
+  decoder.reset();
+
+  rateIndex = 0;
+  while (rateIndex < rateCount && rates[rateIndex] <= baseBaud)
+    rateIndex++;
+
+  negotiations++;
+  enter(BAUD_SEND_REQUEST);
+}
+
+bool BaudNegotiator::busy() const
+{
+  return current != BAUD_IDLE;
+}
+
+uint32_t BaudNegotiator::baud() const
+{
+  return goodBaud;
+}
+
+BaudNegotiationState BaudNegotiator::state() const
+{
+  return current;
+}
+
+void BaudNegotiator::enter(BaudNegotiationState next)
+{
+  current = next;
+  enteredAt = transport.now(transport.ctx);
+}
+
+void BaudNegotiator::sendFrame(uint8_t op, const uint8_t *payload, uint8_t len)
+{
+  uint8_t frame[LINK_MAX_FRAME];
+  size_t frameLen = linkEncodeFrame(frame, ++seq, op, payload, len);
+  transport.write(frame, frameLen, transport.ctx);
+}
+
+void BaudNegotiator::nextRate()
+{
+  rateIndex++;
+  enter(BAUD_SEND_REQUEST);
+}
+
+void BaudNegotiator::fail()
+{
+  // Go back to the last confirmed rate and give the peer time to do the same
+  failures++;
+  setBaud(goodBaud, transport.ctx);
+  decoder.reset();
+  enter(BAUD_REVERT);
+}
+
+void BaudNegotiator::handleFrame(const LinkFrame &frame)
+{
+  if (frame.seq != seq)
+    return;
+
+  if (current == BAUD_WAIT_REQUEST_ACK)
+  {
+    if (frame.op == LINK_OP_ACK)
+    {
+      setBaud(rates[rateIndex], transport.ctx);
+      decoder.reset();
+      enter(BAUD_SETTLE);
+    }
+    else if (frame.op == LINK_OP_NAK)
+    {
+      // Rate not supported by the peer, try the next one
+      rejected++;
+      nextRate();
+    }
+  }
+  else if (current == BAUD_WAIT_ECHO)
+  {
+    if (frame.op == LINK_OP_ECHO && frame.len == sizeof(nonce) && memcmp(frame.payload, nonce, sizeof(nonce)) == 0)
+    {
+      goodBaud = rates[rateIndex];
+      nextRate();
+    }
+    else
+    {
+      fail();
+    }
+  }
+}
+
+bool BaudNegotiator::poll()
+{
+  if (current == BAUD_IDLE)
+    return false;
+
+  LinkFrame frame;
+  int c;
+  while ((c = transport.read(transport.ctx)) >= 0)
+  {
+    if (decoder.feed((uint8_t)c, frame) == LINK_DECODE_FRAME)
+      handleFrame(frame);
+  }
+
+  unsigned long elapsed = transport.now(transport.ctx) - enteredAt;
+  switch (current)
+  {
+  case BAUD_SEND_REQUEST:
+  {
+    if (rateIndex >= rateCount)
+    {
+      enter(BAUD_IDLE);
+      break;
+    }
+
+    uint32_t rate = rates[rateIndex];
+    uint8_t payload[4] = {(uint8_t)rate, (uint8_t)(rate >> 8), (uint8_t)(rate >> 16), (uint8_t)(rate >> 24)};
+    sendFrame(LINK_OP_BAUD, payload, sizeof(payload));
+    probes++;
+    enter(BAUD_WAIT_REQUEST_ACK);
+    break;
+  }
+  case BAUD_WAIT_REQUEST_ACK:
+    if (elapsed >= BAUD_REPLY_MS)
+    {
+      // No answer at a rate that is known to work, leave the link alone
+      failures++;
+      enter(BAUD_IDLE);
+    }
+    break;
+  case BAUD_SETTLE:
+    if (elapsed >= BAUD_SETTLE_MS)
+    {
+      unsigned long stamp = transport.now(transport.ctx);
+      nonce[0] = seq;
+      nonce[1] = (uint8_t)stamp;
+      nonce[2] = (uint8_t)(stamp >> 8);
+      nonce[3] = (uint8_t)rateIndex ^ 0x5A;
+      sendFrame(LINK_OP_ECHO, nonce, sizeof(nonce));
+      enter(BAUD_WAIT_ECHO);
+    }
+    break;
+  case BAUD_WAIT_ECHO:
+    if (elapsed >= BAUD_REPLY_MS)
+      fail();
+    break;
+  case BAUD_REVERT:
+    if (elapsed >= BAUD_CONFIRM_MS)
+      enter(BAUD_IDLE);
+    break;
+  default:
+    break;
+  }
+
+  return current != BAUD_IDLE;
+}
@@ -0,0 +1,76 @@
+#ifndef BAUD_NEGOTIATOR_H
+#define BAUD_NEGOTIATOR_H
+
+#include <stdint.h>
+#include "link_protocol.h"
+#include "link_window.h"
+
+/**
+ * Serial baud-rate negotiation with the Arduino.
+ *
+ * Starting from the base rate, each higher candidate is requested with a
+ * LINK_OP_BAUD frame. Once the peer acks, both sides switch and the rate is
+ * confirmed with an ECHO round trip (the CRC covers the payload). A NAK means
+ * the peer does not support that rate and the next one is tried. A failed
+ * confirmation drops back to the last good rate and stops probing; the peer
+ * reverts on its own if it gets no ECHO within BAUD_CONFIRM_MS.
+ *
+ * Driven by poll() through a LinkTransport, so it also runs on a host.
+ */
+
+#define BAUD_MAX_RATES 6
+#define BAUD_REPLY_MS 100
+#define BAUD_SETTLE_MS 20
+#define BAUD_CONFIRM_MS 250
+
+enum BaudNegotiationState
+{
+  BAUD_IDLE,
+  BAUD_SEND_REQUEST,
+  BAUD_WAIT_REQUEST_ACK,
+  BAUD_SETTLE,
+  BAUD_WAIT_ECHO,
+  BAUD_REVERT
+};
+
+class BaudNegotiator
+{
+public:
+  BaudNegotiator(const LinkTransport &transport, void (*setBaud)(uint32_t baud, void *ctx),
+                 const uint32_t *rates, uint8_t rateCount);
+
+  // Restart from baseBaud and probe every configured rate above it
+  void start(uint32_t baseBaud);
+  // Advance the state machine, returns true while a negotiation is running
+  bool poll();
+  bool busy() const;
+  uint32_t baud() const;
+  BaudNegotiationState state() const;
+
+  uint32_t negotiations;
+  uint32_t probes;
+  uint32_t rejected;
+  uint32_t failures;
+
+private:
+  void enter(BaudNegotiationState next);
+  void sendFrame(uint8_t op, const uint8_t *payload, uint8_t len);
+  void handleFrame(const LinkFrame &frame);
+  void nextRate();
+  void fail();
+
+  LinkTransport transport;
+  void (*setBaud)(uint32_t baud, void *ctx);
+  uint32_t rates[BAUD_MAX_RATES];
+  uint8_t rateCount;
+
+  BaudNegotiationState current;
+  uint8_t rateIndex;
+  uint32_t goodBaud;
+  uint8_t seq;
+  uint8_t nonce[4];
+  unsigned long enteredAt;
+  LinkDecoder decoder;
+};
+
+#endif
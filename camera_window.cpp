@@ -0,0 +1,79 @@
+#include "camera_window.h"
+#include <stdlib.h>
+#include <string.h>
+
+bool cameraModeSize(int mode, uint16_t &width, uint16_t &height)
+{
+  switch (mode)
+  {
+  case CAMERA_MODE_CIF:
+    width = 400;
+    height = 296;
+    return true;
+  case CAMERA_MODE_SVGA:
+    width = 800;
+    height = 600;
+    return true;
+  case CAMERA_MODE_UXGA:
+    width = 1600;
+    height = 1200;
+    return true;
+  default:
+    return false;
+  }
+}
+
+const char *cameraWindowError(const CameraWindow &window)
+{
+  if (window.mode == CAMERA_WINDOW_OFF)
+    return nullptr;
+
+  uint16_t modeWidth, modeHeight;
+  if (!cameraModeSize(window.mode, modeWidth, modeHeight))
+    return "unknown sensor mode";
+  if (window.width == 0 || window.height == 0 || window.outWidth == 0 || window.outHeight == 0)
+    return "empty window";
+  if (window.width % CAMERA_WINDOW_ALIGN || window.height % CAMERA_WINDOW_ALIGN ||
+      window.outWidth % CAMERA_WINDOW_ALIGN || window.outHeight % CAMERA_WINDOW_ALIGN)
+    return "sizes must be multiples of 4";
+  if (window.x + window.width > modeWidth || window.y + window.height > modeHeight)
+    return "window outside the sensor mode";
+  if (window.outWidth > window.width || window.outHeight > window.height)
+    return "output larger than the window, the sensor only scales down";
+  return nullptr;
+}
+
+bool cameraWindowParse(const char *text, CameraWindow &window)
+{
+  if (strcmp(text, "off") == 0)
+  {
+    window = CAMERA_WINDOW_FULL;
+    return true;
+  }
+
+  long values[7];
+  const char *p = text;
+  for (int i = 0; i < 7; i++)
+  {
+    char *end;
+    values[i] = strtol(p, &end, 10);
+    if (end == p || values[i] < 0 || values[i] > 0xFFFF)
+      return false;
+    if (i < 6 && *end != ',')
+      return false;
+    p = end + 1;
+    if (i == 6 && *end != '\0')
+      return false;
+  }
+  if (values[0] > CAMERA_MODE_UXGA)
+    return false;
+
+  window.mode = (int8_t)values[0];
+  window.x = values[1];
+  window.y = values[2];
+  window.width = values[3];
+  window.height = values[4];
+  window.outWidth = values[5];
+  window.outHeight = values[6];
+  return true;
+}
@@ -0,0 +1,47 @@
+#ifndef CAMERA_WINDOW_H
+#define CAMERA_WINDOW_H
+
+#include <stdint.h>
+
+/**
+ * Sensor-level capture window (region of interest) for the OV2640.
+ *
+ * The sensor reads one of its three modes (CIF 400x296, SVGA 800x600, UXGA
+ * 1600x1200), crops the window at (x, y) of width x height out of it and
+ * scales that down to outWidth x outHeight before JPEG encoding, see
+ * set_res_raw() in esp32-camera. Only the region the server looks at is
+ * encoded and uploaded. A window with mode CAMERA_WINDOW_OFF keeps the
+ * frame size of the profile. No Arduino dependencies, so the limits can be
+ * checked on a host; configGenerator/main.py checks the same limits.
+ */
+
+#define CAMERA_WINDOW_OFF -1
+#define CAMERA_WINDOW_FULL {CAMERA_WINDOW_OFF, 0, 0, 0, 0, 0, 0}
+#define CAMERA_WINDOW_ALIGN 4 // window and output sizes are set in units of 4 pixels
+
+enum CameraSensorMode
+{
+  CAMERA_MODE_CIF = 0,
+  CAMERA_MODE_SVGA = 1,
+  CAMERA_MODE_UXGA = 2
+};
+
+struct CameraWindow
+{
+  int8_t mode; // CameraSensorMode or CAMERA_WINDOW_OFF
+  uint16_t x;
+  uint16_t y;
+  uint16_t width;
+  uint16_t height;
+  uint16_t outWidth;
+  uint16_t outHeight;
+};
+
+// Sensor pixels of a mode, false for an unknown mode
+bool cameraModeSize(int mode, uint16_t &width, uint16_t &height);
+// nullptr when the window fits the sensor, otherwise what is wrong with it
+const char *cameraWindowError(const CameraWindow &window);
+// "mode,x,y,width,height,outWidth,outHeight" or "off", false when malformed
+bool cameraWindowParse(const char *text, CameraWindow &window);
+
+#endif
@@ -61,6 +61,74 @@ code_template = {
     "led_intensity": "analogWrite(LED_GPIO_NUM, {val});",
 }
 
+# Output size of each framesize value
+framesizes = {
+    0: (96, 96),
+    1: (160, 120),
+    2: (176, 144),
+    3: (240, 176),
+    4: (240, 240),
+    5: (320, 240),
+    6: (400, 296),
+    7: (480, 320),
+    8: (640, 480),
+    9: (800, 600),
+    10: (1024, 768),
+    11: (1280, 720),
+    12: (1280, 1024),
+    13: (1600, 1200),
+}
+
+# OV2640 sensor modes a capture window is cut from, same limits as camera_window.cpp
+sensor_modes = {0: (400, 296), 1: (800, 600), 2: (1600, 1200)}
+window_keys = ["mode", "x", "y", "width", "height", "out_width", "out_height"]
+
+
+def window_error(window):
+    """Return what is wrong with a capture window, None when the sensor accepts it.
+
+    A window is {"mode": 0-2, "x", "y", "width", "height", "out_width", "out_height"}:
+    the sensor crops width x height at (x, y) out of the mode and scales it down
+    to out_width x out_height. Sizes are multiples of 4, mode -1 keeps the whole frame.
+    """
+    missing = [key for key in window_keys if key not in window]
+    if missing:
+        return "missing " + ", ".join(missing)
+    if window["mode"] not in sensor_modes:
+        return "unknown sensor mode"
+    mode_width, mode_height = sensor_modes[window["mode"]]
+    sizes = [window[key] for key in window_keys[3:]]
+    if min(sizes) <= 0:
+        return "empty window"
+    if any(size % 4 for size in sizes):
+        return "sizes must be multiples of 4"
+    if min(window["x"], window["y"]) < 0:
+        return "negative offset"
+    if window["x"] + window["width"] > mode_width or window["y"] + window["height"] > mode_height:
+        return "window outside the sensor mode"
+    if window["out_width"] > window["width"] or window["out_height"] > window["height"]:
+        return "output larger than the window, the sensor only scales down"
+    return None
+
+
+def window_lines(window, framesize):
+    """Table entry for profileWindows in esp32.ino and the bandwidth it saves."""
+    error = window_error(window)
+    if error:
+        raise ValueError("Invalid window: " + error)
+
+    values = [window[key] for key in window_keys]
+    frame_width, frame_height = framesizes[framesize]
+    # JPEG size grows about linearly with the pixel count
+    share = window["out_width"] * window["out_height"] / (frame_width * frame_height)
+    return [
+        "// profileWindows entry: {" + ", ".join(str(v) for v in values) + "}",
+        "// /config?window=" + ",".join(str(v) for v in values),
+        "// %dx%d instead of %dx%d: about %d%% of the pixels, %d%% less to encode and upload"
+        % (window["out_width"], window["out_height"], frame_width, frame_height,
+           round(share * 100), round((1 - share) * 100)),
+    ]
+
 
 def generate_code(json_path):
     with open(json_path, "r") as f:
@@ -71,6 +139,11 @@ def generate_code(json_path):
         val = user_config.get(key, default_config.get(key, 0))
         code_lines.append(template.format(val=val))
 
+    window = user_config.get("window")
+    if window and window.get("mode", -1) >= 0:
+        framesize = user_config.get("framesize", default_config["framesize"])
+        code_lines.extend(window_lines(window, framesize))
+
     return "\n".join(code_lines)
 
 
@@ -5,6 +5,17 @@
 #include <LiquidCrystal_I2C.h>
 #include "esp_camera.h"
 #include "stream_handler.h"
+#include "game_utils.h"
+#include "arduino_link.h"
+#include "state_profiler.h"
+#include "vision_client.h"
+#include "vision_queue.h"
+#include "camera_window.h"
+#include "frame_change.h"
+#include "esp_jpg_decode.h"
+#include "xo_classifier.h"
+#include "vision_cache.h"
+#include <atomic>
 
 // Include game files
 #include "xo_x_game.h"
@@ -19,6 +30,13 @@
 #define ENABLE_SERVER_CONFIG 1
 #define ENABLE_SERVER_GAME_CHANGE 1
 #define ENABLE_SERVER_GAME_INFO 1
+#define ENABLE_SERVER_LINK_INFO 1
+#define ENABLE_SERVER_PROFILE 1 // needs ENABLE_STATE_PROFILER (state_profiler.h)
+
+// Read the XO board on the device once it is calibrated (/config?xo_board=), see xo_classifier.h
+#define ENABLE_XO_CLASSIFIER 1
+// Answer repeated reads of an unchanged scene from earlier replies, see vision_cache.h
+#define ENABLE_VISION_CACHE 1
 
 // LCD Display
 #define ENABLE_DISPLAY 1
@@ -44,14 +62,6 @@
 #define PCLK_GPIO_NUM 22
 #define LED_GPIO_NUM 4
 
-// Serial2 Pins (comm with Arduino)
-#define RXD2 13
-#define TXD2 12
-#define STEPPER_COUNT 10
-#define TIMEOUT_MS_SERVO 5000
-#define TIMEOUT_MS_STEPPER 5000
-#define MAX_SIZE 30
-
 // Game management
 enum GameType
 {
@@ -89,6 +99,14 @@ const char *password = "1234abcdABCD";
 // Main server endpoint
 const char *serverEndpoint = "http://192.168.25.177:8000/process";
 
+// Vision worker, see startPythonData
+#define VISION_TASK_STACK 8192
+#define VISION_TASK_CORE 0 // loop() runs on core 1
+SemaphoreHandle_t visionMutex = NULL; // held while a frame is taken or returned, or the camera settings change
+TaskHandle_t visionTaskHandle = NULL;
+VisionQueue visionQueue;
+VisionClient visionClient;
+
 // HTTP server
 #if ENABLE_ESP32_SERVER
 AsyncWebServer server(80);
@@ -114,13 +132,9 @@ void stopRubikGame();
 void stopMemoryGame();
 void stopCupsGame();
 
-String readLine();
-bool sendServoCommand(int a1, int a2, int a3);
-bool sendStepperCommand(const int cmds[10]);
-
 void changeConfig(String command);
 String getPythonData(String command);
-void parseCSV(const char *csv, int arr[], int &count);
+void initVision();
 
 #if ENABLE_DISPLAY
 void initDisplay();
@@ -143,6 +157,16 @@ void handleGetCurrentGame(AsyncWebServerRequest *request);
 void handleConfig(AsyncWebServerRequest *request);
 #endif
 
+#if ENABLE_SERVER_LINK_INFO
+void handleLinkStatus(AsyncWebServerRequest *request);
+void handleLinkStats(AsyncWebServerRequest *request);
+void handleVisionStats(AsyncWebServerRequest *request);
+#endif
+
+#if ENABLE_SERVER_PROFILE && ENABLE_STATE_PROFILER
+void handleProfile(AsyncWebServerRequest *request);
+#endif
+
 #if ENABLE_SERVER_STREAMING
 void handleStream(AsyncWebServerRequest *request);
 void handleStreamJpg(AsyncWebServerRequest *request);
@@ -157,9 +181,10 @@ void setup()
   Serial.setDebugOutput(true);
 
   // Arduino communication
-  Serial2.begin(9600, SERIAL_8N1, RXD2, TXD2);
+  initArduinoLink();
 
   initCamera();
+  initVision();
   connectToWiFi();
   initGames();
   changeConfig("none");
@@ -271,65 +296,104 @@ void connectToWiFi()
   Serial.println(WiFi.localIP());
 }
 
-// Arduino communication functions
-String readLine(int timeout)
+// Capture window per camera profile, see camera_window.h. The server crops fixed regions
+// out of the whole frame, so a window only goes in together with the matching server change.
+struct ProfileWindow
+{
+  const char *game;
+  CameraWindow window;
+};
+ProfileWindow profileWindows[] = {
+    {"xo", CAMERA_WINDOW_FULL},
+    {"rubik", CAMERA_WINDOW_FULL},
+    {"memory", CAMERA_WINDOW_FULL},
+    {"cups", CAMERA_WINDOW_FULL},
+};
+#define PROFILE_WINDOW_COUNT (sizeof(profileWindows) / sizeof(profileWindows[0]))
+
+CameraWindow *profileWindow(const String &game)
 {
-  unsigned long start = millis();
-  String s;
-  while (millis() - start < timeout)
+  for (size_t i = 0; i < PROFILE_WINDOW_COUNT; i++)
   {
-    if (Serial2.available())
-    {
-      char c = Serial2.read();
-      if (c == '\n')
-        break;
-      s += c;
-    }
+    if (game == profileWindows[i].game)
+      return &profileWindows[i].window;
   }
+  return nullptr;
+}
 
-  if (s.length() > 0 && s[s.length() - 1] == '\r')
-    s.remove(s.length() - 1, 1);
-
-  Serial.print("Received: ");
-  Serial.println(s);
+// Must come after set_framesize, which resets the window
+bool applyCameraWindow(sensor_t *s, const CameraWindow &window)
+{
+  if (window.mode == CAMERA_WINDOW_OFF)
+    return true;
+  if (s->id.PID != OV2640_PID)
+  {
+    Serial.println("Capture windows are only supported on the OV2640");
+    return false;
+  }
 
-  return s;
+  // On the OV2640 startX selects the sensor mode, the other start/end arguments are unused
+  return s->set_res_raw(s, window.mode, 0, 0, 0, window.x, window.y, window.width, window.height,
+                        window.outWidth, window.outHeight, false, false) == 0;
 }
 
-bool sendServoCommand(int a1, int a2, int a3)
+// Change detection per camera profile for gated requests (see frame_change.h),
+// profiles without an entry upload every frame
+struct ProfileGate
 {
-  while (Serial2.available())
-    Serial2.read();
+  const char *game;
+  ChangeThresholds thresholds;
+};
+const ProfileGate profileGates[] = {
+    // blockSad, enterBlocks, exitBlocks, stableFrames, forceAfter
+    {"xo", {240, 1, 0, 1, 15}},
+    {"cups", {240, 2, 0, 1, 10}},
+};
+#define PROFILE_GATE_COUNT (sizeof(profileGates) / sizeof(profileGates[0]))
+ChangeGate changeGate; // used by the vision worker only
+// Set by changeConfig under visionMutex, applied by the worker before its next frame
+const ChangeThresholds *gateThresholds = nullptr;
+bool gateThresholdsChanged = false;
 
-  Serial2.print('A');
-  Serial2.print(',');
-  Serial2.print(a1);
-  Serial2.print(',');
-  Serial2.print(a2);
-  Serial2.print(',');
-  Serial2.println(a3);
+const ChangeThresholds *profileThresholds(const String &game)
+{
+  for (size_t i = 0; i < PROFILE_GATE_COUNT; i++)
+  {
+    if (game == profileGates[i].game)
+      return &profileGates[i].thresholds;
+  }
+  return nullptr;
+}
 
-  String resp = readLine(TIMEOUT_MS_SERVO);
+// On-device XO board reader, the server is asked when it is less sure than XO_MIN_CONFIDENCE
+#define XO_MIN_CONFIDENCE 60
+#define VISION_GRAY_MAX_PIXELS (128 * 96) // 1:8 decode of an XGA frame
+XoBoardRect xoBoard = {0, 0, 0, 0};  // permille of the frame, set with /config?xo_board=
+const XoClassifierLimits xoLimits = {40, 4, 12, 12, 30};
+VisionCache visionCache; // cleared on every arm motion and camera profile change
+// Only actions that just read the scene, the Rubik ones record each face on the server
+const char *cacheableActions[] = {"xo", "memory", "cupsResult"};
 
-  return (resp == "OK");
+bool visionCacheable(const char *action)
+{
+  for (size_t i = 0; i < sizeof(cacheableActions) / sizeof(cacheableActions[0]); i++)
+  {
+    if (strcmp(action, cacheableActions[i]) == 0)
+      return true;
+  }
+  return false;
 }
 
-bool sendStepperCommand(const int cmds[STEPPER_COUNT])
+void printReply(const char *label, const VisionReply &reply)
 {
-  while (Serial2.available())
-    Serial2.read();
-
-  Serial2.print('S');
-  for (int i = 0; i < STEPPER_COUNT; i++)
+  Serial.print(label);
+  for (uint8_t i = 0; i < reply.count; i++)
   {
-    Serial2.print(',');
-    Serial2.print(cmds[i]);
+    if (i)
+      Serial.print(',');
+    Serial.print(reply.values[i]);
   }
-  Serial2.println();
-
-  String resp = readLine(TIMEOUT_MS_STEPPER);
-
-  return (resp == "OK");
+  Serial.println();
 }
 
 // Change camera configuration
@@ -342,6 +406,8 @@ void changeConfig(String game)
   latestGame = game;
   Serial.println("Changing config to: " + game);
 
+  // Not while a capture from the previous game is still running
+  xSemaphoreTake(visionMutex, portMAX_DELAY);
   sensor_t *s = esp_camera_sensor_get();
 
 
@@ -486,75 +552,368 @@ void changeConfig(String game)
     s->set_ae_level(s, 0);
     analogWrite(LED_GPIO_NUM, 0);
   }
+
+  CameraWindow *window = profileWindow(game);
+  if (window && !applyCameraWindow(s, *window))
+    Serial.println("Capture window not applied, using the whole frame");
+  gateThresholds = profileThresholds(game);
+  gateThresholdsChanged = true;
+  visionCache.invalidate();
+  xSemaphoreGive(visionMutex);
 }
 
 // Server communication functions
-String getPythonData(String command)
+// Camera and vision server as seen by the vision worker
+class CameraTransport : public VisionTransport
 {
-  if (WiFi.status() != WL_CONNECTED)
+public:
+  bool capture(uint32_t &frameMs) override
   {
-    Serial.println("WiFi not connected.");
-    return "ERROR";
+    if (WiFi.status() != WL_CONNECTED)
+    {
+      Serial.println("WiFi not connected.");
+      return false;
+    }
+
+    // Only the frame itself is taken under the mutex, a camera profile change
+    // does not wait for the upload
+    xSemaphoreTake(visionMutex, portMAX_DELAY);
+    if (gateThresholdsChanged)
+    {
+      changeGate.setThresholds(gateThresholds);
+      gateThresholdsChanged = false;
+    }
+    // Before the frame is taken: an arm motion that starts while it is taken makes its reply stale
+    frameEpoch = visionCache.epoch();
+    fb = esp_camera_fb_get();
+    xSemaphoreGive(visionMutex);
+    if (!fb)
+    {
+      Serial.println("Camera capture failed");
+      return false;
+    }
+    // Same clock as millis()
+    frameMs = fb->timestamp.tv_sec * 1000UL + fb->timestamp.tv_usec / 1000;
+    decoded = false;
+    return true;
   }
 
-  camera_fb_t *fb = nullptr;
+  void release() override
+  {
+    if (fb)
+    {
+      xSemaphoreTake(visionMutex, portMAX_DELAY);
+      esp_camera_fb_return(fb);
+      xSemaphoreGive(visionMutex);
+    }
+    fb = nullptr;
+    haveReading = false;
+    haveHash = false;
+  }
 
-  fb = esp_camera_fb_get();
-  if (!fb)
+  bool changed() override
   {
-    Serial.println("Camera capture failed");
-    return "ERROR";
+    if (!decode())
+      return true;
+    return changeGate.check(thumbnail);
   }
 
-  HTTPClient http;
-  http.setTimeout(5000);
-  String fullUrl = String(serverEndpoint) + "?action=" + command;
-  http.begin(fullUrl);
-  http.addHeader("Content-Type", "image/jpeg");
+  bool answer(const char *action, VisionReply &reply) override
+  {
+    haveReading = false;
+    haveHash = false;
+#if ENABLE_VISION_CACHE
+    if (visionCacheable(action) && decode())
+    {
+      frameHash = perceptualHash(thumbnail.pixels);
+      haveHash = true;
+      if (visionCache.lookup(action, frameHash, thumbnail.pixels, reply))
+      {
+        printReply("Cached response: ", reply);
+        return true;
+      }
+    }
+#endif
+
+#if ENABLE_XO_CLASSIFIER
+    if (strcmp(action, "xo") != 0 || !xoBoardCalibrated(xoBoard))
+      return false;
 
-  int httpResponseCode = http.POST(fb->buf, fb->len);
-  String response = "";
+    uint32_t start = micros();
+    if (decode() && grayWidth)
+      haveReading = xoClassify(gray, grayWidth, grayHeight, xoBoard, xoLimits, reading);
+    xoLocalUs.record(micros() - start);
 
-  if (httpResponseCode > 0)
+    if (!haveReading || reading.boardConfidence < XO_MIN_CONFIDENCE)
+    {
+      xoFallbacks++;
+      return false;
+    }
+    xoLocalReads++;
+    xoFormatReply(reading, reply);
+    printReply("Board read on device: ", reply);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  void gateDone(bool uploaded) override
+  {
+    if (uploaded)
+      changeGate.accept();
+    else
+      changeGate.reset();
+  }
+
+  bool upload(const char *action, VisionReply &reply) override
   {
-    response = http.getString();
-    if (response == "error")
+    size_t length = 0;
+    int httpResponseCode = visionClient.post(action, fb ? fb->buf : nullptr, fb ? fb->len : 0, body, sizeof(body), length);
+
+    if (httpResponseCode == VISION_HTTP_TOO_LONG)
     {
-      Serial.println("POST failed. HTTP error code: " + String(httpResponseCode) + " - " + http.errorToString(httpResponseCode) + " - " + response);
-      response = "ERROR";
+      Serial.println("Server response too long");
+      return false;
     }
+    if (httpResponseCode <= 0)
+    {
+      Serial.println("POST failed. HTTP error code: " + String(httpResponseCode) + " - " + HTTPClient::errorToString(httpResponseCode));
+      return false;
+    }
+
+    uint32_t start = micros();
+    bool binary = visionReplyIsBinary(body, length);
+    bool parsed = visionReplyParse(body, length, visionActionId(action), reply);
+    replyParseUs.record(micros() - start);
+    if (!parsed)
+    {
+      Serial.println("POST failed. HTTP code: " + String(httpResponseCode) + " - unreadable or error reply");
+      return false;
+    }
+    if (binary)
+      binaryReplies++;
     else
+      csvReplies++;
+
+    printReply("Server response: ", reply);
+    if (haveReading)
+      compareReading(reply);
+    if (haveHash)
+      visionCache.store(frameEpoch, action, frameHash, thumbnail.pixels, reply);
+    return true;
+  }
+
+  // Boards read on the device or sent to the server, and whether the server agreed with the
+  // local guess of a fallback
+  std::atomic<uint32_t> xoLocalReads{0};
+  std::atomic<uint32_t> xoFallbacks{0};
+  std::atomic<uint32_t> xoAgreed{0};
+  std::atomic<uint32_t> xoDisagreed{0};
+  LogHistogram xoLocalUs; // decode (unless the gate did it) and classification
+  // Replies in the binary format or as CSV, and the time to read either into a VisionReply
+  std::atomic<uint32_t> binaryReplies{0};
+  std::atomic<uint32_t> csvReplies{0};
+  LogHistogram replyParseUs;
+
+private:
+  // 1:8 decode into the gate thumbnail and a grayscale copy for the classifier, once per frame
+  bool decode()
+  {
+    if (!decoded)
     {
-      Serial.println("Server response: " + response);
+      grayWidth = 0;
+      decodedOk = esp_jpg_decode(fb->len, JPG_SCALE_8X, readJpeg, writeGray, this) == ESP_OK;
+      if (decodedOk)
+        thumbnail.finish();
+      decoded = true;
     }
+    return decodedOk;
   }
-  else
+
+  void compareReading(const VisionReply &reply)
+  {
+    if (reply.count < 15)
+      return;
+
+    bool same = true;
+    for (int i = 0; i < 9; i++)
+      same = same && reply.values[(i / 3) * 5 + 1 + i % 3] == reading.cells[i];
+    if (same)
+      xoAgreed++;
+    else
+      xoDisagreed++;
+  }
+
+  static size_t readJpeg(void *arg, size_t index, uint8_t *buf, size_t len)
   {
-    Serial.println("POST failed. HTTP error code: " + String(httpResponseCode) + " - " + http.errorToString(httpResponseCode));
-    response = "ERROR";
+    CameraTransport *self = (CameraTransport *)arg;
+    if (buf)
+      memcpy(buf, self->fb->buf + index, len);
+    return len;
   }
 
-  http.end();
+  static bool writeGray(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+  {
+    CameraTransport *self = (CameraTransport *)arg;
+    if (!data)
+    {
+      if (x == 0 && y == 0)
+      {
+        // Start of the image, w x h is its decoded size
+        self->thumbnail.begin(w, h);
+        bool fits = (uint32_t)w * h <= VISION_GRAY_MAX_PIXELS;
+        self->grayWidth = fits ? w : 0;
+        self->grayHeight = fits ? h : 0;
+      }
+      return true;
+    }
+
+    self->thumbnail.addRgb(x, y, w, h, data);
+    if (self->grayWidth)
+    {
+      for (uint16_t row = 0; row < h; row++)
+      {
+        uint8_t *out = self->gray + (uint32_t)(y + row) * self->grayWidth + x;
+        for (uint16_t col = 0; col < w; col++, data += 3)
+          out[col] = (77 * data[0] + 150 * data[1] + 29 * data[2]) >> 8;
+      }
+    }
+    return true;
+  }
 
-  esp_camera_fb_return(fb);
+  camera_fb_t *fb = nullptr;
+  bool decoded = false;
+  bool decodedOk = false;
+  LumaThumbnail thumbnail;
+  uint8_t gray[VISION_GRAY_MAX_PIXELS];
+  uint16_t grayWidth = 0; // 0 when the decoded frame did not fit
+  uint16_t grayHeight = 0;
+  bool haveReading = false;
+  XoReading reading;
+  uint32_t frameEpoch = 0; // of the vision cache when the frame was taken
+  bool haveHash = false;
+  uint64_t frameHash = 0;
+  uint8_t body[VISION_REPLY_BODY_MAX]; // reply as read from the socket
+};
 
-  return response;
+CameraTransport cameraTransport;
+
+uint32_t visionClock()
+{
+  return millis();
 }
 
-void parseCSV(const char *csv, int arr[], int &count)
+void invalidateVisionCache()
 {
-  count = 0;
-  char buffer[256];
-  strncpy(buffer, csv, sizeof(buffer));
-  buffer[sizeof(buffer) - 1] = '\0';
+  visionCache.invalidate();
+}
 
-  char *token = strtok(buffer, ",");
+// Vision worker: serves the queued requests on the other core, next to the game loop
+void visionTask(void *)
+{
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    bool served = true;
+    while (served)
+      served = visionServe(visionQueue, cameraTransport, visionClock);
+  }
+}
+
+void initVision()
+{
+  if (!visionClient.begin(serverEndpoint))
+    Serial.println("Invalid server endpoint");
+  visionMutex = xSemaphoreCreateMutex();
+  // Whatever the camera saw before the arm moved is no longer worth reusing
+  setArmMotionHook(invalidateVisionCache);
+  xTaskCreatePinnedToCore(visionTask, "vision", VISION_TASK_STACK, nullptr, 1, &visionTaskHandle, VISION_TASK_CORE);
+}
+
+VisionFuture startPythonData(const char *command, uint32_t timeoutMs, uint32_t freshAfterMs, uint8_t flags)
+{
+  VisionFuture future = visionQueue.submit(command, millis(), timeoutMs, freshAfterMs, flags);
+  if (future == VISION_FUTURE_INVALID)
+    Serial.println("Vision queue full");
+  else
+    xTaskNotifyGive(visionTaskHandle);
+  return future;
+}
+
+bool pythonDataCaptured(VisionFuture future)
+{
+  VisionStatus status = visionQueue.status(future, millis());
+  return status != VISION_PENDING;
+}
+
+bool pollVisionReply(VisionFuture future, VisionStatus &status, VisionReply &reply)
+{
+  status = visionQueue.collect(future, millis(), reply);
+  if (status == VISION_PENDING || status == VISION_CAPTURED)
+    return false;
+
+  if (status == VISION_EXPIRED)
+    Serial.println("Vision request expired");
+  return true;
+}
 
-  while (token != NULL && count < MAX_SIZE)
+void cancelPythonData(VisionFuture future)
+{
+  visionQueue.cancel(future);
+}
+
+void cancelAllPythonData()
+{
+  visionQueue.cancelAll();
+}
+
+// Blocking version for the games that read the camera in one step
+String getPythonData(String command)
+{
+  VisionFuture future = startPythonData(command.c_str(), VISION_DEFAULT_TIMEOUT_MS, millis());
+  if (future == VISION_FUTURE_INVALID)
+    return "ERROR";
+
+  VisionStatus status;
+  VisionReply reply;
+  while (!pollVisionReply(future, status, reply))
   {
-    arr[count++] = atoi(token);
-    token = strtok(NULL, ",");
+    // Let a game switch through instead of sitting out the upload
+    if (requestedGameIndex != -2)
+    {
+      cancelPythonData(future);
+      return "ERROR";
+    }
+    delay(1);
   }
+  if (status != VISION_DONE)
+    return "ERROR";
+
+  char csv[VISION_REPLY_BODY_MAX];
+  visionReplyFormatCsv(reply, csv, sizeof(csv));
+  return csv;
+}
+
+// Compare a cell table with the IK model, and regenerate it with ARM_IK_TABLES
+void calibrateArmTable(const char *name, int (*table)[ARM_IK_JOINTS], uint8_t rows, uint8_t cols)
+{
+  static const ArmGeometry geometry = ARM_GEOMETRY_DEFAULTS;
+  ArmBoard board;
+  armBoardFromTable(geometry, table, rows, cols, board);
+
+  ArmIkReport report;
+  armIkCompare(geometry, board, rows, cols, table, report);
+  Serial.printf("IK %s: %u cells, %u out of reach, mean error %.1f/%.1f/%.1f/%.1f, worst %.0f at cell %u\n",
+                name, report.cells, report.unreachable, report.meanError[0], report.meanError[1],
+                report.meanError[2], report.meanError[3], report.worstError, report.worstCell);
+
+#if ARM_IK_TABLES
+  uint8_t unreachable = armIkTable(geometry, board, rows, cols, table);
+  if (unreachable > 0)
+    Serial.printf("IK %s: kept %u hand-tuned cells\n", name, unreachable);
+#endif
 }
 
 // LCD Display
@@ -639,6 +998,10 @@ void performGameSwitch(int gameIndex)
 
   bool sameGame = (currentGameIndex == gameIndex);
 
+  // The next game must not trust angles left over from the previous one
+  invalidateArmState();
+  cancelAllPythonData();
+
   // Stop the current game if one is running
   if (currentGameIndex >= 0 && currentGameIndex < GAME_COUNT)
   {
@@ -708,6 +1071,16 @@ void setupServerEndpoints()
     request->send(response); });
 #endif
 
+#if ENABLE_SERVER_LINK_INFO
+  server.on("/linkStatus", HTTP_GET, handleLinkStatus);
+  server.on("/linkStats", HTTP_GET, handleLinkStats);
+  server.on("/visionStats", HTTP_GET, handleVisionStats);
+#endif
+
+#if ENABLE_SERVER_PROFILE && ENABLE_STATE_PROFILER
+  server.on("/profile", HTTP_GET, handleProfile);
+#endif
+
   server.begin();
   Serial.println("HTTP server started on port 80");
 
@@ -717,6 +1090,8 @@ void setupServerEndpoints()
 
 #if ENABLE_SERVER_CONFIG
   Serial.println("Use '/config' to set config.");
+  Serial.println("Use '/config?window=mode,x,y,width,height,outWidth,outHeight' to crop the capture of the running profile, 'window=off' to undo it.");
+  Serial.println("Use '/config?xo_board=x0,y0,x1,y1' (permille of the frame) to read the XO board on the device.");
 #endif
 
 #if ENABLE_SERVER_GAME_CHANGE
@@ -726,6 +1101,16 @@ void setupServerEndpoints()
 #if ENABLE_SERVER_GAME_INFO
   Serial.println("Use '/getCurrentGame' to get current game info.");
 #endif
+
+#if ENABLE_SERVER_LINK_INFO
+  Serial.println("Use '/linkStatus' to get Arduino link info.");
+  Serial.println("Use '/linkStats' to get command latency histograms and retry counters.");
+  Serial.println("Use '/visionStats' to get vision server request times, queue, change gate, cache and XO classifier counters.");
+#endif
+
+#if ENABLE_SERVER_PROFILE && ENABLE_STATE_PROFILER
+  Serial.println("Use '/profile' to get the time spent in each game state, '/profile?reset=1' to clear it.");
+#endif
 }
 
 void addCorsHeaders(AsyncWebServerResponse *response)
@@ -746,12 +1131,54 @@ void handleConfig(AsyncWebServerRequest *request)
 {
   sensor_t *s = esp_camera_sensor_get();
 
+  CameraWindow window;
+  bool hasWindow = request->hasParam("window");
+  if (hasWindow)
+  {
+    const char *error = "expected mode,x,y,width,height,outWidth,outHeight or off";
+    if (cameraWindowParse(request->getParam("window")->value().c_str(), window))
+      error = cameraWindowError(window);
+    if (error)
+    {
+      request->send(400, "text/plain", String("Invalid window: ") + error);
+      return;
+    }
+  }
+
   if (request->hasParam("framesize"))
   {
     String value = request->getParam("framesize")->value();
     s->set_framesize(s, (framesize_t)value.toInt());
   }
 
+  if (request->hasParam("xo_board"))
+  {
+    XoBoardRect board;
+    if (sscanf(request->getParam("xo_board")->value().c_str(), "%hu,%hu,%hu,%hu", &board.x0, &board.y0, &board.x1, &board.y1) != 4 ||
+        (!xoBoardCalibrated(board) && board.x1 + board.y1 != 0))
+    {
+      request->send(400, "text/plain", "Invalid xo_board: expected x0,y0,x1,y1 in permille of the frame, 0,0,0,0 to turn it off");
+      return;
+    }
+    xoBoard = board;
+  }
+
+  if (hasWindow)
+  {
+    if (window.mode == CAMERA_WINDOW_OFF)
+      s->set_framesize(s, s->status.framesize);
+    else if (!applyCameraWindow(s, window))
+    {
+      request->send(400, "text/plain", "Capture window not supported by this sensor");
+      return;
+    }
+
+    // Kept for the running profile until reboot
+    CameraWindow *profile = profileWindow(latestGame);
+    if (profile)
+      *profile = window;
+  }
+
   if (request->hasParam("quality"))
     s->set_quality(s, request->getParam("quality")->value().toInt());
   if (request->hasParam("contrast"))
@@ -923,4 +1350,111 @@ void handleGetCurrentGame(AsyncWebServerRequest *request)
   request->send(webResponse);
 }
 #endif
+
+#if ENABLE_SERVER_LINK_INFO
+void handleLinkStatus(AsyncWebServerRequest *request)
+{
+  ArduinoLinkStatus status;
+  getArduinoLinkStatus(status);
+
+  String json = "{";
+  json += "\"mode\":\"" + String(status.binary ? "binary" : "ascii") + "\",";
+  json += "\"negotiating\":" + String(status.negotiating ? "true" : "false") + ",";
+  json += "\"baud\":" + String(status.baud) + ",";
+  json += "\"negotiations\":" + String(status.negotiations) + ",";
+  json += "\"probes\":" + String(status.probes) + ",";
+  json += "\"rejectedRates\":" + String(status.rejected) + ",";
+  json += "\"baudFailures\":" + String(status.baudFailures) + ",";
+  json += "\"linkErrors\":" + String(status.linkErrors) + ",";
+  json += "\"retransmits\":" + String(status.retransmits) + ",";
+  json += "\"windowFailures\":" + String(status.windowFailures) + ",";
+  json += "\"elidedSteps\":" + String(status.elidedSteps) + ",";
+  json += "\"elidedCommands\":" + String(status.elidedCommands) + ",";
+  json += "\"armStateResets\":" + String(status.armStateResets) + ",";
+  json += "\"uartOverflows\":" + String(status.uartOverflows) + ",";
+  json += "\"droppedLines\":" + String(status.droppedLines);
+  json += "}";
+
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", json);
+  addCorsHeaders(response);
+  request->send(response);
+}
+
+void handleLinkStats(AsyncWebServerRequest *request)
+{
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", linkStatsJson());
+  addCorsHeaders(response);
+  request->send(response);
+}
+
+void handleVisionStats(AsyncWebServerRequest *request)
+{
+  String json = visionClient.statsJson();
+  json.remove(json.length() - 1);
+  json += ",\"queue\":{\"submitted\":" + String(visionQueue.submitted);
+  json += ",\"rejected\":" + String(visionQueue.rejected);
+  json += ",\"expired\":" + String(visionQueue.expired);
+  json += ",\"cancelled\":" + String(visionQueue.cancelledCount);
+  json += ",\"failed\":" + String(visionQueue.failed) + "}";
+  json += ",\"changeGate\":{\"frames\":" + String(changeGate.frames);
+  json += ",\"uploadsAvoided\":" + String(changeGate.skipped);
+  json += ",\"forced\":" + String(changeGate.forced) + "}";
+  json += ",\"cache\":{\"hits\":" + String(visionCache.hits.load());
+  json += ",\"misses\":" + String(visionCache.misses.load());
+  json += ",\"invalidations\":" + String(visionCache.invalidations.load()) + "}";
+  json += ",\"xoClassifier\":{\"local\":" + String(cameraTransport.xoLocalReads.load());
+  json += ",\"fallbacks\":" + String(cameraTransport.xoFallbacks.load());
+  json += ",\"agreed\":" + String(cameraTransport.xoAgreed.load());
+  json += ",\"disagreed\":" + String(cameraTransport.xoDisagreed.load()) + ",";
+  appendHistogram(json, "us", cameraTransport.xoLocalUs);
+  json += "},\"replies\":{\"binary\":" + String(cameraTransport.binaryReplies.load());
+  json += ",\"csv\":" + String(cameraTransport.csvReplies.load()) + ",";
+  appendHistogram(json, "parseUs", cameraTransport.replyParseUs);
+  json += "}}";
+
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", json);
+  addCorsHeaders(response);
+  request->send(response);
+}
+#endif
+
+#if ENABLE_SERVER_PROFILE && ENABLE_STATE_PROFILER
+// {"memory":{"3":{"count":..,"totalUs":..,"maxUs":..,"lastUs":..},..},..}, keys are the state enum values
+void handleProfile(AsyncWebServerRequest *request)
+{
+  bool reset = request->hasParam("reset") && toBool(request->getParam("reset")->value());
+
+  String json = "{";
+  for (StateProfiler *profiler = StateProfiler::first; profiler; profiler = profiler->next)
+  {
+    if (json.length() > 1)
+      json += ",";
+    json += "\"" + String(profiler->name) + "\":{";
+
+    bool firstState = true;
+    for (int i = 0; i < STATE_PROFILER_MAX_STATES; i++)
+    {
+      const StateTiming &timing = profiler->states[i];
+      if (timing.count == 0)
+        continue;
+      if (!firstState)
+        json += ",";
+      firstState = false;
+      json += "\"" + String(i) + "\":{\"count\":" + String(timing.count);
+      json += ",\"totalUs\":" + String(timing.totalUs);
+      json += ",\"maxUs\":" + String(timing.maxUs);
+      json += ",\"lastUs\":" + String(timing.lastUs) + "}";
+    }
+    json += "}";
+
+    if (reset)
+      profiler->reset();
+  }
+  json += "}";
+
+  AsyncWebServerResponse *response = request->beginResponse(200, "application/json", json);
+  addCorsHeaders(response);
+  request->send(response);
+}
+#endif
 #endif
@@ -0,0 +1,148 @@
+#include "frame_change.h"
+#include <string.h>
+
+#define THUMB_PIXELS (CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT)
+
+void LumaThumbnail::begin(uint16_t width, uint16_t height)
+{
+  sourceWidth = width ? width : 1;
+  sourceHeight = height ? height : 1;
+  memset(sums, 0, sizeof(sums));
+  memset(counts, 0, sizeof(counts));
+}
+
+void LumaThumbnail::addRgb(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *rgb)
+{
+  for (uint16_t row = 0; row < h; row++)
+  {
+    uint32_t sy = (uint32_t)(y + row) * CHANGE_THUMB_HEIGHT / sourceHeight;
+    if (sy >= CHANGE_THUMB_HEIGHT)
+      break;
+    for (uint16_t col = 0; col < w; col++, rgb += 3)
+    {
+      uint32_t sx = (uint32_t)(x + col) * CHANGE_THUMB_WIDTH / sourceWidth;
+      if (sx >= CHANGE_THUMB_WIDTH)
+        continue;
+      // BT.601 luma in 8.8 fixed point
+      uint32_t luma = (77 * rgb[0] + 150 * rgb[1] + 29 * rgb[2]) >> 8;
+      sums[sy * CHANGE_THUMB_WIDTH + sx] += luma;
+      counts[sy * CHANGE_THUMB_WIDTH + sx]++;
+    }
+  }
+}
+
+void LumaThumbnail::finish()
+{
+  for (int i = 0; i < THUMB_PIXELS; i++)
+    pixels[i] = counts[i] ? sums[i] / counts[i] : 0;
+}
+
+uint32_t changeBlockSad(const uint8_t *a, const uint8_t *b, int blockX, int blockY)
+{
+  uint32_t sad = 0;
+  for (int y = 0; y < CHANGE_BLOCK; y++)
+  {
+    int offset = (blockY * CHANGE_BLOCK + y) * CHANGE_THUMB_WIDTH + blockX * CHANGE_BLOCK;
+    for (int x = 0; x < CHANGE_BLOCK; x++)
+    {
+      int diff = (int)a[offset + x] - (int)b[offset + x];
+      sad += diff < 0 ? -diff : diff;
+    }
+  }
+  return sad;
+}
+
+uint16_t changedBlocks(const uint8_t *a, const uint8_t *b, uint16_t blockSad)
+{
+  uint16_t count = 0;
+  for (int by = 0; by < CHANGE_BLOCKS_Y; by++)
+  {
+    for (int bx = 0; bx < CHANGE_BLOCKS_X; bx++)
+    {
+      if (changeBlockSad(a, b, bx, by) > blockSad)
+        count++;
+    }
+  }
+  return count;
+}
+
+ChangeGate::ChangeGate()
+{
+  frames = 0;
+  skipped = 0;
+  forced = 0;
+  limits = nullptr;
+  reset();
+}
+
+void ChangeGate::setThresholds(const ChangeThresholds *thresholds)
+{
+  limits = thresholds;
+  reset();
+}
+
+void ChangeGate::reset()
+{
+  hasReference = false;
+  hasPrevious = false;
+  changed = false;
+  stable = 0;
+  skippedInRow = 0;
+}
+
+bool ChangeGate::check(const LumaThumbnail &frame)
+{
+  frames++;
+  bool upload = true;
+
+  if (limits && hasReference)
+  {
+    uint16_t fromReference = changedBlocks(frame.pixels, reference, limits->blockSad);
+    uint16_t fromPrevious = hasPrevious ? changedBlocks(frame.pixels, previous, limits->blockSad) : CHANGE_BLOCKS;
+
+    if (!changed && fromReference >= limits->enterBlocks)
+    {
+      changed = true;
+      stable = 0;
+    }
+    else if (changed && fromReference <= limits->exitBlocks)
+    {
+      // Back to what was uploaded last, e.g. a hand passed over the board
+      changed = false;
+    }
+
+    if (changed)
+      stable = fromPrevious <= limits->exitBlocks ? stable + 1 : 0;
+    upload = changed && stable >= limits->stableFrames;
+
+    if (!upload && limits->forceAfter && skippedInRow + 1 >= limits->forceAfter)
+    {
+      upload = true;
+      forced++;
+    }
+  }
+
+  memcpy(previous, frame.pixels, sizeof(previous));
+  hasPrevious = true;
+
+  if (upload)
+  {
+    skippedInRow = 0;
+  }
+  else
+  {
+    skippedInRow++;
+    skipped++;
+  }
+  return upload;
+}
+
+void ChangeGate::accept()
+{
+  if (!hasPrevious)
+    return;
+  memcpy(reference, previous, sizeof(reference));
+  hasReference = true;
+  changed = false;
+  stable = 0;
+}
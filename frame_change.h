@@ -0,0 +1,90 @@
+#ifndef FRAME_CHANGE_H
+#define FRAME_CHANGE_H
+
+#include <stdint.h>
+
+/**
+ * Frame change detector that keeps unchanged scenes from being uploaded.
+ *
+ * Each frame is reduced to a small luminance thumbnail, fed from the 1:8
+ * JPEG decode the way esp_jpg_decode() hands out RGB888 blocks. The
+ * thumbnail is cut into blocks and a block counts as changed when its sum
+ * of absolute differences (SAD) exceeds the profile threshold. ChangeGate
+ * compares every frame with the last uploaded one (the reference) and with
+ * the frame before it. A change of at least enterBlocks opens the gate, and
+ * the frame is uploaded once it has differed from its predecessor by no
+ * more than exitBlocks for stableFrames frames in a row; a scene that goes
+ * back to the reference (a hand passing over the board) closes the gate
+ * again. After forceAfter skipped frames one is uploaded anyway. No Arduino
+ * dependencies, so the kernels run on a host on decoded recordings.
+ */
+
+#define CHANGE_THUMB_WIDTH 32
+#define CHANGE_THUMB_HEIGHT 24
+#define CHANGE_BLOCK 4 // block side in thumbnail pixels
+#define CHANGE_BLOCKS_X (CHANGE_THUMB_WIDTH / CHANGE_BLOCK)
+#define CHANGE_BLOCKS_Y (CHANGE_THUMB_HEIGHT / CHANGE_BLOCK)
+#define CHANGE_BLOCKS (CHANGE_BLOCKS_X * CHANGE_BLOCKS_Y)
+
+struct ChangeThresholds
+{
+  uint16_t blockSad;    // SAD over one block (16 pixels) that counts it as changed
+  uint8_t enterBlocks;  // changed blocks against the reference to open the gate
+  uint8_t exitBlocks;   // at most this many: unchanged against the previous frame / reference
+  uint8_t stableFrames; // frames without change before the upload
+  uint8_t forceAfter;   // upload anyway after this many skipped frames, 0 = never
+};
+
+class LumaThumbnail
+{
+public:
+  // Size of the decoded image, resets the accumulators
+  void begin(uint16_t width, uint16_t height);
+  // A rectangle of RGB888 pixels at (x, y)
+  void addRgb(uint16_t x, uint16_t y, uint16_t w, uint16_t h, const uint8_t *rgb);
+  void finish();
+
+  uint8_t pixels[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT];
+
+private:
+  uint16_t sourceWidth;
+  uint16_t sourceHeight;
+  uint32_t sums[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT];
+  uint16_t counts[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT];
+};
+
+// SAD of one block between two thumbnails
+uint32_t changeBlockSad(const uint8_t *a, const uint8_t *b, int blockX, int blockY);
+// Blocks whose SAD exceeds blockSad
+uint16_t changedBlocks(const uint8_t *a, const uint8_t *b, uint16_t blockSad);
+
+class ChangeGate
+{
+public:
+  ChangeGate();
+
+  // nullptr disables the gate, every frame is uploaded
+  void setThresholds(const ChangeThresholds *thresholds);
+  // Forget the reference, the next frame is uploaded
+  void reset();
+  // True when the frame should be uploaded
+  bool check(const LumaThumbnail &frame);
+  // The frame passed by check() was uploaded and becomes the reference
+  void accept();
+
+  uint32_t frames;
+  uint32_t skipped; // uploads avoided
+  uint32_t forced;
+
+private:
+  const ChangeThresholds *limits;
+  bool hasReference;
+  bool hasPrevious;
+  bool changed;
+  uint8_t stable;
+  uint8_t skippedInRow;
+  uint8_t reference[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT];
+  uint8_t previous[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT];
+};
+
+#endif
@@ -2,13 +2,48 @@
 #define GAME_UTILS_H
 
 #include <Arduino.h>
+#include "link_window.h"
+#include "link_stats.h"
+#include "retry_policy.h"
+#include "arm_planner.h"
+#include "arm_ik.h"
+#include "vision_queue.h"
 
+// Order reach moves with the motion planner instead of the fixed per-game sequences
+#ifndef ENABLE_ARM_PLANNER
+#define ENABLE_ARM_PLANNER 1
+#endif
+// 0 = keep the hand-tuned cell tables and only print how far the IK model is from them,
+// 1 = regenerate every cell from the three reference cells of each table (see arm_ik.h)
+#define ARM_IK_TABLES 0
+// Move the arm towards its next pick while the game waits for the player or the camera
+#define ENABLE_ARM_PREPOSITION 1
+
+// Give up on a vision request that has not been started by then
+#define VISION_DEFAULT_TIMEOUT_MS 10000
+// Capture and read a frame, blocks the game loop until the reply (or a game switch).
+// The values as CSV, "ERROR" when the request failed.
 String getPythonData(String command);
-void parseCSV(const char *csv, int arr[], int &count);
+// Non-blocking getPythonData: queue the request for the vision worker, then poll the future
+// with pollVisionReply until it returns true. freshAfterMs (a millis() time) rejects frames taken before it,
+// 0 takes any frame. flags are VISION_* request flags (vision_queue.h): a VISION_GATED request is
+// only uploaded when the scene changed since the last gated upload of the profile (see
+// frame_change.h), otherwise it finishes as VISION_UNCHANGED.
+// Returns VISION_FUTURE_INVALID when the queue is full.
+VisionFuture startPythonData(const char *command, uint32_t timeoutMs = VISION_DEFAULT_TIMEOUT_MS, uint32_t freshAfterMs = 0, uint8_t flags = 0);
+// The frame has been taken, the arm may move while it is uploaded
+bool pythonDataCaptured(VisionFuture future);
+// False while the request runs. Then status is VISION_DONE with the values in reply,
+// VISION_UNCHANGED, or the reason it failed.
+bool pollVisionReply(VisionFuture future, VisionStatus &status, VisionReply &reply);
+void cancelPythonData(VisionFuture future);
+// Every queued and running request, on a game switch
+void cancelAllPythonData();
 bool sendServoCommand(int a1, int a2, int a3);
 bool sendStepperCommand(const int cmds[10]);
 void changeConfig(String command);
 void printOnLCD(const String &msg);
+void calibrateArmTable(const char *name, int (*table)[ARM_IK_JOINTS], uint8_t rows, uint8_t cols);
 
 // Arm enum
 enum ArmMotor
@@ -20,4 +55,39 @@ enum ArmMotor
   GRIP = 4
 };
 
+// Multi-joint move sent as a single command, see LinkPose
+typedef LinkPose ArmPose;
+#define POSE_SEQUENTIAL LINK_POSE_SEQUENTIAL
+
+void poseBegin(ArmPose &pose, uint16_t staggerMs = POSE_SEQUENTIAL);
+bool poseAdd(ArmPose &pose, ArmMotor motor, int angle, int overShoot = 0);
+bool sendPoseCommand(const ArmPose &pose);
+
+// Last acknowledged angle of every joint, ARM_TIMING_UNKNOWN_ANGLE where it is not known.
+// Commands that would not move anything are answered without going on the wire.
+void getArmAngles(int angles[ARM_TIMING_JOINTS]);
+// Forget the joint angles, e.g. when switching games
+void invalidateArmState();
+// Plan the move to `goal` from the current joint angles, returns false when the
+// planner is disabled or the constraints cannot be met (callers use their fixed order)
+bool planPose(ArmPose &pose, const ArmGoal &goal, const ArmConstraint *constraints, uint8_t count);
+
+// Sparse stepper command: only the steppers that turn, all of them start together
+typedef LinkStepperMove StepperMove;
+
+void stepperBegin(StepperMove &move);
+bool stepperAdd(StepperMove &move, uint8_t stepper, int angle, int direction);
+bool sendStepperMove(const StepperMove &move);
+
+// Non-blocking commands, poll the returned ticket until it is no longer pending
+LinkTicket submitServoCommand(int a1, int a2, int a3);
+LinkTicket submitPoseCommand(const ArmPose &pose);
+LinkTicket submitStepperMove(const StepperMove &move);
+LinkTicketStatus pollLinkCommand(LinkTicket ticket);
+void cancelLinkCommand(LinkTicket ticket);
+
+// Submit the pose when the retry policy allows it and poll it, returns true once it is acknowledged.
+// `ticket` must start out as LINK_TICKET_INVALID and is owned by the caller.
+bool executePose(const ArmPose &pose, LinkTicket &ticket, RetryPolicy &retry);
+
 #endif
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_game.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+
+/**
+ * game_sim: plays whole games on the host against the simulated Arduino
+ * and reports, per game, the game time as it would pass on the robot, the
+ * commands sent and the time spent (and the arm standing still) in each
+ * state of the game loop.
+ *
+ *   game_sim [--game xo|xo_o|memory|cups|rubik|all] [--runs N] [--seed N]
+ *            [--loss P] [--latency-ms N] [--capture-ms N] [--upload-ms N]
+ *            [--vision-fail P] [--limit-s N] [--verbose] [--log]
+ *
+ * Exits 1 when a game did not finish in time or the arm stopped answering.
+ */
+
+static const char *opName(uint8_t op)
+{
+  switch (op)
+  {
+  case LINK_OP_SERVO:
+    return "servo";
+  case LINK_OP_STEPPER:
+    return "stepper";
+  case LINK_OP_POSE:
+    return "pose";
+  case LINK_OP_BAUD:
+    return "baud";
+  case LINK_OP_ECHO:
+    return "echo";
+  case LINK_OP_STEPPER_SPARSE:
+    return "sparse";
+  default:
+    return "other";
+  }
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: game_sim [--game xo|xo_o|memory|cups|rubik|all] [--runs N] [--seed N]\n"
+                  "                [--loss P] [--latency-ms N] [--capture-ms N] [--upload-ms N]\n"
+                  "                [--vision-fail P] [--limit-s N] [--verbose] [--log]\n");
+  exit(2);
+}
+
+static void report(const SimGame &game, uint32_t seed, const SimGameResult &result, bool log)
+{
+  printf("%s seed %u: %s in %.1f s, arm idle %.1f s\n", game.name, seed,
+         result.finished ? "finished" : "TIMED OUT", result.durationUs / 1e6, result.idleUs / 1e6);
+
+  uint32_t ops[256] = {};
+  uint32_t ascii = 0;
+  for (const SimCommand &command : result.commands)
+  {
+    ops[command.op]++;
+    if (!command.binary)
+      ascii++;
+  }
+  printf("  commands %u (%u ASCII lines, %u binary frames):", (unsigned)result.commands.size(), ascii,
+         (unsigned)result.commands.size() - ascii);
+  for (int op = 0; op < 256; op++)
+  {
+    if (ops[op])
+      printf(" %s %u", opName(op), ops[op]);
+  }
+  printf("\n  uart %u writes, %u bytes out, %u bytes in; vision %u captures, %u uploads\n", result.uartWrites,
+         result.bytesOut, result.bytesIn, result.captures, result.uploads);
+  if (result.elidedSteps)
+    printf("  arm state cache dropped %u steps, %u whole commands\n", result.elidedSteps, result.elidedCommands);
+  if (result.armGaveUp)
+    printf("  arm not responding %u times\n", result.armGaveUp);
+
+  printf("  %-26s %10s %10s\n", "state", "time s", "idle s");
+  for (int state = 0; state < STATE_PROFILER_MAX_STATES; state++)
+  {
+    if (!result.states[state].us)
+      continue;
+    const char *name = state < game.stateCount ? game.states[state] : "?";
+    printf("  %-26s %10.2f %10.2f\n", name, result.states[state].us / 1e6, result.states[state].idleUs / 1e6);
+  }
+
+  if (log)
+  {
+    for (const SimCommand &command : result.commands)
+      printf("    %10.3f %10.3f  %s\n", command.startUs / 1e6, command.doneUs / 1e6, command.text.c_str());
+  }
+}
+
+int main(int argc, char **argv)
+{
+  const char *gameName = "all";
+  int runs = 1;
+  uint32_t seed = 1;
+  bool log = false;
+  SimArduinoConfig link;
+  SimOptions options;
+
+  for (int i = 1; i < argc; i++)
+  {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--verbose") == 0)
+      hostSerialEcho = true;
+    else if (strcmp(arg, "--log") == 0)
+      log = true;
+    else if (!hasValue)
+      usage();
+    else if (strcmp(arg, "--game") == 0)
+      gameName = argv[++i];
+    else if (strcmp(arg, "--runs") == 0)
+      runs = atoi(argv[++i]);
+    else if (strcmp(arg, "--seed") == 0)
+      seed = strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(arg, "--loss") == 0)
+      link.lossRate = atof(argv[++i]);
+    else if (strcmp(arg, "--latency-ms") == 0)
+      link.latencyUs = atoi(argv[++i]) * 1000;
+    else if (strcmp(arg, "--capture-ms") == 0)
+      options.vision.captureMs = atoi(argv[++i]);
+    else if (strcmp(arg, "--upload-ms") == 0)
+      options.vision.uploadMs = atoi(argv[++i]);
+    else if (strcmp(arg, "--vision-fail") == 0)
+      options.vision.failRate = atof(argv[++i]);
+    else if (strcmp(arg, "--limit-s") == 0)
+      options.limitMs = atoi(argv[++i]) * 1000;
+    else
+      usage();
+  }
+
+  bool all = strcmp(gameName, "all") == 0;
+  if (!all && !simFindGame(gameName))
+    usage();
+
+  link.baud = ARDUINO_LINK_BAUD;
+  link.seed = seed;
+  options.vision.seed = seed;
+  simLink(link);
+  printf("link: %s at %u baud\n", ARDUINO_LINK_BINARY ? "binary" : "ASCII", hostUartBaud());
+
+  int failures = 0;
+  for (int g = 0; g < simGameCount; g++)
+  {
+    const SimGame &game = simGames[g];
+    if (!all && strcmp(game.name, gameName) != 0)
+      continue;
+
+    double total = 0;
+    for (int run = 0; run < runs; run++)
+    {
+      SimWorld *world = simMakeWorld(game.name, seed + run);
+      SimGameResult result;
+      if (!simPlayGame(game, *world, options, result) || result.armGaveUp)
+        failures++;
+      report(game, seed + run, result, log);
+
+      // The robot has to have put its pieces on the board
+      SimXoWorld *xo = dynamic_cast<SimXoWorld *>(world);
+      if (xo && (xo->misplaced || !xo->finished()))
+      {
+        printf("  board %s, %u pieces misplaced\n", xo->finished() ? "complete" : "NOT complete", xo->misplaced);
+        failures++;
+      }
+      total += result.durationUs / 1e6;
+      delete world;
+    }
+    if (runs > 1)
+      printf("%s: mean %.1f s over %d games\n", game.name, total / runs, runs);
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,145 @@
+#include <Arduino.h>
+#include <ctype.h>
+#include <stdarg.h>
+#include "host_clock.h"
+
+bool hostSerialEcho = false;
+HardwareSerial Serial(true);
+HardwareSerial Serial2(false);
+
+unsigned long millis()
+{
+  return (unsigned long)(hostNowUs() / 1000);
+}
+
+unsigned long micros()
+{
+  return (unsigned long)hostNowUs();
+}
+
+void delay(unsigned long ms)
+{
+  if (hostInTask())
+    hostTaskWait([] { return false; }, (uint64_t)ms * 1000);
+  else
+    hostAdvanceUs((uint64_t)ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  if (hostInTask())
+    hostTaskWait([] { return false; }, us);
+  else
+    hostAdvanceUs(us);
+}
+
+// Same generator on every run, randomSeed() picks another sequence
+static uint32_t randomState = 0x2545F491;
+
+void randomSeed(unsigned long seed)
+{
+  randomState = seed ? (uint32_t)seed : 0x2545F491;
+}
+
+long random(long howBig)
+{
+  if (howBig <= 0)
+    return 0;
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return (long)(randomState % (uint32_t)howBig);
+}
+
+long random(long howSmall, long howBig)
+{
+  if (howSmall >= howBig)
+    return howSmall;
+  return howSmall + random(howBig - howSmall);
+}
+
+std::string String::format(long value, unsigned char base)
+{
+  if (base == DEC)
+    return std::to_string(value);
+  return (value < 0 ? "-" : "") + format((unsigned long)(value < 0 ? -value : value), base);
+}
+
+std::string String::format(unsigned long value, unsigned char base)
+{
+  if (base < 2 || base > 16)
+    base = DEC;
+  std::string digits;
+  do
+  {
+    digits.insert(digits.begin(), "0123456789ABCDEF"[value % base]);
+    value /= base;
+  } while (value);
+  return digits;
+}
+
+std::string String::format(double value, unsigned char decimals)
+{
+  char buffer[64];
+  snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+  return buffer;
+}
+
+void String::trim()
+{
+  size_t first = 0;
+  while (first < text.size() && isspace((unsigned char)text[first]))
+    first++;
+  size_t last = text.size();
+  while (last > first && isspace((unsigned char)text[last - 1]))
+    last--;
+  text = text.substr(first, last - first);
+}
+
+void String::toLowerCase()
+{
+  for (size_t i = 0; i < text.size(); i++)
+    text[i] = (char)tolower((unsigned char)text[i]);
+}
+
+void String::toUpperCase()
+{
+  for (size_t i = 0; i < text.size(); i++)
+    text[i] = (char)toupper((unsigned char)text[i]);
+}
+
+void String::replace(const String &from, const String &to)
+{
+  if (from.text.empty())
+    return;
+  size_t pos = 0;
+  while ((pos = text.find(from.text, pos)) != std::string::npos)
+  {
+    text.replace(pos, from.text.size(), to.text);
+    pos += to.text.size();
+  }
+}
+
+size_t Print::printf(const char *format, ...)
+{
+  char buffer[256];
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(buffer, sizeof(buffer), format, args);
+  va_end(args);
+  if (length < 0)
+    return 0;
+  return write((const uint8_t *)buffer, std::min<size_t>(length, sizeof(buffer) - 1));
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size)
+{
+  if (!echo || !hostSerialEcho)
+    return size;
+  for (size_t i = 0; i < size; i++)
+  {
+    if (buffer[i] != '\r')
+      putchar(buffer[i]);
+  }
+  return size;
+}
@@ -0,0 +1,147 @@
+#include "host_clock.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct HostTaskThread
+{
+  std::function<bool()> ready;
+  uint64_t wakeUs = 0;
+  bool waiting = true;
+};
+
+// Leaked on purpose: task threads block forever and must not outlive these at exit
+static std::mutex &lock = *new std::mutex;
+static std::condition_variable &changed = *new std::condition_variable;
+static std::vector<HostTaskThread *> &tasks = *new std::vector<HostTaskThread *>;
+static std::multimap<uint64_t, std::function<void()>> &events = *new std::multimap<uint64_t, std::function<void()>>;
+static uint64_t nowUs = 0;
+static thread_local HostTaskThread *currentTask = nullptr;
+
+uint64_t hostNowUs()
+{
+  return nowUs;
+}
+
+void hostSchedule(uint64_t atUs, std::function<void()> event)
+{
+  events.emplace(atUs < nowUs ? nowUs : atUs, std::move(event));
+}
+
+bool hostInTask()
+{
+  return currentTask != nullptr;
+}
+
+void hostTaskWait(const std::function<bool()> &ready, uint64_t timeoutUs)
+{
+  HostTaskThread *task = currentTask;
+  std::unique_lock<std::mutex> guard(lock);
+  task->ready = ready;
+  task->wakeUs = timeoutUs == HOST_NEVER ? HOST_NEVER : nowUs + timeoutUs;
+  task->waiting = true;
+  changed.notify_all();
+  changed.wait(guard, [task] { return !task->waiting; });
+}
+
+void hostRunTasks()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  bool ran = true;
+  while (ran)
+  {
+    ran = false;
+    for (size_t i = 0; i < tasks.size(); i++)
+    {
+      HostTaskThread *task = tasks[i];
+      if (task->wakeUs > nowUs && !(task->ready && task->ready()))
+        continue;
+
+      task->waiting = false;
+      changed.notify_all();
+      changed.wait(guard, [task] { return task->waiting; });
+      ran = true;
+    }
+  }
+}
+
+void hostStartTask(void (*function)(void *), void *arg)
+{
+  HostTaskThread *task = new HostTaskThread;
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    tasks.push_back(task);
+  }
+
+  std::thread([task, function, arg] {
+    currentTask = task;
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      changed.wait(guard, [task] { return !task->waiting; });
+    }
+    function(arg);
+    // A task that returns never runs again
+    hostTaskWait([] { return false; }, HOST_NEVER);
+  }).detach();
+
+  hostRunTasks();
+}
+
+static uint64_t nextWakeUs()
+{
+  uint64_t next = events.empty() ? HOST_NEVER : events.begin()->first;
+  std::lock_guard<std::mutex> guard(lock);
+  for (size_t i = 0; i < tasks.size(); i++)
+  {
+    if (tasks[i]->wakeUs < next)
+      next = tasks[i]->wakeUs;
+  }
+  return next;
+}
+
+static void fireDueEvents()
+{
+  while (!events.empty() && events.begin()->first <= nowUs)
+  {
+    std::function<void()> event = std::move(events.begin()->second);
+    events.erase(events.begin());
+    event();
+    hostRunTasks();
+  }
+}
+
+bool hostAdvanceUntil(const std::function<bool()> &ready, uint64_t deadlineUs)
+{
+  fireDueEvents();
+  hostRunTasks();
+  while (!ready())
+  {
+    if (nowUs >= deadlineUs)
+      return false;
+
+    uint64_t next = nextWakeUs();
+    if (next == HOST_NEVER && deadlineUs == HOST_NEVER)
+    {
+      fprintf(stderr, "host clock: the main thread waits for something that can never happen\n");
+      abort();
+    }
+    nowUs = next < deadlineUs ? (next > nowUs ? next : nowUs) : deadlineUs;
+    fireDueEvents();
+    hostRunTasks();
+  }
+  return true;
+}
+
+void hostAdvanceTo(uint64_t us)
+{
+  hostAdvanceUntil([] { return false; }, us);
+}
+
+void hostAdvanceUs(uint64_t us)
+{
+  hostAdvanceTo(nowUs + us);
+}
@@ -0,0 +1,42 @@
+#ifndef HOST_CLOCK_H
+#define HOST_CLOCK_H
+
+#include <stdint.h>
+#include <functional>
+
+/**
+ * Virtual time for the host build.
+ *
+ * Time only moves when the main thread (the game loop) waits: delay(), a
+ * blocking FreeRTOS call with a timeout, or the simulation advancing its
+ * loop. Events scheduled with hostSchedule() (bytes arriving from the
+ * simulated Arduino, a simulated player moving) fire in time order while
+ * it moves.
+ *
+ * FreeRTOS tasks run on threads, but only one thread runs at a time: a task
+ * runs until it blocks, and the main thread lets every task that became
+ * ready run before it goes on. The link receive task and the vision worker
+ * therefore interleave with the game loop the same way on every run.
+ */
+
+#define HOST_NEVER UINT64_MAX
+
+uint64_t hostNowUs();
+// Main thread only: move time forward to `us`, firing every event due on the way
+void hostAdvanceTo(uint64_t us);
+void hostAdvanceUs(uint64_t us);
+// Main thread only: advance until ready() holds or the deadline, returns ready()
+bool hostAdvanceUntil(const std::function<bool()> &ready, uint64_t deadlineUs);
+
+// Run `event` on the main thread once the clock reaches `atUs` (events at the same time run in order)
+void hostSchedule(uint64_t atUs, std::function<void()> event);
+
+// Tasks
+bool hostInTask();
+// Task side: block until ready() holds or timeoutUs passed (HOST_NEVER for no timeout)
+void hostTaskWait(const std::function<bool()> &ready, uint64_t timeoutUs);
+// Main side: run every task that can make progress until all of them wait again
+void hostRunTasks();
+void hostStartTask(void (*function)(void *), void *arg);
+
+#endif
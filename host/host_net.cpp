@@ -0,0 +1,425 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <deque>
+#include <vector>
+#include "host_clock.h"
+#include "host_net.h"
+
+struct HostConnection
+{
+  bool clientOpen;
+  bool serverOpen;
+  bool closeArrived; // the server's close reached the client
+  std::deque<uint8_t> rx;
+};
+
+static HostNetServer *netServer = nullptr;
+static uint64_t netRoundTripUs = 0;
+static std::vector<HostConnection> netConnections;
+static HostNetStats netStats = {};
+
+void hostNetAttach(HostNetServer *server, uint64_t roundTripUs)
+{
+  netServer = server;
+  netRoundTripUs = roundTripUs;
+}
+
+const HostNetStats &hostNetStats()
+{
+  return netStats;
+}
+
+void hostNetSend(int connection, const uint8_t *data, size_t length)
+{
+  if (!netConnections[connection].serverOpen)
+    return;
+  std::vector<uint8_t> bytes(data, data + length);
+  hostSchedule(hostNowUs() + netRoundTripUs / 2, [connection, bytes] {
+    HostConnection &conn = netConnections[connection];
+    if (!conn.clientOpen)
+      return;
+    conn.rx.insert(conn.rx.end(), bytes.begin(), bytes.end());
+    netStats.bytesIn += bytes.size();
+  });
+}
+
+void hostNetClose(int connection)
+{
+  if (!netConnections[connection].serverOpen)
+    return;
+  netConnections[connection].serverOpen = false;
+  hostSchedule(hostNowUs() + netRoundTripUs / 2, [connection] { netConnections[connection].closeArrived = true; });
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+  stop();
+  // SYN and SYN-ACK, or the reset of a refused connect
+  delayMicroseconds(netRoundTripUs);
+
+  int id = (int)netConnections.size();
+  netConnections.push_back({false, false, false, {}});
+  if (!netServer || !netServer->accept(id))
+  {
+    netStats.refused++;
+    return 0;
+  }
+  netStats.connects++;
+  netConnections[id].clientOpen = true;
+  netConnections[id].serverOpen = true;
+  connection = id;
+  return 1;
+}
+
+uint8_t WiFiClient::connected()
+{
+  if (connection < 0)
+    return 0;
+  HostConnection &conn = netConnections[connection];
+  return !conn.closeArrived || !conn.rx.empty();
+}
+
+void WiFiClient::stop()
+{
+  if (connection < 0)
+    return;
+  int id = connection;
+  connection = -1;
+  HostConnection &conn = netConnections[id];
+  conn.clientOpen = false;
+  conn.rx.clear();
+  if (!conn.serverOpen)
+    return;
+  hostSchedule(hostNowUs() + netRoundTripUs / 2, [id] {
+    netConnections[id].serverOpen = false;
+    if (netServer)
+      netServer->closed(id);
+  });
+}
+
+size_t WiFiClient::write(const uint8_t *buffer, size_t size)
+{
+  // A close from the server answers the next write with a reset
+  if (connection < 0 || netConnections[connection].closeArrived)
+    return 0;
+
+  int id = connection;
+  std::vector<uint8_t> bytes(buffer, buffer + size);
+  netStats.bytesOut += size;
+  hostSchedule(hostNowUs() + netRoundTripUs / 2, [id, bytes] {
+    if (netConnections[id].serverOpen && netServer)
+      netServer->receive(id, bytes.data(), bytes.size());
+  });
+  return size;
+}
+
+int WiFiClient::available()
+{
+  return connection < 0 ? 0 : (int)netConnections[connection].rx.size();
+}
+
+int WiFiClient::read()
+{
+  uint8_t byte;
+  return read(&byte, 1) == 1 ? byte : -1;
+}
+
+int WiFiClient::read(uint8_t *buffer, size_t size)
+{
+  if (connection < 0)
+    return -1;
+  std::deque<uint8_t> &rx = netConnections[connection].rx;
+  if (rx.empty())
+    return netConnections[connection].closeArrived ? 0 : -1;
+  size_t n = std::min(size, rx.size());
+  std::copy(rx.begin(), rx.begin() + n, buffer);
+  rx.erase(rx.begin(), rx.begin() + n);
+  return (int)n;
+}
+
+int WiFiClient::peek()
+{
+  if (connection < 0 || netConnections[connection].rx.empty())
+    return -1;
+  return netConnections[connection].rx.front();
+}
+
+void WiFiClient::flush()
+{
+  if (connection >= 0)
+    netConnections[connection].rx.clear();
+}
+
+bool HTTPClient::begin(WiFiClient &client, const String &host, uint16_t port, const String &uri)
+{
+  clear();
+  this->client = &client;
+  this->host = host;
+  this->port = port;
+  this->uri = uri;
+  return true;
+}
+
+void HTTPClient::end()
+{
+  disconnect();
+  clear();
+}
+
+void HTTPClient::clear()
+{
+  returnCode = 0;
+  size = -1;
+  chunked = false;
+  headers = "";
+}
+
+void HTTPClient::disconnect()
+{
+  if (!connected())
+    return;
+  // What is left of the reply, the next one starts clean
+  client->flush();
+  if (!reuse || !canReuse)
+    client->stop();
+}
+
+bool HTTPClient::connected()
+{
+  return client && (client->available() > 0 || client->connected());
+}
+
+bool HTTPClient::connect()
+{
+  if (connected())
+  {
+    client->flush();
+    return true;
+  }
+  return client && client->connect(host.c_str(), port);
+}
+
+void HTTPClient::addHeader(const String &name, const String &value)
+{
+  headers += name + ": " + value + "\r\n";
+}
+
+bool HTTPClient::sendHeader(const char *type)
+{
+  String header = String(type) + " " + uri + " HTTP/1.1\r\nHost: " + host;
+  if (port != 80)
+    header += ":" + String((unsigned int)port);
+  header += "\r\nUser-Agent: ESP32HTTPClient\r\nConnection: ";
+  header += reuse ? "keep-alive" : "close";
+  header += "\r\nAccept-Encoding: identity;q=1,chunked;q=0.1,*;q=0\r\n";
+  header += headers + "\r\n";
+  return client->write((const uint8_t *)header.c_str(), header.length()) == header.length();
+}
+
+int HTTPClient::POST(uint8_t *payload, size_t size)
+{
+  if (!connect())
+    return returnError(HTTPC_ERROR_CONNECTION_REFUSED);
+  if (payload && size > 0)
+    addHeader("Content-Length", String((unsigned int)size));
+  if (!sendHeader("POST"))
+    return returnError(HTTPC_ERROR_SEND_HEADER_FAILED);
+  if (payload && size > 0 && client->write(payload, size) != size)
+    return returnError(HTTPC_ERROR_SEND_PAYLOAD_FAILED);
+  return returnError(handleHeaderResponse());
+}
+
+// One line without its CR LF, waiting for the rest of it up to the timeout
+bool HTTPClient::readLine(String &line)
+{
+  line = "";
+  unsigned long lastData = millis();
+  while (connected())
+  {
+    int c = client->read();
+    if (c < 0)
+    {
+      if (millis() - lastData > timeoutMs)
+        return false;
+      delay(1);
+      continue;
+    }
+    lastData = millis();
+    if (c == '\n')
+    {
+      line.trim();
+      return true;
+    }
+    line += (char)c;
+  }
+  return false;
+}
+
+int HTTPClient::handleHeaderResponse()
+{
+  if (!connected())
+    return HTTPC_ERROR_NOT_CONNECTED;
+
+  canReuse = reuse;
+  size = -1;
+  chunked = false;
+  String transferEncoding;
+  unsigned long lastData = millis();
+  while (connected())
+  {
+    if (client->available() <= 0)
+    {
+      if (millis() - lastData > timeoutMs)
+        return HTTPC_ERROR_READ_TIMEOUT;
+      delay(10);
+      continue;
+    }
+
+    String line;
+    if (!readLine(line))
+      break;
+    lastData = millis();
+
+    if (line.startsWith("HTTP/1."))
+    {
+      canReuse = canReuse && line[7] != '0';
+      returnCode = line.substring(9, 12).toInt();
+      continue;
+    }
+    if (line.length() == 0)
+    {
+      if (transferEncoding.length() > 0)
+      {
+        if (transferEncoding != "chunked")
+          return HTTPC_ERROR_ENCODING;
+        chunked = true;
+      }
+      return returnCode ? returnCode : HTTPC_ERROR_NO_HTTP_SERVER;
+    }
+
+    int colon = line.indexOf(':');
+    if (colon < 0)
+      continue;
+    String name = line.substring(0, colon);
+    String value = line.substring(colon + 1);
+    name.toLowerCase();
+    value.trim();
+    if (name == "content-length")
+      size = value.toInt();
+    else if (name == "transfer-encoding")
+      transferEncoding = value;
+    else if (name == "connection" && value.indexOf("close") >= 0 && value.indexOf("keep-alive") < 0)
+      canReuse = false;
+  }
+  return HTTPC_ERROR_CONNECTION_LOST;
+}
+
+WiFiClient *HTTPClient::getStreamPtr()
+{
+  return connected() ? client : nullptr;
+}
+
+// `length` bytes of the body to the stream, a short write fails the transfer
+int HTTPClient::writeToStreamDataBlock(Stream *stream, int length)
+{
+  uint8_t buffer[128];
+  int written = 0;
+  unsigned long lastData = millis();
+  while (written < length)
+  {
+    if (!connected())
+      return HTTPC_ERROR_CONNECTION_LOST;
+    int bytes = client->read(buffer, std::min<size_t>(sizeof(buffer), length - written));
+    if (bytes <= 0)
+    {
+      if (millis() - lastData > timeoutMs)
+        return HTTPC_ERROR_READ_TIMEOUT;
+      delay(1);
+      continue;
+    }
+    lastData = millis();
+    if (stream->write(buffer, bytes) != (size_t)bytes)
+      return HTTPC_ERROR_STREAM_WRITE;
+    written += bytes;
+  }
+  return written;
+}
+
+int HTTPClient::writeToStream(Stream *stream)
+{
+  if (!stream)
+    return returnError(HTTPC_ERROR_NO_STREAM);
+  if (!connected())
+    return returnError(HTTPC_ERROR_NOT_CONNECTED);
+
+  int total = 0;
+  if (!chunked)
+  {
+    total = writeToStreamDataBlock(stream, size);
+    if (total < 0)
+      return returnError(total);
+    end();
+    return total;
+  }
+
+  for (;;)
+  {
+    String chunkHeader;
+    if (!readLine(chunkHeader) || chunkHeader.length() == 0)
+      return returnError(HTTPC_ERROR_READ_TIMEOUT);
+    int length = (int)strtol(chunkHeader.c_str(), nullptr, 16);
+    if (length == 0)
+      break;
+
+    int bytes = writeToStreamDataBlock(stream, length);
+    if (bytes < 0)
+      return returnError(bytes);
+    total += bytes;
+
+    // CR LF after the chunk data
+    String trailer;
+    if (!readLine(trailer) || trailer.length() != 0)
+      return returnError(HTTPC_ERROR_READ_TIMEOUT);
+  }
+  end();
+  return total;
+}
+
+int HTTPClient::returnError(int error)
+{
+  if (error < 0 && connected())
+    client->stop();
+  return error;
+}
+
+String HTTPClient::errorToString(int error)
+{
+  switch (error)
+  {
+  case HTTPC_ERROR_CONNECTION_REFUSED:
+    return "connection refused";
+  case HTTPC_ERROR_SEND_HEADER_FAILED:
+    return "send header failed";
+  case HTTPC_ERROR_SEND_PAYLOAD_FAILED:
+    return "send payload failed";
+  case HTTPC_ERROR_NOT_CONNECTED:
+    return "not connected";
+  case HTTPC_ERROR_CONNECTION_LOST:
+    return "connection lost";
+  case HTTPC_ERROR_NO_STREAM:
+    return "no stream";
+  case HTTPC_ERROR_NO_HTTP_SERVER:
+    return "no HTTP server";
+  case HTTPC_ERROR_TOO_LESS_RAM:
+    return "too less ram";
+  case HTTPC_ERROR_ENCODING:
+    return "Transfer-Encoding not supported";
+  case HTTPC_ERROR_STREAM_WRITE:
+    return "Stream write error";
+  case HTTPC_ERROR_READ_TIMEOUT:
+    return "read Timeout";
+  default:
+    return String();
+  }
+}
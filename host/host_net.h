@@ -0,0 +1,44 @@
+#ifndef HOST_NET_H
+#define HOST_NET_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The far end of the host WiFiClient (WiFi.h).
+ *
+ * Every connection goes to the one attached server, whatever the host and
+ * port. Opening one takes a round trip, bytes and closes travel half a round
+ * trip each way. The client sees a close from the server once it has read
+ * what arrived before it, as on the ESP32, so HTTPClient can tell a
+ * kept-alive connection the server dropped from one it can reuse.
+ */
+
+class HostNetServer
+{
+public:
+  virtual ~HostNetServer() {}
+  // A client connects, false refuses it
+  virtual bool accept(int connection) { return true; }
+  // Called on the main thread when bytes from the client arrive
+  virtual void receive(int connection, const uint8_t *data, size_t length) = 0;
+  // The client closed the connection
+  virtual void closed(int connection) {}
+};
+
+struct HostNetStats
+{
+  uint32_t connects;
+  uint32_t refused;
+  uint32_t bytesOut; // client to server
+  uint32_t bytesIn;
+};
+
+void hostNetAttach(HostNetServer *server, uint64_t roundTripUs);
+// Server side: bytes to the client
+void hostNetSend(int connection, const uint8_t *data, size_t length);
+// Server side: close the connection, later bytes from the client are dropped
+void hostNetClose(int connection);
+const HostNetStats &hostNetStats();
+
+#endif
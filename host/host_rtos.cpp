@@ -0,0 +1,281 @@
+#include <Arduino.h>
+#include <deque>
+#include <vector>
+#include "driver/uart.h"
+#include "host_clock.h"
+#include "host_uart.h"
+
+struct HostQueue
+{
+  size_t itemSize;
+  size_t length;
+  std::deque<std::vector<uint8_t>> items;
+};
+
+struct HostTask
+{
+  TaskFunction_t function;
+  void *arg;
+  uint32_t notifications;
+};
+
+static thread_local HostTask *selfTask = nullptr;
+
+// Wait up to `ticks` for ready(): a task blocks, the main thread moves the clock
+static bool waitFor(const std::function<bool()> &ready, TickType_t ticks)
+{
+  if (ready())
+    return true;
+  if (ticks == 0)
+    return false;
+
+  uint64_t timeoutUs = ticks == portMAX_DELAY ? HOST_NEVER : (uint64_t)ticks * portTICK_PERIOD_MS * 1000;
+  if (hostInTask())
+  {
+    hostTaskWait(ready, timeoutUs);
+    return ready();
+  }
+  return hostAdvanceUntil(ready, timeoutUs == HOST_NEVER ? HOST_NEVER : hostNowUs() + timeoutUs);
+}
+
+// Whatever the main thread made ready runs before it goes on, like a higher priority task would
+static void wakeTasks()
+{
+  if (!hostInTask())
+    hostRunTasks();
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize)
+{
+  HostQueue *queue = new HostQueue;
+  queue->itemSize = itemSize;
+  queue->length = length;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+  if (!waitFor([queue] { return queue->items.size() < queue->length; }, ticks))
+    return pdFALSE;
+
+  const uint8_t *bytes = (const uint8_t *)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  wakeTasks();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+  if (!waitFor([queue] { return !queue->items.empty(); }, ticks))
+    return pdFALSE;
+
+  if (queue->itemSize > 0)
+    memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  wakeTasks();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue)
+{
+  queue->items.clear();
+  return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+  return queue->items.size();
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+  return xQueueCreate(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+  SemaphoreHandle_t mutex = xQueueCreate(1, 0);
+  xSemaphoreGive(mutex);
+  return mutex;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+  return xQueueReceive(semaphore, nullptr, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+  return xQueueSend(semaphore, nullptr, 0);
+}
+
+static void runTask(void *arg)
+{
+  selfTask = (HostTask *)arg;
+  selfTask->function(selfTask->arg);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle)
+{
+  HostTask *task = new HostTask{function, arg, 0};
+  if (handle)
+    *handle = task;
+  hostStartTask(runTask, task);
+  return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t priority, TaskHandle_t *handle, BaseType_t core)
+{
+  return xTaskCreate(function, name, stack, arg, priority, handle);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+  delay(ticks * portTICK_PERIOD_MS);
+}
+
+TickType_t xTaskGetTickCount()
+{
+  return (TickType_t)(millis() / portTICK_PERIOD_MS);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  task->notifications++;
+  wakeTasks();
+  return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks)
+{
+  HostTask *task = selfTask;
+  if (!waitFor([task] { return task->notifications > 0; }, ticks))
+    return 0;
+
+  uint32_t count = task->notifications;
+  task->notifications = clear ? 0 : count - 1;
+  return count;
+}
+
+// UART_NUM_2, wired to the peer attached with hostUartAttach()
+static HostUartPeer *uartPeer = nullptr;
+static QueueHandle_t uartEvents = nullptr;
+static std::deque<uint8_t> uartRx;
+static size_t uartRxSize = 0;
+static uint32_t uartBaud = 115200;
+static uint64_t txFreeUs = 0;
+static HostUartStats uartStats = {};
+
+void hostUartAttach(HostUartPeer *peer)
+{
+  uartPeer = peer;
+}
+
+uint32_t hostUartBaud()
+{
+  return uartBaud;
+}
+
+uint64_t hostUartByteUs(uint32_t baud)
+{
+  return (10ULL * 1000000 + baud - 1) / baud;
+}
+
+const HostUartStats &hostUartStats()
+{
+  return uartStats;
+}
+
+void hostUartDeliver(const uint8_t *data, size_t length, uint32_t baud)
+{
+  if (baud != uartBaud)
+  {
+    uartStats.garbledIn += length;
+    return;
+  }
+  if (!uartEvents)
+    return;
+
+  uart_event_t event = {};
+  if (uartRx.size() + length > uartRxSize)
+  {
+    uartStats.overflows++;
+    event.type = UART_BUFFER_FULL;
+  }
+  else
+  {
+    uartRx.insert(uartRx.end(), data, data + length);
+    uartStats.bytesIn += length;
+    event.type = UART_DATA;
+    event.size = length;
+  }
+  xQueueSend(uartEvents, &event, 0);
+}
+
+esp_err_t uart_driver_install(uart_port_t port, int rxBufferSize, int txBufferSize, int queueSize,
+                              QueueHandle_t *queue, int flags)
+{
+  uartRxSize = rxBufferSize;
+  uartEvents = xQueueCreate(queueSize, sizeof(uart_event_t));
+  if (queue)
+    *queue = uartEvents;
+  return ESP_OK;
+}
+
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config)
+{
+  uartBaud = config->baud_rate;
+  return ESP_OK;
+}
+
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts)
+{
+  return ESP_OK;
+}
+
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud)
+{
+  uartBaud = baud;
+  return ESP_OK;
+}
+
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks)
+{
+  return waitFor([] { return hostNowUs() >= txFreeUs; }, ticks) ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t uart_flush_input(uart_port_t port)
+{
+  uartRx.clear();
+  return ESP_OK;
+}
+
+int uart_write_bytes(uart_port_t port, const void *data, size_t length)
+{
+  // Writes leave the port one after the other, each arrives once its last byte is out
+  uint64_t start = txFreeUs > hostNowUs() ? txFreeUs : hostNowUs();
+  txFreeUs = start + length * hostUartByteUs(uartBaud);
+  uartStats.writes++;
+  uartStats.bytesOut += length;
+
+  std::vector<uint8_t> bytes((const uint8_t *)data, (const uint8_t *)data + length);
+  uint32_t baud = uartBaud;
+  hostSchedule(txFreeUs, [bytes, baud] {
+    if (uartPeer)
+      uartPeer->receive(bytes.data(), bytes.size(), baud);
+  });
+  return (int)length;
+}
+
+int uart_read_bytes(uart_port_t port, void *buffer, uint32_t length, TickType_t ticks)
+{
+  if (!waitFor([] { return !uartRx.empty(); }, ticks))
+    return 0;
+
+  size_t n = std::min<size_t>(length, uartRx.size());
+  std::copy(uartRx.begin(), uartRx.begin() + n, (uint8_t *)buffer);
+  uartRx.erase(uartRx.begin(), uartRx.begin() + n);
+  return (int)n;
+}
@@ -0,0 +1,41 @@
+#ifndef HOST_UART_H
+#define HOST_UART_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * The far end of the host UART driver (driver/uart.h).
+ *
+ * Bytes written by the ESP32 side reach the peer once they have been
+ * clocked out at the driver's baud rate, one write after the other. Bytes
+ * the peer delivers at a rate other than the driver's are lost, as they
+ * would be on the wire.
+ */
+
+class HostUartPeer
+{
+public:
+  virtual ~HostUartPeer() {}
+  // Called on the main thread when the last byte of a write arrives, `baud` is the sender's rate
+  virtual void receive(const uint8_t *data, size_t length, uint32_t baud) = 0;
+};
+
+struct HostUartStats
+{
+  uint32_t writes;
+  uint32_t bytesOut;
+  uint32_t bytesIn;
+  uint32_t garbledIn; // bytes lost to a baud rate mismatch
+  uint32_t overflows;
+};
+
+void hostUartAttach(HostUartPeer *peer);
+// Bytes from the peer, arriving now
+void hostUartDeliver(const uint8_t *data, size_t length, uint32_t baud);
+uint32_t hostUartBaud();
+// Microseconds a byte takes on the wire at `baud` (8N1)
+uint64_t hostUartByteUs(uint32_t baud);
+const HostUartStats &hostUartStats();
+
+#endif
@@ -0,0 +1,211 @@
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+/**
+ * Host build of the parts of the Arduino core the sketch modules use.
+ *
+ * millis(), micros() and delay() run on the virtual clock of host_clock.h,
+ * so a game plays at simulation speed and its timings are reproducible.
+ * Serial prints to stdout only when hostSerialEcho is set.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+using std::max;
+using std::min;
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+
+class String
+{
+public:
+  String() {}
+  String(const char *text) : text(text ? text : "") {}
+  String(const std::string &text) : text(text) {}
+  String(char c) : text(1, c) {}
+  String(int value, unsigned char base = DEC) : text(format((long)value, base)) {}
+  String(unsigned int value, unsigned char base = DEC) : text(format((unsigned long)value, base)) {}
+  String(long value, unsigned char base = DEC) : text(format(value, base)) {}
+  String(unsigned long value, unsigned char base = DEC) : text(format(value, base)) {}
+  String(float value, unsigned char decimals = 2) : text(format((double)value, decimals)) {}
+  String(double value, unsigned char decimals = 2) : text(format(value, decimals)) {}
+
+  unsigned int length() const { return text.size(); }
+  bool isEmpty() const { return text.empty(); }
+  const char *c_str() const { return text.c_str(); }
+  bool reserve(unsigned int size)
+  {
+    text.reserve(size);
+    return true;
+  }
+
+  char charAt(unsigned int index) const { return index < text.size() ? text[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char &operator[](unsigned int index) { return text[index]; }
+
+  String substring(unsigned int from) const { return from < text.size() ? String(text.substr(from)) : String(); }
+  String substring(unsigned int from, unsigned int to) const
+  {
+    if (from > to)
+      std::swap(from, to);
+    return from < text.size() ? String(text.substr(from, to - from)) : String();
+  }
+  int indexOf(char c, unsigned int from = 0) const { return position(text.find(c, from)); }
+  int indexOf(const String &s, unsigned int from = 0) const { return position(text.find(s.text, from)); }
+  int lastIndexOf(char c) const { return position(text.rfind(c)); }
+  bool startsWith(const String &s) const { return text.compare(0, s.text.size(), s.text) == 0; }
+  bool endsWith(const String &s) const
+  {
+    return text.size() >= s.text.size() && text.compare(text.size() - s.text.size(), s.text.size(), s.text) == 0;
+  }
+
+  long toInt() const { return atol(text.c_str()); }
+  float toFloat() const { return (float)atof(text.c_str()); }
+  void trim();
+  void toLowerCase();
+  void toUpperCase();
+  void remove(unsigned int index) { text.erase(std::min<size_t>(index, text.size())); }
+  void remove(unsigned int index, unsigned int count) { text.erase(std::min<size_t>(index, text.size()), count); }
+  void replace(const String &from, const String &to);
+
+  bool concat(const String &s)
+  {
+    text += s.text;
+    return true;
+  }
+  bool concat(const char *s, unsigned int length)
+  {
+    text.append(s, length);
+    return true;
+  }
+  template <typename T>
+  bool concat(T value) { return concat(String(value)); }
+  template <typename T>
+  String &operator+=(T value)
+  {
+    concat(value);
+    return *this;
+  }
+
+  bool equals(const String &s) const { return text == s.text; }
+  bool operator==(const String &s) const { return text == s.text; }
+  bool operator==(const char *s) const { return text == (s ? s : ""); }
+  bool operator!=(const String &s) const { return text != s.text; }
+  bool operator!=(const char *s) const { return !(*this == s); }
+  bool operator<(const String &s) const { return text < s.text; }
+
+private:
+  static int position(size_t found) { return found == std::string::npos ? -1 : (int)found; }
+  static std::string format(long value, unsigned char base);
+  static std::string format(unsigned long value, unsigned char base);
+  static std::string format(double value, unsigned char decimals);
+
+  std::string text;
+};
+
+inline String operator+(const String &a, const String &b)
+{
+  String sum(a);
+  sum += b;
+  return sum;
+}
+template <typename T>
+inline String operator+(const String &a, T b)
+{
+  String sum(a);
+  sum += b;
+  return sum;
+}
+inline String operator+(const char *a, const String &b) { return String(a) + b; }
+
+class Print
+{
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) { return write(&c, 1); }
+  virtual size_t write(const uint8_t *buffer, size_t size) = 0;
+
+  size_t print(const String &s) { return write((const uint8_t *)s.c_str(), s.length()); }
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned int value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(unsigned long value, int base = DEC) { return print(String(value, (unsigned char)base)); }
+  size_t print(double value, int decimals = 2) { return print(String(value, (unsigned char)decimals)); }
+
+  size_t println() { return print("\r\n"); }
+  template <typename T>
+  size_t println(T value)
+  {
+    size_t n = print(value);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(T value, int format)
+  {
+    size_t n = print(value, format);
+    return n + println();
+  }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print
+{
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+  virtual int peek() { return -1; }
+  virtual void flush() {}
+  void setTimeout(unsigned long) {}
+};
+
+#define SERIAL_8N1 0x800001c
+
+class HardwareSerial : public Stream
+{
+public:
+  explicit HardwareSerial(bool echo) : echo(echo) {}
+  void begin(unsigned long, uint32_t = SERIAL_8N1, int8_t = -1, int8_t = -1) {}
+  void end() {}
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+
+private:
+  bool echo;
+};
+
+// Serial echoes to stdout when set, Serial2 is never used by the link (see arduino_link.cpp)
+extern bool hostSerialEcho;
+extern HardwareSerial Serial;
+extern HardwareSerial Serial2;
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef HOST_HTTPCLIENT_H
+#define HOST_HTTPCLIENT_H
+
+// The part of the ESP32 HTTPClient the sketch uses, with its keep-alive rules:
+// a connection is reused while it is open and the server did not ask to close
+// it, begin() and end() clear the added headers, an error stops the connection
+
+#include <Arduino.h>
+#include <WiFi.h>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+class HTTPClient
+{
+public:
+  bool begin(WiFiClient &client, const String &host, uint16_t port, const String &uri = "/");
+  void end();
+  void setReuse(bool reuse) { this->reuse = reuse; }
+  void setTimeout(uint16_t timeoutMs) { this->timeoutMs = timeoutMs; }
+  void addHeader(const String &name, const String &value);
+
+  int POST(uint8_t *payload, size_t size);
+  // Content-Length of the reply, -1 when there is none (chunked)
+  int getSize() { return size; }
+  int writeToStream(Stream *stream);
+  WiFiClient *getStreamPtr();
+  bool connected();
+
+  static String errorToString(int error);
+
+private:
+  void clear();
+  void disconnect();
+  bool connect();
+  bool sendHeader(const char *type);
+  int handleHeaderResponse();
+  int writeToStreamDataBlock(Stream *stream, int length);
+  bool readLine(String &line);
+  int returnError(int error);
+
+  WiFiClient *client = nullptr;
+  String host;
+  uint16_t port = 80;
+  String uri;
+  String headers;
+  bool reuse = true;
+  bool canReuse = false;
+  uint16_t timeoutMs = 5000;
+  int returnCode = 0;
+  int size = -1;
+  bool chunked = false;
+};
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef HOST_WIFI_H
+#define HOST_WIFI_H
+
+// WiFiClient for the host build, its connections go to the server of host_net.h
+
+#include <Arduino.h>
+
+class WiFiClient : public Stream
+{
+public:
+  int connect(const char *host, uint16_t port);
+  uint8_t connected();
+  void stop();
+
+  size_t write(const uint8_t *buffer, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int read(uint8_t *buffer, size_t size);
+  int peek() override;
+  // Drops what has been received, as the ESP32 one does
+  void flush() override;
+
+private:
+  int connection = -1;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef HOST_DRIVER_UART_H
+#define HOST_DRIVER_UART_H
+
+// ESP-IDF UART driver for the host build, the port is wired to the simulated Arduino (sim_arduino.h)
+
+#include <stddef.h>
+#include "freertos/queue.h"
+
+typedef int esp_err_t;
+typedef int uart_port_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define UART_NUM_2 2
+#define UART_PIN_NO_CHANGE -1
+
+typedef enum
+{
+  UART_DATA,
+  UART_BREAK,
+  UART_BUFFER_FULL,
+  UART_FIFO_OVF,
+  UART_FRAME_ERR,
+  UART_PARITY_ERR,
+  UART_DATA_BREAK,
+  UART_PATTERN_DET,
+  UART_EVENT_MAX
+} uart_event_type_t;
+
+typedef struct
+{
+  uart_event_type_t type;
+  size_t size;
+  bool timeout_flag;
+} uart_event_t;
+
+typedef enum
+{
+  UART_DATA_8_BITS = 3
+} uart_word_length_t;
+typedef enum
+{
+  UART_PARITY_DISABLE = 0
+} uart_parity_t;
+typedef enum
+{
+  UART_STOP_BITS_1 = 1
+} uart_stop_bits_t;
+typedef enum
+{
+  UART_HW_FLOWCTRL_DISABLE = 0
+} uart_hw_flowcontrol_t;
+typedef enum
+{
+  UART_SCLK_APB = 0
+} uart_sclk_t;
+
+typedef struct
+{
+  int baud_rate;
+  uart_word_length_t data_bits;
+  uart_parity_t parity;
+  uart_stop_bits_t stop_bits;
+  uart_hw_flowcontrol_t flow_ctrl;
+  uint8_t rx_flow_ctrl_thresh;
+  uart_sclk_t source_clk;
+} uart_config_t;
+
+esp_err_t uart_driver_install(uart_port_t port, int rxBufferSize, int txBufferSize, int queueSize,
+                              QueueHandle_t *queue, int flags);
+esp_err_t uart_param_config(uart_port_t port, const uart_config_t *config);
+esp_err_t uart_set_pin(uart_port_t port, int tx, int rx, int rts, int cts);
+esp_err_t uart_set_baudrate(uart_port_t port, uint32_t baud);
+esp_err_t uart_wait_tx_done(uart_port_t port, TickType_t ticks);
+esp_err_t uart_flush_input(uart_port_t port);
+int uart_write_bytes(uart_port_t port, const void *data, size_t length);
+int uart_read_bytes(uart_port_t port, void *buffer, uint32_t length, TickType_t ticks);
+
+#endif
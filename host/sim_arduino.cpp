@@ -0,0 +1,434 @@
+#include "sim_arduino.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "host_clock.h"
+#include "baud_negotiator.h"
+
+SimArduino::SimArduino(const SimArduinoConfig &config) : config(config), timing(config.timing)
+{
+  listener = nullptr;
+  currentBaud = config.baud;
+  previousBaud = config.baud;
+  confirmBy = 0;
+  freeUs = 0;
+  replyFreeUs = 0;
+  random = config.seed ? config.seed : 1;
+  for (int i = 0; i < SIM_JOINTS; i++)
+    angles[i] = ARM_TIMING_UNKNOWN_ANGLE;
+  inFrame = false;
+  recentCount = 0;
+  newestSeq = 0;
+  lost = 0;
+  garbled = 0;
+  duplicates = 0;
+  naks = 0;
+  motionUs = 0;
+}
+
+void SimArduino::setListener(SimArduinoListener *listener)
+{
+  this->listener = listener;
+}
+
+bool SimArduino::busy(uint64_t nowUs) const
+{
+  return nowUs < freeUs;
+}
+
+int SimArduino::angle(uint8_t joint) const
+{
+  return joint < SIM_JOINTS ? angles[joint] : ARM_TIMING_UNKNOWN_ANGLE;
+}
+
+uint32_t SimArduino::baud() const
+{
+  return currentBaud;
+}
+
+const std::vector<SimCommand> &SimArduino::commands() const
+{
+  return log;
+}
+
+void SimArduino::clearLog()
+{
+  log.clear();
+}
+
+bool SimArduino::lose()
+{
+  if (config.lossRate <= 0)
+    return false;
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+  return random < config.lossRate * 4294967296.0;
+}
+
+void SimArduino::receive(const uint8_t *data, size_t length, uint32_t baud)
+{
+  std::vector<uint8_t> bytes(data, data + length);
+  auto arrive = [this, bytes, baud] {
+    if (baud != currentBaud)
+    {
+      garbled += bytes.size();
+      return;
+    }
+    if (lose())
+    {
+      lost++;
+      return;
+    }
+    for (size_t i = 0; i < bytes.size(); i++)
+      feed(bytes[i]);
+  };
+
+  if (config.latencyUs > 0)
+    hostSchedule(hostNowUs() + config.latencyUs, arrive);
+  else
+    arrive();
+}
+
+void SimArduino::feed(uint8_t byte)
+{
+  if (!inFrame && byte == LINK_SOF)
+    inFrame = true;
+
+  if (inFrame)
+  {
+    LinkFrame frame;
+    LinkDecodeResult result = decoder.feed(byte, frame);
+    if (result == LINK_DECODE_FRAME)
+    {
+      inFrame = false;
+      handleFrame(frame);
+    }
+    else if (result == LINK_DECODE_ERROR)
+    {
+      inFrame = false;
+    }
+    return;
+  }
+
+  if (byte == '\n')
+  {
+    handleLine(line.c_str());
+    line.clear();
+  }
+  else if (byte != '\r' && line.size() < 64)
+  {
+    line += (char)byte;
+  }
+}
+
+static int parseInts(const char *text, int *values, int max)
+{
+  int count = 0;
+  while (*text && count < max)
+  {
+    char *end;
+    long value = strtol(text, &end, 10);
+    if (end == text)
+      return -1;
+    values[count++] = (int)value;
+    text = end;
+    if (*text == ',')
+      text++;
+    else if (*text)
+      return -1;
+  }
+  return *text ? -1 : count;
+}
+
+// The steppers a dense command turns
+static LinkStepperMove denseMove(const int cmds[LINK_STEPPER_MOTORS * 2])
+{
+  LinkStepperMove move;
+  move.count = 0;
+  for (int i = 0; i < LINK_STEPPER_MOTORS; i++)
+  {
+    if (cmds[i * 2] == 0)
+      continue;
+    move.motor[move.count] = i;
+    move.angle[move.count] = cmds[i * 2];
+    move.direction[move.count] = cmds[i * 2 + 1] ? 1 : 0;
+    move.count++;
+  }
+  return move;
+}
+
+void SimArduino::handleLine(const char *text)
+{
+  int values[3 * LINK_STEPPER_MOTORS];
+  int count = strlen(text) > 2 && text[1] == ',' ? parseInts(text + 2, values, 3 * LINK_STEPPER_MOTORS) : -1;
+
+  if (text[0] == 'A' && count == 3)
+  {
+    LinkPose pose = {1, LINK_POSE_SEQUENTIAL, {(uint8_t)values[0]}, {(int16_t)values[1]}, {(int8_t)values[2]}};
+    run(false, LINK_OP_SERVO, 0, text, timing.servoMs(values[0], values[1], values[2]), &pose, nullptr);
+  }
+  else if (text[0] == 'S' && count == 2 * LINK_STEPPER_MOTORS)
+  {
+    LinkStepperMove move = denseMove(values);
+    run(false, LINK_OP_STEPPER, 0, text, timing.stepperMs(values), nullptr, &move);
+  }
+  else if (text[0] == 'T' && count > 0 && count % 3 == 0)
+  {
+    LinkStepperMove move;
+    move.count = count / 3;
+    for (int i = 0; i < move.count; i++)
+    {
+      move.motor[i] = values[i * 3];
+      move.angle[i] = values[i * 3 + 1];
+      move.direction[i] = values[i * 3 + 2];
+    }
+    run(false, LINK_OP_STEPPER_SPARSE, 0, text, timing.stepperMs(move), nullptr, &move);
+  }
+  else
+  {
+    reply(hostNowUs(), (const uint8_t *)"ERROR\r\n", 7);
+  }
+}
+
+static std::string poseText(const LinkPose &pose)
+{
+  std::string text = "P," + std::to_string(pose.staggerMs);
+  for (int i = 0; i < pose.count; i++)
+    text += "," + std::to_string(pose.motor[i]) + "," + std::to_string(pose.angle[i]) + "," + std::to_string(pose.overShoot[i]);
+  return text;
+}
+
+static std::string denseText(const int cmds[LINK_STEPPER_MOTORS * 2])
+{
+  std::string text = "S";
+  for (int i = 0; i < LINK_STEPPER_MOTORS * 2; i++)
+    text += "," + std::to_string(cmds[i]);
+  return text;
+}
+
+static std::string sparseText(const LinkStepperMove &move)
+{
+  std::string text = "T";
+  for (int i = 0; i < move.count; i++)
+    text += "," + std::to_string(move.motor[i]) + "," + std::to_string(move.angle[i]) + "," + std::to_string(move.direction[i]);
+  return text;
+}
+
+void SimArduino::handleFrame(const LinkFrame &frame)
+{
+  uint64_t now = hostNowUs();
+  bool command = frame.op == LINK_OP_SERVO || frame.op == LINK_OP_STEPPER || frame.op == LINK_OP_POSE ||
+                 frame.op == LINK_OP_STEPPER_SPARSE;
+
+  if (command)
+  {
+    // A retransmission of a command that already ran (or is running): ack it again
+    for (int i = 0; i < recentCount; i++)
+    {
+      if (recent[i].seq != frame.seq)
+        continue;
+      duplicates++;
+      replyFrame(recent[i].doneUs > now ? recent[i].doneUs : now, frame.seq, LINK_OP_ACK, nullptr, 0);
+      return;
+    }
+  }
+
+  switch (frame.op)
+  {
+  case LINK_OP_SERVO:
+  {
+    uint8_t motor;
+    int16_t angle;
+    int8_t overShoot;
+    if (!linkDecodeServo(frame, motor, angle, overShoot))
+      break;
+    LinkPose pose = {1, LINK_POSE_SEQUENTIAL, {motor}, {angle}, {overShoot}};
+    char text[32];
+    snprintf(text, sizeof(text), "A,%d,%d,%d", motor, angle, overShoot);
+    run(true, frame.op, frame.seq, text, timing.servoMs(motor, angle, overShoot), &pose, nullptr);
+    return;
+  }
+  case LINK_OP_POSE:
+  {
+    LinkPose pose;
+    if (!linkDecodePose(frame, pose))
+      break;
+    std::string text = poseText(pose);
+    run(true, frame.op, frame.seq, text, timing.poseMs(pose), &pose, nullptr);
+    return;
+  }
+  case LINK_OP_STEPPER:
+  {
+    int cmds[LINK_STEPPER_MOTORS * 2];
+    if (!linkDecodeStepper(frame, cmds))
+      break;
+    LinkStepperMove move = denseMove(cmds);
+    run(true, frame.op, frame.seq, denseText(cmds), timing.stepperMs(cmds), nullptr, &move);
+    return;
+  }
+  case LINK_OP_STEPPER_SPARSE:
+  {
+    LinkStepperMove move;
+    if (!linkDecodeStepperMove(frame, move))
+      break;
+    run(true, frame.op, frame.seq, sparseText(move), timing.stepperMs(move), nullptr, &move);
+    return;
+  }
+  case LINK_OP_BAUD:
+  {
+    if (frame.len != 4)
+      break;
+    uint32_t rate = frame.payload[0] | frame.payload[1] << 8 | frame.payload[2] << 16 | (uint32_t)frame.payload[3] << 24;
+    bool supported = false;
+    for (size_t i = 0; i < config.rates.size(); i++)
+      supported = supported || config.rates[i] == rate;
+    if (!supported)
+    {
+      uint8_t code = LINK_NAK_BAD_PAYLOAD;
+      naks++;
+      replyFrame(now + config.timing.commandOverheadMs * 1000ULL, frame.seq, LINK_OP_NAK, &code, 1);
+      return;
+    }
+
+    // Acked at the old rate, switch once the ack is out, revert without an ECHO at the new rate
+    replyFrame(now + config.timing.commandOverheadMs * 1000ULL, frame.seq, LINK_OP_ACK, nullptr, 0);
+    hostSchedule(replyFreeUs, [this, rate] {
+      previousBaud = currentBaud;
+      currentBaud = rate;
+      decoder.reset();
+      inFrame = false;
+      uint64_t deadline = hostNowUs() + BAUD_CONFIRM_MS * 1000ULL;
+      confirmBy = deadline;
+      hostSchedule(deadline, [this, deadline] {
+        if (confirmBy != deadline)
+          return;
+        currentBaud = previousBaud;
+        confirmBy = 0;
+      });
+    });
+    return;
+  }
+  case LINK_OP_ECHO:
+    confirmBy = 0;
+    replyFrame(now + config.timing.commandOverheadMs * 1000ULL, frame.seq, LINK_OP_ECHO, frame.payload, frame.len);
+    return;
+  default:
+  {
+    uint8_t code = LINK_NAK_BAD_OPCODE;
+    naks++;
+    replyFrame(now, frame.seq, LINK_OP_NAK, &code, 1);
+    return;
+  }
+  }
+
+  uint8_t code = LINK_NAK_BAD_PAYLOAD;
+  naks++;
+  replyFrame(now, frame.seq, LINK_OP_NAK, &code, 1);
+}
+
+void SimArduino::run(bool binary, uint8_t op, uint8_t seq, const std::string &text, uint32_t motionMs,
+                     const LinkPose *pose, const LinkStepperMove *steppers)
+{
+  uint64_t now = hostNowUs();
+  SimCommand command;
+  command.receivedUs = now;
+  command.startUs = (freeUs > now ? freeUs : now) + config.timing.commandOverheadMs * 1000ULL;
+  command.doneUs = command.startUs + motionMs * 1000ULL;
+  command.binary = binary;
+  command.op = op;
+  command.text = text;
+  log.push_back(command);
+
+  freeUs = command.doneUs;
+  motionUs += motionMs * 1000ULL;
+
+  if (binary)
+  {
+    // Remember the last SIM_RECENT_COMMANDS sequence numbers, a late retransmission runs out of order
+    if (recentCount == 0 || (int8_t)(seq - newestSeq) > 0)
+      newestSeq = seq;
+    uint8_t kept = 0;
+    for (int i = 0; i < recentCount; i++)
+    {
+      if ((uint8_t)(newestSeq - recent[i].seq) < SIM_RECENT_COMMANDS)
+        recent[kept++] = recent[i];
+    }
+    recentCount = kept;
+    if (recentCount == SIM_RECENT_COMMANDS)
+    {
+      memmove(recent, recent + 1, sizeof(recent) - sizeof(recent[0]));
+      recentCount--;
+    }
+    recent[recentCount++] = {seq, command.doneUs};
+  }
+
+  LinkPose moved = pose ? *pose : LinkPose{0, 0, {}, {}, {}};
+  LinkStepperMove turned = steppers ? *steppers : LinkStepperMove{0, {}, {}, {}};
+  hostSchedule(command.doneUs, [this, binary, seq, moved, turned] {
+    for (int i = 0; i < moved.count; i++)
+    {
+      if (moved.motor[i] >= SIM_JOINTS)
+        continue;
+      angles[moved.motor[i]] = moved.angle[i];
+      if (listener)
+        listener->jointMoved(moved.motor[i], moved.angle[i], angles);
+    }
+    if (turned.count > 0 && listener)
+      listener->steppersTurned(turned);
+
+    if (binary)
+      replyFrame(hostNowUs(), seq, LINK_OP_ACK, nullptr, 0);
+    else
+      reply(hostNowUs(), (const uint8_t *)"OK\r\n", 4);
+  });
+}
+
+void SimArduino::reply(uint64_t atUs, const uint8_t *data, size_t length)
+{
+  if (lose())
+  {
+    lost++;
+    return;
+  }
+
+  replyFreeUs = (replyFreeUs > atUs ? replyFreeUs : atUs) + length * hostUartByteUs(currentBaud);
+  std::vector<uint8_t> bytes(data, data + length);
+  uint32_t baud = currentBaud;
+  hostSchedule(replyFreeUs + config.latencyUs, [bytes, baud] { hostUartDeliver(bytes.data(), bytes.size(), baud); });
+}
+
+void SimArduino::replyFrame(uint64_t atUs, uint8_t seq, uint8_t op, const uint8_t *payload, uint8_t length)
+{
+  uint8_t frame[LINK_MAX_FRAME];
+  size_t frameLength = linkEncodeFrame(frame, seq, op, payload, length);
+  reply(atUs, frame, frameLength);
+}
+
+std::string simCommandText(const std::vector<SimCommand> &commands)
+{
+  std::string text;
+  for (size_t i = 0; i < commands.size(); i++)
+    text += commands[i].text + "\n";
+  return text;
+}
+
+std::vector<std::string> simJointSteps(const std::vector<SimCommand> &commands)
+{
+  std::vector<std::string> steps;
+  for (size_t i = 0; i < commands.size(); i++)
+  {
+    const std::string &text = commands[i].text;
+    if (text[0] != 'P')
+    {
+      steps.push_back(text);
+      continue;
+    }
+
+    int values[3 + 3 * LINK_POSE_MAX_STEPS];
+    int count = parseInts(text.c_str() + 2, values, 1 + 3 * LINK_POSE_MAX_STEPS);
+    for (int k = 1; k + 2 < count; k += 3)
+      steps.push_back("A," + std::to_string(values[k]) + "," + std::to_string(values[k + 1]) + "," + std::to_string(values[k + 2]));
+  }
+  return steps;
+}
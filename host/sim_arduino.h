@@ -0,0 +1,126 @@
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "host_uart.h"
+#include "arm_timing.h"
+#include "link_protocol.h"
+#include "link_window.h"
+
+/**
+ * Simulated Arduino on the other end of the link.
+ *
+ * Speaks both firmware dialects: ASCII lines ("A,motor,angle,overshoot",
+ * dense "S,..." and sparse "T,..." stepper lines, each answered "OK") and
+ * binary frames (link_protocol.h, acked by sequence number, a repeated
+ * sequence number is acked without running the command again, BAUD and
+ * ECHO as baud_negotiator.h expects). Commands run one after the other and
+ * are answered once the motion is over; ArmTimingModel gives the servo
+ * travel from the angle change, the stepper time per 90 degrees and the
+ * parse overhead. Messages can be lost and delayed in either direction.
+ *
+ * Every command is logged in a canonical text form, so the streams of two
+ * builds (ASCII or binary, older or newer game code) can be compared.
+ */
+
+#define SIM_JOINTS ARM_TIMING_JOINTS
+#define SIM_RECENT_COMMANDS LINK_SEQ_SPAN // sequence numbers remembered to spot retransmissions
+
+struct SimArduinoConfig
+{
+  ArmTimingParams timing = ARM_TIMING_DEFAULTS;
+  uint32_t baud = 9600;
+  // Rates the firmware accepts in a BAUD request
+  std::vector<uint32_t> rates = {9600, 115200, 250000, 500000};
+  double lossRate = 0;      // chance that a command or a reply is lost
+  uint32_t latencyUs = 0;   // added to every message, each way
+  uint32_t seed = 1;
+};
+
+// One command as it ran on the Arduino
+struct SimCommand
+{
+  uint64_t receivedUs;
+  uint64_t startUs;
+  uint64_t doneUs;
+  bool binary;
+  uint8_t op;       // LinkOpcode, LINK_OP_SERVO for an "A" line, LINK_OP_STEPPER(_SPARSE) for "S" ("T")
+  std::string text; // canonical form: "A,1,90,10", "P,65535,1,90,10,0,45,0", "S,90,0,...", "T,2,90,1"
+};
+
+class SimArduinoListener
+{
+public:
+  virtual ~SimArduinoListener() {}
+  // A joint reached `angle`, `angles` holds every joint after the move
+  virtual void jointMoved(uint8_t joint, int angle, const int angles[SIM_JOINTS]) {}
+  virtual void steppersTurned(const LinkStepperMove &move) {}
+};
+
+class SimArduino : public HostUartPeer
+{
+public:
+  explicit SimArduino(const SimArduinoConfig &config = SimArduinoConfig());
+
+  void setListener(SimArduinoListener *listener);
+  void receive(const uint8_t *data, size_t length, uint32_t baud) override;
+
+  // A command is running or waiting to run
+  bool busy(uint64_t nowUs) const;
+  int angle(uint8_t joint) const;
+  uint32_t baud() const;
+
+  const std::vector<SimCommand> &commands() const;
+  void clearLog();
+
+  uint32_t lost;       // messages dropped by the loss model
+  uint32_t garbled;    // bytes received at the wrong baud rate
+  uint32_t duplicates; // binary commands acked again without running
+  uint32_t naks;
+  uint64_t motionUs;   // total time spent moving
+
+private:
+  void feed(uint8_t byte);
+  void handleLine(const char *line);
+  void handleFrame(const LinkFrame &frame);
+  void run(bool binary, uint8_t op, uint8_t seq, const std::string &text, uint32_t motionMs,
+           const LinkPose *pose, const LinkStepperMove *steppers);
+  void reply(uint64_t atUs, const uint8_t *data, size_t length);
+  void replyFrame(uint64_t atUs, uint8_t seq, uint8_t op, const uint8_t *payload, uint8_t length);
+  bool lose();
+
+  SimArduinoConfig config;
+  SimArduinoListener *listener;
+  ArmTimingModel timing;
+  uint32_t currentBaud;
+  uint32_t previousBaud;
+  uint64_t confirmBy; // a new rate reverts unless an ECHO arrives by then, 0 = confirmed
+  uint64_t freeUs;      // the current command finishes
+  uint64_t replyFreeUs; // the last reply is out
+  uint32_t random;
+  int angles[SIM_JOINTS];
+
+  LinkDecoder decoder;
+  bool inFrame;
+  std::string line;
+
+  struct Done
+  {
+    uint8_t seq;
+    uint64_t doneUs;
+  };
+  Done recent[SIM_RECENT_COMMANDS];
+  uint8_t recentCount;
+  uint8_t newestSeq;
+
+  std::vector<SimCommand> log;
+};
+
+// Join the commands of a log, one per line
+std::string simCommandText(const std::vector<SimCommand> &commands);
+// Joint moves of a log, poses split into "A" steps, so an ASCII and a binary stream compare equal
+std::vector<std::string> simJointSteps(const std::vector<SimCommand> &commands);
+
+#endif
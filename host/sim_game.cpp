@@ -0,0 +1,166 @@
+#include "sim_game.h"
+#include <string.h>
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "game_utils.h"
+#include "xo_x_game.h"
+#include "xo_o_game.h"
+#include "memory_game.h"
+#include "threeCups_game.h"
+#include "rubik_game.h"
+
+static const char *const xoStates[] = {"GAME_INIT", "ROBOT_INIT", "ROBOT_THINKING", "ROBOT_GRABBING",
+                                       "ROBOT_PLACING", "ROBOT_RETREATING", "WAITING_FOR_PLAYER",
+                                       "CAPTURING_BOARD", "ROBOT_FINAL_RETREAT", "GAME_OVER"};
+static const char *const memoryStates[] = {"GAME_IDLE", "GAME_INIT", "GAME_FIND_MATCH", "GAME_PICK_RANDOM1",
+                                           "GAME_REVEAL1", "GAME_PICK_RANDOM2", "GAME_REVEAL2",
+                                           "GAME_MATCH_FOUND", "GAME_MOVE_MATCHED_CARD1",
+                                           "GAME_MOVE_MATCHED_CARD2", "GAME_RETURN_UNMATCHED", "GAME_COMPLETED"};
+static const char *const cupsStates[] = {"GAME_INIT", "WAITING_FOR_DETECTION", "PROCESSING_MULTIPLE_CUPS",
+                                         "GAME_OVER", "PICK_CUP", "ROBOT_RETREATING", "DROP_CUP"};
+static const char *const rubikStates[] = {"RUBIK_TURN_IN", "RUBIK_SETTLE", "RUBIK_CAPTURE", "RUBIK_TURN_ON",
+                                          "RUBIK_WAIT_UPLOADS", "RUBIK_SOLVE", "RUBIK_SOLUTION", "RUBIK_DONE"};
+
+#define STATES(names) names, sizeof(names) / sizeof(names[0])
+
+const SimGame simGames[] = {
+    {"xo", startXOGame, xoGameLoop, stopXOGame, "xo", 9, STATES(xoStates)},
+    {"xo_o", startXOOGame, xoOGameLoop, stopXOOGame, "xoO", 9, STATES(xoStates)},
+    {"memory", startMemoryGame, memoryGameLoop, stopMemoryGame, "memory", 11, STATES(memoryStates)},
+    {"cups", startCupsGame, cupsGameLoop, stopCupsGame, "cups", 3, STATES(cupsStates)},
+    {"rubik", startRubikGame, rubikGameLoop, stopRubikGame, "rubik", 7, STATES(rubikStates)},
+};
+const uint8_t simGameCount = sizeof(simGames) / sizeof(simGames[0]);
+
+const SimGame *simFindGame(const char *name)
+{
+  for (int i = 0; i < simGameCount; i++)
+  {
+    if (strcmp(simGames[i].name, name) == 0)
+      return &simGames[i];
+  }
+  return nullptr;
+}
+
+SimWorld *simMakeWorld(const char *game, uint32_t seed)
+{
+  if (strcmp(game, "xo") == 0)
+    return new SimXoWorld(seed, true);
+  if (strcmp(game, "xo_o") == 0)
+    return new SimXoWorld(seed, false);
+  if (strcmp(game, "memory") == 0)
+    return new SimMemoryWorld(seed);
+  if (strcmp(game, "cups") == 0)
+    return new SimCupsWorld(seed);
+  if (strcmp(game, "rubik") == 0)
+    return new SimRubikWorld(seed);
+  return nullptr;
+}
+
+SimArduino &simLink(const SimArduinoConfig &config)
+{
+  static SimArduino *arduino = nullptr;
+  if (!arduino)
+  {
+    arduino = new SimArduino(config);
+    hostUartAttach(arduino);
+    initArduinoLink();
+  }
+  return *arduino;
+}
+
+static StateProfiler *findProfiler(const char *name)
+{
+  for (StateProfiler *profiler = StateProfiler::first; profiler; profiler = profiler->next)
+  {
+    if (strcmp(profiler->name, name) == 0)
+      return profiler;
+  }
+  return nullptr;
+}
+
+uint64_t simBusyUs(const std::vector<SimCommand> &commands, uint64_t fromUs, uint64_t toUs)
+{
+  uint64_t busy = 0;
+  // Commands run one after the other, so the ones that matter are at the end
+  for (size_t i = commands.size(); i-- > 0;)
+  {
+    const SimCommand &command = commands[i];
+    if (command.doneUs <= fromUs)
+      break;
+    uint64_t start = command.startUs > fromUs ? command.startUs : fromUs;
+    uint64_t end = command.doneUs < toUs ? command.doneUs : toUs;
+    if (end > start)
+      busy += end - start;
+  }
+  return busy;
+}
+
+bool simPlayGame(const SimGame &game, SimWorld &world, const SimOptions &options, SimGameResult &result)
+{
+  SimArduino &arduino = simLink();
+  StateProfiler *profiler = findProfiler(game.profiler);
+
+  result = SimGameResult();
+  size_t firstCommand = arduino.commands().size();
+  HostUartStats uart = hostUartStats();
+  SimSketchStats sketch = simSketchStats();
+  ArduinoLinkStatus link;
+  getArduinoLinkStatus(link);
+
+  arduino.setListener(&world);
+  simSketchBegin(&world, options.vision);
+
+  // As performGameSwitch() does
+  invalidateArmState();
+  cancelAllPythonData();
+  uint64_t startUs = hostNowUs();
+  game.start();
+  world.start();
+
+  uint64_t limitUs = startUs + (uint64_t)options.limitMs * 1000;
+  while (hostNowUs() < limitUs)
+  {
+    uint8_t state = profiler ? profiler->state() : STATE_PROFILER_NONE;
+    uint64_t from = hostNowUs();
+    game.loop();
+    if (profiler && profiler->state() == game.doneState)
+    {
+      result.finished = true;
+      break;
+    }
+    hostAdvanceUs(1000);
+
+    // The whole iteration counts for the state the loop was in when it started
+    if (state == STATE_PROFILER_NONE)
+      state = profiler ? profiler->state() : STATE_PROFILER_NONE;
+    if (state < STATE_PROFILER_MAX_STATES)
+    {
+      uint64_t to = hostNowUs();
+      uint64_t busy = simBusyUs(arduino.commands(), from, to);
+      result.states[state].us += to - from;
+      result.states[state].idleUs += to - from - busy;
+    }
+  }
+
+  result.durationUs = hostNowUs() - startUs;
+  result.commands.assign(arduino.commands().begin() + firstCommand, arduino.commands().end());
+  result.idleUs = result.durationUs - simBusyUs(result.commands, startUs, hostNowUs());
+  result.uartWrites = hostUartStats().writes - uart.writes;
+  result.bytesOut = hostUartStats().bytesOut - uart.bytesOut;
+  result.bytesIn = hostUartStats().bytesIn - uart.bytesIn;
+  result.captures = simSketchStats().captures - sketch.captures;
+  result.uploads = simSketchStats().uploads - sketch.uploads;
+  result.armGaveUp = simSketchStats().armGaveUp - sketch.armGaveUp;
+  ArduinoLinkStatus linkAfter;
+  getArduinoLinkStatus(linkAfter);
+  result.elidedSteps = linkAfter.elidedSteps - link.elidedSteps;
+  result.elidedCommands = linkAfter.elidedCommands - link.elidedCommands;
+
+  game.stop();
+  // Let the arm finish what it was doing before the next game
+  hostAdvanceUntil([&arduino] { return !arduino.busy(hostNowUs()); }, hostNowUs() + 60000000ULL);
+  hostAdvanceUs(100000);
+  arduino.setListener(nullptr);
+  return result.finished;
+}
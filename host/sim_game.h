@@ -0,0 +1,76 @@
+#ifndef SIM_GAME_H
+#define SIM_GAME_H
+
+#include <stdint.h>
+#include <vector>
+#include "sim_arduino.h"
+#include "sim_sketch.h"
+#include "sim_world.h"
+#include "state_profiler.h"
+
+/**
+ * Plays a whole game on the host against a simulated Arduino and world.
+ *
+ * The game loop runs the way loop() runs it on the device, with the
+ * virtual clock moving one millisecond between iterations and whatever the
+ * game blocks on in between, so a game of several minutes takes well under
+ * a second. The result holds the game time, the commands the Arduino ran
+ * and, per state of the game, the time spent there and how much of it the
+ * arm stood still.
+ */
+
+struct SimGame
+{
+  const char *name;
+  void (*start)();
+  void (*loop)();
+  void (*stop)();
+  const char *profiler; // StateProfiler of the game loop
+  uint8_t doneState;    // the game is over once the loop sits in this state
+  const char *const *states;
+  uint8_t stateCount;
+};
+
+extern const SimGame simGames[];
+extern const uint8_t simGameCount;
+
+const SimGame *simFindGame(const char *name);
+SimWorld *simMakeWorld(const char *game, uint32_t seed);
+
+struct SimOptions
+{
+  SimVisionConfig vision;
+  uint32_t limitMs = 600000; // give up on a game after this much game time
+};
+
+struct SimStateTime
+{
+  uint64_t us;
+  uint64_t idleUs; // the arm was not moving
+};
+
+struct SimGameResult
+{
+  bool finished;
+  uint64_t durationUs;
+  uint64_t idleUs;
+  std::vector<SimCommand> commands;
+  uint32_t uartWrites;
+  uint32_t bytesOut;
+  uint32_t bytesIn;
+  uint32_t captures;
+  uint32_t uploads;
+  uint32_t armGaveUp;
+  uint32_t elidedSteps;    // dropped by the arm state cache, each one an ASCII line
+  uint32_t elidedCommands; // whole commands the cache answered without the wire
+  SimStateTime states[STATE_PROFILER_MAX_STATES];
+};
+
+// The simulated Arduino, the link to it is brought up on the first call (later configs are ignored)
+SimArduino &simLink(const SimArduinoConfig &config = SimArduinoConfig());
+// Start `game`, run its loop until it is over or out of time, then stop it
+bool simPlayGame(const SimGame &game, SimWorld &world, const SimOptions &options, SimGameResult &result);
+// Time the arm spent moving between two instants
+uint64_t simBusyUs(const std::vector<SimCommand> &commands, uint64_t fromUs, uint64_t toUs);
+
+#endif
@@ -0,0 +1,200 @@
+#include "sim_sketch.h"
+#include <Arduino.h>
+#include "game_utils.h"
+
+static SimWorld *world = nullptr;
+static SimVisionConfig visionConfig;
+static SimSketchStats stats = {};
+static std::string lastLcd;
+static std::string config = "none";
+static VisionQueue visionQueue;
+static TaskHandle_t visionTaskHandle = nullptr;
+static uint32_t failState = 1;
+
+// Camera and vision server in front of the simulated world
+class SimTransport : public VisionTransport
+{
+public:
+  bool capture(uint32_t &frameMs) override
+  {
+    delay(visionConfig.captureMs);
+    if (!world)
+      return false;
+    world->capture();
+    frameMs = millis();
+    stats.captures++;
+    return true;
+  }
+
+  void release() override {}
+
+  bool upload(const char *action, VisionReply &reply) override
+  {
+    delay(visionConfig.uploadMs);
+    stats.uploads++;
+
+    VisionReply answer;
+    if (!world || failUpload() || !world->answer(action, answer))
+    {
+      stats.uploadFailures++;
+      return false;
+    }
+
+    // Through the wire format, as the server would send it
+    uint8_t body[VISION_REPLY_BODY_MAX];
+    int length = visionReplyEncode(answer, body, sizeof(body));
+    return length > 0 && visionReplyParse(body, length, visionActionId(action), reply);
+  }
+
+  bool changed() override
+  {
+    return !world || world->frameVersion() != acceptedVersion;
+  }
+
+  // A new world starts at version 1 again
+  void forget()
+  {
+    acceptedVersion = 0;
+  }
+
+  void gateDone(bool uploaded) override
+  {
+    acceptedVersion = uploaded && world ? world->frameVersion() : 0;
+    if (!uploaded)
+      stats.unchanged++;
+  }
+
+private:
+  bool failUpload()
+  {
+    if (visionConfig.failRate <= 0)
+      return false;
+    failState ^= failState << 13;
+    failState ^= failState >> 17;
+    failState ^= failState << 5;
+    return failState < visionConfig.failRate * 4294967296.0;
+  }
+
+  uint32_t acceptedVersion = 0;
+};
+
+static SimTransport transport;
+
+static uint32_t visionClock()
+{
+  return millis();
+}
+
+static void visionTask(void *)
+{
+  for (;;)
+  {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    while (visionServe(visionQueue, transport, visionClock))
+    {
+    }
+  }
+}
+
+void simSketchBegin(SimWorld *simWorld, const SimVisionConfig &vision)
+{
+  world = simWorld;
+  visionConfig = vision;
+  failState = vision.seed ? vision.seed : 1;
+  transport.forget();
+  if (!visionTaskHandle)
+    xTaskCreate(visionTask, "vision", 8192, nullptr, 1, &visionTaskHandle);
+}
+
+const SimSketchStats &simSketchStats()
+{
+  return stats;
+}
+
+const std::string &simLastLcd()
+{
+  return lastLcd;
+}
+
+const std::string &simConfig()
+{
+  return config;
+}
+
+VisionQueue &simVisionQueue()
+{
+  return visionQueue;
+}
+
+void changeConfig(String command)
+{
+  config = command.c_str();
+}
+
+void printOnLCD(const String &msg)
+{
+  lastLcd = msg.c_str();
+  stats.lcdWrites++;
+  if (lastLcd == "Arm not responding")
+    stats.armGaveUp++;
+}
+
+void calibrateArmTable(const char *name, int (*table)[ARM_IK_JOINTS], uint8_t rows, uint8_t cols)
+{
+  if (world)
+    world->armTable(name, table, rows * cols);
+}
+
+VisionFuture startPythonData(const char *command, uint32_t timeoutMs, uint32_t freshAfterMs, uint8_t flags)
+{
+  VisionFuture future = visionQueue.submit(command, millis(), timeoutMs, freshAfterMs, flags);
+  if (future == VISION_FUTURE_INVALID)
+    Serial.println("Vision queue full");
+  else
+    xTaskNotifyGive(visionTaskHandle);
+  return future;
+}
+
+bool pythonDataCaptured(VisionFuture future)
+{
+  return visionQueue.status(future, millis()) != VISION_PENDING;
+}
+
+bool pollVisionReply(VisionFuture future, VisionStatus &status, VisionReply &reply)
+{
+  status = visionQueue.collect(future, millis(), reply);
+  if (status == VISION_PENDING || status == VISION_CAPTURED)
+    return false;
+
+  if (status == VISION_EXPIRED)
+    Serial.println("Vision request expired");
+  return true;
+}
+
+void cancelPythonData(VisionFuture future)
+{
+  visionQueue.cancel(future);
+}
+
+void cancelAllPythonData()
+{
+  visionQueue.cancelAll();
+}
+
+String getPythonData(String command)
+{
+  VisionFuture future = startPythonData(command.c_str(), VISION_DEFAULT_TIMEOUT_MS, millis());
+  if (future == VISION_FUTURE_INVALID)
+    return "ERROR";
+
+  VisionStatus status;
+  VisionReply reply;
+  while (!pollVisionReply(future, status, reply))
+    delay(1);
+  if (status != VISION_DONE)
+    return "ERROR";
+
+  char csv[VISION_REPLY_BODY_MAX];
+  visionReplyFormatCsv(reply, csv, sizeof(csv));
+  return csv;
+}
@@ -0,0 +1,43 @@
+#ifndef SIM_SKETCH_H
+#define SIM_SKETCH_H
+
+#include <stdint.h>
+#include <string>
+#include "sim_world.h"
+#include "vision_queue.h"
+
+/**
+ * Host side of esp32.ino: the functions the games call into the sketch
+ * (changeConfig, printOnLCD, calibrateArmTable and the vision requests).
+ *
+ * Vision requests go through the real VisionQueue and visionServe() on a
+ * worker task, like on the device, with a camera and server that answer
+ * from the SimWorld after a modelled capture and upload time.
+ */
+
+struct SimVisionConfig
+{
+  uint32_t captureMs = 100; // frame taken after
+  uint32_t uploadMs = 300;  // request sent and answered after
+  double failRate = 0;      // uploads the server fails
+  uint32_t seed = 1;
+};
+
+struct SimSketchStats
+{
+  uint32_t captures;
+  uint32_t uploads;
+  uint32_t uploadFailures;
+  uint32_t unchanged; // gated requests answered without an upload
+  uint32_t lcdWrites;
+  uint32_t armGaveUp; // "Arm not responding" on the LCD
+};
+
+// Starts the vision worker on the first call, then points the camera at `world`
+void simSketchBegin(SimWorld *world, const SimVisionConfig &vision = SimVisionConfig());
+const SimSketchStats &simSketchStats();
+const std::string &simLastLcd();
+const std::string &simConfig();
+VisionQueue &simVisionQueue();
+
+#endif
@@ -0,0 +1,348 @@
+#include "sim_world.h"
+#include <stdlib.h>
+#include <string.h>
+#include "host_clock.h"
+
+#define XO_EMPTY 0
+#define XO_X 1
+#define XO_O 2
+
+SimWorld::SimWorld(uint32_t seed)
+{
+  randomState = seed ? seed : 1;
+  sceneVersion = 1;
+  capturedVersion = 0;
+}
+
+uint32_t SimWorld::draw(uint32_t bound)
+{
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return bound ? randomState % bound : 0;
+}
+
+SimXoWorld::SimXoWorld(uint32_t seed, bool robotIsX) : SimWorld(seed)
+{
+  this->robotIsX = robotIsX;
+  memset(board, 0, sizeof(board));
+  memset(frame, 0, sizeof(frame));
+  holding = false;
+  playerThinking = false;
+  lastGrip = -1;
+  boardTable = nullptr;
+  stackTable = nullptr;
+  stackCount = 0;
+  misplaced = 0;
+}
+
+void SimXoWorld::start()
+{
+  // The player is X in the other game and goes first
+  if (!robotIsX)
+    playerMove();
+}
+
+void SimXoWorld::capture()
+{
+  memcpy(frame, board, sizeof(frame));
+  captured();
+}
+
+bool SimXoWorld::answer(const char *action, VisionReply &reply)
+{
+  if (strcmp(action, "xo") != 0)
+    return false;
+
+  // Rows of (stack, three cells, stack), the stacks are not read by the games
+  visionReplyClear(reply);
+  reply.action = VISION_ACTION_XO;
+  for (int row = 0; row < 3; row++)
+  {
+    reply.values[reply.count++] = 0;
+    for (int col = 0; col < 3; col++)
+      reply.values[reply.count++] = frame[row][col];
+    reply.values[reply.count++] = 0;
+  }
+  return true;
+}
+
+void SimXoWorld::armTable(const char *name, int (*table)[ARM_IK_JOINTS], uint8_t count)
+{
+  if (strcmp(name, "xo board") == 0 && count == 9)
+    boardTable = table;
+  else if (strcmp(name, "xo stack") == 0)
+  {
+    stackTable = table;
+    stackCount = count;
+  }
+}
+
+int SimXoWorld::findCell(int (*table)[ARM_IK_JOINTS], uint8_t count, const int angles[SIM_JOINTS]) const
+{
+  if (!table)
+    return -1;
+  for (int i = 0; i < count; i++)
+  {
+    bool match = true;
+    for (int j = 0; j < ARM_IK_JOINTS && match; j++)
+      match = abs(angles[j] - table[i][j]) <= SIM_POSE_TOLERANCE;
+    if (match)
+      return i;
+  }
+  return -1;
+}
+
+void SimXoWorld::jointMoved(uint8_t joint, int angle, const int angles[SIM_JOINTS])
+{
+  if (joint != SIM_JOINTS - 1)
+    return;
+
+  int previous = lastGrip;
+  lastGrip = angle;
+  if (previous < 0 || angle == previous)
+    return;
+
+  if (angle < previous)
+  {
+    // Closing over the stack picks up a piece
+    holding = findCell(stackTable, stackCount, angles) >= 0;
+    return;
+  }
+  if (!holding)
+    return;
+
+  holding = false;
+  int cell = findCell(boardTable, 9, angles);
+  if (cell < 0 || board[cell / 3][cell % 3] != XO_EMPTY)
+  {
+    misplaced++;
+    return;
+  }
+
+  board[cell / 3][cell % 3] = robotIsX ? XO_X : XO_O;
+  changed();
+  playerMove();
+}
+
+int SimXoWorld::winner() const
+{
+  static const int lines[8][3] = {{0, 1, 2}, {3, 4, 5}, {6, 7, 8}, {0, 3, 6}, {1, 4, 7}, {2, 5, 8}, {0, 4, 8}, {2, 4, 6}};
+  for (int i = 0; i < 8; i++)
+  {
+    int a = board[lines[i][0] / 3][lines[i][0] % 3];
+    if (a != XO_EMPTY && a == board[lines[i][1] / 3][lines[i][1] % 3] && a == board[lines[i][2] / 3][lines[i][2] % 3])
+      return a;
+  }
+  return XO_EMPTY;
+}
+
+bool SimXoWorld::finished() const
+{
+  if (winner() != XO_EMPTY)
+    return true;
+  for (int i = 0; i < 9; i++)
+  {
+    if (board[i / 3][i % 3] == XO_EMPTY)
+      return false;
+  }
+  return true;
+}
+
+void SimXoWorld::playerMove()
+{
+  if (finished() || playerThinking)
+    return;
+
+  playerThinking = true;
+  uint32_t thinkMs = SIM_XO_THINK_MIN_MS + draw(SIM_XO_THINK_MAX_MS - SIM_XO_THINK_MIN_MS + 1);
+  hostSchedule(hostNowUs() + thinkMs * 1000ULL, [this] {
+    playerThinking = false;
+    int player = robotIsX ? XO_O : XO_X;
+    int robot = robotIsX ? XO_X : XO_O;
+    int choice = -1;
+
+    // Win, then block, then anything
+    int order[2] = {player, robot};
+    for (int k = 0; k < 2 && choice < 0; k++)
+    {
+      for (int i = 0; i < 9 && choice < 0; i++)
+      {
+        if (board[i / 3][i % 3] != XO_EMPTY)
+          continue;
+        board[i / 3][i % 3] = order[k];
+        if (winner() == order[k])
+          choice = i;
+        board[i / 3][i % 3] = XO_EMPTY;
+      }
+    }
+    if (choice < 0)
+    {
+      int empty[9];
+      int count = 0;
+      for (int i = 0; i < 9; i++)
+      {
+        if (board[i / 3][i % 3] == XO_EMPTY)
+          empty[count++] = i;
+      }
+      if (count == 0)
+        return;
+      choice = empty[draw(count)];
+    }
+
+    board[choice / 3][choice % 3] = player;
+    changed();
+  });
+}
+
+SimMemoryWorld::SimMemoryWorld(uint32_t seed) : SimWorld(seed)
+{
+  static const int pairs[6] = {0, 0, 1, 1, 2, 2};
+  memcpy(layout, pairs, sizeof(layout));
+  for (int i = 5; i > 0; i--)
+  {
+    int j = draw(i + 1);
+    int swap = layout[i];
+    layout[i] = layout[j];
+    layout[j] = swap;
+  }
+}
+
+SimMemoryWorld::SimMemoryWorld(uint32_t seed, const int cards[6]) : SimWorld(seed)
+{
+  memcpy(layout, cards, sizeof(layout));
+}
+
+void SimMemoryWorld::capture()
+{
+  captured();
+}
+
+bool SimMemoryWorld::answer(const char *action, VisionReply &reply)
+{
+  if (strcmp(action, "memory") != 0)
+    return false;
+
+  // The shape of every cell, the game only reads the card it just turned
+  visionReplyClear(reply);
+  reply.action = VISION_ACTION_MEMORY;
+  for (int i = 0; i < 6; i++)
+    reply.values[reply.count++] = layout[i];
+  return true;
+}
+
+SimCupsWorld::SimCupsWorld(uint32_t seed) : SimWorld(seed)
+{
+  bool any = false;
+  for (int i = 0; i < 3; i++)
+  {
+    balls[i] = draw(2) ? 1 + draw(3) : 0;
+    any = any || balls[i];
+  }
+  if (!any)
+    balls[draw(3)] = 1 + draw(3);
+}
+
+void SimCupsWorld::capture()
+{
+  captured();
+}
+
+bool SimCupsWorld::answer(const char *action, VisionReply &reply)
+{
+  if (strcmp(action, "cupsResult") != 0)
+    return false;
+
+  visionReplyClear(reply);
+  reply.action = VISION_ACTION_CUPS;
+  for (int i = 0; i < 3; i++)
+    reply.values[reply.count++] = balls[i];
+  return true;
+}
+
+SimRubikWorld::SimRubikWorld(uint32_t seed, uint8_t moves) : SimWorld(seed)
+{
+  this->moves = moves < VISION_REPLY_MAX_VALUES ? moves : VISION_REPLY_MAX_VALUES;
+  faces = 0;
+  turns = 0;
+  // Face 1-5 and a quarter, half or counter quarter turn, never the same face twice in a row
+  int last = 0;
+  for (int i = 0; i < this->moves; i++)
+  {
+    int face;
+    do
+    {
+      face = 1 + draw(5);
+    } while (face == last);
+    last = face;
+    solution[i] = face * 10 + 1 + draw(3);
+  }
+}
+
+void SimRubikWorld::capture()
+{
+  frame = cube;
+  captured();
+}
+
+void SimRubikWorld::face(int index)
+{
+  faces++;
+  if (index >= 0 && index < SIM_RUBIK_FACES)
+    seen[index] = frame;
+}
+
+void SimRubikWorld::addSolution(VisionReply &reply) const
+{
+  for (int i = 0; i < moves; i++)
+    reply.values[reply.count++] = solution[i];
+}
+
+bool SimRubikWorld::answer(const char *action, VisionReply &reply)
+{
+  visionReplyClear(reply);
+  if (strcmp(action, "rubikReset") == 0)
+  {
+    reply.action = VISION_ACTION_RUBIK_RESET;
+    return true;
+  }
+  if (strncmp(action, "rubikFace&face=", 15) == 0)
+  {
+    face(atoi(action + 15));
+    reply.action = VISION_ACTION_RUBIK_FACE;
+    return true;
+  }
+  if (strcmp(action, "rubik") == 0)
+  {
+    face(faces);
+    if (faces == SIM_RUBIK_FACES)
+      addSolution(reply);
+    return true;
+  }
+  if (strcmp(action, "rubikSolve") == 0)
+  {
+    reply.action = VISION_ACTION_RUBIK_SOLVE;
+    addSolution(reply);
+    return true;
+  }
+  return false;
+}
+
+void SimRubikWorld::steppersTurned(const LinkStepperMove &move)
+{
+  turns++;
+  SimCubeTurn turn = {};
+  for (int i = 0; i < move.count; i++)
+  {
+    uint8_t quarters = move.angle[i] / 90 % 4;
+    turn[move.motor[i]] = move.direction[i] ? (4 - quarters) % 4 : quarters;
+  }
+
+  SimCubeTurn inverse;
+  for (int i = 0; i < LINK_STEPPER_MOTORS; i++)
+    inverse[i] = (4 - turn[i]) % 4;
+  if (!cube.empty() && cube.back() == inverse)
+    cube.pop_back();
+  else
+    cube.push_back(turn);
+}
@@ -0,0 +1,160 @@
+#ifndef SIM_WORLD_H
+#define SIM_WORLD_H
+
+#include <stdint.h>
+#include <array>
+#include <vector>
+#include "sim_arduino.h"
+#include "vision_reply.h"
+#include "arm_ik.h"
+
+/**
+ * What the camera sees while a game plays on the host.
+ *
+ * A world answers the vision server actions of its game from the last frame
+ * the camera took, and follows the arm through the simulated Arduino, e.g.
+ * the XO world puts a piece on the board where the grip opens over a cell.
+ * The cell tables reach it through calibrateArmTable(), the way the sketch
+ * hands them to the IK check, so the world and the game share one copy.
+ * Everything random is drawn from the seed, a run is reproducible.
+ */
+
+class SimWorld : public SimArduinoListener
+{
+public:
+  explicit SimWorld(uint32_t seed);
+  virtual ~SimWorld() {}
+
+  virtual const char *name() const = 0;
+  // The game just started
+  virtual void start() {}
+  // The camera takes a frame, answer() reads from it
+  virtual void capture() = 0;
+  virtual bool answer(const char *action, VisionReply &reply) = 0;
+  // A cell table of the game, `count` rows of ARM_IK_JOINTS angles
+  virtual void armTable(const char *name, int (*table)[ARM_IK_JOINTS], uint8_t count) {}
+  // The game reached its end as far as the world can tell
+  virtual bool finished() const { return false; }
+
+  // Changes whenever the scene does, for the gated reads
+  uint32_t version() const { return sceneVersion; }
+  uint32_t frameVersion() const { return capturedVersion; }
+
+protected:
+  uint32_t draw(uint32_t bound);
+  void changed() { sceneVersion++; }
+  void captured() { capturedVersion = sceneVersion; }
+
+private:
+  uint32_t randomState;
+  uint32_t sceneVersion;
+  uint32_t capturedVersion;
+};
+
+#define SIM_XO_THINK_MIN_MS 1500
+#define SIM_XO_THINK_MAX_MS 3500
+#define SIM_POSE_TOLERANCE 2 // degrees between the arm and a table cell
+
+// XO board with a player who answers every robot move after some thought:
+// win if possible, block, otherwise a random empty cell
+class SimXoWorld : public SimWorld
+{
+public:
+  SimXoWorld(uint32_t seed, bool robotIsX);
+
+  const char *name() const override { return robotIsX ? "xo" : "xo_o"; }
+  void start() override;
+  void capture() override;
+  bool answer(const char *action, VisionReply &reply) override;
+  void armTable(const char *name, int (*table)[ARM_IK_JOINTS], uint8_t count) override;
+  void jointMoved(uint8_t joint, int angle, const int angles[SIM_JOINTS]) override;
+  bool finished() const override;
+
+  int cell(int row, int col) const { return board[row][col]; }
+  uint32_t misplaced; // pieces the grip let go of away from a board cell
+
+private:
+  int findCell(int (*table)[ARM_IK_JOINTS], uint8_t count, const int angles[SIM_JOINTS]) const;
+  void playerMove();
+  int winner() const;
+
+  bool robotIsX;
+  int board[3][3];
+  int frame[3][3];
+  bool holding;
+  bool playerThinking;
+  int lastGrip;
+  int (*boardTable)[ARM_IK_JOINTS];
+  int (*stackTable)[ARM_IK_JOINTS];
+  uint8_t stackCount;
+};
+
+// Memory cards: three pairs of shapes in a random layout
+class SimMemoryWorld : public SimWorld
+{
+public:
+  explicit SimMemoryWorld(uint32_t seed);
+  // A given layout, the shape of each cell 0..5
+  SimMemoryWorld(uint32_t seed, const int cards[6]);
+
+  const char *name() const override { return "memory"; }
+  void capture() override;
+  bool answer(const char *action, VisionReply &reply) override;
+
+  int shape(int cell) const { return layout[cell]; }
+
+private:
+  int layout[6];
+};
+
+// Three cups, a random set of them hides a coloured ball
+class SimCupsWorld : public SimWorld
+{
+public:
+  explicit SimCupsWorld(uint32_t seed);
+
+  const char *name() const override { return "cups"; }
+  void capture() override;
+  bool answer(const char *action, VisionReply &reply) override;
+
+  int ball(int cup) const { return balls[cup]; }
+
+private:
+  int balls[3]; // colour index, 0 = no ball
+};
+
+#define SIM_RUBIK_FACES 11 // frames of a scan, as rubik_game.cpp takes them
+
+// Quarter turns of every stepper in one command, 0-3 clockwise
+typedef std::array<uint8_t, LINK_STEPPER_MOTORS> SimCubeTurn;
+
+// Rubik's cube: every scan frame is acknowledged, the solve returns `moves` random face turns.
+// The faces come indexed ("rubikFace&face=N", then "rubikSolve") or as the old "rubik"
+// action, numbered in the order they arrive and the last one answered with the moves.
+// The cube is the turns it went through with the ones undone right after dropped, so
+// the same position always reads the same whatever way the robot got there.
+class SimRubikWorld : public SimWorld
+{
+public:
+  SimRubikWorld(uint32_t seed, uint8_t moves = 20);
+
+  const char *name() const override { return "rubik"; }
+  void capture() override;
+  bool answer(const char *action, VisionReply &reply) override;
+  void steppersTurned(const LinkStepperMove &move) override;
+
+  uint32_t faces;   // scan frames received
+  uint32_t turns;   // stepper commands the cube went through
+  uint8_t moves;
+  std::vector<SimCubeTurn> cube;
+  std::vector<SimCubeTurn> seen[SIM_RUBIK_FACES]; // the cube in the last frame of every face
+
+private:
+  void face(int index);
+  void addSolution(VisionReply &reply) const;
+
+  int solution[VISION_REPLY_MAX_VALUES];
+  std::vector<SimCubeTurn> frame;
+};
+
+#endif
@@ -0,0 +1,180 @@
+#include <math.h>
+#include "test_check.h"
+#include "arm_ik.h"
+
+// Forward and inverse kinematics against each other, board interpolation,
+// and the error report of the model against every hand-tuned table
+
+extern void getAnglesForPosition(int idx, int angles[4]);
+extern void getAnglesForCell(int x, int y, int angles[4]);
+extern void getAnglesForStack(int index, int angles[4]);
+extern void getAnglesForCup(int cupPosition, int angles[4]);
+
+#define POSITION_MM 1.0f
+// The pitch sums three servo angles, each rounded to a whole degree
+#define PITCH_DEG 1.5f
+
+static const ArmGeometry geometry = ARM_GEOMETRY_DEFAULTS;
+
+static bool near(const ArmPoint &a, const ArmPoint &b, float mm)
+{
+  return fabsf(a.x - b.x) <= mm && fabsf(a.y - b.y) <= mm && fabsf(a.z - b.z) <= mm &&
+         fabsf(a.pitch - b.pitch) <= PITCH_DEG;
+}
+
+static void testRoundTrip()
+{
+  // Every pose of the working range the solver can reach comes back to the same point
+  int solved = 0;
+  int failed = 0;
+  for (int base = 30; base <= 150; base += 15)
+  {
+    for (int shoulder = 10; shoulder <= 110; shoulder += 10)
+    {
+      for (int elbow = 60; elbow <= 170; elbow += 10)
+      {
+        for (int wrist = 30; wrist <= 90; wrist += 10)
+        {
+          int angles[ARM_IK_JOINTS] = {base, shoulder, elbow, wrist};
+          ArmPoint point;
+          armIkForward(geometry, angles, point);
+
+          int back[ARM_IK_JOINTS];
+          if (!armIkSolve(geometry, point, back))
+            continue;
+          ArmPoint again;
+          armIkForward(geometry, back, again);
+          // Servo angles are whole degrees, a degree at full reach is a few mm
+          if (near(point, again, 6 * POSITION_MM))
+            solved++;
+          else
+            failed++;
+        }
+      }
+    }
+  }
+  printf("round trip: %d poses solved back, %d off\n", solved, failed);
+  CHECK(solved > 1000);
+  CHECK_EQ(failed, 0);
+
+  // The solution of the configured elbow branch is the pose itself
+  int pose[ARM_IK_JOINTS] = {110, 43, 124, 73};
+  ArmPoint point;
+  armIkForward(geometry, pose, point);
+  int back[ARM_IK_JOINTS];
+  CHECK(armIkSolve(geometry, point, back));
+  for (int i = 0; i < ARM_IK_JOINTS; i++)
+    CHECK(abs(back[i] - pose[i]) <= 1);
+}
+
+static void testReach()
+{
+  // Beyond the stretched arm, and inside the base
+  float full = geometry.upperArm + geometry.forearm + geometry.hand;
+  int angles[ARM_IK_JOINTS];
+  CHECK(!armIkSolve(geometry, {full + 10, 0, geometry.baseHeight, 0}, angles));
+  CHECK(!armIkSolve(geometry, {0, 0, geometry.baseHeight - 200, 0}, angles));
+  // Behind the arm the base would have to leave 0..180
+  CHECK(!armIkSolve(geometry, {0, -150, geometry.baseHeight, 0}, angles));
+}
+
+static void testBoard()
+{
+  int table[9][ARM_IK_JOINTS];
+  for (int cell = 0; cell < 9; cell++)
+    getAnglesForCell(cell / 3, cell % 3, table[cell]);
+
+  ArmBoard board;
+  armBoardFromTable(geometry, table, 3, 3, board);
+
+  // The reference cells are where the table puts them
+  const int references[] = {0, 2, 6};
+  for (int cell : references)
+  {
+    ArmPoint measured;
+    armIkForward(geometry, table[cell], measured);
+    CHECK(near(armBoardPoint(board, cell / 3, cell % 3), measured, 0.01f));
+  }
+
+  // Generated cells: the reference cells come back within a degree, every cell lands on its board point
+  int generated[9][ARM_IK_JOINTS];
+  for (int cell = 0; cell < 9; cell++)
+    for (int i = 0; i < ARM_IK_JOINTS; i++)
+      generated[cell][i] = -1;
+  CHECK_EQ(armIkTable(geometry, board, 3, 3, generated), 0);
+  for (int cell : references)
+  {
+    for (int i = 0; i < ARM_IK_JOINTS; i++)
+      CHECK(abs(generated[cell][i] - table[cell][i]) <= 1);
+  }
+  for (int cell = 0; cell < 9; cell++)
+  {
+    ArmPoint point;
+    armIkForward(geometry, generated[cell], point);
+    CHECK(near(point, armBoardPoint(board, cell / 3, cell % 3), 6 * POSITION_MM));
+  }
+
+  // Cells out of reach keep their angles
+  ArmBoard far = board;
+  far.colStep.x += 200;
+  int kept[9][ARM_IK_JOINTS];
+  for (int cell = 0; cell < 9; cell++)
+    for (int i = 0; i < ARM_IK_JOINTS; i++)
+      kept[cell][i] = table[cell][i];
+  uint8_t unreachable = armIkTable(geometry, far, 3, 3, kept);
+  CHECK(unreachable > 0);
+  CHECK(kept[8][0] == table[8][0] && kept[8][1] == table[8][1]);
+}
+
+// The model against a hand-tuned table, as calibrateArmTable() prints it on the device
+static void compare(const char *name, const int (*table)[ARM_IK_JOINTS], uint8_t rows, uint8_t cols)
+{
+  ArmBoard board;
+  armBoardFromTable(geometry, table, rows, cols, board);
+  ArmIkReport report;
+  armIkCompare(geometry, board, rows, cols, table, report);
+
+  printf("  %-18s %u cells, %u out of reach, mean %.1f/%.1f/%.1f/%.1f, max %.0f/%.0f/%.0f/%.0f, worst at cell %u\n",
+         name, report.cells, report.unreachable, report.meanError[0], report.meanError[1], report.meanError[2],
+         report.meanError[3], report.maxError[0], report.maxError[1], report.maxError[2], report.maxError[3],
+         report.worstCell);
+  CHECK_EQ(report.cells + report.unreachable, rows * cols);
+  float worst = 0;
+  for (int i = 0; i < ARM_IK_JOINTS; i++)
+  {
+    CHECK(report.meanError[i] <= report.maxError[i]);
+    worst = report.maxError[i] > worst ? report.maxError[i] : worst;
+  }
+  CHECK(report.worstError == worst);
+}
+
+static void testTables()
+{
+  int xo[9][ARM_IK_JOINTS];
+  for (int cell = 0; cell < 9; cell++)
+    getAnglesForCell(cell / 3, cell % 3, xo[cell]);
+  int stack[5][ARM_IK_JOINTS];
+  for (int k = 0; k < 5; k++)
+    getAnglesForStack(k, stack[k]);
+  int memory[6][ARM_IK_JOINTS];
+  for (int cell = 0; cell < 6; cell++)
+    getAnglesForPosition(cell, memory[cell]);
+  int cups[3][ARM_IK_JOINTS];
+  for (int cup = 0; cup < 3; cup++)
+    getAnglesForCup(cup, cups[cup]);
+
+  printf("model against the hand-tuned tables, degrees base/shoulder/elbow/wrist:\n");
+  compare("XO angleData", xo, 3, 3);
+  compare("XO stackAngleData", stack, 5, 1);
+  compare("memory cell_0..5", memory, 2, 3);
+  compare("cupAngleData", cups, 1, 3);
+}
+
+int main()
+{
+  testRoundTrip();
+  testReach();
+  testBoard();
+  testTables();
+  return TEST_RESULT();
+}
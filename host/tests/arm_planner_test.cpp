@@ -0,0 +1,260 @@
+#include <string>
+#include <vector>
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "arm_state.h"
+#include "game_utils.h"
+#include "sim_game.h"
+
+// Every entry of the pose tables (memory cell_0..cell_8, XO angleData and
+// stackAngleData, cupAngleData) reached the way the games plan it and the
+// way the hand-coded order sent it: same final angles, planned time vs current
+
+extern void startMoveOperation(int from, int to);
+extern bool updateArmMove();
+extern void getAnglesForPosition(int idx, int angles[4]);
+extern void setupServoMoveSequence(int baseAngle, int shoulderAngle, int elbowAngle, int wristAngle, int gripAngle);
+extern bool processServoMoveStep();
+extern void getAnglesForCell(int x, int y, int angles[4]);
+extern void getAnglesForStack(int index, int angles[4]);
+extern void setupGripCupPose(int cup);
+extern bool cupsExecutePose();
+extern void getAnglesForCup(int cupPosition, int angles[4]);
+
+// Per game constants, as in the game files
+#define MEMORY_GRIP_OPEN 120
+#define MEMORY_GRIP_CLOSED 60
+#define MEMORY_SHOULDER 105
+#define XO_GRIP_OPEN 110
+#define XO_GRIP_CLOSED 80
+#define XO_SHOULDER 90
+#define CUPS_GRIP_OPEN 130
+#define CUPS_GRIP_CLOSED 90
+
+#define LOOP_US 1000
+
+#define MEMORY_CELLS 9
+#define XO_STACK 5
+#define CUPS 3
+
+struct Step
+{
+  int joint;
+  int angle;
+  int overShoot;
+};
+
+struct Reach
+{
+  int start[ARM_TIMING_JOINTS];
+  int goal[ARM_TIMING_JOINTS];
+  std::vector<Step> current; // the hand-coded order, one servo command per step
+};
+
+struct TableResult
+{
+  const char *name;
+  int moves;
+  uint64_t plannedUs;
+  uint64_t currentUs;
+  uint64_t bestGainUs;
+};
+
+static void moveArm(SimArduino &arduino, const int angles[ARM_TIMING_JOINTS])
+{
+  for (int joint = 0; joint < ARM_TIMING_JOINTS; joint++)
+    CHECK(sendServoCommand(joint, angles[joint], 0));
+  arduino.clearLog();
+}
+
+static bool reached(SimArduino &arduino, const int goal[ARM_TIMING_JOINTS])
+{
+  for (int joint = 0; joint < ARM_TIMING_JOINTS; joint++)
+  {
+    // Within the tolerance the arm state cache drops steps at
+    if (abs(arduino.angle(joint) - goal[joint]) > ARM_STATE_TOLERANCE)
+      return false;
+  }
+  return true;
+}
+
+// End of the command that set the grip to `grip`, the last step of a memory grab
+static uint64_t gripDoneUs(const std::vector<SimCommand> &commands, int grip)
+{
+  std::string closing = "A,4," + std::to_string(grip) + ",0";
+  for (const SimCommand &command : commands)
+  {
+    for (const std::string &step : simJointSteps({command}))
+    {
+      if (step == closing)
+        return command.doneUs;
+    }
+  }
+  return 0;
+}
+
+static uint64_t runCurrent(SimArduino &arduino, const Reach &reach)
+{
+  moveArm(arduino, reach.start);
+  uint64_t startUs = hostNowUs();
+  for (const Step &step : reach.current)
+    CHECK(sendServoCommand(step.joint, step.angle, step.overShoot));
+  CHECK(reached(arduino, reach.goal));
+  return arduino.commands().back().doneUs - startUs;
+}
+
+// Timed up to the end of the last command, or of the grip close when `grabOnly`
+template <typename Start, typename Update>
+static uint64_t runPlanned(SimArduino &arduino, const Reach &reach, bool grabOnly, Start start, Update update)
+{
+  moveArm(arduino, reach.start);
+  uint64_t startUs = hostNowUs();
+  start();
+  while (!update())
+    hostAdvanceUs(LOOP_US);
+  if (grabOnly)
+    return gripDoneUs(arduino.commands(), reach.goal[GRIP]) - startUs;
+  CHECK(reached(arduino, reach.goal));
+  return arduino.commands().back().doneUs - startUs;
+}
+
+static void report(TableResult &table, const Reach &reach, uint64_t plannedUs, uint64_t currentUs)
+{
+  // The ASCII link runs a plan one step at a time too, each step waits for the next game loop
+  uint64_t slackUs = ARDUINO_LINK_BINARY ? 0 : reach.current.size() * LOOP_US;
+  CHECK(plannedUs > 0);
+  CHECK(plannedUs <= currentUs + slackUs);
+  table.moves++;
+  table.plannedUs += plannedUs;
+  table.currentUs += currentUs;
+  if (currentUs > plannedUs + table.bestGainUs)
+    table.bestGainUs = currentUs - plannedUs;
+}
+
+static void setGoal(Reach &reach, const int angles[4], int grip)
+{
+  for (int joint = 0; joint < 4; joint++)
+    reach.goal[joint] = angles[joint];
+  reach.goal[GRIP] = grip;
+}
+
+// Grab from every memory cell, starting over any other cell with the grip open
+static void replayMemory(SimArduino &arduino, TableResult &table)
+{
+  for (int cell = 0; cell < MEMORY_CELLS; cell++)
+  {
+    int angles[4];
+    getAnglesForPosition(cell, angles);
+    for (int from = 0; from < MEMORY_CELLS; from++)
+    {
+      if (from == cell)
+        continue;
+      Reach reach;
+      getAnglesForPosition(from, reach.start);
+      reach.start[GRIP] = MEMORY_GRIP_OPEN;
+      setGoal(reach, angles, MEMORY_GRIP_CLOSED);
+      reach.current = {{GRIP, MEMORY_GRIP_OPEN, 0},  {SHOULDER, MEMORY_SHOULDER, 10}, {BASE, angles[0], 0},
+                       {WRIST, angles[3], 0},        {ELBOW, angles[2], 0},           {SHOULDER, angles[1], 0},
+                       {GRIP, MEMORY_GRIP_CLOSED, 0}};
+
+      // The carry and the place that follow are not planned, only the grab is timed
+      int to = cell == 6 ? 7 : 6;
+      uint64_t plannedUs =
+          runPlanned(arduino, reach, true, [cell, to] { startMoveOperation(cell, to); }, updateArmMove);
+      report(table, reach, plannedUs, runCurrent(arduino, reach));
+    }
+  }
+}
+
+static void replayXOMove(SimArduino &arduino, Reach &reach, TableResult &table)
+{
+  const int *goal = reach.goal;
+  reach.current = {{SHOULDER, XO_SHOULDER, 10}, {BASE, goal[0], 0},     {WRIST, goal[3], 0},
+                   {ELBOW, goal[2], 0},         {SHOULDER, goal[1], 0}, {GRIP, goal[GRIP], 0}};
+  uint64_t plannedUs = runPlanned(
+      arduino, reach, false, [goal] { setupServoMoveSequence(goal[0], goal[1], goal[2], goal[3], goal[GRIP]); },
+      processServoMoveStep);
+  report(table, reach, plannedUs, runCurrent(arduino, reach));
+}
+
+// Grab from every stack position starting at the retreat pose, place on every cell starting over every stack position
+static void replayXO(SimArduino &arduino, TableResult &stack, TableResult &cells)
+{
+  for (int k = 0; k < XO_STACK; k++)
+  {
+    int piece[4];
+    getAnglesForStack(k, piece);
+    Reach grab;
+    for (int joint = 0; joint < 4; joint++)
+      grab.start[joint] = 90;
+    grab.start[GRIP] = XO_GRIP_OPEN;
+    setGoal(grab, piece, XO_GRIP_CLOSED);
+    replayXOMove(arduino, grab, stack);
+
+    for (int cell = 0; cell < 9; cell++)
+    {
+      int angles[4];
+      getAnglesForCell(cell / 3, cell % 3, angles);
+      Reach place;
+      for (int joint = 0; joint < ARM_TIMING_JOINTS; joint++)
+        place.start[joint] = grab.goal[joint];
+      setGoal(place, angles, XO_GRIP_OPEN);
+      replayXOMove(arduino, place, cells);
+    }
+  }
+}
+
+// Grab and lift every cup, starting at the retreat pose and over every other cup
+static void replayCups(SimArduino &arduino, TableResult &table)
+{
+  for (int cup = 0; cup < CUPS; cup++)
+  {
+    int angles[4];
+    getAnglesForCup(cup, angles);
+    for (int from = -1; from < CUPS; from++)
+    {
+      if (from == cup)
+        continue;
+      Reach reach;
+      if (from < 0)
+      {
+        for (int joint = 0; joint < 4; joint++)
+          reach.start[joint] = 90;
+      }
+      else
+        getAnglesForCup(from, reach.start);
+      reach.start[GRIP] = CUPS_GRIP_OPEN;
+      setGoal(reach, angles, CUPS_GRIP_CLOSED);
+      reach.goal[SHOULDER] = angles[1] + 40;
+      reach.current = {{GRIP, CUPS_GRIP_OPEN, 0},    {BASE, angles[0], 0},      {WRIST, angles[3], 0},
+                       {ELBOW, angles[2], 0},        {SHOULDER, angles[1], 0},  {GRIP, CUPS_GRIP_CLOSED, 0},
+                       {SHOULDER, angles[1] + 40, 0}};
+
+      uint64_t plannedUs = runPlanned(arduino, reach, false, [cup] { setupGripCupPose(cup); }, cupsExecutePose);
+      report(table, reach, plannedUs, runCurrent(arduino, reach));
+    }
+  }
+}
+
+int main()
+{
+  SimArduinoConfig config;
+  config.baud = ARDUINO_LINK_BAUD;
+  SimArduino &arduino = simLink(config);
+
+  TableResult tables[] = {{"memory cell_0..cell_8"}, {"XO stackAngleData"}, {"XO angleData"}, {"cupAngleData"}};
+  replayMemory(arduino, tables[0]);
+  replayXO(arduino, tables[1], tables[2]);
+  replayCups(arduino, tables[3]);
+
+  printf("%s link          moves   planned s   current s   saved   best move\n", ARDUINO_LINK_BINARY ? "binary" : "ASCII ");
+  for (const TableResult &table : tables)
+  {
+    CHECK(table.moves > 0);
+    printf("  %-22s %3d   %9.2f   %9.2f   %4.0f%%   %6.0f ms\n", table.name, table.moves, table.plannedUs / 1e6,
+           table.currentUs / 1e6, 100.0 * ((double)table.currentUs - table.plannedUs) / table.currentUs,
+           table.bestGainUs / 1000.0);
+  }
+  return TEST_RESULT();
+}
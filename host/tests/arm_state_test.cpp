@@ -0,0 +1,110 @@
+#include <string.h>
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "arm_state.h"
+#include "game_utils.h"
+#include "sim_game.h"
+
+// ArmStateCache on its own, then every arm game played in full: the round
+// trips that went on the wire against those the games asked for
+
+#define GAMES_PER_KIND 3
+
+static void testCache()
+{
+  ArmStateCache cache;
+  CHECK(!cache.redundant(BASE, 90));
+  cache.acknowledge(BASE, 90);
+  CHECK(cache.redundant(BASE, 90));
+  CHECK(cache.redundant(BASE, 90 + ARM_STATE_TOLERANCE));
+  CHECK(!cache.redundant(BASE, 90 + ARM_STATE_TOLERANCE + 1));
+  CHECK(!cache.redundant(SHOULDER, 90));
+
+  // Steps to where the joint is go, and the later step of a joint compares to the earlier one
+  ArmPose pose;
+  poseBegin(pose);
+  poseAdd(pose, BASE, 90);
+  poseAdd(pose, SHOULDER, 60);
+  poseAdd(pose, SHOULDER, 60);
+  poseAdd(pose, BASE, 120);
+  CHECK_EQ(cache.elide(pose), 2);
+  CHECK(pose.count == 2 && pose.motor[0] == SHOULDER && pose.motor[1] == BASE);
+  CHECK_EQ(cache.elidedSteps, 2);
+  CHECK_EQ(cache.elidedCommands, 0);
+
+  // Acknowledged, so the same pose again is a whole command saved
+  cache.acknowledge(pose);
+  CHECK_EQ(cache.elide(pose), 2);
+  CHECK_EQ(pose.count, 0);
+  CHECK_EQ(cache.elidedCommands, 1);
+
+  // A grouped pose keeps its groups: base + wrist together, then shoulder + grip
+  cache.acknowledge(WRIST, 45);
+  ArmPose grouped;
+  poseBegin(grouped, LINK_POSE_GROUPED | 1 << 1 | 1 << 3);
+  poseAdd(grouped, BASE, 30);
+  poseAdd(grouped, WRIST, 45);
+  poseAdd(grouped, SHOULDER, 60);
+  poseAdd(grouped, GRIP, 100);
+  CHECK_EQ(cache.elide(grouped), 2);
+  CHECK(grouped.count == 2 && grouped.motor[0] == BASE && grouped.motor[1] == GRIP);
+  CHECK_EQ(grouped.staggerMs, LINK_POSE_GROUPED);
+
+  cache.invalidate();
+  CHECK_EQ(cache.angle(BASE), ARM_STATE_UNKNOWN);
+  CHECK(!cache.redundant(BASE, 120));
+  CHECK_EQ(cache.invalidations, 1);
+}
+
+// Whole games, the world checks the arm put everything where it belongs
+static void replayGames()
+{
+  SimArduinoConfig config;
+  config.baud = ARDUINO_LINK_BAUD;
+  simLink(config);
+
+  printf("%s link      round trips   without cache   saved   steps dropped\n", ARDUINO_LINK_BINARY ? "binary" : "ASCII ");
+  for (int g = 0; g < simGameCount; g++)
+  {
+    const SimGame &game = simGames[g];
+    // The cube turns are relative, the cache never drops them
+    if (strcmp(game.name, "rubik") == 0)
+      continue;
+
+    uint32_t sent = 0;
+    uint32_t saved = 0;
+    uint32_t steps = 0;
+    for (int seed = 1; seed <= GAMES_PER_KIND; seed++)
+    {
+      SimWorld *world = simMakeWorld(game.name, seed);
+      SimGameResult result;
+      SimOptions options;
+      CHECK(simPlayGame(game, *world, options, result));
+      CHECK_EQ(result.armGaveUp, 0);
+      SimXoWorld *xo = dynamic_cast<SimXoWorld *>(world);
+      if (xo)
+        CHECK(xo->finished() && xo->misplaced == 0);
+
+      // An ASCII line per step, a binary frame per command
+      sent += result.commands.size();
+      saved += ARDUINO_LINK_BINARY ? result.elidedCommands : result.elidedSteps;
+      steps += result.elidedSteps;
+      delete world;
+    }
+
+    printf("  %-14s %11u   %13u   %4.0f%%   %13u\n", game.name, sent, sent + saved, 100.0 * saved / (sent + saved),
+           steps);
+    // A binary pose is one round trip however many steps it drops, it only gets shorter
+    CHECK(steps > 0);
+    if (!ARDUINO_LINK_BINARY)
+      CHECK(saved > 0);
+  }
+}
+
+int main()
+{
+  testCache();
+  replayGames();
+  return TEST_RESULT();
+}
@@ -0,0 +1,125 @@
+#include <Arduino.h>
+#include <driver/uart.h>
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "baud_negotiator.h"
+#include "sim_arduino.h"
+
+// The negotiator against Arduinos that accept only some of the rates, or accept a rate they cannot hold
+
+static const uint32_t candidates[] = {115200, 250000, 500000};
+
+static void uartWrite(const uint8_t *buf, size_t len, void *ctx)
+{
+  uart_write_bytes(UART_NUM_2, buf, len);
+}
+
+static int uartRead(void *ctx)
+{
+  uint8_t byte;
+  return uart_read_bytes(UART_NUM_2, &byte, 1, 0) == 1 ? byte : -1;
+}
+
+static unsigned long uartNow(void *ctx)
+{
+  return millis();
+}
+
+static void uartSetBaud(uint32_t baud, void *ctx)
+{
+  uart_set_baudrate(UART_NUM_2, baud);
+}
+
+// Acks a BAUD request for any rate it lists, but loses everything sent faster than `limit`
+class NoisyLine : public HostUartPeer
+{
+public:
+  NoisyLine(SimArduino &arduino, uint32_t limit) : arduino(arduino), limit(limit) {}
+
+  void receive(const uint8_t *data, size_t length, uint32_t baud) override
+  {
+    if (baud <= limit)
+      arduino.receive(data, length, baud);
+  }
+
+private:
+  SimArduino &arduino;
+  uint32_t limit;
+};
+
+struct Scenario
+{
+  const char *name;
+  std::vector<uint32_t> rates; // the Arduino accepts
+  uint32_t limit;              // fastest rate the line carries
+  uint32_t expected;
+  uint32_t rejected;
+  uint32_t failures;
+};
+
+static void run(const Scenario &scenario)
+{
+  SimArduinoConfig config;
+  config.baud = ARDUINO_LINK_BAUD;
+  config.rates = scenario.rates;
+  SimArduino arduino(config);
+  NoisyLine line(arduino, scenario.limit);
+  hostUartAttach(&line);
+  uart_set_baudrate(UART_NUM_2, ARDUINO_LINK_BAUD);
+
+  LinkTransport transport = {uartWrite, uartRead, uartNow, nullptr};
+  BaudNegotiator negotiator(transport, uartSetBaud, candidates, sizeof(candidates) / sizeof(candidates[0]));
+  uint64_t startUs = hostNowUs();
+  negotiator.start(ARDUINO_LINK_BAUD);
+  while (negotiator.poll())
+    hostAdvanceUs(1000);
+  uint64_t tookUs = hostNowUs() - startUs;
+
+  // The Arduino has given up on an unconfirmed rate by then
+  hostAdvanceUs(2 * BAUD_CONFIRM_MS * 1000);
+
+  printf("  %-32s %7u baud in %4.0f ms, %u rejected, %u failed\n", scenario.name, negotiator.baud(), tookUs / 1000.0,
+         negotiator.rejected, negotiator.failures);
+  CHECK_EQ(negotiator.baud(), scenario.expected);
+  CHECK_EQ(hostUartBaud(), scenario.expected);
+  CHECK_EQ(arduino.baud(), scenario.expected);
+  CHECK_EQ(negotiator.rejected, scenario.rejected);
+  CHECK_EQ(negotiator.failures, scenario.failures);
+  CHECK_EQ(negotiator.state(), BAUD_IDLE);
+
+  // Both ends talk at the agreed rate
+  LinkWindow window(transport, 500, 0);
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  LinkTicket ticket = window.submit(LINK_OP_SERVO, payload, linkPackServo(payload, 0, 90, 0));
+  LinkTicketStatus status;
+  do
+  {
+    hostAdvanceUs(1000);
+    window.poll();
+  } while ((status = window.check(ticket)) == LINK_TICKET_PENDING);
+  CHECK_EQ(status, LINK_TICKET_ACKED);
+
+  hostUartAttach(nullptr);
+}
+
+int main()
+{
+  uart_config_t uartConfig = {};
+  uartConfig.baud_rate = ARDUINO_LINK_BAUD;
+  uart_driver_install(UART_NUM_2, 1024, 0, 256, nullptr, 0);
+  uart_param_config(UART_NUM_2, &uartConfig);
+
+  printf("negotiated from %u baud:\n", ARDUINO_LINK_BAUD);
+  const Scenario scenarios[] = {
+      {"every rate", {9600, 115200, 250000, 500000}, UINT32_MAX, 500000, 0, 0},
+      {"up to 115200", {9600, 115200}, UINT32_MAX, 115200, 2, 0},
+      {"base rate only", {9600}, UINT32_MAX, 9600, 3, 0},
+      {"115200 missing", {9600, 250000, 500000}, UINT32_MAX, 500000, 1, 0},
+      {"500000 acked, line too slow", {9600, 115200, 250000, 500000}, 250000, 250000, 0, 1},
+      {"nothing above base gets through", {9600, 115200, 250000, 500000}, 9600, 9600, 0, 1},
+  };
+  for (const Scenario &scenario : scenarios)
+    run(scenario);
+  return TEST_RESULT();
+}
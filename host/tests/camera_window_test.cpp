@@ -0,0 +1,165 @@
+#include <string.h>
+#include "test_check.h"
+#include "camera_window.h"
+
+// Capture windows against the OV2640 limits, the /config?window= parser, and
+// the share of the profile frame a window leaves to encode and upload, as
+// configGenerator/main.py estimates it
+
+struct FrameSize
+{
+  int framesize;
+  uint16_t width;
+  uint16_t height;
+};
+
+// The framesizes changeConfig() sets per game
+static const FrameSize frameSizes[] = {{10, 1024, 768}, {13, 1600, 1200}};
+
+static bool valid(const CameraWindow &window)
+{
+  return cameraWindowError(window) == nullptr;
+}
+
+static bool failsWith(const CameraWindow &window, const char *error)
+{
+  const char *got = cameraWindowError(window);
+  return got && strcmp(got, error) == 0;
+}
+
+static void testModes()
+{
+  uint16_t width = 0, height = 0;
+  CHECK(cameraModeSize(CAMERA_MODE_CIF, width, height) && width == 400 && height == 296);
+  CHECK(cameraModeSize(CAMERA_MODE_SVGA, width, height) && width == 800 && height == 600);
+  CHECK(cameraModeSize(CAMERA_MODE_UXGA, width, height) && width == 1600 && height == 1200);
+  CHECK(!cameraModeSize(3, width, height));
+  CHECK(!cameraModeSize(CAMERA_WINDOW_OFF, width, height));
+}
+
+static void testLimits()
+{
+  CameraWindow full = CAMERA_WINDOW_FULL;
+  CHECK(valid(full));
+
+  // The whole of every mode, unscaled and scaled down
+  for (int mode = CAMERA_MODE_CIF; mode <= CAMERA_MODE_UXGA; mode++)
+  {
+    uint16_t width, height;
+    cameraModeSize(mode, width, height);
+    CHECK(valid({(int8_t)mode, 0, 0, width, height, width, height}));
+    CHECK(valid({(int8_t)mode, 0, 0, width, height, CAMERA_WINDOW_ALIGN, CAMERA_WINDOW_ALIGN}));
+  }
+
+  CHECK(failsWith({3, 0, 0, 400, 296, 400, 296}, "unknown sensor mode"));
+  CHECK(failsWith({CAMERA_MODE_SVGA, 0, 0, 0, 600, 0, 600}, "empty window"));
+  CHECK(failsWith({CAMERA_MODE_SVGA, 0, 0, 800, 600, 800, 0}, "empty window"));
+  CHECK(failsWith({CAMERA_MODE_SVGA, 0, 0, 802, 600, 800, 600}, "sizes must be multiples of 4"));
+  CHECK(failsWith({CAMERA_MODE_SVGA, 0, 0, 800, 600, 798, 600}, "sizes must be multiples of 4"));
+
+  // Right up to the edge of the mode, then one step past it
+  CHECK(valid({CAMERA_MODE_SVGA, 400, 300, 400, 300, 400, 300}));
+  CHECK(failsWith({CAMERA_MODE_SVGA, 401, 300, 400, 300, 400, 300}, "window outside the sensor mode"));
+  CHECK(failsWith({CAMERA_MODE_SVGA, 400, 304, 400, 300, 400, 300}, "window outside the sensor mode"));
+  CHECK(failsWith({CAMERA_MODE_CIF, 0, 0, 800, 600, 400, 296}, "window outside the sensor mode"));
+
+  // The sensor only scales down
+  const char *upscaled = "output larger than the window, the sensor only scales down";
+  CHECK(failsWith({CAMERA_MODE_SVGA, 0, 0, 400, 300, 404, 300}, upscaled));
+  CHECK(failsWith({CAMERA_MODE_SVGA, 0, 0, 400, 300, 400, 304}, upscaled));
+}
+
+static void testParse()
+{
+  CameraWindow window = {CAMERA_MODE_CIF, 1, 2, 3, 4, 5, 6};
+  CHECK(cameraWindowParse("off", window));
+  CHECK_EQ(window.mode, CAMERA_WINDOW_OFF);
+
+  CHECK(cameraWindowParse("2,400,300,800,600,640,480", window));
+  CHECK(window.mode == CAMERA_MODE_UXGA && window.x == 400 && window.y == 300 && window.width == 800 &&
+        window.height == 600 && window.outWidth == 640 && window.outHeight == 480);
+  CHECK(valid(window));
+
+  // Parsed but out of the limits: the error is cameraWindowError()'s to report
+  CHECK(cameraWindowParse("1,0,0,802,600,800,600", window));
+  CHECK(!valid(window));
+
+  // Malformed ones leave the window as it was
+  const char *malformed[] = {"", "on", "1,0,0,800,600,800", "1,0,0,800,600,800,600,1", "1,0,0,800,600,800,600,",
+                             "1;0;0;800;600;800;600", "3,0,0,800,600,800,600", "-1,0,0,800,600,800,600",
+                             "1,-4,0,800,600,800,600", "1,0,0,70000,600,800,600", "1,0,0,800x,600,800,600",
+                             "1,0,0,800,600,800,600 "};
+  CameraWindow before = {CAMERA_MODE_SVGA, 4, 8, 12, 16, 12, 16};
+  for (const char *text : malformed)
+  {
+    window = before;
+    bool parsed = cameraWindowParse(text, window);
+    if (parsed)
+      printf("parsed \"%s\"\n", text);
+    CHECK(!parsed);
+    CHECK(memcmp(&window, &before, sizeof(window)) == 0);
+  }
+}
+
+// Share of the profile frame the window leaves, JPEG size grows about linearly with the pixel count
+static double pixelShare(const CameraWindow &window, const FrameSize &frame)
+{
+  if (window.mode == CAMERA_WINDOW_OFF)
+    return 1;
+  return (double)window.outWidth * window.outHeight / ((double)frame.width * frame.height);
+}
+
+static void testBandwidth()
+{
+  struct Example
+  {
+    const char *name;
+    int framesize;
+    CameraWindow window;
+  };
+  // Regions of the kind the server looks at, the real ones go in with the server change
+  const Example examples[] = {
+      {"whole frame", 10, CAMERA_WINDOW_FULL},
+      {"xo board", 10, {CAMERA_MODE_UXGA, 400, 200, 800, 800, 512, 512}},
+      {"rubik face", 10, {CAMERA_MODE_SVGA, 200, 100, 400, 400, 400, 400}},
+      {"memory board", 13, {CAMERA_MODE_UXGA, 0, 200, 1600, 800, 1200, 600}},
+      {"memory reveal", 13, {CAMERA_MODE_UXGA, 200, 300, 1200, 400, 900, 300}},
+      {"cups row", 10, {CAMERA_MODE_SVGA, 0, 200, 800, 200, 800, 200}},
+  };
+
+  printf("window           frame        output     pixels   saved\n");
+  for (const Example &example : examples)
+  {
+    const FrameSize *frame = nullptr;
+    for (const FrameSize &size : frameSizes)
+    {
+      if (size.framesize == example.framesize)
+        frame = &size;
+    }
+    CHECK(frame != nullptr);
+    CHECK(valid(example.window));
+    if (!frame)
+      continue;
+
+    double share = pixelShare(example.window, *frame);
+    uint16_t outWidth = example.window.mode == CAMERA_WINDOW_OFF ? frame->width : example.window.outWidth;
+    uint16_t outHeight = example.window.mode == CAMERA_WINDOW_OFF ? frame->height : example.window.outHeight;
+    printf("  %-14s %4ux%-4u   %4ux%-4u   %5.0f%%   %4.0f%%\n", example.name, frame->width, frame->height, outWidth,
+           outHeight, share * 100, (1 - share) * 100);
+    CHECK(share > 0 && share <= 1);
+  }
+
+  // main.py window_lines() says "about 38% of the pixels" for this window on framesize 13
+  CameraWindow window;
+  CHECK(cameraWindowParse("2,0,200,1600,800,1200,600", window));
+  CHECK_EQ((int)(pixelShare(window, frameSizes[1]) * 100 + 0.5), 38);
+}
+
+int main()
+{
+  testModes();
+  testLimits();
+  testParse();
+  testBandwidth();
+  return TEST_RESULT();
+}
@@ -0,0 +1,307 @@
+#include <chrono>
+#include <string.h>
+#include <vector>
+#include "test_check.h"
+#include "frame_change.h"
+
+// The thumbnail and SAD kernels, ChangeGate on a synthetic recording of the
+// XO board (camera noise, a hand passing over, a piece placed), and the cost
+// of the kernels per frame
+
+// 1:8 decode of an XGA frame, what the gate sees on the device
+#define SOURCE_WIDTH 128
+#define SOURCE_HEIGHT 96
+#define NOISE 3 // camera noise, +-luma levels per pixel
+#define BENCH_FRAMES 20000
+
+// The XO profile of esp32.ino: blockSad, enterBlocks, exitBlocks, stableFrames, forceAfter
+static const ChangeThresholds xoThresholds = {240, 1, 0, 1, 15};
+
+struct Image
+{
+  std::vector<uint8_t> rgb = std::vector<uint8_t>(SOURCE_WIDTH * SOURCE_HEIGHT * 3);
+
+  void set(int x, int y, uint8_t r, uint8_t g, uint8_t b)
+  {
+    uint8_t *p = &rgb[(y * SOURCE_WIDTH + x) * 3];
+    p[0] = r;
+    p[1] = g;
+    p[2] = b;
+  }
+
+  void fill(int x0, int y0, int w, int h, uint8_t level)
+  {
+    for (int y = y0; y < y0 + h; y++)
+      for (int x = x0; x < x0 + w; x++)
+        set(x, y, level, level, level);
+  }
+};
+
+static uint32_t noiseState = 1;
+
+static int noise()
+{
+  noiseState = noiseState * 1103515245 + 12345;
+  return (int)((noiseState >> 16) % (2 * NOISE + 1)) - NOISE;
+}
+
+// Board background: a gradient with fresh noise on every frame
+static Image scene()
+{
+  Image image;
+  for (int y = 0; y < SOURCE_HEIGHT; y++)
+  {
+    for (int x = 0; x < SOURCE_WIDTH; x++)
+    {
+      int level = 80 + x / 2 + y / 4 + noise();
+      image.set(x, y, level, level, level);
+    }
+  }
+  return image;
+}
+
+// As esp_jpg_decode() hands it out: 16x8 MCU rows, left to right, top to bottom
+static void decode(const Image &image, LumaThumbnail &thumbnail, int tileWidth = 16, int tileHeight = 8)
+{
+  thumbnail.begin(SOURCE_WIDTH, SOURCE_HEIGHT);
+  std::vector<uint8_t> tile(tileWidth * tileHeight * 3);
+  for (int y = 0; y < SOURCE_HEIGHT; y += tileHeight)
+  {
+    for (int x = 0; x < SOURCE_WIDTH; x += tileWidth)
+    {
+      int w = x + tileWidth <= SOURCE_WIDTH ? tileWidth : SOURCE_WIDTH - x;
+      int h = y + tileHeight <= SOURCE_HEIGHT ? tileHeight : SOURCE_HEIGHT - y;
+      for (int row = 0; row < h; row++)
+        memcpy(&tile[row * w * 3], &image.rgb[((y + row) * SOURCE_WIDTH + x) * 3], w * 3);
+      thumbnail.addRgb(x, y, w, h, tile.data());
+    }
+  }
+  thumbnail.finish();
+}
+
+static void testThumbnail()
+{
+  LumaThumbnail thumbnail;
+
+  // BT.601 weights, white stays white
+  const uint8_t colours[][4] = {{255, 255, 255, 255}, {0, 0, 0, 0}, {255, 0, 0, 76}, {0, 255, 0, 149},
+                                {0, 0, 255, 28}};
+  for (const uint8_t *colour : colours)
+  {
+    Image image;
+    for (int y = 0; y < SOURCE_HEIGHT; y++)
+      for (int x = 0; x < SOURCE_WIDTH; x++)
+        image.set(x, y, colour[0], colour[1], colour[2]);
+    decode(image, thumbnail);
+    bool flat = true;
+    for (uint8_t pixel : thumbnail.pixels)
+      flat = flat && pixel == colour[3];
+    CHECK(flat);
+  }
+
+  // Every thumbnail pixel averages its 4x4 source pixels
+  Image image;
+  for (int y = 0; y < SOURCE_HEIGHT; y++)
+    for (int x = 0; x < SOURCE_WIDTH; x++)
+      image.set(x, y, (x % 4) * 40, (x % 4) * 40, (x % 4) * 40);
+  decode(image, thumbnail);
+  CHECK_EQ(thumbnail.pixels[0], 60);
+  CHECK_EQ(thumbnail.pixels[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT - 1], 60);
+
+  // A square on the source lands on its thumbnail pixels only
+  image.fill(0, 0, SOURCE_WIDTH, SOURCE_HEIGHT, 100);
+  image.fill(32, 16, 8, 8, 200);
+  decode(image, thumbnail);
+  CHECK(thumbnail.pixels[4 * CHANGE_THUMB_WIDTH + 8] == 200 && thumbnail.pixels[5 * CHANGE_THUMB_WIDTH + 9] == 200);
+  CHECK(thumbnail.pixels[4 * CHANGE_THUMB_WIDTH + 7] == 100 && thumbnail.pixels[6 * CHANGE_THUMB_WIDTH + 8] == 100);
+
+  // The order and size of the decoded tiles make no difference
+  Image noisy = scene();
+  LumaThumbnail rows, tiles;
+  decode(noisy, rows, SOURCE_WIDTH, 1);
+  decode(noisy, tiles, 24, 8);
+  CHECK(memcmp(rows.pixels, tiles.pixels, sizeof(rows.pixels)) == 0);
+
+  // Sources that do not divide into the thumbnail: every pixel still gets a value, nothing is written past it
+  thumbnail.begin(100, 70);
+  std::vector<uint8_t> white(100 * 70 * 3, 255);
+  thumbnail.addRgb(0, 0, 100, 70, white.data());
+  thumbnail.addRgb(96, 64, 8, 8, white.data()); // past the edge of the image
+  thumbnail.finish();
+  bool flat = true;
+  for (uint8_t pixel : thumbnail.pixels)
+    flat = flat && pixel == 255;
+  CHECK(flat);
+}
+
+static void testSad()
+{
+  uint8_t a[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT];
+  uint8_t b[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT];
+  memset(a, 100, sizeof(a));
+  memset(b, 100, sizeof(b));
+  CHECK_EQ(changedBlocks(a, b, 0), 0);
+
+  // Both signs count
+  b[0] = 110;
+  b[1] = 90;
+  CHECK_EQ(changeBlockSad(a, b, 0, 0), 20);
+  CHECK_EQ(changeBlockSad(b, a, 0, 0), 20);
+  CHECK_EQ(changeBlockSad(a, b, 1, 0), 0);
+
+  // The last pixel of the last block
+  b[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT - 1] = 0;
+  CHECK_EQ(changeBlockSad(a, b, CHANGE_BLOCKS_X - 1, CHANGE_BLOCKS_Y - 1), 100);
+
+  // A block changes only above the threshold
+  CHECK_EQ(changedBlocks(a, b, 19), 2);
+  CHECK_EQ(changedBlocks(a, b, 20), 1);
+  CHECK_EQ(changedBlocks(a, b, 100), 0);
+
+  // Every block on its own
+  memcpy(b, a, sizeof(b));
+  for (int block = 0; block < CHANGE_BLOCKS; block++)
+  {
+    int x = block % CHANGE_BLOCKS_X * CHANGE_BLOCK + 1;
+    int y = block / CHANGE_BLOCKS_X * CHANGE_BLOCK + 2;
+    b[y * CHANGE_THUMB_WIDTH + x] = 255;
+  }
+  CHECK_EQ(changedBlocks(a, b, 154), CHANGE_BLOCKS);
+  CHECK_EQ(changedBlocks(a, b, 155), 0);
+
+  // Camera noise stays under the XO threshold, a piece does not
+  LumaThumbnail first, second;
+  Image board = scene();
+  decode(board, first);
+  decode(scene(), second);
+  CHECK_EQ(changedBlocks(first.pixels, second.pixels, xoThresholds.blockSad), 0);
+  board.fill(48, 32, 16, 16, 20);
+  decode(board, second);
+  CHECK_EQ(changedBlocks(first.pixels, second.pixels, xoThresholds.blockSad), 1);
+}
+
+struct Frame
+{
+  const char *what;
+  int pieces; // pieces on the board
+  bool hand;
+  bool upload; // what the gate should say
+};
+
+static Image frameOf(const Frame &frame)
+{
+  Image image = scene();
+  // Pieces go into the cells of a 3x3 board in the middle of the frame
+  for (int piece = 0; piece < frame.pieces; piece++)
+    image.fill(32 + piece % 3 * 24, 16 + piece / 3 * 24, 16, 16, 20);
+  if (frame.hand)
+    image.fill(0, 40, 96, 40, 190);
+  return image;
+}
+
+static void testGate()
+{
+  LumaThumbnail thumbnail;
+  ChangeGate gate;
+
+  // Without thresholds every frame goes
+  for (int i = 0; i < 3; i++)
+  {
+    decode(scene(), thumbnail);
+    CHECK(gate.check(thumbnail));
+  }
+  CHECK_EQ(gate.skipped, 0);
+
+  gate.setThresholds(&xoThresholds);
+  const Frame recording[] = {
+      {"first frame", 0, false, true},
+      {"same board", 0, false, false},
+      {"same board", 0, false, false},
+      {"hand over the board", 0, true, false},
+      {"hand gone", 0, false, false},
+      {"piece placed", 1, false, false},
+      {"piece settled", 1, false, true},
+      {"same board", 1, false, false},
+      {"hand over the board", 1, true, false},
+      {"hand stays", 1, true, true},
+      {"hand gone", 1, false, false},
+      {"hand gone", 1, false, true},
+      {"second piece", 2, false, false},
+      {"second piece settled", 2, false, true},
+  };
+  int uploads = 0;
+  for (const Frame &frame : recording)
+  {
+    decode(frameOf(frame), thumbnail);
+    bool upload = gate.check(thumbnail);
+    if (upload != frame.upload)
+      printf("%s: upload %d, expected %d\n", frame.what, upload, frame.upload);
+    CHECK_EQ(upload, frame.upload);
+    if (upload)
+    {
+      gate.accept();
+      uploads++;
+    }
+  }
+  CHECK_EQ(gate.skipped, sizeof(recording) / sizeof(recording[0]) - uploads);
+  CHECK_EQ(gate.forced, 0);
+
+  // An unchanged board is uploaded once every forceAfter frames
+  gate.reset();
+  decode(frameOf({"", 2, false, true}), thumbnail);
+  CHECK(gate.check(thumbnail));
+  gate.accept();
+  int forced = 0;
+  for (int i = 1; i <= 3 * xoThresholds.forceAfter; i++)
+  {
+    decode(frameOf({"", 2, false, false}), thumbnail);
+    if (gate.check(thumbnail))
+    {
+      CHECK_EQ(i % xoThresholds.forceAfter, 0);
+      gate.accept();
+      forced++;
+    }
+  }
+  CHECK_EQ(forced, 3);
+  CHECK_EQ(gate.forced, 3);
+
+  // A reset forgets the reference, the next frame goes whatever it shows
+  gate.reset();
+  CHECK(gate.check(thumbnail));
+}
+
+static void benchKernels()
+{
+  Image image = scene();
+  LumaThumbnail reference, thumbnail;
+  decode(image, reference);
+
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_FRAMES; i++)
+    decode(image, thumbnail);
+  double thumbUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() /
+                   BENCH_FRAMES;
+
+  uint32_t blocks = 0;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_FRAMES; i++)
+  {
+    thumbnail.pixels[i % sizeof(thumbnail.pixels)] ^= 0x80;
+    blocks += changedBlocks(thumbnail.pixels, reference.pixels, xoThresholds.blockSad);
+  }
+  double sadUs = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() /
+                 BENCH_FRAMES;
+
+  printf("%dx%d source to thumbnail: %.2f us, changedBlocks over %d blocks: %.3f us (%u changed)\n", SOURCE_WIDTH,
+         SOURCE_HEIGHT, thumbUs, CHANGE_BLOCKS, sadUs, blocks);
+  CHECK(blocks > 0);
+}
+
+int main()
+{
+  testThumbnail();
+  testSad();
+  testGate();
+  benchKernels();
+  return TEST_RESULT();
+}
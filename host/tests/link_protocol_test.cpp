@@ -0,0 +1,213 @@
+#include <string.h>
+#include "test_check.h"
+#include "link_protocol.h"
+
+// Codec round trips, corrupted frames, and the bytes each command takes on the wire next to its ASCII line
+
+static int decodeAll(LinkDecoder &decoder, const uint8_t *data, size_t length, LinkFrame *frames, int max)
+{
+  int count = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    LinkFrame frame;
+    if (decoder.feed(data[i], frame) == LINK_DECODE_FRAME && count < max)
+      frames[count++] = frame;
+  }
+  return count;
+}
+
+static void testCrc()
+{
+  // CRC-16/CCITT-FALSE check value
+  CHECK_EQ(linkCrc16((const uint8_t *)"123456789", 9), 0x29B1);
+}
+
+static void testRoundTrips()
+{
+  uint8_t out[LINK_MAX_FRAME];
+  LinkFrame frame;
+  LinkDecoder decoder;
+
+  size_t length = linkEncodeServo(out, 7, 3, -120, -15);
+  CHECK_EQ(length, LINK_FRAME_OVERHEAD + 4);
+  CHECK_EQ(decodeAll(decoder, out, length, &frame, 1), 1);
+  uint8_t motor;
+  int16_t angle;
+  int8_t overShoot;
+  CHECK(linkDecodeServo(frame, motor, angle, overShoot));
+  CHECK_EQ(frame.seq, 7);
+  CHECK_EQ(motor, 3);
+  CHECK_EQ(angle, -120);
+  CHECK_EQ(overShoot, -15);
+
+  int cmds[LINK_STEPPER_MOTORS * 2] = {90, 0, 180, 1, 0, 0, 270, 1, 90, 1};
+  length = linkEncodeStepper(out, 255, cmds);
+  CHECK_EQ(decodeAll(decoder, out, length, &frame, 1), 1);
+  int decoded[LINK_STEPPER_MOTORS * 2];
+  CHECK(linkDecodeStepper(frame, decoded));
+  CHECK(memcmp(cmds, decoded, sizeof(cmds)) == 0);
+
+  LinkPose pose = {};
+  pose.count = LINK_POSE_MAX_STEPS;
+  pose.staggerMs = LINK_POSE_GROUPED | 0x06;
+  for (int i = 0; i < pose.count; i++)
+  {
+    pose.motor[i] = i % 5;
+    pose.angle[i] = 20 * i - 30;
+    pose.overShoot[i] = i - 3;
+  }
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  uint8_t payloadLength = linkPackPose(payload, pose);
+  CHECK(payloadLength > 0);
+  length = linkEncodeFrame(out, 1, LINK_OP_POSE, payload, payloadLength);
+  CHECK_EQ(decodeAll(decoder, out, length, &frame, 1), 1);
+  LinkPose decodedPose;
+  CHECK(linkDecodePose(frame, decodedPose));
+  CHECK_EQ(decodedPose.count, pose.count);
+  CHECK_EQ(decodedPose.staggerMs, pose.staggerMs);
+  for (int i = 0; i < pose.count; i++)
+  {
+    CHECK_EQ(decodedPose.motor[i], pose.motor[i]);
+    CHECK_EQ(decodedPose.angle[i], pose.angle[i]);
+    CHECK_EQ(decodedPose.overShoot[i], pose.overShoot[i]);
+  }
+
+  LinkStepperMove move = {};
+  move.count = 2;
+  move.motor[0] = 1;
+  move.angle[0] = 270;
+  move.motor[1] = 4;
+  move.angle[1] = 90;
+  move.direction[1] = 1;
+  payloadLength = linkPackStepperMove(payload, move);
+  length = linkEncodeFrame(out, 2, LINK_OP_STEPPER_SPARSE, payload, payloadLength);
+  CHECK_EQ(decodeAll(decoder, out, length, &frame, 1), 1);
+  LinkStepperMove decodedMove;
+  CHECK(linkDecodeStepperMove(frame, decodedMove));
+  CHECK_EQ(decodedMove.count, 2);
+  CHECK_EQ(decodedMove.angle[0], 270);
+  CHECK_EQ(decodedMove.direction[1], 1);
+
+  length = linkEncodeNak(out, 9, LINK_NAK_CRC);
+  CHECK_EQ(decodeAll(decoder, out, length, &frame, 1), 1);
+  CHECK_EQ(frame.op, LINK_OP_NAK);
+  CHECK_EQ(frame.payload[0], LINK_NAK_CRC);
+
+  // A frame carrying the wrong payload for its opcode is rejected
+  length = linkEncodeAck(out, 4);
+  CHECK_EQ(decodeAll(decoder, out, length, &frame, 1), 1);
+  CHECK(!linkDecodeServo(frame, motor, angle, overShoot));
+  CHECK(!linkDecodePose(frame, decodedPose));
+}
+
+static void testCorruption()
+{
+  uint8_t frame[LINK_MAX_FRAME];
+  size_t length = linkEncodeServo(frame, 42, 1, 105, 10);
+  LinkFrame frames[4];
+
+  // No single flipped bit gets through as a frame
+  int accepted = 0;
+  uint32_t crcErrors = 0;
+  for (size_t byte = 0; byte < length; byte++)
+  {
+    for (int bit = 0; bit < 8; bit++)
+    {
+      uint8_t copy[LINK_MAX_FRAME];
+      memcpy(copy, frame, length);
+      copy[byte] ^= 1 << bit;
+      LinkDecoder decoder;
+      accepted += decodeAll(decoder, copy, length, frames, 4);
+      crcErrors += decoder.crcErrors;
+    }
+  }
+  CHECK_EQ(accepted, 0);
+  CHECK(crcErrors > 0);
+
+  // Garbage, a truncated frame and an oversized length before a good frame
+  uint8_t stream[3 * LINK_MAX_FRAME];
+  size_t n = 0;
+  stream[n++] = 0x00;
+  stream[n++] = 0x13;
+  stream[n++] = LINK_SOF;
+  stream[n++] = LINK_MAX_PAYLOAD + 1;
+  memcpy(stream + n, frame, 4); // SOF, len, seq, op then nothing
+  n += 4;
+  memcpy(stream + n, frame, length);
+  n += length;
+
+  LinkDecoder decoder;
+  int count = decodeAll(decoder, stream, n, frames, 4);
+  CHECK_EQ(decoder.lengthErrors, 1);
+  // The truncated frame swallows the start of the good one, the next good frame decodes again
+  uint8_t next[LINK_MAX_FRAME];
+  size_t nextLength = linkEncodeServo(next, 43, 2, 60, 0);
+  count += decodeAll(decoder, next, nextLength, frames + count, 4 - count);
+  CHECK(count >= 1);
+  CHECK_EQ(frames[count - 1].seq, 43);
+
+  // Back to back frames split at every byte decode the same
+  uint8_t pair[2 * LINK_MAX_FRAME];
+  memcpy(pair, frame, length);
+  memcpy(pair + length, next, nextLength);
+  LinkDecoder split;
+  CHECK_EQ(decodeAll(split, pair, length + nextLength, frames, 4), 2);
+  CHECK_EQ(frames[0].seq, 42);
+  CHECK_EQ(frames[1].seq, 43);
+}
+
+static void reportWireSize()
+{
+  uint8_t out[LINK_MAX_FRAME];
+  uint8_t payload[LINK_MAX_PAYLOAD];
+
+  size_t servo = linkEncodeServo(out, 0, 1, 105, 10);
+  size_t servoLine = strlen("A,1,105,10\r\n");
+
+  int cmds[LINK_STEPPER_MOTORS * 2] = {90, 0, 0, 0, 270, 1, 0, 0, 90, 1};
+  size_t stepper = linkEncodeStepper(out, 0, cmds);
+  size_t stepperLine = strlen("S,90,0,0,0,270,1,0,0,90,1\r\n");
+
+  LinkStepperMove move = {};
+  move.count = 1;
+  move.motor[0] = 2;
+  move.angle[0] = 90;
+  size_t sparse = linkEncodeFrame(out, 0, LINK_OP_STEPPER_SPARSE, payload, linkPackStepperMove(payload, move));
+
+  // A reach move: four joints the ASCII link sends as four lines, each acked
+  LinkPose pose = {};
+  pose.count = 4;
+  pose.staggerMs = LINK_POSE_SEQUENTIAL;
+  const int angles[4] = {135, 60, 110, 45};
+  const int overShoots[4] = {0, 10, -10, 0};
+  size_t poseLines = 0;
+  for (int i = 0; i < 4; i++)
+  {
+    pose.motor[i] = i;
+    pose.angle[i] = angles[i];
+    pose.overShoot[i] = overShoots[i];
+    poseLines += snprintf((char *)out, sizeof(out), "A,%d,%d,%d\r\n", i, angles[i], overShoots[i]);
+  }
+  size_t poseFrame = linkEncodeFrame(out, 0, LINK_OP_POSE, payload, linkPackPose(payload, pose));
+  size_t ack = linkEncodeAck(out, 0);
+
+  printf("bytes on the wire, binary frame vs ASCII line:\n");
+  printf("  servo          %2u vs %2u, reply %u vs 4 (\"OK\\r\\n\")\n", (unsigned)servo, (unsigned)servoLine,
+         (unsigned)ack);
+  printf("  dense stepper  %2u vs %2u\n", (unsigned)stepper, (unsigned)stepperLine);
+  printf("  sparse stepper %2u vs %2u (one face)\n", (unsigned)sparse, (unsigned)strlen("S,0,0,0,0,90,0,0,0,0,0\r\n"));
+  printf("  4-joint pose   %2u vs %2u, 1 reply vs 4\n", (unsigned)poseFrame, (unsigned)poseLines);
+
+  CHECK(servo <= servoLine);
+  CHECK(stepper < stepperLine);
+  CHECK(poseFrame < poseLines);
+}
+
+int main()
+{
+  testCrc();
+  testRoundTrips();
+  testCorruption();
+  reportWireSize();
+  return TEST_RESULT();
+}
@@ -0,0 +1,147 @@
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "test_check.h"
+#include "link_rx.h"
+
+// ByteRing and LineAssembler with the input split at every byte, overflows, and the ring across threads
+
+static const char *stream = "OK\r\nERROR\r\n\r\nA,1,105,10\nOK\r\n";
+static const char *expected[] = {"OK", "ERROR", "", "A,1,105,10", "OK"};
+
+// Push `chunks` through the ring and the assembler, one chunk at a time
+static std::vector<std::string> assemble(const std::vector<std::string> &chunks, ByteRing &ring, LineAssembler &lines)
+{
+  std::vector<std::string> out;
+  for (const std::string &chunk : chunks)
+  {
+    for (char c : chunk)
+      ring.push((uint8_t)c);
+    int byte;
+    while ((byte = ring.pop()) >= 0)
+    {
+      if (lines.feed((uint8_t)byte))
+        out.push_back(std::string(lines.line(), lines.length()));
+    }
+  }
+  return out;
+}
+
+static void testSplits()
+{
+  std::string all = stream;
+  size_t count = sizeof(expected) / sizeof(expected[0]);
+
+  // Every split point, and every pair of split points
+  for (size_t i = 0; i <= all.size(); i++)
+  {
+    for (size_t j = i; j <= all.size(); j++)
+    {
+      ByteRing ring;
+      LineAssembler lines;
+      std::vector<std::string> out = assemble({all.substr(0, i), all.substr(i, j - i), all.substr(j)}, ring, lines);
+      bool same = out.size() == count;
+      for (size_t k = 0; same && k < count; k++)
+        same = out[k] == expected[k];
+      CHECK(same);
+      if (!same)
+        return;
+    }
+  }
+
+  // One byte at a time
+  std::vector<std::string> bytes;
+  for (char c : all)
+    bytes.push_back(std::string(1, c));
+  ByteRing ring;
+  LineAssembler lines;
+  CHECK_EQ(assemble(bytes, ring, lines).size(), count);
+}
+
+static void testOverflow()
+{
+  ByteRing ring;
+  LineAssembler lines;
+  std::string tooLong(LINK_MAX_LINE + 10, 'x');
+  std::vector<std::string> out = assemble({tooLong.substr(0, 30), tooLong.substr(30) + "\r\n", "OK", "\r\n"}, ring, lines);
+  // The long line is dropped, not returned truncated, and the next one is intact
+  CHECK_EQ(out.size(), 1);
+  CHECK(out.size() == 1 && out[0] == "OK");
+  CHECK_EQ(lines.overflows, 1);
+
+  // The longest line that fits
+  std::string longest(LINK_MAX_LINE - 1, 'y');
+  out = assemble({longest + "\n"}, ring, lines);
+  CHECK(out.size() == 1 && out[0] == longest);
+}
+
+static void testRing()
+{
+  ByteRing ring;
+  for (int i = 0; i < LINK_RX_RING_SIZE; i++)
+    CHECK(ring.push((uint8_t)i));
+  CHECK(!ring.push(0));
+  CHECK_EQ(ring.dropped, 1);
+  CHECK_EQ(ring.available(), LINK_RX_RING_SIZE);
+  CHECK_EQ(ring.pop(), 0);
+  ring.clear();
+  CHECK_EQ(ring.available(), 0);
+  CHECK_EQ(ring.pop(), -1);
+
+  // Past the 16-bit index wrap, in uneven bursts
+  uint32_t pushed = 0;
+  uint32_t popped = 0;
+  bool ordered = true;
+  while (pushed < 200000)
+  {
+    for (int i = 0; i < 37; i++)
+      ring.push((uint8_t)pushed++);
+    int byte;
+    for (int i = 0; i < 37 && (byte = ring.pop()) >= 0; i++)
+      ordered = ordered && byte == (uint8_t)popped++;
+  }
+  CHECK(ordered);
+  CHECK_EQ(ring.dropped, 1);
+}
+
+static void testThreads()
+{
+  // The UART task and the link reader run on different cores on the device
+  ByteRing ring;
+  const uint32_t total = 200000;
+  std::thread producer([&ring] {
+    // A full ring counts as dropped, here the byte is pushed again
+    for (uint32_t i = 0; i < total; i++)
+    {
+      while (!ring.push((uint8_t)(i * 7)))
+        std::this_thread::yield();
+    }
+  });
+
+  uint32_t received = 0;
+  bool ordered = true;
+  while (received < total)
+  {
+    int byte = ring.pop();
+    if (byte < 0)
+    {
+      std::this_thread::yield();
+      continue;
+    }
+    ordered = ordered && byte == (uint8_t)(received * 7);
+    received++;
+  }
+  producer.join();
+  CHECK(ordered);
+  CHECK_EQ(ring.available(), 0);
+}
+
+int main()
+{
+  testSplits();
+  testOverflow();
+  testRing();
+  testThreads();
+  return TEST_RESULT();
+}
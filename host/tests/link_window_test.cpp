@@ -0,0 +1,233 @@
+#include <Arduino.h>
+#include <driver/uart.h>
+#include <set>
+#include <vector>
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "link_window.h"
+#include "sim_arduino.h"
+
+// The command window against the simulated Arduino with latency and loss:
+// every command runs exactly once, and commands/s next to one command at a time.
+// Tickets kept past a wrap of the sequence number, and the done ticket.
+
+#define TEST_BAUD 115200
+#define TEST_COMMANDS 200
+
+static void uartWrite(const uint8_t *buf, size_t len, void *ctx)
+{
+  uart_write_bytes(UART_NUM_2, buf, len);
+}
+
+static int uartRead(void *ctx)
+{
+  uint8_t byte;
+  return uart_read_bytes(UART_NUM_2, &byte, 1, 0) == 1 ? byte : -1;
+}
+
+static unsigned long uartNow(void *ctx)
+{
+  return millis();
+}
+
+struct WindowRun
+{
+  uint32_t acked;
+  uint32_t failed;
+  uint32_t executed;
+  uint32_t reordered;
+  uint32_t retransmits;
+  double commandsPerSecond;
+};
+
+// `depth` commands outstanding at most, 1 is the blocking send-and-wait
+static WindowRun runCommands(uint8_t depth, double loss, uint32_t latencyMs)
+{
+  SimArduinoConfig config;
+  config.baud = TEST_BAUD;
+  config.lossRate = loss;
+  config.latencyUs = latencyMs * 1000;
+  config.seed = 7;
+  SimArduino arduino(config);
+  hostUartAttach(&arduino);
+
+  LinkTransport transport = {uartWrite, uartRead, uartNow, nullptr};
+  LinkWindow window(transport, TIMEOUT_MS_SERVO, LINK_MAX_RETRIES);
+
+  LinkTicket tickets[LINK_WINDOW_SIZE];
+  uint8_t ticketCount = 0;
+  WindowRun run = {};
+  uint32_t submitted = 0;
+  uint64_t startUs = hostNowUs();
+
+  while (run.acked + run.failed < TEST_COMMANDS)
+  {
+    // Short moves, so the link and not the arm sets the pace
+    while (submitted < TEST_COMMANDS && ticketCount < depth && !window.full())
+    {
+      uint8_t payload[LINK_MAX_PAYLOAD];
+      uint8_t length = linkPackServo(payload, submitted % 4, 90 + submitted % 2, 0);
+      tickets[ticketCount++] = window.submit(LINK_OP_SERVO, payload, length);
+      submitted++;
+    }
+
+    hostAdvanceUs(100);
+    window.poll();
+    for (int i = 0; i < ticketCount;)
+    {
+      LinkTicketStatus status = window.check(tickets[i]);
+      if (status == LINK_TICKET_PENDING)
+      {
+        i++;
+        continue;
+      }
+      if (status == LINK_TICKET_ACKED)
+        run.acked++;
+      else
+        run.failed++;
+      tickets[i] = tickets[--ticketCount];
+    }
+  }
+
+  // Execution order on the Arduino against the submit order
+  run.executed = arduino.commands().size();
+  int previousJoint = -1;
+  for (const SimCommand &command : arduino.commands())
+  {
+    int joint = command.text[2] - '0';
+    if (previousJoint >= 0 && joint != (previousJoint + 1) % 4)
+      run.reordered++;
+    previousJoint = joint;
+  }
+  run.retransmits = window.retransmits;
+  run.commandsPerSecond = TEST_COMMANDS / ((hostNowUs() - startUs) / 1e6);
+
+  // Let the late replies land before the next run
+  hostAdvanceUs(1000000);
+  window.poll();
+  hostUartAttach(nullptr);
+  return run;
+}
+
+// A peer that acks whatever it is told to, no time passes
+static std::vector<uint8_t> ackBytes;
+static size_t ackRead = 0;
+static unsigned long fakeMs = 0;
+
+static void fakeWrite(const uint8_t *buf, size_t len, void *ctx) {}
+
+static int fakeRead(void *ctx)
+{
+  return ackRead < ackBytes.size() ? ackBytes[ackRead++] : -1;
+}
+
+static unsigned long fakeNow(void *ctx)
+{
+  return fakeMs;
+}
+
+static void ack(LinkTicket ticket)
+{
+  uint8_t frame[LINK_MAX_FRAME];
+  uint8_t len = linkEncodeFrame(frame, (uint8_t)ticket, LINK_OP_ACK, nullptr, 0);
+  ackBytes.insert(ackBytes.end(), frame, frame + len);
+}
+
+static void testTickets()
+{
+  LinkTransport transport = {fakeWrite, fakeRead, fakeNow, nullptr};
+  LinkWindow window(transport, TIMEOUT_MS_SERVO, LINK_MAX_RETRIES);
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  uint8_t length = linkPackServo(payload, 0, 90, 0);
+
+  // A ticket nobody read, kept while 256 more commands go through
+  LinkTicket stale = window.submit(LINK_OP_SERVO, payload, length);
+  CHECK(stale >= 0);
+  ack(stale);
+  window.poll();
+  CHECK(window.check(stale) == LINK_TICKET_ACKED);
+  LinkTicket ticket = stale;
+  for (int i = 0; i < 256; i++)
+  {
+    ticket = window.submit(LINK_OP_SERVO, payload, length);
+    if (i < 255)
+    {
+      ack(ticket);
+      window.poll();
+      CHECK(window.check(ticket) == LINK_TICKET_ACKED);
+    }
+  }
+  // Same sequence number on the wire, still another command
+  CHECK_EQ((uint8_t)ticket, (uint8_t)stale);
+  CHECK(ticket != stale);
+  CHECK(window.check(stale) == LINK_TICKET_UNKNOWN);
+  CHECK(window.check(ticket) == LINK_TICKET_PENDING);
+  window.release(stale);
+  CHECK(window.check(ticket) == LINK_TICKET_PENDING);
+  ack(ticket);
+  window.poll();
+  CHECK(window.check(ticket) == LINK_TICKET_ACKED);
+
+  // Tickets wrap to 0 with the sequence numbers still in step
+  for (int i = 0; i < LINK_TICKET_MASK; i++)
+  {
+    ticket = window.reserve();
+    window.finish(ticket, true);
+    window.check(ticket);
+  }
+  ticket = window.submit(LINK_OP_SERVO, payload, length);
+  CHECK(ticket >= 0 && ticket <= LINK_TICKET_MASK);
+  ack(ticket);
+  window.poll();
+  CHECK(window.check(ticket) == LINK_TICKET_ACKED);
+
+  // The done ticket reads as acked with every slot taken, and takes none
+  while (!window.full())
+    window.submit(LINK_OP_SERVO, payload, length);
+  CHECK(window.check(LINK_TICKET_DONE) == LINK_TICKET_ACKED);
+  CHECK(window.check(LINK_TICKET_DONE) == LINK_TICKET_ACKED);
+  window.release(LINK_TICKET_DONE);
+  CHECK_EQ(window.outstanding(), LINK_WINDOW_SIZE);
+  CHECK(window.check(LINK_TICKET_INVALID) == LINK_TICKET_UNKNOWN);
+}
+
+int main()
+{
+  testTickets();
+
+  uart_config_t uartConfig = {};
+  uartConfig.baud_rate = TEST_BAUD;
+  uart_driver_install(UART_NUM_2, 4096, 0, 1024, nullptr, 0);
+  uart_param_config(UART_NUM_2, &uartConfig);
+
+  printf("%d servo commands at %d baud, commands/s:\n", TEST_COMMANDS, TEST_BAUD);
+  printf("  %-18s %10s %10s %12s\n", "link", "blocking", "window", "retransmits");
+
+  const double losses[] = {0, 0, 0.05, 0.05};
+  const uint32_t latencies[] = {0, 10, 0, 10};
+  for (int i = 0; i < 4; i++)
+  {
+    WindowRun blocking = runCommands(1, losses[i], latencies[i]);
+    WindowRun pipelined = runCommands(LINK_WINDOW_SIZE, losses[i], latencies[i]);
+
+    char name[32];
+    snprintf(name, sizeof(name), "%.0f%% loss, %u ms", losses[i] * 100, latencies[i]);
+    printf("  %-18s %10.1f %10.1f %12u\n", name, blocking.commandsPerSecond, pipelined.commandsPerSecond,
+           pipelined.retransmits);
+    if (pipelined.reordered)
+      printf("  %-18s %u commands ran out of submit order after a loss\n", "", pipelined.reordered);
+
+    // Acked exactly once, a retransmission is acked without running again
+    CHECK_EQ(blocking.acked, TEST_COMMANDS);
+    CHECK_EQ(blocking.executed, TEST_COMMANDS);
+    CHECK_EQ(pipelined.acked, TEST_COMMANDS);
+    CHECK_EQ(pipelined.executed, TEST_COMMANDS);
+    if (losses[i] == 0)
+      CHECK_EQ(pipelined.reordered, 0);
+    CHECK(pipelined.commandsPerSecond >= blocking.commandsPerSecond);
+    if (latencies[i])
+      CHECK(pipelined.commandsPerSecond > 1.5 * blocking.commandsPerSecond);
+  }
+  return TEST_RESULT();
+}
@@ -0,0 +1,126 @@
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <Arduino.h>
+#include "test_check.h"
+#include "log_histogram.h"
+#include "link_stats.h"
+
+// Bucket bounds, percentiles, concurrent records, the JSON report, and the cost of record()
+
+#define BENCH_RECORDS 10000000
+#define RECORD_BUDGET_NS 100
+
+static void testBuckets()
+{
+  CHECK_EQ(LogHistogram::bucketFor(0), 0);
+  CHECK_EQ(LogHistogram::bucketFor(1), 1);
+  CHECK_EQ(LogHistogram::bucketFor(2), 2);
+  CHECK_EQ(LogHistogram::bucketFor(3), 2);
+  CHECK_EQ(LogHistogram::bucketFor(4), 3);
+  CHECK_EQ(LogHistogram::bucketFor(UINT32_MAX), LOG_HISTOGRAM_BUCKETS - 1);
+  CHECK_EQ(LogHistogram::bucketUpper(LOG_HISTOGRAM_BUCKETS - 1), UINT32_MAX);
+
+  // Every bucket ends where the next one starts
+  for (uint8_t bucket = 0; bucket < LOG_HISTOGRAM_BUCKETS - 1; bucket++)
+  {
+    uint32_t upper = LogHistogram::bucketUpper(bucket);
+    CHECK_EQ(LogHistogram::bucketFor(upper), bucket);
+    CHECK_EQ(LogHistogram::bucketFor(upper + 1), bucket + 1);
+  }
+}
+
+static void testPercentiles()
+{
+  LogHistogram hist;
+  CHECK_EQ(hist.count(), 0);
+  CHECK_EQ(hist.percentile(50), 0);
+
+  for (uint32_t value = 1; value <= 1000; value++)
+    hist.record(value);
+  CHECK_EQ(hist.count(), 1000);
+  CHECK_EQ(hist.max(), 1000);
+
+  // An upper bound, less than twice the exact value, and never above the maximum
+  const uint8_t pcts[] = {1, 50, 90, 99, 100};
+  for (uint8_t pct : pcts)
+  {
+    uint32_t exact = pct * 10;
+    uint32_t bound = hist.percentile(pct);
+    CHECK(bound >= exact);
+    CHECK(bound < 2 * exact);
+    CHECK(bound <= hist.max());
+  }
+  CHECK_EQ(hist.percentile(100), 1000);
+
+  // A single slow outlier shows in max and p100 only
+  LogHistogram rtt;
+  for (int i = 0; i < 999; i++)
+    rtt.record(3000);
+  rtt.record(2000000);
+  CHECK_EQ(rtt.percentile(99), 4095);
+  CHECK_EQ(rtt.percentile(100), 2000000);
+
+  hist.reset();
+  CHECK_EQ(hist.count(), 0);
+  CHECK_EQ(hist.max(), 0);
+}
+
+static void testConcurrentRecords()
+{
+  LogHistogram hist;
+  const int threads = 4;
+  const uint32_t perThread = 100000;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; t++)
+  {
+    workers.emplace_back([&hist, t, perThread] {
+      for (uint32_t i = 0; i < perThread; i++)
+        hist.record(i * threads + t);
+    });
+  }
+  for (std::thread &worker : workers)
+    worker.join();
+
+  CHECK_EQ(hist.count(), threads * perThread);
+  CHECK_EQ(hist.max(), threads * perThread - 1);
+}
+
+static void testJson()
+{
+  LogHistogram hist;
+  hist.record(0);
+  hist.record(5);
+  hist.record(6);
+  String json;
+  appendHistogram(json, "servo", hist);
+  CHECK(json == "\"servo\":{\"count\":3,\"p50\":6,\"p90\":6,\"p99\":6,\"max\":6,\"buckets\":{\"0\":1,\"7\":2}}");
+}
+
+static void benchRecord()
+{
+  LogHistogram hist;
+  uint32_t value = 12345;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < BENCH_RECORDS; i++)
+  {
+    // Round trip times spread over several buckets
+    value = value * 1103515245 + 12345;
+    hist.record(value >> 12);
+  }
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_RECORDS;
+
+  printf("record(): %.1f ns per call on this host (budget %d ns)\n", ns, RECORD_BUDGET_NS);
+  CHECK_EQ(hist.count(), BENCH_RECORDS);
+  CHECK(ns < RECORD_BUDGET_NS);
+}
+
+int main()
+{
+  testBuckets();
+  testPercentiles();
+  testConcurrentRecords();
+  testJson();
+  benchRecord();
+  return TEST_RESULT();
+}
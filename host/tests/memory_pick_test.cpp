@@ -0,0 +1,97 @@
+#include <algorithm>
+#include <vector>
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "sim_game.h"
+
+// The memory game over every layout of three pairs on the 2x3 board, picking
+// by arm travel against the random picker it replaced: mean and p95 game time
+
+extern bool memoryRandomPick;
+
+#define LAYOUTS 90
+#define RANDOM_RUNS 5 // the random picker draws from millis(), each run starts at another time
+
+struct PickResult
+{
+  std::vector<double> seconds;
+  uint32_t unfinished = 0;
+};
+
+static double mean(const std::vector<double> &values)
+{
+  double sum = 0;
+  for (double value : values)
+    sum += value;
+  return sum / values.size();
+}
+
+static double p95(std::vector<double> values)
+{
+  std::sort(values.begin(), values.end());
+  return values[(values.size() * 95 + 99) / 100 - 1];
+}
+
+static void play(const SimGame &game, const int layout[6], uint32_t seed, PickResult &pick)
+{
+  SimMemoryWorld world(seed, layout);
+  SimGameResult result;
+  SimOptions options;
+  if (!simPlayGame(game, world, options, result) || result.armGaveUp)
+  {
+    pick.unfinished++;
+    return;
+  }
+  pick.seconds.push_back(result.durationUs / 1e6);
+}
+
+int main()
+{
+  SimArduinoConfig config;
+  config.baud = ARDUINO_LINK_BAUD;
+  simLink(config);
+
+  const SimGame *game = simFindGame("memory");
+  CHECK(game != nullptr);
+  if (!game)
+    return TEST_RESULT();
+
+  PickResult travel;
+  PickResult random;
+  int layout[6] = {0, 0, 1, 1, 2, 2};
+  int layouts = 0;
+  do
+  {
+    layouts++;
+    memoryRandomPick = false;
+    play(*game, layout, layouts, travel);
+
+    memoryRandomPick = true;
+    for (int run = 0; run < RANDOM_RUNS; run++)
+    {
+      // Move millis() on by a few ms, so the picks fall elsewhere
+      hostAdvanceUs((1 + layouts * 7 + run * 13) % 29 * 1000);
+      play(*game, layout, layouts, random);
+    }
+  } while (std::next_permutation(layout, layout + 6));
+  memoryRandomPick = false;
+
+  CHECK_EQ(layouts, LAYOUTS);
+  CHECK_EQ(travel.unfinished, 0);
+  CHECK_EQ(random.unfinished, 0);
+  CHECK_EQ(travel.seconds.size(), LAYOUTS);
+  CHECK_EQ(random.seconds.size(), LAYOUTS * RANDOM_RUNS);
+  if (travel.seconds.empty() || random.seconds.empty())
+    return TEST_RESULT();
+
+  printf("%d layouts      games   mean s   p95 s   worst s\n", layouts);
+  printf("  travel picker  %5u   %6.1f   %5.1f   %7.1f\n", (unsigned)travel.seconds.size(), mean(travel.seconds),
+         p95(travel.seconds), *std::max_element(travel.seconds.begin(), travel.seconds.end()));
+  printf("  random picker  %5u   %6.1f   %5.1f   %7.1f\n", (unsigned)random.seconds.size(), mean(random.seconds),
+         p95(random.seconds), *std::max_element(random.seconds.begin(), random.seconds.end()));
+
+  CHECK(mean(travel.seconds) < mean(random.seconds));
+  CHECK(p95(travel.seconds) <= p95(random.seconds));
+  return TEST_RESULT();
+}
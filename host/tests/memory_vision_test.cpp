@@ -0,0 +1,77 @@
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "sim_game.h"
+
+// The memory game with the board read overlapping the arm move, against the
+// arm standing still until the read is back, over a range of mock vision
+// latencies: game time per card turned
+
+extern bool memoryOverlapRead;
+
+#define SEEDS 10
+#define CAPTURE_MS 100
+
+struct ReadResult
+{
+  uint64_t us = 0;
+  uint32_t reads = 0;
+};
+
+static ReadResult play(const SimGame &game, bool overlap, uint32_t uploadMs)
+{
+  ReadResult total;
+  memoryOverlapRead = overlap;
+  for (uint32_t seed = 1; seed <= SEEDS; seed++)
+  {
+    SimWorld *world = simMakeWorld("memory", seed);
+    SimGameResult result;
+    SimOptions options;
+    options.vision.captureMs = CAPTURE_MS;
+    options.vision.uploadMs = uploadMs;
+    options.vision.seed = seed;
+    CHECK(simPlayGame(game, *world, options, result));
+    CHECK_EQ(result.armGaveUp, 0);
+    total.us += result.durationUs;
+    total.reads += result.uploads;
+    delete world;
+  }
+  memoryOverlapRead = true;
+  return total;
+}
+
+int main()
+{
+  SimArduinoConfig config;
+  config.baud = ARDUINO_LINK_BAUD;
+  simLink(config);
+
+  const SimGame *game = simFindGame("memory");
+  CHECK(game != nullptr);
+  if (!game)
+    return TEST_RESULT();
+
+  const uint32_t uploads[] = {150, 300, 600, 1200, 2400};
+  printf("%s link, capture %u ms, %d games each\n", ARDUINO_LINK_BINARY ? "binary" : "ASCII", CAPTURE_MS, SEEDS);
+  printf("  upload ms   reads   arm waits s/read   overlapped s/read   saved\n");
+  double lastSavedMs = 0;
+  for (uint32_t uploadMs : uploads)
+  {
+    ReadResult still = play(*game, false, uploadMs);
+    ReadResult overlap = play(*game, true, uploadMs);
+    // The picks do not depend on time, both games turn the same cards
+    CHECK_EQ(overlap.reads, still.reads);
+    if (!still.reads || overlap.reads != still.reads)
+      continue;
+
+    double stillS = still.us / 1e6 / still.reads;
+    double overlapS = overlap.us / 1e6 / overlap.reads;
+    printf("  %9u   %5u   %16.2f   %17.2f   %4.0f ms\n", uploadMs, still.reads, stillS, overlapS,
+           (stillS - overlapS) * 1000);
+    CHECK(overlap.us < still.us);
+    // The more the upload takes, the more of the next move it hides
+    CHECK((stillS - overlapS) * 1000 >= lastSavedMs - 1);
+    lastSavedMs = (stillS - overlapS) * 1000;
+  }
+  return TEST_RESULT();
+}
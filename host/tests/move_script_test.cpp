@@ -0,0 +1,252 @@
+#include <string>
+#include <vector>
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "game_utils.h"
+#include "move_script.h"
+#include "sim_game.h"
+
+// The move scripts of the memory, XO and cups games against the command
+// stream the hand-written state machines sent before them. Built without
+// the planner, so the games run their scripts.
+//
+// On the ASCII link the stream must be byte for byte the old one, one
+// "A,joint,angle,overshoot" line per step. On the binary link the steps are
+// the same, in the same order, but a script goes out as one sequential POSE
+// frame instead of one SERVO frame per step: that difference is intended.
+
+extern void startMoveOperation(int from, int to);
+extern bool updateArmMove();
+extern void getAnglesForPosition(int idx, int angles[4]);
+extern void setupServoMoveSequence(int baseAngle, int shoulderAngle, int elbowAngle, int wristAngle, int gripAngle);
+extern bool processServoMoveStep();
+extern void getAnglesForCell(int x, int y, int angles[4]);
+extern void getAnglesForStack(int index, int angles[4]);
+extern void setupGripCupPose(int cup);
+extern void setupDropCupPose(int cup);
+extern void setupRetreatPose();
+extern bool cupsExecutePose();
+extern void getAnglesForCup(int cupPosition, int angles[4]);
+
+// Per game constants, as in the game files
+#define MEMORY_GRIP_OPEN 120
+#define MEMORY_GRIP_CLOSED 60
+#define MEMORY_SHOULDER 105
+#define XO_GRIP_OPEN 110
+#define XO_GRIP_CLOSED 80
+#define XO_SHOULDER 90
+#define CUPS_GRIP_OPEN 130
+#define CUPS_GRIP_CLOSED 90
+#define CUPS_SHOULDER 80
+
+#if ENABLE_ARM_PLANNER
+#error "move_script_test needs the sketch built with ENABLE_ARM_PLANNER=0"
+#endif
+
+// MOVE_SCRIPT() refuses these at compile time
+constexpr MoveStep badJoint[] = {stepTo(ARM_TIMING_JOINTS, 90)};
+constexpr MoveStep badAngle[] = {stepTo(BASE, 200)};
+constexpr MoveStep badOffset[] = {stepToTarget(SHOULDER, 100)};
+constexpr MoveStep tooLong[] = {stepTo(BASE, 90), stepTo(BASE, 90), stepTo(BASE, 90), stepTo(BASE, 90),
+                                stepTo(BASE, 90), stepTo(BASE, 90), stepTo(BASE, 90), stepTo(BASE, 90),
+                                stepTo(BASE, 90)};
+constexpr MoveStep settled[] = {stepTo(BASE, 90), stepTo(BASE, 90), stepTo(BASE, 90), stepTo(BASE, 90, 0, 100),
+                                stepTo(BASE, 90), stepTo(BASE, 90), stepTo(BASE, 90), stepTo(BASE, 90),
+                                stepTo(BASE, 90)};
+static_assert(!moveScriptValid(badJoint), "joint out of range");
+static_assert(!moveScriptValid(badAngle), "angle out of range");
+static_assert(!moveScriptValid(badOffset), "offset out of range");
+static_assert(LINK_POSE_MAX_STEPS < 9 && !moveScriptValid(tooLong), "more steps than a pose command holds");
+static_assert(moveScriptValid(settled), "a settle time starts a new pose command");
+
+MOVE_SCRIPT(twoSegments,
+            stepTo(GRIP, 100),
+            stepToTarget(SHOULDER, 10, 5, 250),
+            stepToTarget(BASE),
+            stepToTarget(ELBOW, -20));
+
+static std::string line(int joint, int angle, int overShoot = 0)
+{
+  return "A," + std::to_string(joint) + "," + std::to_string(angle) + "," + std::to_string(overShoot);
+}
+
+static void testSegments()
+{
+  ArmGoal target;
+  armGoalBegin(target);
+  armGoalSet(target, SHOULDER, 60);
+  armGoalSet(target, ELBOW, 120);
+
+  LinkPose pose;
+  uint16_t settleMs;
+  uint8_t next = moveScriptSegment(twoSegments, 4, 0, target, pose, settleMs);
+  CHECK_EQ(next, 2);
+  CHECK_EQ(settleMs, 250);
+  CHECK(pose.count == 2 && pose.motor[1] == SHOULDER && pose.angle[1] == 70 && pose.overShoot[1] == 5);
+
+  // The base has no target angle, its step is left out
+  next = moveScriptSegment(twoSegments, 4, next, target, pose, settleMs);
+  CHECK_EQ(next, 4);
+  CHECK_EQ(settleMs, 0);
+  CHECK(pose.count == 1 && pose.motor[0] == ELBOW && pose.angle[0] == 100);
+}
+
+struct Replay
+{
+  const char *name;
+  int scripts;                     // script runs the sequence is made of
+  std::vector<std::string> before; // what the state machines sent, one line per step
+};
+
+// Run one sequence of the game and compare what the Arduino received with `replay.before`
+template <typename Start, typename Update>
+static void replay(SimArduino &arduino, const Replay &replay, Start start, Update update)
+{
+  // The state machines had no arm state cache, nothing they sent was dropped for being where the arm already was
+  invalidateArmState();
+  arduino.clearLog();
+  uint32_t bytesOut = hostUartStats().bytesOut;
+  start();
+  while (!update())
+    hostAdvanceUs(1000);
+  bytesOut = hostUartStats().bytesOut - bytesOut;
+
+  const std::vector<SimCommand> &commands = arduino.commands();
+  std::vector<std::string> steps = simJointSteps(commands);
+  bool same = steps == replay.before;
+  CHECK(same);
+  if (!same)
+  {
+    printf("  %s differs:\n", replay.name);
+    for (size_t k = 0; k < steps.size() || k < replay.before.size(); k++)
+      printf("    %-14s %s\n", k < replay.before.size() ? replay.before[k].c_str() : "-",
+             k < steps.size() ? steps[k].c_str() : "-");
+  }
+
+  uint32_t lineBytes = 0;
+  for (const std::string &step : replay.before)
+    lineBytes += step.size() + 2;
+  if (ARDUINO_LINK_BINARY)
+  {
+    CHECK_EQ(commands.size(), replay.scripts);
+    for (const SimCommand &command : commands)
+      CHECK_EQ(command.op, LINK_OP_POSE);
+  }
+  else
+  {
+    // One line per step, "\r\n" terminated, nothing else on the wire
+    CHECK_EQ(commands.size(), replay.before.size());
+    CHECK_EQ(bytesOut, lineBytes);
+  }
+  printf("  %-28s %2u steps  %2u commands  %4u bytes (%u as lines)\n", replay.name, (unsigned)steps.size(),
+         (unsigned)commands.size(), bytesOut, lineBytes);
+}
+
+// Grab (GRAB_OPEN_GRIP .. GRAB_CLOSE_GRIP) and release (RELEASE_SHOULDER_DEFAULT .. RELEASE_OPEN_GRIP)
+static std::vector<std::string> memoryBefore(int from, int to)
+{
+  int src[4];
+  int dest[4];
+  getAnglesForPosition(from, src);
+  getAnglesForPosition(to, dest);
+  std::vector<std::string> lines = {
+      line(GRIP, MEMORY_GRIP_OPEN), line(SHOULDER, MEMORY_SHOULDER, 10), line(BASE, src[0]),
+      line(WRIST, src[3]),          line(ELBOW, src[2]),                 line(SHOULDER, src[1]),
+      line(GRIP, MEMORY_GRIP_CLOSED),
+      line(SHOULDER, MEMORY_SHOULDER, 10), line(ELBOW, 140), line(BASE, dest[0]), line(WRIST, 45),
+      line(ELBOW, dest[2])};
+  if (to != 8)
+  {
+    const std::vector<std::string> place = {line(WRIST, 55), line(SHOULDER, dest[1] + 10), line(WRIST, dest[3]),
+                                            line(SHOULDER, dest[1])};
+    lines.insert(lines.end(), place.begin(), place.end());
+  }
+  lines.push_back(line(GRIP, MEMORY_GRIP_OPEN));
+  return lines;
+}
+
+// setupServoMoveSequence + processServoMoveStep: shoulder up, base, wrist, elbow, shoulder, grip
+static std::vector<std::string> xoBefore(const int angles[4], int grip)
+{
+  return {line(SHOULDER, XO_SHOULDER, 10), line(BASE, angles[0]),     line(WRIST, angles[3]),
+          line(ELBOW, angles[2]),          line(SHOULDER, angles[1]), line(GRIP, grip)};
+}
+
+static void replayMemory(SimArduino &arduino)
+{
+  const int moves[][2] = {{0, 6}, {6, 3}, {5, 7}, {2, 8}, {7, 8}};
+  for (const int *move : moves)
+  {
+    int from = move[0];
+    int to = move[1];
+    std::string name = "memory " + std::to_string(from) + " -> " + std::to_string(to);
+    Replay expected = {name.c_str(), to == 8 ? 2 : 3, memoryBefore(from, to)};
+    replay(arduino, expected, [from, to] { startMoveOperation(from, to); }, updateArmMove);
+  }
+}
+
+static void replayXO(SimArduino &arduino)
+{
+  const int retreat[4] = {90, 90, 90, 90};
+  for (int k = 0; k < 5; k++)
+  {
+    int piece[4];
+    getAnglesForStack(k, piece);
+    int cell[4];
+    getAnglesForCell(k % 3, (k + 1) % 3, cell);
+
+    std::string name = "xo stack " + std::to_string(k);
+    replay(arduino, {name.c_str(), 1, xoBefore(piece, XO_GRIP_CLOSED)},
+           [&piece] { setupServoMoveSequence(piece[0], piece[1], piece[2], piece[3], XO_GRIP_CLOSED); },
+           processServoMoveStep);
+    name = "xo cell " + std::to_string(k % 3) + "," + std::to_string((k + 1) % 3);
+    replay(arduino, {name.c_str(), 1, xoBefore(cell, XO_GRIP_OPEN)},
+           [&cell] { setupServoMoveSequence(cell[0], cell[1], cell[2], cell[3], XO_GRIP_OPEN); },
+           processServoMoveStep);
+    // The shoulder is already at 90 when its last step comes, the arm state cache drops it
+    std::vector<std::string> retreatLines = xoBefore(retreat, XO_GRIP_OPEN);
+    retreatLines.erase(retreatLines.begin() + 4);
+    replay(arduino, {"xo retreat", 1, retreatLines},
+           [&retreat] { setupServoMoveSequence(retreat[0], retreat[1], retreat[2], retreat[3], XO_GRIP_OPEN); },
+           processServoMoveStep);
+  }
+}
+
+// gripCups, dropCups and retreatArm
+static void replayCups(SimArduino &arduino)
+{
+  for (int cup = 0; cup < 3; cup++)
+  {
+    int angles[4];
+    getAnglesForCup(cup, angles);
+    std::string name = "cups grip " + std::to_string(cup);
+    replay(arduino,
+           {name.c_str(), 1,
+            {line(GRIP, CUPS_GRIP_OPEN), line(BASE, angles[0]), line(WRIST, angles[3]), line(ELBOW, angles[2]),
+             line(SHOULDER, angles[1]), line(GRIP, CUPS_GRIP_CLOSED), line(SHOULDER, angles[1] + 40)}},
+           [cup] { setupGripCupPose(cup); }, cupsExecutePose);
+    name = "cups drop " + std::to_string(cup);
+    replay(arduino, {name.c_str(), 1, {line(SHOULDER, angles[1] + 1), line(GRIP, CUPS_GRIP_OPEN)}},
+           [cup] { setupDropCupPose(cup); }, cupsExecutePose);
+    replay(arduino,
+           {"cups retreat", 1,
+            {line(SHOULDER, CUPS_SHOULDER), line(BASE, 90), line(WRIST, 90), line(ELBOW, 90),
+             line(GRIP, CUPS_GRIP_OPEN)}},
+           [] { setupRetreatPose(); }, cupsExecutePose);
+  }
+}
+
+int main()
+{
+  testSegments();
+
+  SimArduinoConfig config;
+  config.baud = ARDUINO_LINK_BAUD;
+  SimArduino &arduino = simLink(config);
+  printf("%s link, move scripts against the state machines:\n", ARDUINO_LINK_BINARY ? "binary" : "ASCII");
+  replayMemory(arduino);
+  replayXO(arduino);
+  replayCups(arduino);
+  return TEST_RESULT();
+}
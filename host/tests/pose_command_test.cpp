@@ -0,0 +1,108 @@
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "game_utils.h"
+#include "link_stats.h"
+#include "sim_game.h"
+
+// Pose commands as the Arduino receives them: the joints, angles and
+// overshoots that were sent, in order, and the motion time of the steps
+
+static uint64_t motionUs(const std::vector<SimCommand> &commands)
+{
+  uint64_t total = 0;
+  for (const SimCommand &command : commands)
+    total += command.doneUs - command.startUs;
+  return total;
+}
+
+static void resetArm(SimArduino &arduino)
+{
+  for (int joint = 0; joint < ARM_TIMING_JOINTS; joint++)
+    CHECK(sendServoCommand(joint, 90, 0));
+  arduino.clearLog();
+}
+
+int main()
+{
+  SimArduinoConfig config;
+  config.baud = ARDUINO_LINK_BAUD;
+  SimArduino &arduino = simLink(config);
+  resetArm(arduino);
+
+  ArmPose pose;
+  poseBegin(pose);
+  poseAdd(pose, BASE, 120);
+  poseAdd(pose, SHOULDER, 60, 10);
+  poseAdd(pose, ELBOW, 100, -10);
+  CHECK(sendPoseCommand(pose));
+
+  // One POSE frame on the binary link, one line per step on the ASCII one, the same steps either way
+  const std::vector<SimCommand> &commands = arduino.commands();
+  std::vector<std::string> steps = simJointSteps(commands);
+  CHECK_EQ(steps.size(), 3);
+  CHECK(steps.size() == 3 && steps[0] == "A,0,120,0" && steps[1] == "A,1,60,10" && steps[2] == "A,2,100,-10");
+  CHECK_EQ(commands.size(), ARDUINO_LINK_BINARY ? 1 : 3);
+  if (ARDUINO_LINK_BINARY)
+    CHECK(commands.size() == 1 && commands[0].text == "P,65535,0,120,0,1,60,10,2,100,-10");
+  CHECK_EQ(arduino.angle(BASE), 120);
+  CHECK_EQ(arduino.angle(SHOULDER), 60);
+  CHECK_EQ(arduino.angle(ELBOW), 100);
+
+  ArmTimingModel model;
+  for (int joint = 0; joint < ARM_TIMING_JOINTS; joint++)
+    model.setJointAngle(joint, 90);
+  uint32_t sequentialMs = model.poseMs(pose);
+  CHECK_EQ(motionUs(commands), sequentialMs * 1000ULL);
+
+  // Base and wrist together, then the grip
+  resetArm(arduino);
+  ArmPose grouped;
+  poseBegin(grouped, LINK_POSE_GROUPED | 1 << 1);
+  poseAdd(grouped, BASE, 30);
+  poseAdd(grouped, WRIST, 150);
+  poseAdd(grouped, GRIP, 40);
+  CHECK(sendPoseCommand(grouped));
+  steps = simJointSteps(arduino.commands());
+  CHECK(steps.size() == 3 && steps[0] == "A,0,30,0" && steps[1] == "A,3,150,0" && steps[2] == "A,4,40,0");
+  CHECK_EQ(arduino.angle(WRIST), 150);
+  CHECK_EQ(arduino.angle(GRIP), 40);
+
+  for (int joint = 0; joint < ARM_TIMING_JOINTS; joint++)
+    model.setJointAngle(joint, 90);
+  uint32_t groupedMs = model.poseMs(grouped);
+  for (int joint = 0; joint < ARM_TIMING_JOINTS; joint++)
+    model.setJointAngle(joint, 90);
+  uint32_t oneByOneMs = model.servoMs(BASE, 30) + model.servoMs(WRIST, 150) + model.servoMs(GRIP, 40);
+  // The ASCII firmware has no pose command and runs the steps one after the other
+  uint64_t ranUs = motionUs(arduino.commands());
+  CHECK_EQ(ranUs, (ARDUINO_LINK_BINARY ? groupedMs : oneByOneMs) * 1000ULL);
+  CHECK(groupedMs < oneByOneMs);
+
+  printf("%s link: sequential pose %u ms, grouped pose %.0f ms (%u ms one by one)\n",
+         ARDUINO_LINK_BINARY ? "binary" : "ASCII", sequentialMs, ranUs / 1000.0, oneByOneMs);
+
+  // The link is taken, a command that moves nothing is done all the same
+  std::vector<LinkTicket> busy;
+  for (int angle = 100; busy.size() < LINK_WINDOW_SIZE; angle += 10)
+  {
+    LinkTicket ticket = submitServoCommand(BASE, angle, 0);
+    if (ticket == LINK_TICKET_INVALID)
+      break;
+    busy.push_back(ticket);
+  }
+  uint32_t refused = linkStats.busy;
+  CHECK(submitServoCommand(BASE, 20, 0) == LINK_TICKET_INVALID);
+  // The ASCII job refuses it and counts that, the binary window is just full
+  CHECK_EQ(linkStats.busy - refused, ARDUINO_LINK_BINARY ? 0 : 1);
+  LinkTicket elided = submitServoCommand(GRIP, 40, 0);
+  CHECK(elided == LINK_TICKET_DONE);
+  CHECK(pollLinkCommand(elided) == LINK_TICKET_ACKED);
+  for (LinkTicket ticket : busy)
+  {
+    LinkTicketStatus status = LINK_TICKET_PENDING;
+    hostAdvanceUntil([&] { return (status = pollLinkCommand(ticket)) != LINK_TICKET_PENDING; }, HOST_NEVER);
+    CHECK(status == LINK_TICKET_ACKED);
+  }
+  return TEST_RESULT();
+}
@@ -0,0 +1,158 @@
+#include <vector>
+#include "test_check.h"
+#include "retry_policy.h"
+
+// RetryPolicy against a clock the test moves by hand: backoff bounds, give up, defer, reset and the hook
+
+struct HookCall
+{
+  RetryOutcome outcome;
+  uint8_t attempts;
+};
+
+static void recordHook(RetryOutcome outcome, uint8_t attempts, void *ctx)
+{
+  ((std::vector<HookCall> *)ctx)->push_back({outcome, attempts});
+}
+
+// Time from the failure until ready() turns true
+static unsigned long waitedMs(const RetryPolicy &retry, unsigned long &now)
+{
+  unsigned long from = now;
+  while (!retry.ready(now))
+    now++;
+  return now - from;
+}
+
+static void testBackoff()
+{
+  RetryPolicy retry(100, 2000, 10);
+  unsigned long now = 5000;
+  CHECK(retry.ready(now));
+  CHECK_EQ(retry.backoffMs(), 0);
+
+  // Within [delay / 2, delay] and doubling up to the maximum
+  const unsigned long delays[] = {100, 200, 400, 800, 1600, 2000, 2000, 2000, 2000};
+  for (unsigned long delayMs : delays)
+  {
+    CHECK(retry.failure(now));
+    CHECK(!retry.ready(now));
+    unsigned long waited = waitedMs(retry, now);
+    CHECK_EQ(waited, retry.backoffMs());
+    CHECK(waited >= delayMs / 2);
+    CHECK(waited <= delayMs);
+  }
+
+  // A success clears the backoff
+  retry.success(now);
+  CHECK(retry.ready(now));
+  CHECK_EQ(retry.attempts(), 0);
+  CHECK_EQ(retry.backoffMs(), 0);
+  CHECK(retry.failure(now));
+  CHECK(retry.backoffMs() >= 50 && retry.backoffMs() <= 100);
+}
+
+static void testJitter()
+{
+  // The random half differs from one failure to the next
+  RetryPolicy retry(1000, 1000, 255);
+  unsigned long now = 0;
+  unsigned long lowest = 1000;
+  unsigned long highest = 0;
+  for (int i = 0; i < 100; i++)
+  {
+    retry.failure(now);
+    unsigned long backoff = retry.backoffMs();
+    lowest = backoff < lowest ? backoff : lowest;
+    highest = backoff > highest ? backoff : highest;
+    retry.success(now);
+  }
+  CHECK(lowest >= 500 && lowest < 600);
+  CHECK(highest > 900 && highest <= 1000);
+}
+
+static void testGiveUp()
+{
+  std::vector<HookCall> calls;
+  RetryPolicy retry(100, 2000, 3, recordHook, &calls);
+  unsigned long now = 0;
+
+  CHECK(retry.failure(now));
+  waitedMs(retry, now);
+  CHECK(retry.failure(now));
+  waitedMs(retry, now);
+  CHECK(!retry.gaveUp());
+  CHECK(!retry.failure(now));
+  CHECK(retry.gaveUp());
+  CHECK_EQ(retry.attempts(), 3);
+
+  // Not ready however long the caller waits
+  CHECK(!retry.ready(now));
+  CHECK(!retry.ready(now + 60000));
+  CHECK(!retry.ready(now + 0x7FFFFFFF));
+
+  CHECK_EQ(calls.size(), 3);
+  CHECK(calls.size() == 3 && calls[0].outcome == RETRY_FAILED && calls[0].attempts == 1);
+  CHECK(calls.size() == 3 && calls[1].outcome == RETRY_FAILED && calls[1].attempts == 2);
+  CHECK(calls.size() == 3 && calls[2].outcome == RETRY_GAVE_UP && calls[2].attempts == 3);
+
+  retry.reset();
+  CHECK(!retry.gaveUp());
+  CHECK(retry.ready(now));
+  CHECK_EQ(retry.attempts(), 0);
+
+  // The Rubik stepper policy: a single attempt
+  RetryPolicy once(100, 2000, 1);
+  CHECK(!once.failure(0));
+  CHECK(once.gaveUp());
+}
+
+static void testDefer()
+{
+  std::vector<HookCall> calls;
+  RetryPolicy retry(100, 2000, 2, recordHook, &calls);
+  unsigned long now = 1000;
+
+  // A busy link waits baseMs, without using up an attempt or calling the hook
+  for (int i = 0; i < 10; i++)
+  {
+    retry.defer(now);
+    CHECK(!retry.ready(now));
+    CHECK(!retry.ready(now + 99));
+    CHECK(retry.ready(now + 100));
+    now += 100;
+  }
+  CHECK_EQ(retry.attempts(), 0);
+  CHECK(!retry.gaveUp());
+  CHECK_EQ(calls.size(), 0);
+
+  // The success after failures reports how many attempts it took
+  retry.failure(now);
+  now += 2000;
+  retry.success(now);
+  CHECK(calls.size() == 2 && calls[1].outcome == RETRY_SUCCEEDED && calls[1].attempts == 2);
+}
+
+static void testClockWrap()
+{
+  // millis() wraps after 49 days
+  RetryPolicy retry(100, 2000, 5);
+  unsigned long now = (unsigned long)-50;
+  retry.defer(now);
+  CHECK(!retry.ready(now + 99));
+  CHECK(retry.ready(now + 100));
+
+  retry.failure(now);
+  CHECK(!retry.ready(now + retry.backoffMs() - 1));
+  CHECK(retry.ready(now + retry.backoffMs()));
+}
+
+int main()
+{
+  testBackoff();
+  testJitter();
+  testGiveUp();
+  testDefer();
+  testClockWrap();
+  return TEST_RESULT();
+}
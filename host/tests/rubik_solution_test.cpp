@@ -0,0 +1,133 @@
+#include <string.h>
+#include <vector>
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "game_utils.h"
+#include "sim_game.h"
+
+// Recorded cube solutions played the way the baseline sketch did (one dense
+// stepper command per move, 50 ms apart) and the way the game loop does
+// (sparse commands, opposite faces together, polled once per loop): wire
+// bytes, simulated time, and the same turns for every face
+
+extern int moves[30];
+extern uint8_t movesCount;
+void queueSolution();
+bool runTurns();
+
+#define LOOP_US 1000 // a game loop iteration, as simPlayGame() runs it
+
+// face * 10 + 1 (90), 2 (180) or 3 (-90), faces U R F D L are 1 to 5
+static const std::vector<std::vector<int>> solutions = {
+    {11, 43, 22, 51, 33, 12, 41, 23, 52, 31, 13, 42, 21, 53, 32, 11, 43, 52, 21, 33},
+    {21, 51, 13, 41, 32, 22, 53, 11, 43, 31, 23, 52, 12, 42, 33},
+    {31, 12, 33},
+    {12, 42, 22, 52, 11, 41, 23, 51, 32, 13, 43, 21, 53, 31, 12, 41, 22, 33, 52, 21, 13, 42},
+};
+
+// Turns of every face in the order the Arduino ran them
+class FaceTurns : public SimArduinoListener
+{
+public:
+  void steppersTurned(const LinkStepperMove &move) override
+  {
+    for (int i = 0; i < move.count; i++)
+      faces[move.motor[i]].push_back(move.angle[i] * 2 + move.direction[i]);
+  }
+
+  std::vector<int> faces[LINK_STEPPER_MOTORS];
+};
+
+struct Replay
+{
+  uint32_t commands;
+  uint32_t bytesOut;
+  uint64_t us;
+  FaceTurns turns;
+};
+
+// As parseStepperCommands() in the baseline
+static void baselineMove(int move)
+{
+  int motor = move / 10;
+  int code = move % 10;
+  int angle = code == 2 ? 180 : 90;
+  int direction = code == 3 ? 1 : 0;
+  if (code == 3 && motor == 1)
+  {
+    angle = 270;
+    direction = 0;
+  }
+  int cmds[STEPPER_COUNT] = {0};
+  cmds[(motor - 1) * 2] = angle;
+  cmds[(motor - 1) * 2 + 1] = direction;
+  sendStepperCommand(cmds);
+}
+
+static void replay(SimArduino &arduino, const std::vector<int> &solution, bool baseline, Replay &result)
+{
+  arduino.setListener(&result.turns);
+  size_t firstCommand = arduino.commands().size();
+  uint32_t bytesOut = hostUartStats().bytesOut;
+  uint64_t startUs = hostNowUs();
+
+  if (baseline)
+  {
+    for (int move : solution)
+    {
+      baselineMove(move);
+      delay(50);
+    }
+  }
+  else
+  {
+    movesCount = solution.size();
+    for (size_t k = 0; k < solution.size(); k++)
+      moves[k] = solution[k];
+    queueSolution();
+    while (!runTurns())
+      hostAdvanceUs(LOOP_US);
+  }
+  // Until the last turn is over
+  hostAdvanceUntil([&arduino] { return !arduino.busy(hostNowUs()); }, HOST_NEVER);
+
+  result.us = hostNowUs() - startUs;
+  result.commands = arduino.commands().size() - firstCommand;
+  result.bytesOut = hostUartStats().bytesOut - bytesOut;
+  arduino.setListener(nullptr);
+}
+
+int main()
+{
+  SimArduinoConfig config;
+  config.baud = ARDUINO_LINK_BAUD;
+  SimArduino &arduino = simLink(config);
+
+  printf("%s link at %u baud     moves   commands      bytes out     time s\n",
+         ARDUINO_LINK_BINARY ? "binary" : "ASCII", hostUartBaud());
+  for (size_t s = 0; s < solutions.size(); s++)
+  {
+    Replay before = {};
+    Replay after = {};
+    replay(arduino, solutions[s], true, before);
+    replay(arduino, solutions[s], false, after);
+
+    printf("  solution %u                %5u  %3u -> %3u    %4u -> %4u    %5.2f -> %5.2f\n", (unsigned)s,
+           (unsigned)solutions[s].size(), before.commands, after.commands, before.bytesOut, after.bytesOut,
+           before.us / 1e6, after.us / 1e6);
+
+    // Every face turns the same way in the same order
+    for (int face = 0; face < LINK_STEPPER_MOTORS; face++)
+      CHECK(before.turns.faces[face] == after.turns.faces[face]);
+    CHECK_EQ(before.commands, solutions[s].size());
+    CHECK(after.commands <= before.commands);
+    CHECK(after.bytesOut <= before.bytesOut);
+    // The loop notices an ack and the end of the gap up to one iteration late each
+    CHECK(after.us <= before.us + 2 * LOOP_US * after.commands);
+    // Pairs of opposite faces save a round trip and a turn time each
+    if (after.commands < before.commands)
+      CHECK(after.bytesOut < before.bytesOut && after.us < before.us);
+  }
+  return TEST_RESULT();
+}
@@ -0,0 +1,143 @@
+#include <string.h>
+#include "test_check.h"
+#include "host_clock.h"
+#include "arduino_link.h"
+#include "state_profiler.h"
+#include "sim_game.h"
+
+// StateProfiler on its own, then the profile of a simulated game of each
+// kind, as /profile would report it on the robot
+
+// ArmMoveState of memory_game.cpp, updateArmMove() runs in these
+static const char *const memoryArmStates[] = {"MOVE_IDLE", "GRAB_PICK", "RELEASE_CARRY", "RELEASE_PLACE",
+                                              "MOVE_COMPLETE"};
+
+static void testProfiler()
+{
+  // Every profiler joins the list /profile walks, this one stays for the whole run
+  static StateProfiler profiler("test");
+  CHECK_EQ(profiler.state(), STATE_PROFILER_NONE);
+
+  // Staying in a state adds nothing, leaving it closes one visit
+  profiler.enter(2, 1000);
+  profiler.enter(2, 1500);
+  CHECK_EQ(profiler.states[2].count, 0);
+  profiler.enter(3, 1800);
+  CHECK_EQ(profiler.states[2].count, 1);
+  CHECK_EQ(profiler.states[2].totalUs, 800);
+  profiler.enter(2, 2000);
+  profiler.enter(3, 2100);
+  const StateTiming &two = profiler.states[2];
+  CHECK(two.count == 2 && two.totalUs == 900 && two.maxUs == 800 && two.lastUs == 100);
+
+  // Out of range states are not timed
+  profiler.enter(STATE_PROFILER_MAX_STATES, 2500);
+  CHECK_EQ(profiler.states[3].totalUs, 600);
+  CHECK_EQ(profiler.state(), STATE_PROFILER_NONE);
+
+  // micros() wraps after 71 minutes
+  profiler.enter(4, 0xFFFFFF00);
+  profiler.leave(0x100);
+  CHECK_EQ(profiler.states[4].totalUs, 0x200);
+  profiler.leave(0x200);
+  CHECK_EQ(profiler.states[4].count, 1);
+
+  // A reset waits for the game loop
+  profiler.reset();
+  CHECK_EQ(profiler.states[2].count, 2);
+  profiler.enter(5, 3000);
+  CHECK_EQ(profiler.states[2].count, 0);
+  CHECK_EQ(profiler.states[4].totalUs, 0);
+  CHECK_EQ(profiler.state(), 5);
+}
+
+static StateProfiler *findProfiler(const char *name)
+{
+  for (StateProfiler *profiler = StateProfiler::first; profiler; profiler = profiler->next)
+  {
+    if (strcmp(profiler->name, name) == 0)
+      return profiler;
+  }
+  return nullptr;
+}
+
+static uint64_t totalUs(const StateProfiler &profiler)
+{
+  uint64_t us = 0;
+  for (const StateTiming &timing : profiler.states)
+    us += timing.totalUs;
+  return us;
+}
+
+static void printProfile(const StateProfiler &profiler, const char *const *names, uint8_t nameCount)
+{
+  printf("  %-10s %-24s %6s %10s %9s %9s\n", profiler.name, "state", "count", "total s", "max ms", "last ms");
+  for (int state = 0; state < STATE_PROFILER_MAX_STATES; state++)
+  {
+    const StateTiming &timing = profiler.states[state];
+    if (!timing.count)
+      continue;
+    CHECK(timing.maxUs >= timing.lastUs);
+    CHECK((uint64_t)timing.maxUs * timing.count >= timing.totalUs);
+    const char *name = state < nameCount ? names[state] : "";
+    printf("  %-10s %2d %-21s %6u %10.2f %9.1f %9.1f\n", "", state, name, timing.count, timing.totalUs / 1e6,
+           timing.maxUs / 1e3, timing.lastUs / 1e3);
+  }
+}
+
+// A whole game: every loop iteration lands in one state, the totals add up to the game time
+// but for what start() blocks on, e.g. the Rubik reset request
+static void profileGame(const char *name, const char *armProfiler = nullptr, const char *const *armStates = nullptr,
+                        uint8_t armStateCount = 0)
+{
+  const SimGame *game = simFindGame(name);
+  CHECK(game != nullptr);
+  if (!game)
+    return;
+
+  for (StateProfiler *profiler = StateProfiler::first; profiler; profiler = profiler->next)
+    profiler->reset();
+
+  SimWorld *world = simMakeWorld(name, 1);
+  SimGameResult result;
+  SimOptions options;
+  CHECK(simPlayGame(*game, *world, options, result));
+  delete world;
+
+  StateProfiler *profiler = findProfiler(game->profiler);
+  CHECK(profiler != nullptr);
+  if (!profiler)
+    return;
+  uint64_t loopUs = totalUs(*profiler);
+  printf("%s: %.1f s, %.1f s of it in the game loop\n", name, result.durationUs / 1e6, loopUs / 1e6);
+  printProfile(*profiler, game->states, game->stateCount);
+  CHECK_EQ(profiler->state(), STATE_PROFILER_NONE);
+  CHECK(loopUs <= result.durationUs);
+  CHECK(result.durationUs - loopUs < 1000000);
+  CHECK_EQ(profiler->states[game->doneState].count, 1);
+
+  if (armProfiler)
+  {
+    StateProfiler *arm = findProfiler(armProfiler);
+    CHECK(arm != nullptr);
+    if (!arm)
+      return;
+    printProfile(*arm, armStates, armStateCount);
+    CHECK_EQ(totalUs(*arm), loopUs);
+  }
+}
+
+int main()
+{
+  testProfiler();
+
+  SimArduinoConfig config;
+  config.baud = ARDUINO_LINK_BAUD;
+  simLink(config);
+  profileGame("memory", "memoryArm", memoryArmStates, 5);
+  profileGame("xo");
+  profileGame("xo_o");
+  profileGame("cups");
+  profileGame("rubik");
+  return TEST_RESULT();
+}
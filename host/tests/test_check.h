@@ -0,0 +1,39 @@
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+#include <stdio.h>
+
+/**
+ * Minimal checks for the host tests: a failed check prints where and what,
+ * the test goes on, and main() returns TEST_RESULT() so ctest sees the
+ * failure.
+ */
+
+static int testFailures = 0;
+
+#define CHECK(cond)                                                    \
+  do                                                                   \
+  {                                                                    \
+    if (!(cond))                                                       \
+    {                                                                  \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);  \
+      testFailures++;                                                  \
+    }                                                                  \
+  } while (0)
+
+#define CHECK_EQ(a, b)                                                                           \
+  do                                                                                             \
+  {                                                                                              \
+    long long checkA = (long long)(a);                                                           \
+    long long checkB = (long long)(b);                                                           \
+    if (checkA != checkB)                                                                        \
+    {                                                                                            \
+      printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, checkA, \
+             checkB);                                                                            \
+      testFailures++;                                                                            \
+    }                                                                                            \
+  } while (0)
+
+#define TEST_RESULT() (testFailures ? (printf("%d checks failed\n", testFailures), 1) : (printf("ok\n"), 0))
+
+#endif
@@ -0,0 +1,279 @@
+#include <atomic>
+#include <string.h>
+#include <thread>
+#include "test_check.h"
+#include "vision_cache.h"
+
+// The perceptual hash, lookups by hash and thumbnail, LRU replacement, and
+// invalidation by epoch, on its own and from another thread while the
+// vision worker looks up and stores
+
+#define THUMB_PIXELS (CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT)
+#define WORKER_FRAMES 200000
+#define WORKER_INVALIDATIONS 2000
+
+struct Thumbnail
+{
+  uint8_t pixels[THUMB_PIXELS];
+};
+
+static uint32_t noiseState = 1;
+
+static int noise(int amplitude)
+{
+  noiseState = noiseState * 1103515245 + 12345;
+  return (int)((noiseState >> 16) % (2 * amplitude + 1)) - amplitude;
+}
+
+// The XO board on the table, lit from one side: grid lines, dark pieces in the
+// cells of `pieces`, camera noise. `shift` moves the board to the right.
+static Thumbnail board(uint16_t pieces, int brightness = 0, int noiseAmplitude = 0, int shift = 0)
+{
+  Thumbnail thumb;
+  for (int y = 0; y < CHANGE_THUMB_HEIGHT; y++)
+  {
+    for (int x = 0; x < CHANGE_THUMB_WIDTH; x++)
+    {
+      int bx = x - 4 - shift;
+      int level = 60 + x; // table
+      if (bx >= 0 && bx < 24)
+      {
+        int cell = y / 8 * 3 + bx / 8;
+        if (bx % 8 == 0 && bx || y % 8 == 0 && y)
+          level = 90 + x; // grid line
+        else if (pieces & (1 << cell) && bx % 8 >= 2 && bx % 8 < 6 && y % 8 >= 2 && y % 8 < 6)
+          level = 30;
+        else
+          level = 170 + x;
+      }
+      level += brightness + (noiseAmplitude ? noise(noiseAmplitude) : 0);
+      thumb.pixels[y * CHANGE_THUMB_WIDTH + x] = level < 0 ? 0 : level > 255 ? 255 : level;
+    }
+  }
+  return thumb;
+}
+
+static VisionReply replyOf(int value)
+{
+  VisionReply reply;
+  visionReplyClear(reply);
+  reply.values[reply.count++] = value;
+  return reply;
+}
+
+static void testHash()
+{
+  CHECK_EQ(hammingDistance(0, 0), 0);
+  CHECK_EQ(hammingDistance(0, ~0ULL), 64);
+  CHECK_EQ(hammingDistance(1ULL << 63, 1), 2);
+  CHECK_EQ(hammingDistance(0xF0F0, 0x0FF0), 8);
+
+  Thumbnail empty = board(0);
+  uint64_t hash = perceptualHash(empty.pixels);
+  CHECK_EQ(perceptualHash(empty.pixels), hash);
+  // The DC term is left out: a brighter frame is the same frame
+  Thumbnail brighter = board(0, 20);
+  int light = hammingDistance(perceptualHash(brighter.pixels), hash);
+
+  // Noise, one piece, a full board and a camera that moved, against the
+  // VISION_CACHE_MAX_DISTANCE candidates
+  int noisy = 0;
+  for (int i = 0; i < 200; i++)
+  {
+    Thumbnail frame = board(0, 0, 3);
+    int distance = hammingDistance(perceptualHash(frame.pixels), hash);
+    noisy = distance > noisy ? distance : noisy;
+  }
+  Thumbnail onePiece = board(1 << 4);
+  Thumbnail full = board(0x1FF);
+  Thumbnail moved = board(0, 0, 0, 4);
+  int other = hammingDistance(perceptualHash(moved.pixels), hash);
+  printf("hash: %d bits set, distance to the empty board: brighter %d, noise up to %d, one piece %d, full board %d, "
+         "camera moved %d\n",
+         hammingDistance(hash, 0), light, noisy, hammingDistance(perceptualHash(onePiece.pixels), hash),
+         hammingDistance(perceptualHash(full.pixels), hash), other);
+  CHECK(hammingDistance(hash, 0) >= 8);
+  CHECK(light <= 2);
+  CHECK(noisy <= VISION_CACHE_MAX_DISTANCE / 2);
+  CHECK(other > VISION_CACHE_MAX_DISTANCE);
+}
+
+static void testLookup()
+{
+  VisionCache cache;
+  VisionReply reply;
+  Thumbnail empty = board(0);
+  uint64_t hash = perceptualHash(empty.pixels);
+
+  CHECK(!cache.lookup("xo", hash, empty.pixels, reply));
+  cache.store(cache.epoch(), "xo", hash, empty.pixels, replyOf(7));
+  CHECK(cache.lookup("xo", hash, empty.pixels, reply));
+  CHECK(reply.count == 1 && reply.values[0] == 7);
+
+  // The same frame under another action is another question
+  CHECK(!cache.lookup("memory", hash, empty.pixels, reply));
+
+  // Camera noise and light still hit
+  Thumbnail noisy = board(0, 4, 3);
+  CHECK(cache.lookup("xo", perceptualHash(noisy.pixels), noisy.pixels, reply));
+
+  // A piece in one cell hardly moves the hash, the blocks tell
+  for (int cell = 0; cell < 9; cell++)
+  {
+    Thumbnail piece = board(1 << cell);
+    CHECK(!cache.lookup("xo", perceptualHash(piece.pixels), piece.pixels, reply));
+  }
+  // Same thumbnail, a hash far off: not a candidate
+  CHECK(!cache.lookup("xo", ~hash, empty.pixels, reply));
+
+  CHECK_EQ(cache.hits, 2);
+  CHECK_EQ(cache.misses, 12);
+
+  // Long actions are cut as the queue cuts them
+  char action[VISION_ACTION_MAX + 8];
+  memset(action, 'a', sizeof(action) - 1);
+  action[sizeof(action) - 1] = '\0';
+  cache.store(cache.epoch(), action, hash, empty.pixels, replyOf(1));
+  action[VISION_ACTION_MAX - 1] = '\0';
+  CHECK(cache.lookup(action, hash, empty.pixels, reply));
+}
+
+static void testReplacement()
+{
+  VisionCache cache;
+  VisionReply reply;
+  Thumbnail frames[VISION_CACHE_SIZE + 1];
+  uint64_t hashes[VISION_CACHE_SIZE + 1];
+  for (int i = 0; i <= VISION_CACHE_SIZE; i++)
+  {
+    frames[i] = board(1 << i);
+    hashes[i] = perceptualHash(frames[i].pixels);
+  }
+
+  for (int i = 0; i < VISION_CACHE_SIZE; i++)
+    cache.store(cache.epoch(), "xo", hashes[i], frames[i].pixels, replyOf(i));
+  for (int i = 0; i < VISION_CACHE_SIZE; i++)
+  {
+    CHECK(cache.lookup("xo", hashes[i], frames[i].pixels, reply));
+    CHECK_EQ(reply.values[0], i);
+  }
+
+  // Use frame 0 again, frame 1 is then the least recently used one
+  CHECK(cache.lookup("xo", hashes[0], frames[0].pixels, reply));
+  for (int i = 2; i < VISION_CACHE_SIZE; i++)
+    CHECK(cache.lookup("xo", hashes[i], frames[i].pixels, reply));
+  cache.store(cache.epoch(), "xo", hashes[VISION_CACHE_SIZE], frames[VISION_CACHE_SIZE].pixels,
+              replyOf(VISION_CACHE_SIZE));
+  CHECK(!cache.lookup("xo", hashes[1], frames[1].pixels, reply));
+  CHECK(cache.lookup("xo", hashes[0], frames[0].pixels, reply));
+  CHECK(cache.lookup("xo", hashes[VISION_CACHE_SIZE], frames[VISION_CACHE_SIZE].pixels, reply));
+  CHECK_EQ(reply.values[0], VISION_CACHE_SIZE);
+
+  // Entries of an old epoch are taken before any live one
+  cache.invalidate();
+  cache.store(cache.epoch(), "xo", hashes[1], frames[1].pixels, replyOf(11));
+  cache.store(cache.epoch(), "xo", hashes[2], frames[2].pixels, replyOf(12));
+  CHECK(cache.lookup("xo", hashes[1], frames[1].pixels, reply) && reply.values[0] == 11);
+  CHECK(cache.lookup("xo", hashes[2], frames[2].pixels, reply) && reply.values[0] == 12);
+}
+
+static void testInvalidate()
+{
+  VisionCache cache;
+  VisionReply reply;
+  Thumbnail empty = board(0);
+  uint64_t hash = perceptualHash(empty.pixels);
+
+  cache.store(cache.epoch(), "xo", hash, empty.pixels, replyOf(1));
+  cache.invalidate();
+  CHECK(!cache.lookup("xo", hash, empty.pixels, reply));
+  CHECK_EQ(cache.invalidations, 1);
+
+  // The arm moved while the frame was uploaded: its reply is not kept
+  uint32_t frameEpoch = cache.epoch();
+  cache.invalidate();
+  cache.store(frameEpoch, "xo", hash, empty.pixels, replyOf(2));
+  CHECK(!cache.lookup("xo", hash, empty.pixels, reply));
+
+  cache.store(cache.epoch(), "xo", hash, empty.pixels, replyOf(3));
+  CHECK(cache.lookup("xo", hash, empty.pixels, reply) && reply.values[0] == 3);
+  CHECK_EQ(cache.invalidations, 2);
+}
+
+// The vision worker on this thread, the arm task on another: every motion
+// invalidates the cache, then moves a piece. A hit always answers the scene the
+// frame shows, and never with a reply stored before the last invalidation the
+// frame saw.
+#define SCENES 8
+
+static void testConcurrentInvalidate()
+{
+  VisionCache cache;
+  Thumbnail scenes[SCENES];
+  uint64_t hashes[SCENES];
+  for (int i = 0; i < SCENES; i++)
+  {
+    scenes[i] = board(1 << i);
+    hashes[i] = perceptualHash(scenes[i].pixels);
+  }
+  std::atomic<int> scene(0);
+  std::atomic<bool> stop(false);
+
+  std::thread arm([&] {
+    int next = 0;
+    while (!stop)
+    {
+      cache.invalidate();
+      next = (next + 1) % SCENES;
+      scene = next;
+      for (int i = 0; i < 20 && !stop; i++)
+        std::this_thread::yield();
+    }
+  });
+
+  int frames = 0;
+  int hits = 0;
+  int wrongScene = 0;
+  int oldEpoch = 0;
+  for (; frames < WORKER_FRAMES || cache.invalidations < WORKER_INVALIDATIONS; frames++)
+  {
+    // Let the arm thread in on a single core too
+    if (frames % 16 == 0)
+      std::this_thread::yield();
+
+    uint32_t frameEpoch = cache.epoch();
+    int seen = scene;
+    VisionReply reply;
+    if (cache.lookup("xo", hashes[seen], scenes[seen].pixels, reply))
+    {
+      hits++;
+      wrongScene += reply.values[0] != seen;
+      oldEpoch += (int32_t)((uint32_t)reply.values[1] - frameEpoch) < 0;
+    }
+    else
+    {
+      VisionReply stored = replyOf(seen);
+      stored.values[stored.count++] = frameEpoch;
+      cache.store(frameEpoch, "xo", hashes[seen], scenes[seen].pixels, stored);
+    }
+  }
+  stop = true;
+  arm.join();
+
+  printf("worker: %d frames, %d hits, %u invalidations, %d of the wrong scene, %d from before an invalidation\n",
+         frames, hits, cache.invalidations.load(), wrongScene, oldEpoch);
+  CHECK_EQ(wrongScene, 0);
+  CHECK_EQ(oldEpoch, 0);
+  CHECK(hits > 0);
+  CHECK_EQ(cache.hits + cache.misses, frames);
+}
+
+int main()
+{
+  testHash();
+  testLookup();
+  testReplacement();
+  testInvalidate();
+  testConcurrentInvalidate();
+  return TEST_RESULT();
+}
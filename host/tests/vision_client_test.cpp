@@ -0,0 +1,280 @@
+#include <string.h>
+#include <map>
+#include <string>
+#include "test_check.h"
+#include "host_clock.h"
+#include "host_net.h"
+#include "vision_client.h"
+#include "vision_reply.h"
+
+// VisionClient through the host HTTPClient against a scripted server: the
+// connection kept between requests, a new one after the server closed it
+// while idle, no resend once a request may have left, chunked and oversized
+// replies, and the time a request takes with and without reuse
+
+#define ROUND_TRIP_US 8000 // WiFi to the server and back
+#define SERVER_US 30000    // the server reading a frame
+#define ENDPOINT "http://192.168.25.177:8000/process"
+
+class TestServer : public HostNetServer
+{
+public:
+  std::string body = "1,2,3";
+  bool chunked = false;
+  bool closeAfterReply = false; // Connection: close
+  bool dropNext = false;        // close instead of answering the next request
+  int refuse = 0;               // connects refused before one is accepted
+
+  int connections = 0;
+  int requests = 0;
+  int lastConnection = -1;
+  std::string lastHead;
+  size_t lastBodyLength = 0;
+
+  bool accept(int connection) override
+  {
+    if (refuse > 0)
+    {
+      refuse--;
+      return false;
+    }
+    connections++;
+    lastConnection = connection;
+    return true;
+  }
+
+  void receive(int connection, const uint8_t *data, size_t length) override
+  {
+    std::string &in = pending[connection];
+    in.append((const char *)data, length);
+    for (;;)
+    {
+      size_t headEnd = in.find("\r\n\r\n");
+      if (headEnd == std::string::npos)
+        return;
+      size_t bodyLength = 0;
+      size_t field = in.find("Content-Length: ");
+      if (field != std::string::npos && field < headEnd)
+        bodyLength = atoi(in.c_str() + field + 16);
+      if (in.size() < headEnd + 4 + bodyLength)
+        return;
+
+      lastHead = in.substr(0, headEnd);
+      lastBodyLength = bodyLength;
+      in.erase(0, headEnd + 4 + bodyLength);
+      answer(connection);
+    }
+  }
+
+  void closed(int connection) override { pending.erase(connection); }
+
+private:
+  void answer(int connection)
+  {
+    requests++;
+    if (dropNext)
+    {
+      dropNext = false;
+      hostNetClose(connection);
+      return;
+    }
+
+    std::string reply = "HTTP/1.1 200 OK\r\nContent-Type: text/csv\r\n";
+    if (closeAfterReply)
+      reply += "Connection: close\r\n";
+    if (chunked)
+    {
+      reply += "Transfer-Encoding: chunked\r\n\r\n";
+      for (size_t at = 0; at < body.size(); at += 16)
+      {
+        std::string chunk = body.substr(at, 16);
+        char size[8];
+        snprintf(size, sizeof(size), "%zx\r\n", chunk.size());
+        reply += size + chunk + "\r\n";
+      }
+      reply += "0\r\n\r\n";
+    }
+    else
+    {
+      reply += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+    }
+
+    bool close = closeAfterReply;
+    hostSchedule(hostNowUs() + SERVER_US, [connection, reply, close] {
+      hostNetSend(connection, (const uint8_t *)reply.data(), reply.size());
+      if (close)
+        hostNetClose(connection);
+    });
+  }
+
+  std::map<int, std::string> pending;
+};
+
+static TestServer server;
+static const uint8_t frame[] = {0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 0xFF, 0xD9};
+
+static int post(VisionClient &client, const char *action, std::string &reply)
+{
+  uint8_t response[VISION_REPLY_BODY_MAX];
+  size_t length = 99;
+  int code = client.post(action, frame, sizeof(frame), response, sizeof(response), length);
+  reply.assign((const char *)response, length);
+  return code;
+}
+
+static void testReuse()
+{
+  VisionClient client;
+  CHECK(client.begin(ENDPOINT));
+  int connections = server.connections;
+  std::string reply;
+
+  const char *actions[] = {"xo", "memory", "xo"};
+  for (const char *action : actions)
+  {
+    CHECK_EQ(post(client, action, reply), 200);
+    CHECK(reply == server.body);
+  }
+  CHECK_EQ(server.connections, connections + 1);
+  CHECK_EQ(client.requests.load(), 3);
+  CHECK_EQ(client.reused.load(), 2);
+  CHECK(server.lastHead.find("POST /process?action=xo HTTP/1.1") == 0);
+  CHECK(server.lastHead.find("Content-Type: image/jpeg") != std::string::npos);
+  CHECK(server.lastHead.find("Accept: " VISION_REPLY_ACCEPT) != std::string::npos);
+  CHECK_EQ(server.lastBodyLength, sizeof(frame));
+
+  // A server that closes after each reply gets a new connection every time
+  client.disconnect();
+  hostAdvanceUs(ROUND_TRIP_US);
+  server.closeAfterReply = true;
+  connections = server.connections;
+  CHECK_EQ(post(client, "xo", reply), 200);
+  hostAdvanceUs(ROUND_TRIP_US);
+  CHECK_EQ(post(client, "xo", reply), 200);
+  CHECK_EQ(server.connections, connections + 2);
+  server.closeAfterReply = false;
+  client.disconnect();
+}
+
+static void testIdleClose()
+{
+  VisionClient client;
+  client.begin(ENDPOINT);
+  std::string reply;
+  CHECK_EQ(post(client, "xo", reply), 200);
+
+  // The server drops the idle connection, the next request goes out once on a new one
+  hostNetClose(server.lastConnection);
+  hostAdvanceUs(ROUND_TRIP_US);
+  int connections = server.connections;
+  int requests = server.requests;
+  CHECK_EQ(post(client, "xo", reply), 200);
+  CHECK(reply == server.body);
+  CHECK_EQ(server.connections, connections + 1);
+  CHECK_EQ(server.requests, requests + 1);
+  CHECK_EQ(client.reused.load(), 0);
+  CHECK_EQ(client.reconnects.load(), 0);
+  CHECK_EQ(client.freshUs.count(), 2);
+
+  // Closed while the request was on its way: the error is returned, nothing resent
+  requests = server.requests;
+  server.dropNext = true;
+  CHECK(post(client, "xo", reply) < 0);
+  CHECK(reply.empty());
+  CHECK_EQ(server.requests, requests + 1);
+  CHECK_EQ(client.reconnects.load(), 0);
+
+  // A refused connect sent nothing, that one is tried again
+  requests = server.requests;
+  server.refuse = 1;
+  CHECK_EQ(post(client, "xo", reply), 200);
+  CHECK_EQ(server.requests, requests + 1);
+  CHECK_EQ(client.reconnects.load(), 1);
+
+  client.disconnect();
+  hostAdvanceUs(ROUND_TRIP_US);
+  server.refuse = 2;
+  CHECK_EQ(post(client, "xo", reply), HTTPC_ERROR_CONNECTION_REFUSED);
+  CHECK_EQ(server.requests, requests + 1);
+  CHECK_EQ(client.reconnects.load(), 2);
+}
+
+static void testReplies()
+{
+  VisionClient client;
+  client.begin(ENDPOINT);
+  std::string reply;
+  std::string fits(VISION_REPLY_BODY_MAX, 'a');
+  for (size_t i = 0; i < fits.size(); i++)
+    fits[i] = 'a' + i % 26;
+
+  // Chunked, taken apart by HTTPClient into BufferStream
+  server.chunked = true;
+  server.body = fits;
+  CHECK_EQ(post(client, "rubikSolve", reply), 200);
+  CHECK(reply == fits);
+
+  // One byte too many, chunked or not: dropped with the connection it was still arriving on
+  for (int chunked = 1; chunked >= 0; chunked--)
+  {
+    server.chunked = chunked;
+    server.body = fits + "z";
+    int connections = server.connections;
+    CHECK_EQ(post(client, "xo", reply), VISION_HTTP_TOO_LONG);
+    CHECK(reply.empty());
+
+    // The next request starts clean on a new connection
+    server.body = fits;
+    CHECK_EQ(post(client, "xo", reply), 200);
+    CHECK(reply == fits);
+    CHECK_EQ(server.connections, connections + 1);
+  }
+
+  server.chunked = false;
+  server.body = "1,2,3";
+  client.disconnect();
+}
+
+// Mean request time in ms over `count` requests, on one connection or a new one each time
+static double meanMs(bool reuse, int count)
+{
+  VisionClient client;
+  client.begin(ENDPOINT);
+  std::string reply;
+  uint64_t total = 0;
+  for (int i = 0; i < count; i++)
+  {
+    uint64_t start = hostNowUs();
+    CHECK_EQ(post(client, "xo", reply), 200);
+    total += hostNowUs() - start;
+    if (!reuse)
+    {
+      client.disconnect();
+      hostAdvanceUs(ROUND_TRIP_US);
+    }
+  }
+  CHECK_EQ(client.reused.load(), reuse ? count - 1 : 0);
+  client.disconnect();
+  hostAdvanceUs(ROUND_TRIP_US);
+  return total / 1000.0 / count;
+}
+
+static void testLatency()
+{
+  double fresh = meanMs(false, 20);
+  double reused = meanMs(true, 20);
+  printf("request      new connection  kept alive\n");
+  printf("  mean ms    %14.1f  %10.1f\n", fresh, reused);
+  // The handshake is the round trip saved
+  CHECK(fresh - reused >= ROUND_TRIP_US / 1000.0 * 0.9);
+}
+
+int main()
+{
+  hostNetAttach(&server, ROUND_TRIP_US);
+  testReuse();
+  testIdleClose();
+  testReplies();
+  testLatency();
+  return TEST_RESULT();
+}
@@ -0,0 +1,371 @@
+#include <string.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "test_check.h"
+#include "vision_queue.h"
+
+// VisionQueue and visionServe() against a fake transport: futures, order,
+// expiry, cancellation, frame freshness, gating and upload retries, then a
+// worker thread draining the queue while the test submits and cancels
+
+static uint32_t fakeNowMs = 1000;
+
+static uint32_t fakeClock()
+{
+  return fakeNowMs;
+}
+
+class FakeTransport : public VisionTransport
+{
+public:
+  std::vector<uint32_t> frames; // capture times handed out in turn, then fakeNowMs
+  bool captureOk = true;
+  int uploadFailures = 0; // uploads that fail before one succeeds
+  bool sceneChanged = true;
+  bool answerLocally = false;
+  VisionQueue *cancelOnCapture = nullptr; // cancel everything while the frame is taken
+
+  int captures = 0;
+  int releases = 0;
+  int uploads = 0;
+  int gateUploaded = 0;
+  int gateSkipped = 0;
+  char lastAction[VISION_ACTION_MAX] = "";
+
+  bool capture(uint32_t &frameMs) override
+  {
+    if (!captureOk)
+      return false;
+    frameMs = captures < (int)frames.size() ? frames[captures] : fakeNowMs;
+    captures++;
+    if (cancelOnCapture)
+      cancelOnCapture->cancelAll();
+    return true;
+  }
+
+  void release() override { releases++; }
+
+  bool upload(const char *action, VisionReply &reply) override
+  {
+    uploads++;
+    strncpy(lastAction, action, sizeof(lastAction) - 1);
+    if (uploadFailures > 0)
+    {
+      uploadFailures--;
+      return false;
+    }
+    visionReplyClear(reply);
+    reply.values[reply.count++] = uploads;
+    return true;
+  }
+
+  bool answer(const char *, VisionReply &reply) override
+  {
+    if (!answerLocally)
+      return false;
+    visionReplyClear(reply);
+    reply.values[reply.count++] = -1;
+    return true;
+  }
+
+  bool changed() override { return sceneChanged; }
+
+  void gateDone(bool uploaded) override { (uploaded ? gateUploaded : gateSkipped)++; }
+};
+
+static void testFutures()
+{
+  VisionQueue queue;
+  VisionFuture first = queue.submit("xo", fakeNowMs, 1000);
+  VisionFuture second = queue.submit("memory", fakeNowMs, 1000);
+  CHECK(first != VISION_FUTURE_INVALID && second != VISION_FUTURE_INVALID && first != second);
+  CHECK_EQ(queue.status(first, fakeNowMs), VISION_PENDING);
+
+  // Oldest first
+  VisionRequest request;
+  CHECK_EQ(queue.take(fakeNowMs, request), first);
+  CHECK(strcmp(request.action, "xo") == 0);
+  CHECK_EQ(queue.status(first, fakeNowMs), VISION_PENDING);
+  queue.captured(first);
+  CHECK_EQ(queue.status(first, fakeNowMs), VISION_CAPTURED);
+
+  VisionReply reply;
+  visionReplyClear(reply);
+  reply.values[reply.count++] = 7;
+  queue.complete(first, true, &reply);
+
+  VisionReply collected;
+  visionReplyClear(collected);
+  CHECK_EQ(queue.collect(first, fakeNowMs, collected), VISION_DONE);
+  CHECK(collected.count == 1 && collected.values[0] == 7);
+  // Collected once, the future is stale from then on, even when its slot is reused
+  CHECK_EQ(queue.collect(first, fakeNowMs, collected), VISION_UNKNOWN);
+  VisionFuture third = queue.submit("cups", fakeNowMs, 1000);
+  CHECK(third != first);
+  CHECK_EQ(queue.status(first, fakeNowMs), VISION_UNKNOWN);
+  CHECK_EQ(queue.status(VISION_FUTURE_INVALID, fakeNowMs), VISION_UNKNOWN);
+
+  // A pending collect leaves the request in place
+  CHECK_EQ(queue.collect(second, fakeNowMs, collected), VISION_PENDING);
+  CHECK_EQ(queue.take(fakeNowMs, request), second);
+  queue.complete(second, false, nullptr);
+  CHECK_EQ(queue.collect(second, fakeNowMs, collected), VISION_FAILED);
+  CHECK_EQ(queue.failed, 1);
+
+  // Bounded: only third holds a slot, the rest fill up, then the queue is full
+  for (int i = 1; i < VISION_QUEUE_SIZE; i++)
+    CHECK(queue.submit("a", fakeNowMs, 1000) != VISION_FUTURE_INVALID);
+  CHECK_EQ(queue.submit("full", fakeNowMs, 1000), VISION_FUTURE_INVALID);
+  CHECK_EQ(queue.rejected, 1);
+
+  // Actions longer than a slot holds are cut, not overrun
+  VisionQueue small;
+  small.submit("an action name far longer than the slot holds", fakeNowMs, 1000);
+  small.take(fakeNowMs, request);
+  CHECK_EQ(strlen(request.action), VISION_ACTION_MAX - 1);
+}
+
+static void testExpiry()
+{
+  VisionQueue queue;
+  VisionRequest request;
+  VisionFuture taken = queue.submit("xo", fakeNowMs, 100);
+  VisionFuture queued = queue.submit("cups", fakeNowMs, 100);
+  CHECK_EQ(queue.status(queued, fakeNowMs + 100), VISION_PENDING);
+
+  // The worker picked the first one in time, it runs however long it takes.
+  // The second is still queued after its deadline and expires.
+  CHECK_EQ(queue.take(fakeNowMs + 50, request), taken);
+  CHECK_EQ(queue.status(queued, fakeNowMs + 101), VISION_EXPIRED);
+  CHECK_EQ(queue.take(fakeNowMs + 101, request), VISION_FUTURE_INVALID);
+  CHECK_EQ(queue.status(taken, fakeNowMs + 5000), VISION_PENDING);
+  CHECK_EQ(queue.expired, 1);
+  VisionReply reply;
+  CHECK_EQ(queue.collect(queued, fakeNowMs + 5000, reply), VISION_EXPIRED);
+
+  // millis() wraps, the deadline is compared as a difference
+  VisionQueue wrap;
+  VisionFuture future = wrap.submit("xo", 0xFFFFFFF0, 100);
+  CHECK_EQ(wrap.status(future, 0x40), VISION_PENDING);
+  CHECK_EQ(wrap.status(future, 0x60), VISION_EXPIRED);
+}
+
+static void testCancel()
+{
+  VisionQueue queue;
+  VisionRequest request;
+  VisionFuture running = queue.submit("memory", fakeNowMs, 1000);
+  VisionFuture queued = queue.submit("xo", fakeNowMs, 1000);
+  CHECK_EQ(queue.take(fakeNowMs, request), running);
+
+  // A queued request goes at once
+  queue.cancel(queued);
+  CHECK_EQ(queue.status(queued, fakeNowMs), VISION_UNKNOWN);
+  CHECK_EQ(queue.take(fakeNowMs, request), VISION_FUTURE_INVALID);
+
+  // A running one is gone for the game, but its slot is only free once the worker is done
+  queue.cancel(running);
+  CHECK_EQ(queue.status(running, fakeNowMs), VISION_UNKNOWN);
+  CHECK(queue.cancelled(running));
+  for (int i = 0; i < VISION_QUEUE_SIZE - 1; i++)
+    CHECK(queue.submit("a", fakeNowMs, 1000) != VISION_FUTURE_INVALID);
+  CHECK_EQ(queue.submit("a", fakeNowMs, 1000), VISION_FUTURE_INVALID);
+  VisionReply reply;
+  visionReplyClear(reply);
+  queue.complete(running, true, &reply);
+  CHECK(queue.submit("a", fakeNowMs, 1000) != VISION_FUTURE_INVALID);
+  CHECK_EQ(queue.cancelledCount, 2);
+
+  // As on a game switch
+  queue.cancelAll();
+  CHECK_EQ(queue.take(fakeNowMs, request), VISION_FUTURE_INVALID);
+  for (int i = 0; i < VISION_QUEUE_SIZE; i++)
+    CHECK(queue.submit("b", fakeNowMs, 1000) != VISION_FUTURE_INVALID);
+}
+
+static VisionStatus serveOne(VisionQueue &queue, FakeTransport &transport, VisionFuture future, VisionReply &reply)
+{
+  CHECK(visionServe(queue, transport, fakeClock));
+  return queue.collect(future, fakeNowMs, reply);
+}
+
+static void testServe()
+{
+  VisionQueue queue;
+  VisionReply reply;
+  FakeTransport idle;
+  CHECK(!visionServe(queue, idle, fakeClock));
+  CHECK_EQ(idle.captures, 0);
+
+  // Plain request: one capture, one upload, the frame released
+  {
+    FakeTransport transport;
+    VisionFuture future = queue.submit("xo", fakeNowMs, 1000);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_DONE);
+    CHECK(transport.captures == 1 && transport.uploads == 1 && transport.releases == 1);
+    CHECK(strcmp(transport.lastAction, "xo") == 0 && reply.values[0] == 1);
+  }
+
+  // Frames older than the request are dropped, up to VISION_FRESH_RETRIES
+  {
+    FakeTransport transport;
+    transport.frames = {900, 950, 1200};
+    VisionFuture future = queue.submit("memory", fakeNowMs, 1000, 1000);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_DONE);
+    CHECK_EQ(transport.captures, 3);
+    CHECK_EQ(transport.releases, 3);
+
+  }
+
+  // Every frame stale: nothing is uploaded from a scene that may still be moving
+  {
+    FakeTransport transport;
+    transport.frames = {1, 2, 3, 4, 5, 6};
+    VisionFuture future = queue.submit("memory", fakeNowMs, 1000, 1000, VISION_RETRY_UPLOAD);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_FAILED);
+    CHECK_EQ(transport.captures, VISION_FRESH_RETRIES + 1);
+    CHECK_EQ(transport.releases, transport.captures);
+    CHECK_EQ(transport.uploads, 0);
+  }
+
+  // No frame: nothing is captured, release() has nothing to hand back
+  {
+    FakeTransport transport;
+    VisionFuture future = queue.submit("rubikReset", fakeNowMs, 1000, 0, VISION_NO_FRAME);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_DONE);
+    CHECK(transport.captures == 0 && transport.uploads == 1);
+  }
+
+  // Capture and upload failures
+  {
+    FakeTransport transport;
+    transport.captureOk = false;
+    VisionFuture future = queue.submit("xo", fakeNowMs, 1000);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_FAILED);
+    CHECK_EQ(transport.uploads, 0);
+
+    transport.captureOk = true;
+    transport.uploadFailures = 1;
+    future = queue.submit("xo", fakeNowMs, 1000);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_FAILED);
+    CHECK_EQ(transport.uploads, 1);
+
+    // Retried on the same frame
+    transport.uploadFailures = VISION_UPLOAD_ATTEMPTS - 1;
+    future = queue.submit("xo", fakeNowMs, 1000, 0, VISION_RETRY_UPLOAD);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_DONE);
+    CHECK_EQ(transport.uploads, 1 + VISION_UPLOAD_ATTEMPTS);
+    CHECK_EQ(transport.captures, 2);
+    CHECK_EQ(transport.releases, transport.captures);
+  }
+
+  // Gated: an unchanged scene is not uploaded, a changed one reports back
+  {
+    FakeTransport transport;
+    transport.sceneChanged = false;
+    VisionFuture future = queue.submit("xo", fakeNowMs, 1000, 0, VISION_GATED);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_UNCHANGED);
+    CHECK(transport.uploads == 0 && transport.releases == 1);
+    CHECK_EQ(transport.gateUploaded + transport.gateSkipped, 0);
+
+    transport.sceneChanged = true;
+    transport.uploadFailures = 1;
+    future = queue.submit("xo", fakeNowMs, 1000, 0, VISION_GATED);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_FAILED);
+    CHECK_EQ(transport.gateSkipped, 1);
+    future = queue.submit("xo", fakeNowMs, 1000, 0, VISION_GATED);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_DONE);
+    CHECK_EQ(transport.gateUploaded, 1);
+  }
+
+  // Answered from the frame, no upload
+  {
+    FakeTransport transport;
+    transport.answerLocally = true;
+    VisionFuture future = queue.submit("xo", fakeNowMs, 1000, 0, VISION_GATED);
+    CHECK_EQ(serveOne(queue, transport, future, reply), VISION_DONE);
+    CHECK(transport.uploads == 0 && reply.values[0] == -1);
+    CHECK_EQ(transport.gateUploaded, 1);
+  }
+
+  // A game switch while the frame is taken: dropped before the upload, the slot freed
+  {
+    FakeTransport transport;
+    transport.cancelOnCapture = &queue;
+    VisionFuture future = queue.submit("xo", fakeNowMs, 1000);
+    CHECK(visionServe(queue, transport, fakeClock));
+    CHECK_EQ(queue.collect(future, fakeNowMs, reply), VISION_UNKNOWN);
+    CHECK(transport.uploads == 0 && transport.releases == 1);
+    for (int i = 0; i < VISION_QUEUE_SIZE; i++)
+      CHECK(queue.submit("b", fakeNowMs, 1000) != VISION_FUTURE_INVALID);
+  }
+}
+
+// The worker on its own thread, as on the other core: every future the game
+// keeps ends in a final state, every cancelled one disappears, slots never leak
+static void testWorker()
+{
+  VisionQueue queue;
+  FakeTransport transport;
+  std::atomic<bool> stop(false);
+  std::thread worker([&] {
+    while (!stop)
+    {
+      if (!visionServe(queue, transport, fakeClock))
+        std::this_thread::yield();
+    }
+  });
+
+  int done = 0;
+  int rejected = 0;
+  for (int round = 0; round < 2000; round++)
+  {
+    VisionFuture futures[VISION_QUEUE_SIZE];
+    int count = 0;
+    for (int i = 0; i < VISION_QUEUE_SIZE; i++)
+    {
+      futures[count] = queue.submit("xo", fakeNowMs, 60000);
+      if (futures[count] == VISION_FUTURE_INVALID)
+        rejected++;
+      else
+        count++;
+    }
+    // Every third round is a game switch half way
+    if (round % 3 == 0)
+    {
+      queue.cancelAll();
+      count = 0;
+    }
+    for (int i = 0; i < count; i++)
+    {
+      VisionReply reply;
+      VisionStatus status;
+      while ((status = queue.collect(futures[i], fakeNowMs, reply)) == VISION_PENDING || status == VISION_CAPTURED)
+        std::this_thread::yield();
+      CHECK_EQ(status, VISION_DONE);
+      done++;
+    }
+  }
+  stop = true;
+  worker.join();
+
+  printf("worker thread: %d requests done, %d rejected while cancelled ones drained, %u cancelled\n", done, rejected,
+         queue.cancelledCount);
+  CHECK(done > 0);
+  CHECK_EQ(transport.captures, transport.releases);
+  // Nothing left behind
+  queue.cancelAll();
+  VisionRequest request;
+  CHECK_EQ(queue.take(fakeNowMs, request), VISION_FUTURE_INVALID);
+}
+
+int main()
+{
+  testFutures();
+  testExpiry();
+  testCancel();
+  testServe();
+  testWorker();
+  return TEST_RESULT();
+}
@@ -0,0 +1,390 @@
+#include <chrono>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+#include <Arduino.h>
+#include "test_check.h"
+#include "vision_reply.h"
+
+// The binary reply encoder and decoder, the CSV fallback, and per reply parse
+// time and heap use against the baseline's String + parseCSV path
+
+#define BENCH_REPLIES 200000
+#define MAX_SIZE 30 // as in the baseline esp32.ino
+
+// Heap use of the code measure() runs, nothing else runs meanwhile
+static bool counting = false;
+static size_t allocations = 0;
+static size_t allocatedBytes = 0;
+
+void *operator new(size_t size)
+{
+  if (counting)
+  {
+    allocations++;
+    allocatedBytes += size;
+  }
+  void *p = malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+  free(p);
+}
+
+static size_t encode(const VisionReply &reply, uint8_t *out, size_t size = VISION_REPLY_BODY_MAX)
+{
+  int length = visionReplyEncode(reply, out, size);
+  CHECK(length > 0);
+  return length > 0 ? length : 0;
+}
+
+static bool parse(const char *text, VisionReply &reply, uint8_t action = VISION_ACTION_UNKNOWN)
+{
+  return visionReplyParse((const uint8_t *)text, strlen(text), action, reply);
+}
+
+static bool valuesAre(const VisionReply &reply, std::initializer_list<int> values)
+{
+  if (reply.count != values.size())
+    return false;
+  int i = 0;
+  for (int value : values)
+  {
+    if (reply.values[i++] != value)
+      return false;
+  }
+  return true;
+}
+
+static void testActions()
+{
+  CHECK_EQ(visionActionId("xo"), VISION_ACTION_XO);
+  CHECK_EQ(visionActionId("memory"), VISION_ACTION_MEMORY);
+  CHECK_EQ(visionActionId("cupsResult"), VISION_ACTION_CUPS);
+  CHECK_EQ(visionActionId("rubikFace&face=3"), VISION_ACTION_RUBIK_FACE);
+  CHECK_EQ(visionActionId("rubikSolve"), VISION_ACTION_RUBIK_SOLVE);
+  // Only whole names
+  CHECK_EQ(visionActionId("rubik"), VISION_ACTION_UNKNOWN);
+  CHECK_EQ(visionActionId("xoO"), VISION_ACTION_UNKNOWN);
+  CHECK_EQ(visionActionId("x"), VISION_ACTION_UNKNOWN);
+  CHECK_EQ(visionActionId(""), VISION_ACTION_UNKNOWN);
+}
+
+static void testBinary()
+{
+  uint8_t body[VISION_REPLY_BODY_MAX];
+  VisionReply reply, parsed;
+
+  // Values that all fit go as int8, byte for byte as the header describes
+  visionReplyClear(reply);
+  reply.action = VISION_ACTION_CUPS;
+  for (int value : {0, 1, -1, 127, -128})
+    reply.values[reply.count++] = value;
+  size_t length = encode(reply, body);
+  const uint8_t expected[] = {VISION_REPLY_MAGIC, VISION_REPLY_VERSION, VISION_ACTION_CUPS, VISION_REPLY_INT8, 5,
+                              0, 1, 0xFF, 0x7F, 0x80};
+  CHECK(length == sizeof(expected) && memcmp(body, expected, length) == 0);
+  CHECK(visionReplyIsBinary(body, length));
+  CHECK(visionReplyParse(body, length, VISION_ACTION_CUPS, parsed));
+  CHECK(parsed.action == VISION_ACTION_CUPS && !parsed.hasConfidence && valuesAre(parsed, {0, 1, -1, 127, -128}));
+
+  // One value out of int8 makes them all int16, little-endian
+  reply.values[reply.count++] = 128;
+  reply.values[reply.count++] = -32768;
+  reply.values[reply.count++] = 32767;
+  length = encode(reply, body);
+  CHECK_EQ(body[3], VISION_REPLY_INT16);
+  CHECK_EQ(length, VISION_REPLY_HEADER + 8 * 2);
+  CHECK(body[VISION_REPLY_HEADER + 10] == 0x80 && body[VISION_REPLY_HEADER + 11] == 0x00);
+  CHECK(visionReplyParse(body, length, VISION_ACTION_CUPS, parsed));
+  CHECK(valuesAre(parsed, {0, 1, -1, 127, -128, 128, -32768, 32767}));
+
+  // Past int16 does not encode
+  reply.values[reply.count - 1] = 32768;
+  CHECK_EQ(visionReplyEncode(reply, body, sizeof(body)), -1);
+  reply.values[reply.count - 1] = -32769;
+  CHECK_EQ(visionReplyEncode(reply, body, sizeof(body)), -1);
+
+  // Confidence bytes after the values, the largest reply of all
+  visionReplyClear(reply);
+  reply.action = VISION_ACTION_XO;
+  reply.hasConfidence = true;
+  for (int i = 0; i < VISION_REPLY_MAX_VALUES; i++)
+  {
+    reply.values[i] = i * 1000 - 20000;
+    reply.confidence[i] = (uint8_t)(i * 100 / (VISION_REPLY_MAX_VALUES - 1));
+  }
+  reply.count = VISION_REPLY_MAX_VALUES;
+  length = encode(reply, body);
+  CHECK_EQ(length, VISION_REPLY_HEADER + VISION_REPLY_MAX_VALUES * 3);
+  CHECK(length <= VISION_REPLY_BODY_MAX);
+  CHECK_EQ(body[3], VISION_REPLY_INT16 | VISION_REPLY_CONFIDENCE);
+  CHECK(visionReplyParse(body, length, VISION_ACTION_XO, parsed));
+  CHECK(parsed.hasConfidence && parsed.count == VISION_REPLY_MAX_VALUES);
+  CHECK(memcmp(parsed.values, reply.values, sizeof(reply.values)) == 0);
+  CHECK(memcmp(parsed.confidence, reply.confidence, VISION_REPLY_MAX_VALUES) == 0);
+
+  // The buffer must hold all of it
+  CHECK_EQ(visionReplyEncode(reply, body, length - 1), -1);
+  CHECK_EQ(visionReplyEncode(reply, body, length), (int)length);
+
+  // An empty reply is a header only
+  visionReplyClear(reply);
+  reply.action = VISION_ACTION_RUBIK_FACE;
+  length = encode(reply, body);
+  CHECK_EQ(length, VISION_REPLY_HEADER);
+  CHECK(visionReplyParse(body, length, VISION_ACTION_RUBIK_FACE, parsed) && parsed.count == 0);
+}
+
+static void testBinaryRejects()
+{
+  uint8_t body[VISION_REPLY_BODY_MAX];
+  VisionReply reply, parsed;
+  visionReplyClear(reply);
+  reply.action = VISION_ACTION_MEMORY;
+  reply.hasConfidence = true;
+  for (int i = 0; i < 6; i++)
+  {
+    reply.values[reply.count] = i;
+    reply.confidence[reply.count++] = 90;
+  }
+  size_t length = encode(reply, body);
+
+  // Another action's reply, unless one side does not name it
+  CHECK(!visionReplyParse(body, length, VISION_ACTION_XO, parsed));
+  CHECK(visionReplyParse(body, length, VISION_ACTION_UNKNOWN, parsed) && parsed.action == VISION_ACTION_MEMORY);
+  body[2] = VISION_ACTION_UNKNOWN;
+  CHECK(visionReplyParse(body, length, VISION_ACTION_XO, parsed) && parsed.count == 6);
+  body[2] = VISION_ACTION_MEMORY;
+
+  // Truncated, one byte too many, only part of the header
+  CHECK(!visionReplyParse(body, length - 1, VISION_ACTION_MEMORY, parsed));
+  CHECK(!visionReplyParse(body, length + 1, VISION_ACTION_MEMORY, parsed));
+  CHECK(!visionReplyParse(body, VISION_REPLY_HEADER - 1, VISION_ACTION_MEMORY, parsed));
+  CHECK(!visionReplyParse(body, 1, VISION_ACTION_MEMORY, parsed));
+
+  // Header fields out of range
+  struct Corruption
+  {
+    int offset;
+    uint8_t value;
+  };
+  const Corruption corruptions[] = {
+      {1, VISION_REPLY_VERSION + 1},                     // unknown version
+      {3, 0x03 | VISION_REPLY_CONFIDENCE},               // unknown value type
+      {3, VISION_REPLY_CONFIDENCE},                      // no value type
+      {4, VISION_REPLY_MAX_VALUES + 1},                  // more than a reply holds
+      {3, VISION_REPLY_INT16 | VISION_REPLY_CONFIDENCE}, // length no longer matches
+      {3, VISION_REPLY_INT8},                            // confidence bytes left over
+  };
+  for (const Corruption &corruption : corruptions)
+  {
+    uint8_t copy[VISION_REPLY_BODY_MAX];
+    memcpy(copy, body, length);
+    copy[corruption.offset] = corruption.value;
+    CHECK(!visionReplyParse(copy, length, VISION_ACTION_MEMORY, parsed));
+  }
+  CHECK(visionReplyParse(body, length, VISION_ACTION_MEMORY, parsed) && parsed.count == 6);
+
+  // Too many values to encode, none of them is read
+  reply.count = VISION_REPLY_MAX_VALUES + 1;
+  CHECK_EQ(visionReplyEncode(reply, body, sizeof(body)), -1);
+}
+
+static void testCsv()
+{
+  VisionReply reply;
+  CHECK(parse("0,1,2,0,0", reply) && valuesAre(reply, {0, 1, 2, 0, 0}));
+  CHECK(reply.action == VISION_ACTION_UNKNOWN && !reply.hasConfidence);
+  // The action is not checked, CSV does not carry one
+  CHECK(parse("3,1", reply, VISION_ACTION_XO) && valuesAre(reply, {3, 1}));
+  CHECK(parse("\r\n 12, -3 ,4\n", reply) && valuesAre(reply, {12, -3, 4}));
+  // Trailing text after the last number is ignored
+  CHECK(parse("5,6 solved", reply) && valuesAre(reply, {5, 6}));
+  CHECK(parse("1,2,x,4", reply) && valuesAre(reply, {1, 2}));
+  CHECK(parse("7,", reply) && valuesAre(reply, {7}));
+
+  // Nothing to read is an empty reply, the server's "error" a failed one
+  CHECK(parse("", reply) && reply.count == 0);
+  CHECK(parse("ok", reply) && reply.count == 0);
+  CHECK(parse("-", reply) && reply.count == 0);
+  CHECK(!parse("error", reply));
+  CHECK(!parse("\nerror: no board found", reply));
+
+  // Cut at VISION_REPLY_MAX_VALUES
+  char text[VISION_REPLY_BODY_MAX * 2];
+  int pos = 0;
+  for (int i = 0; i < VISION_REPLY_MAX_VALUES + 5; i++)
+    pos += snprintf(text + pos, sizeof(text) - pos, i ? ",%d" : "%d", i);
+  CHECK(parse(text, reply) && reply.count == VISION_REPLY_MAX_VALUES);
+  CHECK_EQ(reply.values[VISION_REPLY_MAX_VALUES - 1], VISION_REPLY_MAX_VALUES - 1);
+
+  // Not NUL terminated: the length bounds it
+  const char body[] = {'1', '2', ',', '3', '4'};
+  CHECK(visionReplyParse((const uint8_t *)body, 4, VISION_ACTION_UNKNOWN, reply) && valuesAre(reply, {12, 3}));
+}
+
+static void testFormatCsv()
+{
+  VisionReply reply;
+  visionReplyClear(reply);
+  char text[16];
+  CHECK_EQ(visionReplyFormatCsv(reply, text, sizeof(text)), 0);
+  CHECK_EQ(strlen(text), 0);
+
+  for (int value : {11, -4, 250, 0})
+    reply.values[reply.count++] = value;
+  CHECK_EQ(visionReplyFormatCsv(reply, text, sizeof(text)), 11);
+  CHECK(strcmp(text, "11,-4,250,0") == 0);
+
+  // Cut to the buffer, the length it would have is still returned
+  CHECK_EQ(visionReplyFormatCsv(reply, text, 6), 11);
+  CHECK(strcmp(text, "11,-4") == 0);
+  CHECK_EQ(visionReplyFormatCsv(reply, text, 0), 11);
+
+  // The text parses back to the same values
+  VisionReply parsed;
+  visionReplyFormatCsv(reply, text, sizeof(text));
+  CHECK(parse(text, parsed) && valuesAre(parsed, {11, -4, 250, 0}));
+}
+
+// As in the baseline esp32.ino
+static void parseCSV(const char *csv, int arr[], int &count)
+{
+  count = 0;
+  char buffer[256];
+  strncpy(buffer, csv, sizeof(buffer));
+  buffer[sizeof(buffer) - 1] = '\0';
+
+  char *token = strtok(buffer, ",");
+
+  while (token != NULL && count < MAX_SIZE)
+  {
+    arr[count++] = atoi(token);
+    token = strtok(NULL, ",");
+  }
+}
+
+struct Sample
+{
+  const char *name;
+  uint8_t action;
+  bool hasConfidence;
+  std::initializer_list<int> values;
+};
+
+// Replies of the size the games get
+static const Sample samples[] = {
+    {"xo board", VISION_ACTION_XO, true, {0, 1, 0, 2, 0, 0, 2, 1, 1, 0, 0, 0, 1, 2, 0}},
+    {"memory cards", VISION_ACTION_MEMORY, false, {3, 1, 4, 1, 5, 9}},
+    {"cups", VISION_ACTION_CUPS, false, {2, 0, 1}},
+    {"rubik moves", VISION_ACTION_RUBIK_SOLVE, false,
+     {11, 43, 22, 51, 33, 12, 41, 23, 52, 31, 13, 42, 21, 53, 32, 11, 43, 52, 21, 33}},
+};
+
+struct Cost
+{
+  double ns;
+  double allocations;
+  double bytes;
+};
+
+template <typename Parse> static Cost measure(Parse parse)
+{
+  allocations = 0;
+  allocatedBytes = 0;
+  counting = true;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < BENCH_REPLIES; i++)
+    parse();
+  double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+  counting = false;
+  return {ns / BENCH_REPLIES, (double)allocations / BENCH_REPLIES, (double)allocatedBytes / BENCH_REPLIES};
+}
+
+static void benchReplies()
+{
+  printf("reply               bytes CSV/bin   String + parseCSV            fixed buffer, CSV      fixed buffer, binary\n");
+  for (const Sample &sample : samples)
+  {
+    VisionReply reply;
+    visionReplyClear(reply);
+    reply.action = sample.action;
+    reply.hasConfidence = sample.hasConfidence;
+    for (int value : sample.values)
+    {
+      reply.confidence[reply.count] = 80;
+      reply.values[reply.count++] = value;
+    }
+    char csv[VISION_REPLY_BODY_MAX];
+    size_t csvLength = visionReplyFormatCsv(reply, csv, sizeof(csv));
+    uint8_t binary[VISION_REPLY_BODY_MAX];
+    size_t binaryLength = encode(reply, binary);
+
+    // What the socket hands over
+    const uint8_t *wire = (const uint8_t *)csv;
+    volatile int sink = 0;
+
+    // Baseline: http.getString() fills a StreamString and returns a String copy of it,
+    // getPythonData() logs it, the game runs parseCSV() on it
+    Cost baseline = measure([&] {
+      String response(std::string((const char *)wire, csvLength));
+      if (response == "error")
+        response = "ERROR";
+      String line = "Server response: " + response;
+      int values[MAX_SIZE];
+      int count;
+      parseCSV(response.c_str(), values, count);
+      sink = sink + count + line.length();
+    });
+
+    // Now: the body read into the caller's buffer, parsed into a VisionReply
+    uint8_t body[VISION_REPLY_BODY_MAX];
+    VisionReply parsed;
+    Cost csvCost = measure([&] {
+      memcpy(body, wire, csvLength);
+      visionReplyParse(body, csvLength, sample.action, parsed);
+      sink = sink + parsed.count;
+    });
+    Cost binaryCost = measure([&] {
+      memcpy(body, binary, binaryLength);
+      visionReplyParse(body, binaryLength, sample.action, parsed);
+      sink = sink + parsed.count;
+    });
+
+    printf("  %-14s   %4u / %-4u   %6.1f ns %3.0f allocs %4.0f B   %6.1f ns %3.0f allocs   %6.1f ns %3.0f allocs\n",
+           sample.name, (unsigned)csvLength, (unsigned)binaryLength, baseline.ns, baseline.allocations, baseline.bytes,
+           csvCost.ns, csvCost.allocations, binaryCost.ns, binaryCost.allocations);
+
+    // Same values either way, in one allocation-free pass
+    int values[MAX_SIZE];
+    int count;
+    parseCSV(csv, values, count);
+    CHECK(count == reply.count && memcmp(values, reply.values, count * sizeof(int)) == 0);
+    CHECK(memcmp(parsed.values, reply.values, reply.count * sizeof(int)) == 0);
+    CHECK(baseline.allocations >= 1);
+    CHECK(csvCost.allocations == 0 && binaryCost.allocations == 0);
+    CHECK(binaryLength <= csvLength + reply.count + VISION_REPLY_HEADER);
+    CHECK(binaryCost.ns < baseline.ns);
+  }
+}
+
+int main()
+{
+  testActions();
+  testBinary();
+  testBinaryRejects();
+  testCsv();
+  testFormatCsv();
+  benchReplies();
+  return TEST_RESULT();
+}
@@ -0,0 +1,256 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+#include "test_check.h"
+#include "xo_classifier.h"
+
+// The on-device XO reader over a corpus of rendered boards: grid lines,
+// pen strokes of varying width and darkness, uneven light, sensor noise and
+// a board a few pixels off its calibration. Per cell accuracy, and how
+// often a board the device would answer on its own (XO_MIN_CONFIDENCE) is
+// read wrong
+
+// As in esp32.ino
+#define XO_MIN_CONFIDENCE 60
+static const XoClassifierLimits limits = {40, 4, 12, 12, 30};
+static const XoBoardRect board = {250, 100, 750, 900};
+
+// 1:8 decode of an XGA frame
+#define WIDTH 128
+#define HEIGHT 96
+#define BOARDS 1000
+#define SUPERSAMPLE 4
+
+static uint32_t randomState = 1;
+
+static uint32_t nextRandom()
+{
+  randomState = randomState * 1103515245 + 12345;
+  return randomState >> 8;
+}
+
+static float uniform(float low, float high)
+{
+  return low + (high - low) * (nextRandom() % 10000) / 10000.0f;
+}
+
+static float gaussian(float sigma)
+{
+  float sum = 0;
+  for (int i = 0; i < 4; i++)
+    sum += uniform(-1, 1);
+  return sum * sigma * 0.866f; // the sum of 4 uniforms has a variance of 4/3
+}
+
+struct Style
+{
+  float offsetX; // board drawn this far off its calibration, pixels
+  float offsetY;
+  float stroke;  // pen width, pixels
+  float paper;   // background gray level
+  float ink;     // pen gray level
+  float light;   // brightness change from left to right
+  float noise;   // sensor noise sigma
+  float size;    // piece size, fraction of the cell
+};
+
+static float segmentDistance(float px, float py, float ax, float ay, float bx, float by)
+{
+  float dx = bx - ax, dy = by - ay;
+  float t = ((px - ax) * dx + (py - ay) * dy) / (dx * dx + dy * dy);
+  t = t < 0 ? 0 : t > 1 ? 1 : t;
+  float ex = px - ax - t * dx, ey = py - ay - t * dy;
+  return sqrtf(ex * ex + ey * ey);
+}
+
+// True when the point is under the pen
+static bool inked(float x, float y, const uint8_t cells[9], const Style &style, float x0, float y0, float cellWidth,
+                  float cellHeight)
+{
+  float half = style.stroke / 2;
+  // Grid lines between the cells
+  for (int k = 1; k < 3; k++)
+  {
+    if (y >= y0 && y <= y0 + 3 * cellHeight && fabsf(x - (x0 + k * cellWidth)) <= half)
+      return true;
+    if (x >= x0 && x <= x0 + 3 * cellWidth && fabsf(y - (y0 + k * cellHeight)) <= half)
+      return true;
+  }
+
+  int col = (int)floorf((x - x0) / cellWidth);
+  int row = (int)floorf((y - y0) / cellHeight);
+  if (col < 0 || col > 2 || row < 0 || row > 2)
+    return false;
+  uint8_t cell = cells[row * 3 + col];
+  float cx = x0 + (col + 0.5f) * cellWidth;
+  float cy = y0 + (row + 0.5f) * cellHeight;
+  float rx = cellWidth * style.size / 2;
+  float ry = cellHeight * style.size / 2;
+  if (cell == XO_CELL_X)
+    return segmentDistance(x, y, cx - rx, cy - ry, cx + rx, cy + ry) <= half ||
+           segmentDistance(x, y, cx - rx, cy + ry, cx + rx, cy - ry) <= half;
+  if (cell == XO_CELL_O)
+  {
+    // An ellipse ring, the distance to it roughly scaled by the radius
+    float nx = (x - cx) / rx, ny = (y - cy) / ry;
+    float r = sqrtf(nx * nx + ny * ny);
+    return fabsf(r - 1) * (rx + ry) / 2 <= half;
+  }
+  return false;
+}
+
+static void render(const uint8_t cells[9], const Style &style, std::vector<uint8_t> &gray)
+{
+  float x0 = board.x0 * WIDTH / 1000.0f + style.offsetX;
+  float y0 = board.y0 * HEIGHT / 1000.0f + style.offsetY;
+  float cellWidth = (board.x1 - board.x0) * WIDTH / 1000.0f / 3;
+  float cellHeight = (board.y1 - board.y0) * HEIGHT / 1000.0f / 3;
+
+  gray.resize(WIDTH * HEIGHT);
+  for (int y = 0; y < HEIGHT; y++)
+  {
+    for (int x = 0; x < WIDTH; x++)
+    {
+      // Pen coverage of the pixel, the 1:8 decode averages 8x8 sensor pixels
+      int covered = 0;
+      for (int sy = 0; sy < SUPERSAMPLE; sy++)
+        for (int sx = 0; sx < SUPERSAMPLE; sx++)
+          covered += inked(x + (sx + 0.5f) / SUPERSAMPLE, y + (sy + 0.5f) / SUPERSAMPLE, cells, style, x0, y0,
+                           cellWidth, cellHeight);
+      float coverage = (float)covered / (SUPERSAMPLE * SUPERSAMPLE);
+      float level = style.paper + (style.ink - style.paper) * coverage;
+      level *= 1 + style.light * ((float)x / WIDTH - 0.5f);
+      level += gaussian(style.noise);
+      gray[y * WIDTH + x] = level < 0 ? 0 : level > 255 ? 255 : (uint8_t)level;
+    }
+  }
+}
+
+static Style randomStyle()
+{
+  Style style;
+  style.offsetX = uniform(-2, 2);
+  style.offsetY = uniform(-2, 2);
+  style.stroke = uniform(1.2f, 2.5f);
+  style.paper = uniform(150, 220);
+  style.ink = uniform(20, 90);
+  style.light = uniform(-0.25f, 0.25f);
+  style.noise = uniform(1, 5);
+  style.size = uniform(0.55f, 0.8f);
+  return style;
+}
+
+static void testBasics()
+{
+  std::vector<uint8_t> gray(WIDTH * HEIGHT, 200);
+  XoReading reading;
+  CHECK(!xoClassify(gray.data(), WIDTH, HEIGHT, {0, 0, 0, 0}, limits, reading));
+  CHECK(!xoClassify(gray.data(), WIDTH, HEIGHT, {0, 0, 1001, 1000}, limits, reading));
+  CHECK(!xoClassify(nullptr, WIDTH, HEIGHT, board, limits, reading));
+  // Cells of a few pixels cannot be read
+  CHECK(!xoClassify(gray.data(), WIDTH, HEIGHT, {500, 500, 560, 560}, limits, reading));
+
+  // A blank board is empty and sure of it
+  CHECK(xoClassify(gray.data(), WIDTH, HEIGHT, board, limits, reading));
+  for (int i = 0; i < 9; i++)
+    CHECK(reading.cells[i] == XO_CELL_EMPTY && reading.confidence[i] == 100);
+  CHECK_EQ(reading.boardConfidence, 100);
+
+  // The server's layout: stacks around every row
+  const uint8_t cells[9] = {XO_CELL_X, XO_CELL_O, XO_CELL_EMPTY, XO_CELL_EMPTY, XO_CELL_X,
+                            XO_CELL_O, XO_CELL_O, XO_CELL_EMPTY, XO_CELL_X};
+  memcpy(reading.cells, cells, sizeof(cells));
+  for (int i = 0; i < 9; i++)
+    reading.confidence[i] = 10 * i;
+  VisionReply reply;
+  xoFormatReply(reading, reply);
+  CHECK(reply.action == VISION_ACTION_XO && reply.count == 15 && reply.hasConfidence);
+  for (int row = 0; row < 3; row++)
+  {
+    CHECK(reply.values[row * 5] == 0 && reply.values[row * 5 + 4] == 0);
+    CHECK(reply.confidence[row * 5] == 100 && reply.confidence[row * 5 + 4] == 100);
+    for (int col = 0; col < 3; col++)
+    {
+      CHECK_EQ(reply.values[row * 5 + 1 + col], cells[row * 3 + col]);
+      CHECK_EQ(reply.confidence[row * 5 + 1 + col], 10 * (row * 3 + col));
+    }
+  }
+}
+
+static void testCorpus()
+{
+  // confusion[truth][read]
+  uint32_t confusion[3][3] = {{0}};
+  uint32_t unread = 0;
+  uint32_t confident = 0;
+  uint32_t confidentWrong = 0;
+  uint32_t wrongBoards = 0;
+  uint32_t confidentCells = 0;
+  uint32_t confidentCellsWrong = 0;
+
+  std::vector<uint8_t> gray;
+  for (int n = 0; n < BOARDS; n++)
+  {
+    uint8_t cells[9];
+    for (int i = 0; i < 9; i++)
+      cells[i] = nextRandom() % 3;
+    Style style = randomStyle();
+    render(cells, style, gray);
+
+    XoReading reading;
+    if (!xoClassify(gray.data(), WIDTH, HEIGHT, board, limits, reading))
+    {
+      unread++;
+      continue;
+    }
+
+    bool right = true;
+    for (int i = 0; i < 9; i++)
+    {
+      confusion[cells[i]][reading.cells[i]]++;
+      right = right && reading.cells[i] == cells[i];
+      if (reading.confidence[i] >= XO_MIN_CONFIDENCE)
+      {
+        confidentCells++;
+        confidentCellsWrong += reading.cells[i] != cells[i];
+      }
+    }
+    wrongBoards += !right;
+    if (reading.boardConfidence >= XO_MIN_CONFIDENCE)
+    {
+      confident++;
+      confidentWrong += !right;
+    }
+  }
+
+  const char *names[] = {"empty", "X", "O"};
+  uint32_t cells = 0, correct = 0;
+  printf("%d rendered boards, cells read as:\n", BOARDS);
+  printf("  truth    %7s %7s %7s   accuracy\n", names[0], names[1], names[2]);
+  for (int truth = 0; truth < 3; truth++)
+  {
+    uint32_t total = confusion[truth][0] + confusion[truth][1] + confusion[truth][2];
+    printf("  %-6s   %7u %7u %7u   %7.2f%%\n", names[truth], confusion[truth][0], confusion[truth][1],
+           confusion[truth][2], total ? 100.0 * confusion[truth][truth] / total : 0);
+    cells += total;
+    correct += confusion[truth][truth];
+  }
+  printf("cells: %.2f%% right, %.2f%% of the cells the reader is sure of are wrong\n", 100.0 * correct / cells,
+         confidentCells ? 100.0 * confidentCellsWrong / confidentCells : 0);
+  printf("boards: %.1f%% read right, %.1f%% answered on the device (confidence >= %d), %u of those wrong\n",
+         100.0 * (BOARDS - unread - wrongBoards) / BOARDS, 100.0 * confident / BOARDS, XO_MIN_CONFIDENCE,
+         confidentWrong);
+
+  CHECK_EQ(unread, 0);
+  CHECK(correct >= cells * 99 / 100);
+  // A board the device answers itself must be right, the others go to the server
+  CHECK_EQ(confidentWrong, 0);
+  CHECK(confident >= BOARDS * 95 / 100);
+}
+
+int main()
+{
+  testBasics();
+  testCorpus();
+  return TEST_RESULT();
+}
@@ -0,0 +1,276 @@
+#include "link_protocol.h"
+#include <string.h>
+
+uint16_t linkCrc16(const uint8_t *data, size_t len, uint16_t crc)
+{
+  for (size_t i = 0; i < len; i++)
+  {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++)
+    {
+      if (crc & 0x8000)
+        crc = (crc << 1) ^ 0x1021;
+      else
+        crc <<= 1;
+    }
+  }
+  return crc;
+}
+
+static void putInt16(uint8_t *out, int16_t value)
+{
+  out[0] = (uint8_t)(value & 0xFF);
+  out[1] = (uint8_t)(((uint16_t)value >> 8) & 0xFF);
+}
+
+static int16_t getInt16(const uint8_t *in)
+{
+  return (int16_t)(in[0] | ((uint16_t)in[1] << 8));
+}
+
+size_t linkEncodeFrame(uint8_t *out, uint8_t seq, uint8_t op, const uint8_t *payload, uint8_t len)
+{
+  if (len > LINK_MAX_PAYLOAD)
+    return 0;
+
+  out[0] = LINK_SOF;
+  out[1] = len;
+  out[2] = seq;
+  out[3] = op;
+  if (len > 0)
+    memcpy(out + 4, payload, len);
+
+  uint16_t crc = linkCrc16(out + 1, 3 + len);
+  out[4 + len] = (uint8_t)(crc & 0xFF);
+  out[5 + len] = (uint8_t)(crc >> 8);
+
+  return LINK_FRAME_OVERHEAD + len;
+}
+
+uint8_t linkPackServo(uint8_t *payload, uint8_t motor, int16_t angle, int8_t overShoot)
+{
+  payload[0] = motor;
+  putInt16(payload + 1, angle);
+  payload[3] = (uint8_t)overShoot;
+  return 4;
+}
+
+uint8_t linkPackStepper(uint8_t *payload, const int cmds[LINK_STEPPER_MOTORS * 2])
+{
+  for (int m = 0; m < LINK_STEPPER_MOTORS; m++)
+  {
+    int angle = cmds[m * 2];
+    if (angle < 0 || angle >= LINK_STEPPER_DIR_BIT)
+      return 0;
+
+    uint16_t packed = (uint16_t)angle;
+    if (cmds[m * 2 + 1])
+      packed |= LINK_STEPPER_DIR_BIT;
+    putInt16(payload + m * 2, (int16_t)packed);
+  }
+  return LINK_STEPPER_MOTORS * 2;
+}
+
+uint8_t linkPackPose(uint8_t *payload, const LinkPose &pose)
+{
+  if (pose.count == 0 || pose.count > LINK_POSE_MAX_STEPS)
+    return 0;
+
+  payload[0] = pose.count;
+  putInt16(payload + 1, (int16_t)pose.staggerMs);
+  uint8_t len = 3;
+  for (int i = 0; i < pose.count; i++)
+    len += linkPackServo(payload + len, pose.motor[i], pose.angle[i], pose.overShoot[i]);
+  return len;
+}
+
+size_t linkEncodeServo(uint8_t *out, uint8_t seq, uint8_t motor, int16_t angle, int8_t overShoot)
+{
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  uint8_t len = linkPackServo(payload, motor, angle, overShoot);
+  return linkEncodeFrame(out, seq, LINK_OP_SERVO, payload, len);
+}
+
+uint8_t linkPackStepperMove(uint8_t *payload, const LinkStepperMove &move)
+{
+  if (move.count == 0 || move.count > LINK_STEPPER_MOTORS)
+    return 0;
+
+  payload[0] = move.count;
+  uint8_t len = 1;
+  for (int i = 0; i < move.count; i++)
+  {
+    if (move.motor[i] >= LINK_STEPPER_MOTORS || move.angle[i] >= LINK_STEPPER_DIR_BIT)
+      return 0;
+
+    uint16_t packed = move.angle[i];
+    if (move.direction[i])
+      packed |= LINK_STEPPER_DIR_BIT;
+    payload[len] = move.motor[i];
+    putInt16(payload + len + 1, (int16_t)packed);
+    len += 3;
+  }
+  return len;
+}
+
+size_t linkEncodeStepper(uint8_t *out, uint8_t seq, const int cmds[LINK_STEPPER_MOTORS * 2])
+{
+  uint8_t payload[LINK_MAX_PAYLOAD];
+  uint8_t len = linkPackStepper(payload, cmds);
+  if (len == 0)
+    return 0;
+  return linkEncodeFrame(out, seq, LINK_OP_STEPPER, payload, len);
+}
+
+size_t linkEncodeAck(uint8_t *out, uint8_t seq)
+{
+  return linkEncodeFrame(out, seq, LINK_OP_ACK, nullptr, 0);
+}
+
+size_t linkEncodeNak(uint8_t *out, uint8_t seq, uint8_t code)
+{
+  return linkEncodeFrame(out, seq, LINK_OP_NAK, &code, 1);
+}
+
+bool linkDecodeServo(const LinkFrame &frame, uint8_t &motor, int16_t &angle, int8_t &overShoot)
+{
+  if (frame.op != LINK_OP_SERVO || frame.len != 4)
+    return false;
+
+  motor = frame.payload[0];
+  angle = getInt16(frame.payload + 1);
+  overShoot = (int8_t)frame.payload[3];
+  return true;
+}
+
+bool linkDecodeStepper(const LinkFrame &frame, int cmds[LINK_STEPPER_MOTORS * 2])
+{
+  if (frame.op != LINK_OP_STEPPER || frame.len != LINK_STEPPER_MOTORS * 2)
+    return false;
+
+  for (int m = 0; m < LINK_STEPPER_MOTORS; m++)
+  {
+    uint16_t packed = (uint16_t)getInt16(frame.payload + m * 2);
+    cmds[m * 2] = packed & ~LINK_STEPPER_DIR_BIT;
+    cmds[m * 2 + 1] = (packed & LINK_STEPPER_DIR_BIT) ? 1 : 0;
+  }
+  return true;
+}
+
+bool linkDecodePose(const LinkFrame &frame, LinkPose &pose)
+{
+  if (frame.op != LINK_OP_POSE || frame.len < 3)
+    return false;
+
+  uint8_t count = frame.payload[0];
+  if (count == 0 || count > LINK_POSE_MAX_STEPS || frame.len != 3 + count * 4)
+    return false;
+
+  pose.count = count;
+  pose.staggerMs = (uint16_t)getInt16(frame.payload + 1);
+  for (int i = 0; i < count; i++)
+  {
+    const uint8_t *step = frame.payload + 3 + i * 4;
+    pose.motor[i] = step[0];
+    pose.angle[i] = getInt16(step + 1);
+    pose.overShoot[i] = (int8_t)step[3];
+  }
+  return true;
+}
+
+bool linkDecodeStepperMove(const LinkFrame &frame, LinkStepperMove &move)
+{
+  if (frame.op != LINK_OP_STEPPER_SPARSE || frame.len < 1)
+    return false;
+
+  uint8_t count = frame.payload[0];
+  if (count == 0 || count > LINK_STEPPER_MOTORS || frame.len != 1 + count * 3)
+    return false;
+
+  move.count = count;
+  for (int i = 0; i < count; i++)
+  {
+    const uint8_t *step = frame.payload + 1 + i * 3;
+    if (step[0] >= LINK_STEPPER_MOTORS)
+      return false;
+
+    uint16_t packed = (uint16_t)getInt16(step + 1);
+    move.motor[i] = step[0];
+    move.angle[i] = packed & ~LINK_STEPPER_DIR_BIT;
+    move.direction[i] = (packed & LINK_STEPPER_DIR_BIT) ? 1 : 0;
+  }
+  return true;
+}
+
+LinkDecoder::LinkDecoder()
+{
+  crcErrors = 0;
+  lengthErrors = 0;
+  reset();
+}
+
+void LinkDecoder::reset()
+{
+  state = WAIT_SOF;
+  index = 0;
+  crc = 0xFFFF;
+  receivedCrc = 0;
+}
+
+LinkDecodeResult LinkDecoder::feed(uint8_t byte, LinkFrame &frame)
+{
+  switch (state)
+  {
+  case WAIT_SOF:
+    if (byte == LINK_SOF)
+    {
+      crc = 0xFFFF;
+      state = READ_LEN;
+    }
+    break;
+  case READ_LEN:
+    if (byte > LINK_MAX_PAYLOAD)
+    {
+      lengthErrors++;
+      reset();
+      return LINK_DECODE_ERROR;
+    }
+    pending.len = byte;
+    crc = linkCrc16(&byte, 1, crc);
+    state = READ_SEQ;
+    break;
+  case READ_SEQ:
+    pending.seq = byte;
+    crc = linkCrc16(&byte, 1, crc);
+    state = READ_OP;
+    break;
+  case READ_OP:
+    pending.op = byte;
+    crc = linkCrc16(&byte, 1, crc);
+    index = 0;
+    state = pending.len > 0 ? READ_PAYLOAD : READ_CRC_LO;
+    break;
+  case READ_PAYLOAD:
+    pending.payload[index++] = byte;
+    crc = linkCrc16(&byte, 1, crc);
+    if (index >= pending.len)
+      state = READ_CRC_LO;
+    break;
+  case READ_CRC_LO:
+    receivedCrc = byte;
+    state = READ_CRC_HI;
+    break;
+  case READ_CRC_HI:
+    receivedCrc |= (uint16_t)byte << 8;
+    if (receivedCrc != crc)
+    {
+      crcErrors++;
+      reset();
+      return LINK_DECODE_ERROR;
+    }
+    frame = pending;
+    reset();
+    return LINK_DECODE_FRAME;
+  }
+  return LINK_DECODE_PENDING;
+}
@@ -0,0 +1,137 @@
+#ifndef LINK_PROTOCOL_H
+#define LINK_PROTOCOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Binary framing for the ESP32 <-> Arduino link.
+ *
+ * Frame layout (multi-byte fields are little-endian):
+ *   [SOF 0xA5][len][seq][opcode][payload: len bytes][crc16 lo][crc16 hi]
+ *
+ * The CRC is CRC-16/CCITT-FALSE over len, seq, opcode and payload.
+ * This file has no Arduino dependencies so it also builds on a host.
+ */
+
+#define LINK_SOF 0xA5
+#define LINK_MAX_PAYLOAD 32
+#define LINK_FRAME_OVERHEAD 6
+#define LINK_MAX_FRAME (LINK_MAX_PAYLOAD + LINK_FRAME_OVERHEAD)
+
+#define LINK_STEPPER_MOTORS 5
+#define LINK_STEPPER_DIR_BIT 0x8000
+
+#define LINK_POSE_MAX_STEPS 7
+#define LINK_POSE_SEQUENTIAL 0xFFFF // each step waits for the previous one to finish
+#define LINK_POSE_GROUPED 0x8000    // | mask: bit i set = step i starts together with step i - 1
+
+enum LinkOpcode
+{
+  LINK_OP_SERVO = 0x01,          // motor:u8, angle:i16, overshoot:i8
+  LINK_OP_STEPPER = 0x02,        // 5 x u16 (angle, bit 15 = direction)
+  LINK_OP_POSE = 0x03,           // count:u8, stagger:u16, count x (motor:u8, angle:i16, overshoot:i8)
+  LINK_OP_BAUD = 0x04,           // baud:u32, acked at the old rate before both sides switch
+  LINK_OP_ECHO = 0x05,           // opaque payload, the peer replies with an ECHO carrying the same bytes
+  LINK_OP_STEPPER_SPARSE = 0x06, // count:u8, count x (motor:u8, angle:u16, bit 15 = direction)
+  LINK_OP_ACK = 0x80,            // empty payload, seq echoes the command
+  LINK_OP_NAK = 0x81             // code:u8
+};
+
+enum LinkNakCode
+{
+  LINK_NAK_CRC = 1,
+  LINK_NAK_BAD_OPCODE = 2,
+  LINK_NAK_BAD_PAYLOAD = 3,
+  LINK_NAK_BUSY = 4
+};
+
+enum LinkDecodeResult
+{
+  LINK_DECODE_PENDING,
+  LINK_DECODE_FRAME,
+  LINK_DECODE_ERROR
+};
+
+struct LinkFrame
+{
+  uint8_t seq;
+  uint8_t op;
+  uint8_t len;
+  uint8_t payload[LINK_MAX_PAYLOAD];
+};
+
+// Multi-joint move acknowledged once. Steps run in order, `staggerMs` apart,
+// or one after the other when staggerMs is LINK_POSE_SEQUENTIAL. With
+// LINK_POSE_GROUPED the steps form groups that run together, each group
+// waiting for the previous one to finish.
+struct LinkPose
+{
+  uint8_t count;
+  uint16_t staggerMs;
+  uint8_t motor[LINK_POSE_MAX_STEPS];
+  int16_t angle[LINK_POSE_MAX_STEPS];
+  int8_t overShoot[LINK_POSE_MAX_STEPS];
+};
+
+// Stepper command carrying only the motors that turn, all of them start together
+struct LinkStepperMove
+{
+  uint8_t count;
+  uint8_t motor[LINK_STEPPER_MOTORS];
+  uint16_t angle[LINK_STEPPER_MOTORS];
+  uint8_t direction[LINK_STEPPER_MOTORS];
+};
+
+uint16_t linkCrc16(const uint8_t *data, size_t len, uint16_t crc = 0xFFFF);
+
+// Payload packers write into `payload` (at least LINK_MAX_PAYLOAD bytes) and return its length, 0 on error
+uint8_t linkPackServo(uint8_t *payload, uint8_t motor, int16_t angle, int8_t overShoot);
+uint8_t linkPackStepper(uint8_t *payload, const int cmds[LINK_STEPPER_MOTORS * 2]);
+uint8_t linkPackPose(uint8_t *payload, const LinkPose &pose);
+uint8_t linkPackStepperMove(uint8_t *payload, const LinkStepperMove &move);
+
+// Encoders write into `out` (at least LINK_MAX_FRAME bytes) and return the frame length, 0 on error
+size_t linkEncodeFrame(uint8_t *out, uint8_t seq, uint8_t op, const uint8_t *payload, uint8_t len);
+size_t linkEncodeServo(uint8_t *out, uint8_t seq, uint8_t motor, int16_t angle, int8_t overShoot);
+size_t linkEncodeStepper(uint8_t *out, uint8_t seq, const int cmds[LINK_STEPPER_MOTORS * 2]);
+size_t linkEncodeAck(uint8_t *out, uint8_t seq);
+size_t linkEncodeNak(uint8_t *out, uint8_t seq, uint8_t code);
+
+// Payload decoders, return false if the frame does not carry a valid payload for that opcode
+bool linkDecodeServo(const LinkFrame &frame, uint8_t &motor, int16_t &angle, int8_t &overShoot);
+bool linkDecodeStepper(const LinkFrame &frame, int cmds[LINK_STEPPER_MOTORS * 2]);
+bool linkDecodePose(const LinkFrame &frame, LinkPose &pose);
+bool linkDecodeStepperMove(const LinkFrame &frame, LinkStepperMove &move);
+
+// Incremental byte-at-a-time decoder, resynchronises on the next SOF after an error
+class LinkDecoder
+{
+public:
+  LinkDecoder();
+  void reset();
+  LinkDecodeResult feed(uint8_t byte, LinkFrame &frame);
+
+  uint32_t crcErrors;
+  uint32_t lengthErrors;
+
+private:
+  enum State
+  {
+    WAIT_SOF,
+    READ_LEN,
+    READ_SEQ,
+    READ_OP,
+    READ_PAYLOAD,
+    READ_CRC_LO,
+    READ_CRC_HI
+  };
+
+  State state;
+  uint8_t index;
+  uint16_t crc;
+  uint16_t receivedCrc;
+  LinkFrame pending;
+};
+
+#endif
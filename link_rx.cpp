@@ -0,0 +1,109 @@
+#include "link_rx.h"
+
+ByteRing::ByteRing()
+{
+  dropped = 0;
+  head.store(0);
+  tail.store(0);
+}
+
+bool ByteRing::push(uint8_t byte)
+{
+  uint16_t h = head.load(std::memory_order_relaxed);
+  uint16_t t = tail.load(std::memory_order_acquire);
+  if ((uint16_t)(h - t) >= LINK_RX_RING_SIZE)
+  {
+    dropped++;
+    return false;
+  }
+
+  data[h & (LINK_RX_RING_SIZE - 1)] = byte;
+  head.store(h + 1, std::memory_order_release);
+  return true;
+}
+
+int ByteRing::pop()
+{
+  uint16_t t = tail.load(std::memory_order_relaxed);
+  uint16_t h = head.load(std::memory_order_acquire);
+  if (h == t)
+    return -1;
+
+  uint8_t byte = data[t & (LINK_RX_RING_SIZE - 1)];
+  tail.store(t + 1, std::memory_order_release);
+  return byte;
+}
+
+size_t ByteRing::available() const
+{
+  return (uint16_t)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire));
+}
+
+void ByteRing::clear()
+{
+  // Consumer side only: drop everything pushed so far
+  tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+LineAssembler::LineAssembler()
+{
+  overflows = 0;
+  reset();
+}
+
+void LineAssembler::reset()
+{
+  len = 0;
+  complete = false;
+  overflowed = false;
+  buffer[0] = '\0';
+}
+
+bool LineAssembler::feed(uint8_t byte)
+{
+  if (complete)
+  {
+    len = 0;
+    complete = false;
+  }
+
+  if (byte == '\n')
+  {
+    if (overflowed)
+    {
+      // The line did not fit, drop it instead of returning a truncated reply
+      overflowed = false;
+      len = 0;
+      return false;
+    }
+
+    if (len > 0 && buffer[len - 1] == '\r')
+      len--;
+    buffer[len] = '\0';
+    complete = true;
+    return true;
+  }
+
+  if (overflowed)
+    return false;
+
+  if (len >= LINK_MAX_LINE - 1)
+  {
+    overflows++;
+    overflowed = true;
+    return false;
+  }
+
+  buffer[len++] = (char)byte;
+  return false;
+}
+
+const char *LineAssembler::line() const
+{
+  return buffer;
+}
+
+uint8_t LineAssembler::length() const
+{
+  return len;
+}
@@ -0,0 +1,54 @@
+#ifndef LINK_RX_H
+#define LINK_RX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+
+/**
+ * Receive-side buffers for the Arduino link. Both classes use static storage
+ * only and have no Arduino dependencies so they also build on a host.
+ */
+
+#define LINK_RX_RING_SIZE 256 // must be a power of two
+#define LINK_MAX_LINE 64
+
+// Single-producer single-consumer byte ring: the UART task pushes, the link reader pops
+class ByteRing
+{
+public:
+  ByteRing();
+  bool push(uint8_t byte);
+  int pop(); // next byte or -1 when empty
+  size_t available() const;
+  void clear();
+
+  uint32_t dropped;
+
+private:
+  uint8_t data[LINK_RX_RING_SIZE];
+  std::atomic<uint16_t> head; // written by the producer
+  std::atomic<uint16_t> tail; // written by the consumer
+};
+
+// Assembles '\n' terminated lines from arbitrarily split input, a trailing '\r' is stripped
+class LineAssembler
+{
+public:
+  LineAssembler();
+  void reset();
+  // Returns true once a complete line is available through line()
+  bool feed(uint8_t byte);
+  const char *line() const;
+  uint8_t length() const;
+
+  uint32_t overflows;
+
+private:
+  char buffer[LINK_MAX_LINE];
+  uint8_t len;
+  bool complete;
+  bool overflowed;
+};
+
+#endif
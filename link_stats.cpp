@@ -0,0 +1,93 @@
+#include "link_stats.h"
+#include "arduino_link.h"
+
+LinkStats linkStats;
+
+static const char *commandNames[LINK_CMD_COUNT] = {"servo", "stepper", "pose"};
+static const char *motorNames[LINK_STATS_MOTORS] = {"base", "shoulder", "elbow", "wrist", "grip"};
+static const char *executorNames[LINK_EXEC_COUNT] = {"memory", "xoX", "xoO", "cups", "rubik"};
+
+void linkStatsRecordMotor(int motor, uint32_t rttUs)
+{
+  if (motor >= 0 && motor < LINK_STATS_MOTORS)
+    linkStats.motorRtt[motor].record(rttUs);
+}
+
+void linkStatsRetryHook(RetryOutcome outcome, uint8_t attempts, void *ctx)
+{
+  uintptr_t executor = (uintptr_t)ctx;
+  if (executor >= LINK_EXEC_COUNT)
+    return;
+
+  if (outcome == RETRY_FAILED)
+    linkStats.executorRetries[executor].fetch_add(1, std::memory_order_relaxed);
+  else if (outcome == RETRY_GAVE_UP)
+    linkStats.executorGaveUp[executor].fetch_add(1, std::memory_order_relaxed);
+}
+
+void appendHistogram(String &json, const char *name, const LogHistogram &hist)
+{
+  json += "\"" + String(name) + "\":{";
+  json += "\"count\":" + String(hist.count());
+  json += ",\"p50\":" + String(hist.percentile(50));
+  json += ",\"p90\":" + String(hist.percentile(90));
+  json += ",\"p99\":" + String(hist.percentile(99));
+  json += ",\"max\":" + String(hist.max());
+
+  // Only non-empty buckets, keyed by their upper bound
+  json += ",\"buckets\":{";
+  bool first = true;
+  for (uint8_t i = 0; i < LOG_HISTOGRAM_BUCKETS; i++)
+  {
+    uint32_t n = hist.bucketCount(i);
+    if (n == 0)
+      continue;
+    if (!first)
+      json += ",";
+    first = false;
+    json += "\"" + String(LogHistogram::bucketUpper(i)) + "\":" + String(n);
+  }
+  json += "}}";
+}
+
+String linkStatsJson()
+{
+  ArduinoLinkStatus status;
+  getArduinoLinkStatus(status);
+
+  String json = "{\"unit\":\"us\",\"commands\":{";
+  for (int i = 0; i < LINK_CMD_COUNT; i++)
+  {
+    if (i > 0)
+      json += ",";
+    appendHistogram(json, commandNames[i], linkStats.commandRtt[i]);
+  }
+
+  json += "},\"motors\":{";
+  for (int i = 0; i < LINK_STATS_MOTORS; i++)
+  {
+    if (i > 0)
+      json += ",";
+    appendHistogram(json, motorNames[i], linkStats.motorRtt[i]);
+  }
+
+  json += "},\"timeouts\":" + String(linkStats.timeouts.load() + status.windowTimeouts);
+  json += ",\"nonOkReplies\":" + String(linkStats.nonOkReplies.load() + status.naks);
+  json += ",\"busy\":" + String(linkStats.busy.load());
+  json += ",\"retries\":{\"retransmits\":" + String(status.retransmits);
+  for (int i = 0; i < LINK_EXEC_COUNT; i++)
+    json += ",\"" + String(executorNames[i]) + "\":" + String(linkStats.executorRetries[i].load());
+  json += "},\"armCache\":{\"elidedSteps\":" + String(status.elidedSteps);
+  json += ",\"elidedCommands\":" + String(status.elidedCommands);
+  json += ",\"resets\":" + String(status.armStateResets);
+  json += "},\"gaveUp\":{";
+  for (int i = 0; i < LINK_EXEC_COUNT; i++)
+  {
+    if (i > 0)
+      json += ",";
+    json += "\"" + String(executorNames[i]) + "\":" + String(linkStats.executorGaveUp[i].load());
+  }
+  json += "}}";
+
+  return json;
+}
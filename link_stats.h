@@ -0,0 +1,57 @@
+#ifndef LINK_STATS_H
+#define LINK_STATS_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "log_histogram.h"
+#include "retry_policy.h"
+
+/**
+ * Arduino link statistics: round-trip histograms (microseconds) per command
+ * type and per ArmMotor, plus error and retry counters. Everything is fixed
+ * size and updated without locks, the HTTP handler only reads it.
+ */
+
+enum LinkCommandKind
+{
+  LINK_CMD_SERVO,
+  LINK_CMD_STEPPER,
+  LINK_CMD_POSE,
+  LINK_CMD_COUNT
+};
+
+// Game-level executors that resubmit a command after a failure
+enum LinkExecutor
+{
+  LINK_EXEC_MEMORY,
+  LINK_EXEC_XO_X,
+  LINK_EXEC_XO_O,
+  LINK_EXEC_CUPS,
+  LINK_EXEC_RUBIK,
+  LINK_EXEC_COUNT
+};
+
+#define LINK_STATS_MOTORS 5 // ArmMotor BASE..GRIP
+
+struct LinkStats
+{
+  LogHistogram commandRtt[LINK_CMD_COUNT];
+  LogHistogram motorRtt[LINK_STATS_MOTORS];
+  std::atomic<uint32_t> timeouts;     // ASCII replies that never came
+  std::atomic<uint32_t> nonOkReplies; // ASCII replies other than "OK"
+  std::atomic<uint32_t> busy;         // commands refused while an ASCII job ran
+  std::atomic<uint32_t> executorRetries[LINK_EXEC_COUNT];
+  std::atomic<uint32_t> executorGaveUp[LINK_EXEC_COUNT];
+};
+
+extern LinkStats linkStats;
+
+void linkStatsRecordMotor(int motor, uint32_t rttUs);
+// RetryHook that counts retries, pass LINK_STATS_CTX(executor) as its context
+void linkStatsRetryHook(RetryOutcome outcome, uint8_t attempts, void *ctx);
+#define LINK_STATS_CTX(executor) ((void *)(uintptr_t)(executor))
+String linkStatsJson();
+// "name":{"count":..,"p50":..,"p90":..,"p99":..,"max":..,"buckets":{..}}
+void appendHistogram(String &json, const char *name, const LogHistogram &hist);
+
+#endif
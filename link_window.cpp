@@ -0,0 +1,230 @@
+#include "link_window.h"
+
+LinkWindow::LinkWindow(const LinkTransport &transport, unsigned long retransmitMs, uint8_t maxRetries)
+{
+  this->transport = transport;
+  this->retransmitMs = retransmitMs;
+  this->maxRetries = maxRetries;
+  nextTicket = 0;
+  sent = 0;
+  retransmits = 0;
+  failures = 0;
+  timeouts = 0;
+  naks = 0;
+  reset();
+}
+
+void LinkWindow::reset()
+{
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+    slots[i].state = SLOT_FREE;
+  decoder.reset();
+}
+
+uint8_t LinkWindow::outstanding() const
+{
+  uint8_t count = 0;
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+  {
+    if (slots[i].state == SLOT_IN_FLIGHT || slots[i].state == SLOT_EXTERNAL)
+      count++;
+  }
+  return count;
+}
+
+bool LinkWindow::full() const
+{
+  if (spanExhausted())
+    return true;
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+  {
+    if (slots[i].state == SLOT_FREE)
+      return false;
+  }
+  return true;
+}
+
+int LinkWindow::findSlot(LinkTicket ticket) const
+{
+  if (ticket < 0)
+    return -1;
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+  {
+    if (slots[i].state != SLOT_FREE && slots[i].ticket == ticket)
+      return i;
+  }
+  return -1;
+}
+
+int LinkWindow::findSeq(uint8_t seq) const
+{
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+  {
+    if (slots[i].state != SLOT_FREE && (uint8_t)slots[i].ticket == seq)
+      return i;
+  }
+  return -1;
+}
+
+// A new sequence number would make the peer forget an unacked one
+bool LinkWindow::spanExhausted() const
+{
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+  {
+    if (slots[i].state == SLOT_IN_FLIGHT && (uint8_t)(nextTicket - slots[i].ticket) >= LINK_SEQ_SPAN)
+      return true;
+  }
+  return false;
+}
+
+int LinkWindow::allocSlot()
+{
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+  {
+    if (slots[i].state == SLOT_FREE)
+      return i;
+  }
+  return -1;
+}
+
+void LinkWindow::transmit(Slot &slot)
+{
+  transport.write(slot.frame, slot.len, transport.ctx);
+  slot.sentAt = transport.now(transport.ctx);
+}
+
+LinkTicket LinkWindow::submit(uint8_t op, const uint8_t *payload, uint8_t len, unsigned long timeoutMs)
+{
+  int idx = allocSlot();
+  if (idx < 0 || spanExhausted())
+    return LINK_TICKET_INVALID;
+
+  Slot &slot = slots[idx];
+  slot.ticket = nextTicket;
+  nextTicket = (nextTicket + 1) & LINK_TICKET_MASK;
+  slot.len = linkEncodeFrame(slot.frame, (uint8_t)slot.ticket, op, payload, len);
+  if (slot.len == 0)
+    return LINK_TICKET_INVALID;
+
+  slot.retries = 0;
+  slot.timeoutMs = timeoutMs > 0 ? timeoutMs : retransmitMs;
+  slot.state = SLOT_IN_FLIGHT;
+  transmit(slot);
+  sent++;
+
+  return slot.ticket;
+}
+
+LinkTicket LinkWindow::reserve()
+{
+  int idx = allocSlot();
+  if (idx < 0)
+    return LINK_TICKET_INVALID;
+
+  Slot &slot = slots[idx];
+  slot.ticket = nextTicket;
+  nextTicket = (nextTicket + 1) & LINK_TICKET_MASK;
+  slot.len = 0;
+  slot.state = SLOT_EXTERNAL;
+
+  return slot.ticket;
+}
+
+void LinkWindow::finish(LinkTicket ticket, bool ok)
+{
+  int idx = findSlot(ticket);
+  if (idx >= 0 && slots[idx].state == SLOT_EXTERNAL)
+    slots[idx].state = ok ? SLOT_ACKED : SLOT_FAILED;
+}
+
+void LinkWindow::handleFrame(const LinkFrame &frame)
+{
+  int idx = findSeq(frame.seq);
+  if (idx < 0 || slots[idx].state != SLOT_IN_FLIGHT)
+    return; // Duplicate or stale reply
+
+  Slot &slot = slots[idx];
+  if (frame.op == LINK_OP_ACK)
+  {
+    slot.state = SLOT_ACKED;
+  }
+  else if (frame.op == LINK_OP_NAK)
+  {
+    naks++;
+    // A corrupted frame is worth resending, anything else will fail again
+    bool corrupted = frame.len > 0 && frame.payload[0] == LINK_NAK_CRC;
+    if (corrupted && slot.retries < maxRetries)
+    {
+      slot.retries++;
+      retransmits++;
+      transmit(slot);
+    }
+    else
+    {
+      slot.state = SLOT_FAILED;
+      failures++;
+    }
+  }
+}
+
+void LinkWindow::poll()
+{
+  LinkFrame frame;
+  int c;
+  while ((c = transport.read(transport.ctx)) >= 0)
+  {
+    if (decoder.feed((uint8_t)c, frame) == LINK_DECODE_FRAME)
+      handleFrame(frame);
+  }
+
+  unsigned long now = transport.now(transport.ctx);
+  for (int i = 0; i < LINK_WINDOW_SIZE; i++)
+  {
+    Slot &slot = slots[i];
+    if (slot.state != SLOT_IN_FLIGHT || now - slot.sentAt < slot.timeoutMs)
+      continue;
+
+    timeouts++;
+    if (slot.retries < maxRetries)
+    {
+      slot.retries++;
+      retransmits++;
+      transmit(slot);
+    }
+    else
+    {
+      slot.state = SLOT_FAILED;
+      failures++;
+    }
+  }
+}
+
+LinkTicketStatus LinkWindow::check(LinkTicket ticket)
+{
+  if (ticket == LINK_TICKET_DONE)
+    return LINK_TICKET_ACKED;
+
+  int idx = findSlot(ticket);
+  if (idx < 0)
+    return LINK_TICKET_UNKNOWN;
+
+  Slot &slot = slots[idx];
+  switch (slot.state)
+  {
+  case SLOT_ACKED:
+    slot.state = SLOT_FREE;
+    return LINK_TICKET_ACKED;
+  case SLOT_FAILED:
+    slot.state = SLOT_FREE;
+    return LINK_TICKET_FAILED;
+  default:
+    return LINK_TICKET_PENDING;
+  }
+}
+
+void LinkWindow::release(LinkTicket ticket)
+{
+  int idx = findSlot(ticket);
+  if (idx >= 0)
+    slots[idx].state = SLOT_FREE;
+}
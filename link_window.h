@@ -0,0 +1,117 @@
+#ifndef LINK_WINDOW_H
+#define LINK_WINDOW_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "link_protocol.h"
+
+/**
+ * Sliding command window on top of the binary link protocol.
+ *
+ * Up to LINK_WINDOW_SIZE commands can be outstanding at once. Each one is
+ * identified by its sequence number, acks are matched out of order and only
+ * frames that have not been acked are retransmitted. The peer is expected to
+ * ack a repeated sequence number without executing the command twice, so it
+ * has to remember the last LINK_SEQ_SPAN of them: while a command waits for
+ * its ack, later ones may only run that far ahead of it.
+ *
+ * The window is transport agnostic: bytes, time and writes go through the
+ * LinkTransport callbacks so it also runs on a host.
+ *
+ * A ticket is the 15 bit count of the command, its low byte the sequence
+ * number on the wire. A ticket kept after its command finished therefore no
+ * longer matches a newer command that reuses the sequence number, it reads
+ * LINK_TICKET_UNKNOWN.
+ */
+
+#define LINK_WINDOW_SIZE 4
+#define LINK_SEQ_SPAN 16 // sequence numbers the peer remembers to spot a retransmission
+#define LINK_TICKET_INVALID -1
+#define LINK_TICKET_DONE -2 // a command with nothing to send, reads as acked and holds no slot
+#define LINK_TICKET_MASK 0x7FFF
+
+typedef int16_t LinkTicket;
+
+enum LinkTicketStatus
+{
+  LINK_TICKET_PENDING,
+  LINK_TICKET_ACKED,
+  LINK_TICKET_FAILED,
+  LINK_TICKET_UNKNOWN
+};
+
+struct LinkTransport
+{
+  void (*write)(const uint8_t *buf, size_t len, void *ctx);
+  int (*read)(void *ctx); // next received byte or -1
+  unsigned long (*now)(void *ctx);
+  void *ctx;
+};
+
+class LinkWindow
+{
+public:
+  LinkWindow(const LinkTransport &transport, unsigned long retransmitMs, uint8_t maxRetries);
+
+  // Queue a command and send it right away, returns LINK_TICKET_INVALID if the window is full.
+  // timeoutMs overrides the retransmit timeout for commands that take longer to execute.
+  LinkTicket submit(uint8_t op, const uint8_t *payload, uint8_t len, unsigned long timeoutMs = 0);
+  // Tickets for commands executed outside the window (e.g. the ASCII fallback)
+  LinkTicket reserve();
+  void finish(LinkTicket ticket, bool ok);
+
+  // Drain received bytes, match acks and retransmit expired frames
+  void poll();
+  // Status of a ticket, a finished ticket is released once its result has been read
+  LinkTicketStatus check(LinkTicket ticket);
+  // Give up on a ticket, a late ack for it is ignored
+  void release(LinkTicket ticket);
+
+  // Drop every outstanding command, the counters are kept
+  void reset();
+  uint8_t outstanding() const;
+  bool full() const;
+
+  uint32_t sent;
+  uint32_t retransmits;
+  uint32_t failures;
+  uint32_t timeouts; // ack deadlines missed, including those followed by a retransmit
+  uint32_t naks;
+
+private:
+  enum SlotState
+  {
+    SLOT_FREE,
+    SLOT_IN_FLIGHT,
+    SLOT_EXTERNAL,
+    SLOT_ACKED,
+    SLOT_FAILED
+  };
+
+  struct Slot
+  {
+    SlotState state;
+    LinkTicket ticket;
+    uint8_t retries;
+    unsigned long sentAt;
+    unsigned long timeoutMs;
+    uint8_t len;
+    uint8_t frame[LINK_MAX_FRAME];
+  };
+
+  int findSlot(LinkTicket ticket) const;
+  int findSeq(uint8_t seq) const;
+  bool spanExhausted() const;
+  int allocSlot();
+  void transmit(Slot &slot);
+  void handleFrame(const LinkFrame &frame);
+
+  LinkTransport transport;
+  unsigned long retransmitMs;
+  uint8_t maxRetries;
+  LinkTicket nextTicket;
+  LinkDecoder decoder;
+  Slot slots[LINK_WINDOW_SIZE];
+};
+
+#endif
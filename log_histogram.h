@@ -0,0 +1,108 @@
+#ifndef LOG_HISTOGRAM_H
+#define LOG_HISTOGRAM_H
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * Fixed-size histogram with power-of-two buckets.
+ *
+ * record() is a relaxed atomic increment plus a compare-and-swap on the
+ * maximum, so it can be called from any task without a lock while a reader
+ * builds a report. Header only with no Arduino dependencies so it also
+ * builds on a host.
+ */
+
+// Bucket 0 holds 0, bucket i holds [2^(i-1), 2^i), the last one also everything above
+#define LOG_HISTOGRAM_BUCKETS 27
+
+class LogHistogram
+{
+public:
+  LogHistogram()
+  {
+    reset();
+  }
+
+  void record(uint32_t value)
+  {
+    counts[bucketFor(value)].fetch_add(1, std::memory_order_relaxed);
+
+    uint32_t seen = maxValue.load(std::memory_order_relaxed);
+    while (value > seen && !maxValue.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  void reset()
+  {
+    for (int i = 0; i < LOG_HISTOGRAM_BUCKETS; i++)
+      counts[i].store(0, std::memory_order_relaxed);
+    maxValue.store(0, std::memory_order_relaxed);
+  }
+
+  uint32_t count() const
+  {
+    uint32_t total = 0;
+    for (int i = 0; i < LOG_HISTOGRAM_BUCKETS; i++)
+      total += counts[i].load(std::memory_order_relaxed);
+    return total;
+  }
+
+  uint32_t bucketCount(uint8_t bucket) const
+  {
+    return bucket < LOG_HISTOGRAM_BUCKETS ? counts[bucket].load(std::memory_order_relaxed) : 0;
+  }
+
+  uint32_t max() const
+  {
+    return maxValue.load(std::memory_order_relaxed);
+  }
+
+  // Upper bound of the bucket holding the given percentile, never above max()
+  uint32_t percentile(uint8_t pct) const
+  {
+    uint32_t total = count();
+    if (total == 0)
+      return 0;
+
+    uint32_t rank = (uint32_t)(((uint64_t)total * pct + 99) / 100);
+    if (rank == 0)
+      rank = 1;
+
+    uint32_t seen = 0;
+    for (uint8_t i = 0; i < LOG_HISTOGRAM_BUCKETS; i++)
+    {
+      seen += counts[i].load(std::memory_order_relaxed);
+      if (seen >= rank)
+      {
+        uint32_t upper = bucketUpper(i);
+        return upper < max() ? upper : max();
+      }
+    }
+    return max();
+  }
+
+  static uint8_t bucketFor(uint32_t value)
+  {
+    if (value == 0)
+      return 0;
+
+    uint8_t bucket = 32 - __builtin_clz(value);
+    return bucket < LOG_HISTOGRAM_BUCKETS ? bucket : LOG_HISTOGRAM_BUCKETS - 1;
+  }
+
+  // Largest value that lands in a bucket
+  static uint32_t bucketUpper(uint8_t bucket)
+  {
+    if (bucket >= LOG_HISTOGRAM_BUCKETS - 1)
+      return UINT32_MAX;
+    return (1UL << bucket) - 1;
+  }
+
+private:
+  std::atomic<uint32_t> counts[LOG_HISTOGRAM_BUCKETS];
+  std::atomic<uint32_t> maxValue;
+};
+
+#endif
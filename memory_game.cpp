@@ -1,5 +1,7 @@
 #include "memory_game.h"
 #include "game_utils.h"
+#include "move_script.h"
+#include "state_profiler.h"
 #include <Arduino.h>
 #include <stdlib.h>
 // #include <ctime>
@@ -13,7 +15,6 @@
 
 extern void changeConfig(String command);
 extern String getPythonData(String command);
-extern void parseCSV(const char *csv, int arr[], int &count);
 extern bool sendServoCommand(int a1, int a2, int a3);
 extern bool sendStepperCommand(const int cmds[]);
 extern void printOnLCD(const String &msg);
@@ -35,27 +36,13 @@ enum MemoryGameState
   GAME_COMPLETED
 };
 
-// States for the grabbing and releasing sequences
+// States for the grabbing and releasing sequences, each one is a single pose command
 enum ArmMoveState
 {
   MOVE_IDLE,
-  GRAB_OPEN_GRIP,
-  GRAB_SHOULDER_DEFAULT,
-  GRAB_SET_BASE,
-  GRAB_SET_WRIST,
-  GRAB_SET_ELBOW,
-  GRAB_SET_SHOULDER,
-  GRAB_CLOSE_GRIP,
-  RELEASE_SHOULDER_DEFAULT,
-  RELEASE_SET_ELBOW_INTERIM,
-  RELEASE_SET_BASE,
-  RELEASE_SET_WRIST_INTERIM,
-  RELEASE_SET_ELBOW,
-  RELEASE_SET_WRIST_MID,
-  RELEASE_SET_SHOULDER_UP,
-  RELEASE_SET_WRIST_FINAL,
-  RELEASE_SET_SHOULDER_FINAL,
-  RELEASE_OPEN_GRIP,
+  GRAB_PICK,         // Open grip, lift shoulder, reach the source cell and close the grip
+  RELEASE_CARRY,     // Lift, swing to the destination and lower the elbow (drop if it is the output)
+  RELEASE_PLACE,     // Settle wrist and shoulder on the destination and open the grip
   MOVE_COMPLETE
 };
 
@@ -75,12 +62,14 @@ public:
   }
 };
 
-Position cell_0(126, 20, 75, 43);
-Position cell_1(111, 29, 90, 50);
-Position cell_2(94, 26, 85, 48);
-Position cell_3(133, 48, 124, 61);
-Position cell_4(113, 55, 135, 67);
-Position cell_5(91, 55, 134, 69);
+// Board cells 0-5 (base, shoulder, elbow, wrist), see calibrateArmTable
+int boardAngles[CELLS_CNT][4] = {
+    {126, 20, 75, 43},
+    {111, 29, 90, 50},
+    {94, 26, 85, 48},
+    {133, 48, 124, 61},
+    {113, 55, 135, 67},
+    {91, 55, 134, 69}};
 Position cell_6(82, 85, 169, 66);  // Temporary position 1
 Position cell_7(147, 78, 165, 72); // Temporary position 2
 Position cell_8(30, 105, 124, 50); // Output position
@@ -96,6 +85,21 @@ int srcIdx = -1;
 int destIdx = -1;
 Position currentSrc(0, 0, 0, 0);
 Position currentDest(0, 0, 0, 0);
+STATE_PROFILER(gameProfile, "memory");
+STATE_PROFILER(armProfile, "memoryArm");
+int nextRevealCell = -1;
+bool visionPending = false; // a board read is running, see module()
+VisionFuture boardRead = VISION_FUTURE_INVALID;
+bool visionResultReady = false;
+bool preMoveStarted = false;
+VisionStatus visionStatus;
+VisionReply visionValues;
+int armAt = -1; // cell the arm last moved a card to, -1 when unknown
+ArmTimingModel travelModel;
+bool memoryRandomPick = false; // the first picker: random cells, fixed order, kept to measure travel against
+bool memoryOverlapRead = true;  // false: the arm stands still until the board is read, kept to measure the overlap
+RetryPolicy armRetry(RETRY_BASE_MS, RETRY_MAX_MS, RETRY_MAX_ATTEMPTS, linkStatsRetryHook, LINK_STATS_CTX(LINK_EXEC_MEMORY));
+MoveScriptRunner armMove(armRetry);
 
 // Game state variables
 int complete = 0;                   // Counter to track the number of completed shapes
@@ -112,20 +116,11 @@ bool matchFound = false;            // Flag to indicate if a match was found
 
 Position getPosition(int idx)
 {
+  if (idx >= 0 && idx < CELLS_CNT)
+    return Position(boardAngles[idx][0], boardAngles[idx][1], boardAngles[idx][2], boardAngles[idx][3]);
+
   switch (idx)
   {
-  case 0:
-    return cell_0;
-  case 1:
-    return cell_1;
-  case 2:
-    return cell_2;
-  case 3:
-    return cell_3;
-  case 4:
-    return cell_4;
-  case 5:
-    return cell_5;
   case 6:
     return cell_6;
   case 7:
@@ -137,30 +132,147 @@ Position getPosition(int idx)
   }
 }
 
-bool executeServoMoveNonBlocking(ArmMotor motor, int angle, int overShoot)
+void getAnglesForPosition(int idx, int angles[4])
 {
-  static unsigned long lastServoAttemptTime = 0;
-  const unsigned long SERVO_RETRY_DELAY = 500; // ms
+  Position position = getPosition(idx);
+  angles[0] = position.base;
+  angles[1] = position.shoulder;
+  angles[2] = position.elbow;
+  angles[3] = position.wrist;
+}
 
-  unsigned long currentTime = millis();
-  if (currentTime - lastServoAttemptTime < SERVO_RETRY_DELAY)
+// Estimated arm travel time between two cells, every joint moves one after the other
+uint32_t travelMs(int from, int to)
+{
+  if (from < 0)
   {
-    return false; // Not enough time has passed for retry
+    uint32_t ms = 0;
+    for (int joint = ArmMotor::BASE; joint <= ArmMotor::WRIST; joint++)
+      ms += travelModel.servoTravelMs(joint, ARM_TIMING_UNKNOWN_ANGLE, 0);
+    return ms;
   }
 
-  bool success = sendServoCommand(motor, angle, overShoot);
-  lastServoAttemptTime = currentTime;
+  Position a = getPosition(from);
+  Position b = getPosition(to);
+  return travelModel.servoTravelMs(ArmMotor::BASE, a.base, b.base) +
+         travelModel.servoTravelMs(ArmMotor::SHOULDER, a.shoulder, b.shoulder) +
+         travelModel.servoTravelMs(ArmMotor::ELBOW, a.elbow, b.elbow) +
+         travelModel.servoTravelMs(ArmMotor::WRIST, a.wrist, b.wrist);
+}
 
-  return success;
+// Time to fetch the card at `from` and put it down at `to`, starting where the arm is
+uint32_t cardMoveMs(int from, int to)
+{
+  return travelMs(armAt, from) + travelMs(from, to);
+}
+
+// Target goal of a cell, grip left out
+ArmGoal cellGoal(const Position &cell)
+{
+  ArmGoal goal;
+  armGoalBegin(goal);
+  armGoalSet(goal, ArmMotor::BASE, cell.base);
+  armGoalSet(goal, ArmMotor::SHOULDER, cell.shoulder);
+  armGoalSet(goal, ArmMotor::ELBOW, cell.elbow);
+  armGoalSet(goal, ArmMotor::WRIST, cell.wrist);
+  return goal;
+}
+
+// Lift and hover over the next cell while the camera result is on its way,
+// the grab that follows only has to lower the shoulder
+MOVE_SCRIPT(preMoveScript,
+            stepTo(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER, 10),
+            stepToTarget(ArmMotor::BASE),
+            stepToTarget(ArmMotor::WRIST),
+            stepToTarget(ArmMotor::ELBOW),
+            stepTo(ArmMotor::GRIP, GRIP_OPEN));
+
+// Open grip, lift shoulder, reach the source cell and close the grip
+MOVE_SCRIPT(grabScript,
+            stepTo(ArmMotor::GRIP, GRIP_OPEN),
+            stepTo(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER, 10),
+            stepToTarget(ArmMotor::BASE),
+            stepToTarget(ArmMotor::WRIST),
+            stepToTarget(ArmMotor::ELBOW),
+            stepToTarget(ArmMotor::SHOULDER),
+            stepTo(ArmMotor::GRIP, GRIP_CLOSED));
+
+// Lift, swing to the destination and lower the elbow
+MOVE_SCRIPT(carryScript,
+            stepTo(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER, 10),
+            stepTo(ArmMotor::ELBOW, 140),
+            stepToTarget(ArmMotor::BASE),
+            stepTo(ArmMotor::WRIST, 45),
+            stepToTarget(ArmMotor::ELBOW));
+
+// Same, dropping the card over the output position
+MOVE_SCRIPT(carryDropScript,
+            stepTo(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER, 10),
+            stepTo(ArmMotor::ELBOW, 140),
+            stepToTarget(ArmMotor::BASE),
+            stepTo(ArmMotor::WRIST, 45),
+            stepToTarget(ArmMotor::ELBOW),
+            stepTo(ArmMotor::GRIP, GRIP_OPEN));
+
+// Settle wrist and shoulder on the destination and open the grip
+MOVE_SCRIPT(placeScript,
+            stepTo(ArmMotor::WRIST, 55),
+            stepToTarget(ArmMotor::SHOULDER, 10),
+            stepToTarget(ArmMotor::WRIST),
+            stepToTarget(ArmMotor::SHOULDER),
+            stepTo(ArmMotor::GRIP, GRIP_OPEN));
+
+// Reaching a cell: the shoulder stays up while the other joints swing, the grip is
+// open before the shoulder goes down and closes only once the arm is in place
+static const ArmConstraint reachConstraints[] = {
+    {ARM_REQUIRE_MIN, ArmMotor::SHOULDER, ArmMotor::BASE, DEFAULT_ANGLE_SHOULDER, 2, 10},
+    {ARM_REQUIRE_MIN, ArmMotor::SHOULDER, ArmMotor::WRIST, DEFAULT_ANGLE_SHOULDER, 2, 10},
+    {ARM_REQUIRE_MIN, ArmMotor::SHOULDER, ArmMotor::ELBOW, DEFAULT_ANGLE_SHOULDER, 2, 10},
+    {ARM_REQUIRE_MIN, ArmMotor::GRIP, ArmMotor::SHOULDER, GRIP_OPEN, 0, 0},
+    {ARM_ORDER, ArmMotor::BASE, ArmMotor::GRIP, 0, 0, 0},
+    {ARM_ORDER, ArmMotor::WRIST, ArmMotor::GRIP, 0, 0, 0},
+    {ARM_ORDER, ArmMotor::ELBOW, ArmMotor::GRIP, 0, 0, 0},
+    {ARM_ORDER, ArmMotor::SHOULDER, ArmMotor::GRIP, 0, 0, 0}};
+
+// Start the move of an arm state from the current source and destination
+void setupArmPose(ArmMoveState state)
+{
+  ArmGoal goal;
+  ArmPose pose;
+
+  switch (state)
+  {
+  case GRAB_PICK:
+    goal = cellGoal(currentSrc);
+    armGoalSet(goal, ArmMotor::GRIP, GRIP_CLOSED);
+    if (planPose(pose, goal, reachConstraints, sizeof(reachConstraints) / sizeof(reachConstraints[0])))
+      armMove.start(pose);
+    else
+      armMove.start(grabScript, goal);
+    break;
+  case RELEASE_CARRY:
+    if (destIdx == 8)
+      armMove.start(carryDropScript, cellGoal(currentDest));
+    else
+      armMove.start(carryScript, cellGoal(currentDest));
+    break;
+  case RELEASE_PLACE:
+    armMove.start(placeScript, cellGoal(currentDest));
+    break;
+  default:
+    break;
+  }
+  armState = state;
 }
 
 void startMoveOperation(int from, int to)
 {
+  armAt = to;
   srcIdx = from;
   destIdx = to;
   currentSrc = getPosition(from);
   currentDest = getPosition(to);
-  armState = GRAB_OPEN_GRIP;
+  setupArmPose(GRAB_PICK);
   if((from == 6 || from == 7) && to < 6){
     printOnLCD("Return cell" + String(from));
   }
@@ -178,105 +290,27 @@ void startMoveOperation(int from, int to)
 
 bool updateArmMove()
 {
-  static unsigned long lastAttemptTime = 0;
-  const unsigned long RETRY_DELAY = 100; // ms
-
-  unsigned long currentTime = millis();
-  if (currentTime - lastAttemptTime < RETRY_DELAY)
-  {
-    return false;
-  }
-  lastAttemptTime = currentTime;
-
-  bool stateCompleted = false;
-
   switch (armState)
   {
-  case GRAB_OPEN_GRIP:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::GRIP, GRIP_OPEN, 0);
-    if (stateCompleted)
-      armState = GRAB_SHOULDER_DEFAULT;
-    break;
-  case GRAB_SHOULDER_DEFAULT:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER, 10);
-    if (stateCompleted)
-      armState = GRAB_SET_BASE;
-    break;
-  case GRAB_SET_BASE:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::BASE, currentSrc.base, 0);
-    if (stateCompleted)
-      armState = GRAB_SET_WRIST;
-    break;
-  case GRAB_SET_WRIST:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::WRIST, currentSrc.wrist, 0);
-    if (stateCompleted)
-      armState = GRAB_SET_ELBOW;
-    break;
-  case GRAB_SET_ELBOW:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::ELBOW, currentSrc.elbow, 0);
-    if (stateCompleted)
-      armState = GRAB_SET_SHOULDER;
-    break;
-  case GRAB_SET_SHOULDER:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::SHOULDER, currentSrc.shoulder, 0);
-    if (stateCompleted)
-      armState = GRAB_CLOSE_GRIP;
+  case GRAB_PICK:
+    if (armMove.update())
+      setupArmPose(RELEASE_CARRY);
     break;
-  case GRAB_CLOSE_GRIP:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::GRIP, GRIP_CLOSED, 0);
-    if (stateCompleted)
-      armState = RELEASE_SHOULDER_DEFAULT;
-    break;
-  case RELEASE_SHOULDER_DEFAULT:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER, 10);
-    if (stateCompleted)
-      armState = RELEASE_SET_ELBOW_INTERIM;
-    break;
-  case RELEASE_SET_ELBOW_INTERIM:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::ELBOW, 140, 0);
-    if (stateCompleted)
-      armState = RELEASE_SET_BASE;
-    break;
-  case RELEASE_SET_BASE:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::BASE, currentDest.base, 0);
-    if (stateCompleted)
-      armState = RELEASE_SET_WRIST_INTERIM;
-    break;
-  case RELEASE_SET_WRIST_INTERIM:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::WRIST, 45, 0);
-    if (stateCompleted)
-      armState = RELEASE_SET_ELBOW;
-    break;
-  case RELEASE_SET_ELBOW:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::ELBOW, currentDest.elbow, 0);
-    if (stateCompleted){
-      if(destIdx == 8) armState = RELEASE_OPEN_GRIP;
-      else armState = RELEASE_SET_WRIST_MID;
+  case RELEASE_CARRY:
+    if (armMove.update())
+    {
+      if (destIdx != 8)
+      {
+        setupArmPose(RELEASE_PLACE);
+        break;
+      }
+      armState = MOVE_COMPLETE;
+      Serial.println("Move operation completed");
+      return true;
     }
     break;
-  case RELEASE_SET_WRIST_MID:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::WRIST, 55, 0);
-    if (stateCompleted)
-      armState = RELEASE_SET_SHOULDER_UP;
-    break;
-  case RELEASE_SET_SHOULDER_UP:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::SHOULDER, currentDest.shoulder + 10, 0);
-    if (stateCompleted)
-      armState = RELEASE_SET_WRIST_FINAL;
-    break;
-  case RELEASE_SET_WRIST_FINAL:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::WRIST, currentDest.wrist, 0);
-    if (stateCompleted)
-      armState = RELEASE_SET_SHOULDER_FINAL;
-    break;
-  case RELEASE_SET_SHOULDER_FINAL:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::SHOULDER, currentDest.shoulder, 0);
-    if (stateCompleted)
-      armState = RELEASE_OPEN_GRIP;
-    break;
-  case RELEASE_OPEN_GRIP:
-    stateCompleted = executeServoMoveNonBlocking(ArmMotor::GRIP, GRIP_OPEN, 0);
-    if (stateCompleted)
+  case RELEASE_PLACE:
+    if (armMove.update())
     {
       armState = MOVE_COMPLETE;
       Serial.println("Move operation completed");
@@ -335,78 +369,62 @@ void initializeGameState()
   Serial.println("Game state initialized");
 }
 
-int pickRandomCell(int currentMatrixState[][COLS])
+// Pick the unknown cell other than `skip` that is quickest to reveal into temporary cell `slot`.
+// All unknown cells are equally likely to hold any shape, so only travel matters.
+int pickUnknownCell(int currentMatrixState[][COLS], int slot, int skip)
 {
-  const int OUT_POSITION = 8; // Consistent with the game loop
-  // Create a list of valid positions to pick from
+  int selectedPosition = -1;
+  uint32_t bestMs = 0;
   int validPositions[CELLS_CNT];
   int validCount = 0;
 
-
-  Serial.println("currest state matrix in random");
   for (int i = 0; i < ROWS; i++)
   {
     for (int j = 0; j < COLS; j++)
     {
-      Serial.print(currentMatrixState[i][j]);
-      Serial.print(", ");
-    }
-    Serial.println(" ");
-  }
-  
-
-  // Find all valid positions (positions that still have cards and are not matched)
-  for (int i = 0; i < ROWS; i++)
-  {
-    for (int j = 0; j < COLS; j++)
-    {
-      int shape = currentMatrixState[i][j];
       int pos = i * COLS + j;
-      /*
-      Serial.print("shape: ");
-      Serial.println(shape);
-      Serial.print("pos: ");
-      Serial.println(pos);
-      */
-
-      if (shape == -1)
+      if (currentMatrixState[i][j] != -1 || pos == skip)
+        continue;
+
+      validPositions[validCount++] = pos;
+      uint32_t ms = cardMoveMs(pos, slot);
+      if (selectedPosition == -1 || ms < bestMs)
       {
-        validPositions[validCount] = pos;
-        validCount++;
+        selectedPosition = pos;
+        bestMs = ms;
       }
     }
   }
-  
-  Serial.print("validCount: ");
-  Serial.println(validCount);
 
-  Serial.println("valid position arr");
-  for (int i = 0; i < validCount; i++)
+  if (selectedPosition == -1)
+    return -1;
+  if (memoryRandomPick)
   {
-    Serial.print(validPositions[i]);
-    Serial.print(", ");
+    selectedPosition = validPositions[millis() % validCount];
+    bestMs = cardMoveMs(selectedPosition, slot);
   }
-  Serial.println("");
-  
-  // If we have valid positions, pick one randomly
-  if (validCount > 0)
-  {
-    int randomIndex = millis() % validCount;
-    int selectedPosition = validPositions[randomIndex];
-    // int selectedPosition = validPositions[0];
 
-    Serial.print("Picked random cell: ");
-    Serial.print(selectedPosition);
-    Serial.print(" (row=");
-    Serial.print(selectedPosition / COLS);
-    Serial.print(", col=");
-    Serial.print(selectedPosition % COLS);
-    Serial.println(")");
-
-    Serial.println("exit random function");
+  Serial.print("Picked cell: ");
+  Serial.print(selectedPosition);
+  Serial.print(" (row=");
+  Serial.print(selectedPosition / COLS);
+  Serial.print(", col=");
+  Serial.print(selectedPosition % COLS);
+  Serial.print(", ");
+  Serial.print(bestMs);
+  Serial.println(" ms)");
+  return selectedPosition;
+}
 
-    return selectedPosition;
+// A shape with one card seen, the next card turned may be its pair
+bool halfKnownPair()
+{
+  for (int shape = 0; shape < SHAPES; shape++)
+  {
+    if (!cardMatched[shape] && cardPositions[shape][0] != -1 && cardPositions[shape][1] == -1)
+      return true;
   }
+  return false;
 }
 
 void recordCardPosition(int shape, int position)
@@ -436,20 +454,17 @@ void recordCardPosition(int shape, int position)
   }
 }
 
-void convetStringTo2D(String input, int length, int outputArray[2][3])
+void convertReplyTo2D(const VisionReply &reply, int length, int outputArray[2][3])
 {
-  int arr[CELLS_CNT];
-  int count = 0;
-  parseCSV(input.c_str(), arr, count);
-  if (count > 0)
+  if (reply.count > 0)
   {
-    for (int i = 0; i < length; i++)
+    for (int i = 0; i < length && i < reply.count; i++)
     {
       int row = i / COLS;
       int col = i % COLS;
       if (row < ROWS && col < COLS)
       {
-        outputArray[row][col] = arr[i];
+        outputArray[row][col] = reply.values[i];
       }
     }
     Serial.println("Converted 2D Array:");
@@ -465,14 +480,53 @@ void convetStringTo2D(String input, int length, int outputArray[2][3])
   }
   else
   {
-    Serial.println("Error: parseCSV returned count 0 or less.");
+    Serial.println("Error: the board read returned no values.");
   }
 }
 
-void module(int outputArray[2][3])
+// Read the board without blocking, returns true once outputArray holds the result.
+// As soon as the frame is taken the arm hovers over `nextCell` (-1: stays where it
+// is) while the image is uploaded, the result is used once that move is done too.
+bool module(int outputArray[2][3], int nextCell)
 {
-  String values = getPythonData("memory");
-  convetStringTo2D(values, CELLS_CNT, outputArray);
+  if (!visionPending)
+  {
+    // The card was just turned, an older buffered frame would still show it face down
+    boardRead = startPythonData("memory", VISION_DEFAULT_TIMEOUT_MS, millis());
+    if (boardRead == VISION_FUTURE_INVALID)
+      return false;
+    visionPending = true;
+    visionResultReady = false;
+    preMoveStarted = false;
+  }
+
+  if (!preMoveStarted && nextCell >= 0 && memoryOverlapRead && pythonDataCaptured(boardRead))
+  {
+    ArmGoal goal = cellGoal(getPosition(nextCell));
+    armGoalSet(goal, ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER);
+    armGoalSet(goal, ArmMotor::GRIP, GRIP_OPEN);
+    ArmPose pose;
+    if (planPose(pose, goal, reachConstraints, sizeof(reachConstraints) / sizeof(reachConstraints[0])))
+      armMove.start(pose);
+    else
+      armMove.start(preMoveScript, goal);
+    preMoveStarted = true;
+  }
+
+  if (!visionResultReady)
+    visionResultReady = pollVisionReply(boardRead, visionStatus, visionValues);
+  // The next move starts from wherever this one ends, never cut it short
+  if (preMoveStarted && !armMove.update())
+    return false;
+  if (!visionResultReady)
+    return false;
+
+  visionPending = false;
+  boardRead = VISION_FUTURE_INVALID;
+  if (visionStatus != VISION_DONE)
+    visionReplyClear(visionValues);
+  convertReplyTo2D(visionValues, CELLS_CNT, outputArray);
+  return true;
 }
 
 void startMemoryGame()
@@ -480,6 +534,11 @@ void startMemoryGame()
   Serial.println("Starting Memory Game");
   changeConfig("memory");
   initializeGameState();
+  calibrateArmTable("memory board", boardAngles, ROWS, COLS);
+  armRetry.reset();
+  armAt = -1;
+  visionPending = false;
+  boardRead = VISION_FUTURE_INVALID;
   gameState = GAME_INIT;
 }
 
@@ -490,6 +549,21 @@ void memoryGameLoop()
   int pos2 = -1;
   int secondCardPos = -1;
 
+  PROFILE_STATE(gameProfile, gameState);
+  PROFILE_STATE(armProfile, armState);
+
+  // The arm gave up on a move, the cards are no longer where the game thinks
+  if (armRetry.gaveUp() && gameState != GAME_COMPLETED)
+  {
+    Serial.println("Arm not responding, game over");
+    armMove.cancel();
+    cancelPythonData(boardRead);
+    boardRead = VISION_FUTURE_INVALID;
+    visionPending = false;
+    armState = MOVE_IDLE;
+    gameState = GAME_COMPLETED;
+  }
+
   unsigned long currentTime = millis();
 
   // Enforce minimum delay between state transitions
@@ -647,7 +721,7 @@ void memoryGameLoop()
 
     case GAME_PICK_RANDOM1:
       // Pick first random card
-      rnd1 = pickRandomCell(currentMatrixState);
+      rnd1 = pickUnknownCell(currentMatrixState, 6, -1);
 
       // Check if we could find a valid position
       if (rnd1 == -1)
@@ -697,9 +771,14 @@ void memoryGameLoop()
     case GAME_REVEAL1:
       if (armState == MOVE_IDLE)
       {
+        // With no pair half known rnd1 cannot match, the next card surely comes from here.
+        // Otherwise the arm stays put, a wrong guess costs two moves.
+        if (!visionPending)
+          nextRevealCell = halfKnownPair() ? -1 : pickUnknownCell(currentMatrixState, 7, rnd1);
         // Read the card with camera
         int matrixFromCamera[2][3];
-        module(matrixFromCamera);
+        if (!module(matrixFromCamera, nextRevealCell))
+          break;
 
         // Get the shape of the card
         int row = rnd1 / COLS;
@@ -745,7 +824,7 @@ void memoryGameLoop()
       // Pick second random card, different from the first
       do
       {
-        rnd2 = pickRandomCell(currentMatrixState);
+        rnd2 = pickUnknownCell(currentMatrixState, 7, rnd1);
 
         // Check if we could find a valid position
         if (rnd2 == -1)
@@ -773,7 +852,8 @@ void memoryGameLoop()
       {
         // Read the card with camera
         int matrixFromCamera[2][3];
-        module(matrixFromCamera);
+        if (!module(matrixFromCamera, -1))
+          break;
 
         // Get the shape of the card
         int row = rnd2 / COLS;
@@ -825,8 +905,16 @@ void memoryGameLoop()
       break;
 
     case GAME_MOVE_MATCHED_CARD1:
+    {
       // Handle moving the first matched card to output area
-      if (tempPositions[0] != -1 && (cardPositions[currentShape1][0] == tempPositions[0] || cardPositions[currentShape1][1] == tempPositions[0]))
+      bool inTemp1 = tempPositions[0] != -1 && (cardPositions[currentShape1][0] == tempPositions[0] || cardPositions[currentShape1][1] == tempPositions[0]);
+      bool inTemp2 = tempPositions[1] != -1 && (cardPositions[currentShape1][0] == tempPositions[1] || cardPositions[currentShape1][1] == tempPositions[1]);
+
+      // Both cards revealed: dump the one closer to the arm first
+      if (inTemp1 && inTemp2 && !memoryRandomPick && cardMoveMs(7, OUT_POSITION) < cardMoveMs(6, OUT_POSITION))
+        inTemp1 = false;
+
+      if (inTemp1)
       {
         // Card 1 is already in temp position 6
         startMoveOperation(6, OUT_POSITION);
@@ -845,7 +933,7 @@ void memoryGameLoop()
           cardPositions[currentShape1][1] = OUT_POSITION;
         }
       }
-      else if (tempPositions[1] != -1 && (cardPositions[currentShape1][0] == tempPositions[1] || cardPositions[currentShape1][1] == tempPositions[1]))
+      else if (inTemp2)
       {
         // Card 1 is already in temp position 7
         startMoveOperation(7, OUT_POSITION);
@@ -870,12 +958,13 @@ void memoryGameLoop()
         // Find which position has a valid card on the board (not in OUT_POSITION)
         int cardPos = -1;
 
-        if (cardPositions[currentShape1][0] < 6)
+        if (cardPositions[currentShape1][0] >= 0 && cardPositions[currentShape1][0] < 6)
         { // Valid board position (0-5)
           cardPos = cardPositions[currentShape1][0];
         }
-        else if (cardPositions[currentShape1][1] < 6)
-        { // Valid board position (0-5)
+        if (cardPositions[currentShape1][1] >= 0 && cardPositions[currentShape1][1] < 6 &&
+            (cardPos == -1 || (!memoryRandomPick && cardMoveMs(cardPositions[currentShape1][1], OUT_POSITION) < cardMoveMs(cardPos, OUT_POSITION))))
+        { // Both on the board: start with the closer one
           cardPos = cardPositions[currentShape1][1];
         }
 
@@ -916,6 +1005,7 @@ void memoryGameLoop()
       gameState = GAME_MOVE_MATCHED_CARD2;
       lastStateChangeTime = currentTime;
       break;
+    }
 
     case GAME_MOVE_MATCHED_CARD2:
       // Handle moving the second matched card to output area
@@ -1013,16 +1103,16 @@ void memoryGameLoop()
       break;
 
     case GAME_RETURN_UNMATCHED:
-      // Return unmatched cards to their original positions
-      if (tempPositions[1] != -1)
+      // Return unmatched cards to their original positions, in the order that saves travel
+      if (tempPositions[1] != -1 &&
+          (tempPositions[0] == -1 || memoryRandomPick ||
+           cardMoveMs(7, tempPositions[1]) + travelMs(tempPositions[1], 6) <= cardMoveMs(6, tempPositions[0]) + travelMs(tempPositions[0], 7)))
       {
-        // Return second card first
         startMoveOperation(7, tempPositions[1]);
         tempPositions[1] = -1;
       }
       else if (tempPositions[0] != -1)
       {
-        // Then return first card
         startMoveOperation(6, tempPositions[0]);
         tempPositions[0] = -1;
       }
@@ -1053,4 +1143,10 @@ void stopMemoryGame()
   changeConfig("none");
   gameState = GAME_IDLE;
   armState = MOVE_IDLE;
+  armMove.cancel();
+  cancelPythonData(boardRead);
+  boardRead = VISION_FUTURE_INVALID;
+  visionPending = false;
+  PROFILE_STOP(gameProfile);
+  PROFILE_STOP(armProfile);
 }
\ No newline at end of file
@@ -0,0 +1,122 @@
+#include "move_script.h"
+#include "game_utils.h"
+
+uint8_t moveScriptSegment(const MoveStep *script, uint8_t count, uint8_t first, const ArmGoal &target,
+                          LinkPose &pose, uint16_t &settleMs)
+{
+  pose.count = 0;
+  pose.staggerMs = LINK_POSE_SEQUENTIAL;
+  settleMs = 0;
+
+  uint8_t i = first;
+  while (i < count && pose.count < LINK_POSE_MAX_STEPS)
+  {
+    const MoveStep &step = script[i++];
+    int angle = step.value;
+    if (step.kind == MOVE_TARGET)
+    {
+      if (target.angle[step.joint] == ARM_PLAN_KEEP)
+        angle = ARM_PLAN_KEEP;
+      else
+        angle += target.angle[step.joint];
+    }
+
+    if (angle != ARM_PLAN_KEEP)
+    {
+      pose.motor[pose.count] = step.joint;
+      pose.angle[pose.count] = angle;
+      pose.overShoot[pose.count] = step.overShoot;
+      pose.count++;
+    }
+
+    if (step.settleMs > 0)
+    {
+      settleMs = step.settleMs;
+      break;
+    }
+  }
+  return i;
+}
+
+MoveScriptRunner::MoveScriptRunner(RetryPolicy &retry) : retry(retry)
+{
+  script = nullptr;
+  count = 0;
+  next = 0;
+  pose.count = 0;
+  ticket = LINK_TICKET_INVALID;
+  settleMs = 0;
+  settleFrom = 0;
+  running = false;
+  settling = false;
+}
+
+void MoveScriptRunner::start(const MoveStep *script, uint8_t count, const ArmGoal &target)
+{
+  cancel();
+  this->script = script;
+  this->count = count;
+  this->target = target;
+  next = 0;
+  running = true;
+  nextSegment();
+}
+
+void MoveScriptRunner::start(const LinkPose &pose)
+{
+  cancel();
+  script = nullptr;
+  count = 0;
+  next = 0;
+  this->pose = pose;
+  settleMs = 0;
+  running = true;
+}
+
+void MoveScriptRunner::nextSegment()
+{
+  next = moveScriptSegment(script, count, next, target, pose, settleMs);
+  settling = false;
+}
+
+bool MoveScriptRunner::update()
+{
+  if (!running)
+    return true;
+
+  if (!settling)
+  {
+    // A segment made only of skipped target steps has nothing to send
+    if (pose.count > 0 && !executePose(pose, ticket, retry))
+      return false;
+    settling = true;
+    settleFrom = millis();
+  }
+
+  if (millis() - settleFrom < settleMs)
+    return false;
+
+  if (next >= count)
+  {
+    running = false;
+    settling = false;
+    return true;
+  }
+
+  nextSegment();
+  return false;
+}
+
+void MoveScriptRunner::cancel()
+{
+  if (ticket != LINK_TICKET_INVALID)
+    cancelLinkCommand(ticket);
+  ticket = LINK_TICKET_INVALID;
+  running = false;
+  settling = false;
+}
+
+bool MoveScriptRunner::busy() const
+{
+  return running;
+}
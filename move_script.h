@@ -0,0 +1,122 @@
+#ifndef MOVE_SCRIPT_H
+#define MOVE_SCRIPT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "arm_planner.h"
+#include "link_window.h"
+#include "retry_policy.h"
+
+/**
+ * Move scripts: fixed arm sequences declared as constant arrays of steps.
+ *
+ * A step sends one joint to an absolute angle, or to the angle of the same
+ * joint in a target goal plus an offset ("target shoulder + 10"), so one
+ * script serves every cell or cup. Steps run one after the other and go out
+ * as a single pose command, a step with a settle time ends the command and
+ * the rest of the script starts settleMs after it is acknowledged.
+ *
+ * MOVE_SCRIPT() checks the steps at compile time and keeps the array in
+ * flash. moveScriptSegment() only fills in a pose, so the commands a script
+ * sends can be checked without the link.
+ */
+
+#define MOVE_SCRIPT_MIN_ANGLE 0
+#define MOVE_SCRIPT_MAX_ANGLE 180
+#define MOVE_SCRIPT_MAX_OFFSET 90
+
+enum MoveTargetKind
+{
+  MOVE_ABSOLUTE, // value is the angle
+  MOVE_TARGET    // value is added to the target angle of the joint
+};
+
+struct MoveStep
+{
+  uint8_t joint;
+  uint8_t kind;
+  int16_t value;
+  int8_t overShoot;
+  uint16_t settleMs;
+};
+
+constexpr MoveStep stepTo(uint8_t joint, int angle, int overShoot = 0, uint16_t settleMs = 0)
+{
+  return MoveStep{joint, MOVE_ABSOLUTE, (int16_t)angle, (int8_t)overShoot, settleMs};
+}
+
+constexpr MoveStep stepToTarget(uint8_t joint, int offset = 0, int overShoot = 0, uint16_t settleMs = 0)
+{
+  return MoveStep{joint, MOVE_TARGET, (int16_t)offset, (int8_t)overShoot, settleMs};
+}
+
+constexpr bool moveStepValid(const MoveStep &step)
+{
+  return step.joint < ARM_TIMING_JOINTS &&
+         (step.kind == MOVE_ABSOLUTE
+              ? step.value >= MOVE_SCRIPT_MIN_ANGLE && step.value <= MOVE_SCRIPT_MAX_ANGLE
+              : step.kind == MOVE_TARGET && step.value >= -MOVE_SCRIPT_MAX_OFFSET && step.value <= MOVE_SCRIPT_MAX_OFFSET);
+}
+
+// `run` is the number of steps already in the current pose command
+constexpr bool moveStepsValid(const MoveStep *steps, size_t count, size_t run)
+{
+  return count == 0 ||
+         (moveStepValid(steps[0]) && run < LINK_POSE_MAX_STEPS &&
+          moveStepsValid(steps + 1, count - 1, steps[0].settleMs > 0 ? 0 : run + 1));
+}
+
+template <size_t N>
+constexpr bool moveScriptValid(const MoveStep (&steps)[N])
+{
+  return N > 0 && N <= 255 && moveStepsValid(steps, N, 0);
+}
+
+#define MOVE_SCRIPT(name, ...)                           \
+  static constexpr MoveStep name[] = {__VA_ARGS__};      \
+  static_assert(moveScriptValid(name), "invalid move script " #name)
+
+// Build the pose command starting at step `first`, returns the index of the step after it.
+// Target steps are skipped when the target has no angle (ARM_PLAN_KEEP) for their joint.
+uint8_t moveScriptSegment(const MoveStep *script, uint8_t count, uint8_t first, const ArmGoal &target,
+                          LinkPose &pose, uint16_t &settleMs);
+
+/**
+ * Runs a move script, or a single pose (e.g. from the planner), without
+ * blocking: call update() from the game loop until it returns true.
+ */
+class MoveScriptRunner
+{
+public:
+  explicit MoveScriptRunner(RetryPolicy &retry);
+
+  void start(const MoveStep *script, uint8_t count, const ArmGoal &target);
+  template <size_t N>
+  void start(const MoveStep (&script)[N], const ArmGoal &target)
+  {
+    start(script, (uint8_t)N, target);
+  }
+  void start(const LinkPose &pose);
+
+  // True once the last command is acknowledged and has settled, and while idle
+  bool update();
+  void cancel();
+  bool busy() const;
+
+private:
+  void nextSegment();
+
+  RetryPolicy &retry;
+  const MoveStep *script;
+  uint8_t count;
+  uint8_t next;
+  ArmGoal target;
+  LinkPose pose;
+  LinkTicket ticket;
+  uint16_t settleMs;
+  unsigned long settleFrom;
+  bool running;
+  bool settling;
+};
+
+#endif
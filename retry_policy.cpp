@@ -0,0 +1,101 @@
+#include "retry_policy.h"
+
+RetryPolicy::RetryPolicy(unsigned long baseMs, unsigned long maxMs, uint8_t maxAttempts, RetryHook hook, void *hookCtx)
+{
+  this->baseMs = baseMs;
+  this->maxMs = maxMs;
+  this->maxAttempts = maxAttempts;
+  this->hook = hook;
+  this->hookCtx = hookCtx;
+  jitterState = 0x9E3779B9;
+  reset();
+}
+
+void RetryPolicy::setHook(RetryHook hook, void *hookCtx)
+{
+  this->hook = hook;
+  this->hookCtx = hookCtx;
+}
+
+void RetryPolicy::reset()
+{
+  failed = 0;
+  exhausted = false;
+  waitFrom = 0;
+  waitMs = 0;
+}
+
+bool RetryPolicy::ready(unsigned long now) const
+{
+  return !exhausted && now - waitFrom >= waitMs;
+}
+
+void RetryPolicy::success(unsigned long now)
+{
+  uint8_t attempts = failed + 1;
+  failed = 0;
+  waitFrom = now;
+  waitMs = 0;
+
+  if (hook)
+    hook(RETRY_SUCCEEDED, attempts, hookCtx);
+}
+
+bool RetryPolicy::failure(unsigned long now)
+{
+  failed++;
+  waitFrom = now;
+
+  if (failed >= maxAttempts)
+  {
+    exhausted = true;
+    waitMs = 0;
+    if (hook)
+      hook(RETRY_GAVE_UP, failed, hookCtx);
+    return false;
+  }
+
+  waitMs = nextBackoff();
+  if (hook)
+    hook(RETRY_FAILED, failed, hookCtx);
+  return true;
+}
+
+void RetryPolicy::defer(unsigned long now)
+{
+  waitFrom = now;
+  waitMs = baseMs;
+}
+
+bool RetryPolicy::gaveUp() const
+{
+  return exhausted;
+}
+
+uint8_t RetryPolicy::attempts() const
+{
+  return failed;
+}
+
+unsigned long RetryPolicy::backoffMs() const
+{
+  return waitMs;
+}
+
+// Equal jitter: half of the exponential delay is fixed, the other half random
+unsigned long RetryPolicy::nextBackoff()
+{
+  unsigned long delayMs = baseMs;
+  for (uint8_t i = 1; i < failed && delayMs < maxMs; i++)
+    delayMs *= 2;
+  if (delayMs > maxMs)
+    delayMs = maxMs;
+
+  // xorshift32, good enough to keep the executors from retrying in lockstep
+  jitterState ^= jitterState << 13;
+  jitterState ^= jitterState >> 17;
+  jitterState ^= jitterState << 5;
+
+  unsigned long half = delayMs / 2;
+  return half + jitterState % (delayMs - half + 1);
+}
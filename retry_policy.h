@@ -0,0 +1,66 @@
+#ifndef RETRY_POLICY_H
+#define RETRY_POLICY_H
+
+#include <stdint.h>
+
+/**
+ * Retry and backoff policy shared by the arm command executors.
+ *
+ * After a success the next command may start right away. After a failure
+ * the next attempt waits an exponentially growing, jittered delay and the
+ * policy gives up once maxAttempts consecutive attempts have failed.
+ * The caller passes the current time in, so the policy has no clock of
+ * its own and builds on a host.
+ */
+
+#define RETRY_BASE_MS 100
+#define RETRY_MAX_MS 2000
+#define RETRY_MAX_ATTEMPTS 5
+
+enum RetryOutcome
+{
+  RETRY_SUCCEEDED,
+  RETRY_FAILED,  // another attempt will follow after the backoff
+  RETRY_GAVE_UP  // maxAttempts reached, nothing runs until reset()
+};
+
+typedef void (*RetryHook)(RetryOutcome outcome, uint8_t attempts, void *ctx);
+
+class RetryPolicy
+{
+public:
+  RetryPolicy(unsigned long baseMs = RETRY_BASE_MS, unsigned long maxMs = RETRY_MAX_MS,
+              uint8_t maxAttempts = RETRY_MAX_ATTEMPTS, RetryHook hook = nullptr, void *hookCtx = nullptr);
+
+  void setHook(RetryHook hook, void *hookCtx);
+  void reset();
+
+  // True when the next attempt may start
+  bool ready(unsigned long now) const;
+  void success(unsigned long now);
+  // Returns false once the policy gave up
+  bool failure(unsigned long now);
+  // The attempt could not start (e.g. the link is busy): wait baseMs without using up an attempt
+  void defer(unsigned long now);
+
+  bool gaveUp() const;
+  uint8_t attempts() const;
+  unsigned long backoffMs() const; // delay before the next attempt, 0 after a success
+
+private:
+  unsigned long nextBackoff();
+
+  unsigned long baseMs;
+  unsigned long maxMs;
+  uint8_t maxAttempts;
+  RetryHook hook;
+  void *hookCtx;
+
+  uint8_t failed;
+  bool exhausted;
+  unsigned long waitFrom;
+  unsigned long waitMs;
+  uint32_t jitterState;
+};
+
+#endif
@@ -1,70 +1,225 @@
 #include "rubik_game.h"
 #include "game_utils.h"
+#include "state_profiler.h"
 #include <Arduino.h>
 
 extern void changeConfig(String command);
 extern String getPythonData(String command);
-extern void parseCSV(const char *csv, int arr[], int &count);
 extern bool sendServoCommand(int a1, int a2, int a3);
 extern bool sendStepperCommand(const int cmds[]);
 extern void printOnLCD(const String &msg);
 
-String movesString;
 int moves[30];
 uint8_t movesCount;
-int i;
-int stepperCmd[10] = {0};
 
-void parseString(String str, int *data, uint8_t &count)
+// Stepper index of each face, in the order of the dense stepper command
+#define STEPPER_U 0
+#define STEPPER_R 1
+#define STEPPER_F 2
+#define STEPPER_D 3
+#define STEPPER_L 4
+
+// Turns are relative, so a resend after a lost reply could turn a face twice:
+// one attempt only, a failure ends the scan or the solve until the game restarts
+static RetryPolicy stepperRetry(RETRY_BASE_MS, RETRY_MAX_MS, 1, linkStatsRetryHook, LINK_STATS_CTX(LINK_EXEC_RUBIK));
+
+// The scan photographs the cube RUBIK_SCANS times. With RUBIK_INDEXED_FACES every
+// frame is uploaded as "rubikFace&face=N" with N its index in rubikScans, so the
+// server can place it whatever order it arrives in, the cube turns on while it
+// uploads, and "rubikSolve" returns the moves once all are in. Otherwise every
+// frame is the old "rubik" action: the server numbers the faces in the order they
+// arrive and answers the last one with the moves, so each upload is waited for
+// and a failed one ends the scan.
+#ifndef RUBIK_INDEXED_FACES
+#define RUBIK_INDEXED_FACES 0 // the server does not know rubikFace/rubikSolve yet
+#endif
+#define RUBIK_SCANS 11
+#define RUBIK_SCAN_ATTEMPTS 3 // frames of one indexed face before the scan is given up
+#define RUBIK_SETTLE_MS 100   // after the last turn, before the frame is taken
+#define RUBIK_TURN_GAP_MS 50
+#define RUBIK_MAX_TURNS 30
+
+// Set before the game starts, the host tests play both
+bool rubikIndexedFaces = RUBIK_INDEXED_FACES;
+
+// 90 degree turn of one face (second < 0) or of two opposite faces, direction 1 is counter-clockwise
+struct RubikTurn
 {
-  count = 0;
-  char buffer[256];
-  strncpy(buffer, str.c_str(), sizeof(buffer));
-  buffer[sizeof(buffer) - 1] = '\0';
-
-  char *token = strtok(buffer, ",");
+  int8_t first;
+  uint8_t firstDirection;
+  int8_t second;
+  uint8_t secondDirection;
+};
+#define NO_TURN {-1, 0, -1, 0}
+
+// One frame of the scan: turns that bring the face in view, and turns that follow the capture
+struct RubikScan
+{
+  RubikTurn before[2];
+  RubikTurn after[2];
+};
+
+static const RubikScan rubikScans[RUBIK_SCANS] = {
+    {{NO_TURN, NO_TURN}, {{STEPPER_R, 0, STEPPER_L, 1}, NO_TURN}}, // then R1 + L3
+    {{NO_TURN, NO_TURN}, {{STEPPER_R, 0, STEPPER_L, 1}, NO_TURN}},
+    {{NO_TURN, NO_TURN}, {{STEPPER_R, 0, STEPPER_L, 1}, NO_TURN}},
+    {{NO_TURN, NO_TURN}, {{STEPPER_R, 0, STEPPER_L, 1}, NO_TURN}},
+    {{{STEPPER_D, 0, STEPPER_U, 1}, NO_TURN}, {NO_TURN, NO_TURN}}, // D1 + U3 first
+    {{{STEPPER_D, 0, STEPPER_U, 1}, NO_TURN}, {NO_TURN, NO_TURN}},
+    {{{STEPPER_D, 0, STEPPER_U, 1}, NO_TURN}, {{STEPPER_D, 0, STEPPER_U, 1}, NO_TURN}},
+    // R1, U3 + D1 / D3 + U1, R3
+    {{{STEPPER_R, 0, -1, 0}, {STEPPER_U, 1, STEPPER_D, 0}}, {{STEPPER_D, 1, STEPPER_U, 0}, {STEPPER_R, 1, -1, 0}}},
+    // L3, U1 + D3 / D1 + U3, L1
+    {{{STEPPER_L, 1, -1, 0}, {STEPPER_U, 0, STEPPER_D, 1}}, {{STEPPER_D, 0, STEPPER_U, 1}, {STEPPER_L, 0, -1, 0}}},
+    // D1, L1 + R3 / R1 + L3, D3
+    {{{STEPPER_D, 0, -1, 0}, {STEPPER_L, 0, STEPPER_R, 1}}, {{STEPPER_R, 0, STEPPER_L, 1}, {STEPPER_D, 1, -1, 0}}},
+    // U3, L3 + R1 / R3 + L1, U1
+    {{{STEPPER_U, 1, -1, 0}, {STEPPER_L, 1, STEPPER_R, 0}}, {{STEPPER_R, 1, STEPPER_L, 0}, {STEPPER_U, 0, -1, 0}}},
+};
+
+enum RubikState
+{
+  RUBIK_TURN_IN,      // turn the next face into view
+  RUBIK_SETTLE,       // let the cube stop, then queue the capture
+  RUBIK_CAPTURE,      // wait for the frame, not for the upload
+  RUBIK_TURN_ON,      // turns after the capture, the upload runs meanwhile
+  RUBIK_WAIT_UPLOADS, // every frame acknowledged before the solve
+  RUBIK_SOLVE,
+  RUBIK_SOLUTION,
+  RUBIK_DONE
+};
+
+enum ScanStatus
+{
+  SCAN_PENDING,
+  SCAN_ACKED,
+  SCAN_FAILED
+};
+
+static RubikState rubikState = RUBIK_DONE;
+static uint8_t scanIndex = 0;
+static int8_t rescanFace = -1; // face taken again after its upload failed
+static VisionFuture scanReads[RUBIK_SCANS];
+static uint8_t scanStatus[RUBIK_SCANS];
+static uint8_t scanAttempts[RUBIK_SCANS];
+static VisionFuture solveRead = VISION_FUTURE_INVALID;
+static unsigned long stateStartTime = 0;
+static unsigned long scanStartTime = 0;
+
+// The loop runs the turns from this queue one at a time, RUBIK_TURN_GAP_MS apart
+static StepperMove turnQueue[RUBIK_MAX_TURNS];
+static uint8_t turnCount = 0;
+static uint8_t turnNext = 0;
+static LinkTicket turnTicket = LINK_TICKET_INVALID;
+static unsigned long turnDoneTime = 0;
+
+STATE_PROFILER(gameProfile, "rubik");
+
+void clearTurns()
+{
+  if (turnTicket != LINK_TICKET_INVALID)
+    cancelLinkCommand(turnTicket);
+  turnTicket = LINK_TICKET_INVALID;
+  turnCount = 0;
+  turnNext = 0;
+}
 
-  while (token != NULL && count < 30)
+void queueMove(const StepperMove &move)
+{
+  if (turnCount >= RUBIK_MAX_TURNS)
   {
-    data[count++] = atoi(token);
-    token = strtok(NULL, ",");
+    Serial.println("Too many cube turns queued");
+    return;
   }
+  turnQueue[turnCount++] = move;
 }
 
-void sendLastFaceToServer(int *data, uint8_t &count)
+// Quarter turn of one or two opposite faces, `inverse` turns them back
+void queueTurn(const RubikTurn &turn, bool inverse)
 {
-    String res = getPythonData("rubik");
+  if (turn.first < 0)
+    return;
+
+  StepperMove move;
+  stepperBegin(move);
+  stepperAdd(move, turn.first, 90, turn.firstDirection ^ inverse);
+  if (turn.second >= 0)
+    stepperAdd(move, turn.second, 90, turn.secondDirection ^ inverse);
+  queueMove(move);
+}
 
-    if (res != "ERROR")
-    {
-      movesString = res;
-      // Convert the string array-like to an integer array
-      parseString(movesString, data, count);
-      Serial.println("Moves: " + res);
-      return;
-    }
-    else
-    {
-      count = 0;
-      Serial.println("Camera failed while scanning face");
-    }
-  
+void queueTurns(const RubikTurn turns[2])
+{
+  queueTurn(turns[0], false);
+  queueTurn(turns[1], false);
 }
 
-void sendFaceToServer()
+// Every turn the scan made after the frame of `face`, forwards or undone from the last one
+void queueTurnsAfter(uint8_t face, bool undo)
 {
-    String res = getPythonData("rubik");
+  for (int k = 0; k < 4 * RUBIK_SCANS; k++)
+  {
+    int step = undo ? 4 * RUBIK_SCANS - 1 - k : k;
+    int scan = step / 4;
+    int part = step % 4;
+    // before[0], before[1], after[0], after[1] of every scan, the face's own before turns are not repeated
+    if (scan < face || (scan == face && part < 2))
+      continue;
+    const RubikTurn *turns = part < 2 ? rubikScans[scan].before : rubikScans[scan].after;
+    queueTurn(turns[part % 2], undo);
+  }
+}
 
-    if (res != "ERROR")
+// Runs the queued turns, one at a time with a gap after each. True once the last
+// one is done, or when a turn failed and the game is over anyway.
+bool runTurns()
+{
+  if (stepperRetry.gaveUp())
+  {
+    clearTurns();
+    return true;
+  }
+
+  if (turnTicket == LINK_TICKET_INVALID)
+  {
+    unsigned long now = millis();
+    if (turnNext > 0 && now - turnDoneTime < RUBIK_TURN_GAP_MS)
+      return false;
+    if (turnNext >= turnCount)
     {
-      Serial.println("Scanned face: " + i);
-      return;
+      turnCount = 0;
+      turnNext = 0;
+      return true;
     }
-    else
+    if (!stepperRetry.ready(now))
+      return false;
+
+    turnTicket = submitStepperMove(turnQueue[turnNext]);
+    if (turnTicket == LINK_TICKET_INVALID)
     {
-      Serial.println("Camera failed while scanning face");
+      stepperRetry.defer(now);
+      return false;
     }
-  
+  }
+
+  LinkTicketStatus status = pollLinkCommand(turnTicket);
+  if (status == LINK_TICKET_PENDING)
+    return false;
+
+  turnTicket = LINK_TICKET_INVALID;
+  turnDoneTime = millis();
+  if (status == LINK_TICKET_ACKED)
+  {
+    stepperRetry.success(turnDoneTime);
+    turnNext++;
+    return false;
+  }
+
+  stepperRetry.failure(turnDoneTime);
+  Serial.println("Stepper command failed, cube state unknown");
+  printOnLCD("Cube motor error");
+  clearTurns();
+  return true;
 }
 
 void startRubikGame()
@@ -87,16 +242,29 @@ void startRubikGame()
   // Fix array assignments
   memset(moves, 0, sizeof(moves));
   movesCount = 0;
-  i = 0;
-  memset(stepperCmd, 0, sizeof(stepperCmd));
+  stepperRetry.reset();
+
+  for (int k = 0; k < RUBIK_SCANS; k++)
+  {
+    scanReads[k] = VISION_FUTURE_INVALID;
+    scanStatus[k] = SCAN_PENDING;
+    scanAttempts[k] = 0;
+  }
+  solveRead = VISION_FUTURE_INVALID;
+  scanIndex = 0;
+  rescanFace = -1;
+  clearTurns();
+  queueTurns(rubikScans[0].before);
+  rubikState = RUBIK_TURN_IN;
+  scanStartTime = millis();
 }
 
-void parseStepperCommands(int move)
+bool addSolutionMove(StepperMove &stepperMove, int move)
 {
   // Moves array = {xy}, where x = motor, y = angle (1, 2, 3)
   // Angle: 1: 90, 2: 180, 3: -90
-  int motor = move / 10; // Changed from 's' to 'move'
-  int code = move % 10;  // Changed from 's' to 'move'
+  int motor = move / 10;
+  int code = move % 10;
 
   int direction = 0;
   int angle = 0;
@@ -111,49 +279,112 @@ void parseStepperCommands(int move)
   }
   else
   {
-    
     angle = 90;
     direction = 1;
-    if(motor == 1){
+    if (motor == 1)
+    {
       angle = 270;
       direction = 0;
     }
   }
 
-  // Clear the stepperCmd array first
-  memset(stepperCmd, 0, sizeof(stepperCmd));
+  if (motor < 1 || motor > 5)
+    return false; // Invalid input
+
+  return stepperAdd(stepperMove, motor - 1, angle, direction);
+}
+
+bool oppositeFaces(int move1, int move2)
+{
+  int a = move1 / 10 - 1;
+  int b = move2 / 10 - 1;
+  return (a == STEPPER_U && b == STEPPER_D) || (a == STEPPER_D && b == STEPPER_U) ||
+         (a == STEPPER_R && b == STEPPER_L) || (a == STEPPER_L && b == STEPPER_R);
+}
+
+void takeSolution(const VisionReply &reply)
+{
+  movesCount = reply.count < 30 ? reply.count : 30;
+  for (int k = 0; k < movesCount; k++)
+    moves[k] = reply.values[k];
+  Serial.println("Moves: " + String(movesCount));
+}
+
+// Collect the finished uploads, which also frees their queue slots
+void collectScans()
+{
+  for (int k = 0; k < RUBIK_SCANS; k++)
+  {
+    VisionStatus status;
+    VisionReply reply;
+    if (scanReads[k] == VISION_FUTURE_INVALID || !pollVisionReply(scanReads[k], status, reply))
+      continue;
+
+    scanReads[k] = VISION_FUTURE_INVALID;
+    scanStatus[k] = status == VISION_DONE ? SCAN_ACKED : SCAN_FAILED;
+    if (scanStatus[k] == SCAN_ACKED)
+      Serial.println("Scanned face: " + String(k));
+    else
+      Serial.println("Camera failed while scanning face " + String(k));
+
+    // The old action answers the last face with the moves
+    if (!rubikIndexedFaces && k == RUBIK_SCANS - 1 && scanStatus[k] == SCAN_ACKED)
+      takeSolution(reply);
+  }
+}
 
-  switch (motor) // Changed from 'id' to 'motor'
+void queueSolution()
+{
+  clearTurns();
+  for (int k = 0; k < movesCount; k++)
   {
-  case 1:
-    stepperCmd[0] = angle;
-    stepperCmd[1] = direction;
-    sendStepperCommand(stepperCmd);
-    break;
-  case 4:
-    stepperCmd[6] = angle;
-    stepperCmd[7] = direction;
-    sendStepperCommand(stepperCmd);
-    break;
-  case 5:
-    stepperCmd[8] = angle;
-    stepperCmd[9] = direction;
-    sendStepperCommand(stepperCmd);
-    break;
-  case 2:
-    stepperCmd[2] = angle;
-    stepperCmd[3] = direction;
-    sendStepperCommand(stepperCmd);
-    break;
-  case 3:
-    stepperCmd[4] = angle;
-    stepperCmd[5] = direction;
-    sendStepperCommand(stepperCmd);
-    break;
-  default:
-    return; // Invalid input
+    StepperMove move;
+    stepperBegin(move);
+    if (!addSolutionMove(move, moves[k]))
+      continue;
+
+    // Opposite faces commute, so the next move can run at the same time
+    if (k + 1 < movesCount && oppositeFaces(moves[k], moves[k + 1]) && addSolutionMove(move, moves[k + 1]))
+      k++;
+
+    queueMove(move);
   }
 }
+
+void cancelRubikReads()
+{
+  for (int k = 0; k < RUBIK_SCANS; k++)
+  {
+    cancelPythonData(scanReads[k]);
+    scanReads[k] = VISION_FUTURE_INVALID;
+  }
+  cancelPythonData(solveRead);
+  solveRead = VISION_FUTURE_INVALID;
+}
+
+void abortScan()
+{
+  printOnLCD("Cube scan failed");
+  cancelRubikReads();
+  movesCount = 0;
+  rubikState = RUBIK_DONE;
+}
+
+// Take the frame of `face` again, false once it failed too often
+bool retakeFace(uint8_t face)
+{
+  if (++scanAttempts[face] >= RUBIK_SCAN_ATTEMPTS)
+  {
+    Serial.println("Face " + String(face) + " failed " + String(RUBIK_SCAN_ATTEMPTS) + " times, giving up");
+    abortScan();
+    return false;
+  }
+
+  Serial.println("Scanning face " + String(face) + " again");
+  scanStatus[face] = SCAN_PENDING;
+  return true;
+}
+
 /**
  * U: 1 -> [0,1]
  * D: 4 -> [6,7]
@@ -163,223 +394,173 @@ void parseStepperCommands(int move)
  */
 void rubikGameLoop()
 {
-  if (i < 4)
-  {
-    delay(100);
-    sendFaceToServer();
-    stepperCmd[2] = 90;
-    stepperCmd[3] = 0;
-    sendStepperCommand(stepperCmd); // R1
-    stepperCmd[2] = 0;
-    delay(50);
-
-    stepperCmd[8] = 90;
-    stepperCmd[9] = 1;
-    sendStepperCommand(stepperCmd); // L3
-    stepperCmd[8] = 0;
-    delay(100);
-  }
-  else if (i >= 4 && i < 8)
+  PROFILE_STATE(gameProfile, rubikState);
+  collectScans();
+
+  // A lost turn leaves the cube in an unknown state, scanning or solving on is pointless
+  if (stepperRetry.gaveUp() && rubikState != RUBIK_DONE)
   {
-    stepperCmd[6] = 90;
-    stepperCmd[7] = 0;
-    sendStepperCommand(stepperCmd); // D1
-    stepperCmd[6] = 0;
-    delay(50);
-
-    stepperCmd[0] = 90;
-    stepperCmd[1] = 1;
-    sendStepperCommand(stepperCmd); // U3
-    stepperCmd[0] = 0;
-    delay(100);
-
-    if (i < 7)
-      sendFaceToServer();
+    Serial.println("Cube motors not responding, game over");
+    cancelRubikReads();
+    movesCount = 0;
+    rubikState = RUBIK_DONE;
+    return;
   }
-  else if (i == 8)
+
+  switch (rubikState)
   {
-    stepperCmd[2] = 90;
-    stepperCmd[3] = 0;
-    sendStepperCommand(stepperCmd); // R1
-    stepperCmd[2] = 0;
-    delay(50);
-
-    stepperCmd[0] = 90;
-    stepperCmd[1] = 1;
-    sendStepperCommand(stepperCmd); // U3
-    stepperCmd[0] = 0;
-    delay(50);
-
-    stepperCmd[6] = 90;
-    stepperCmd[7] = 0;
-    sendStepperCommand(stepperCmd); // D1
-    stepperCmd[6] = 0;
-    delay(100);
-
-    sendFaceToServer();
-
-    // Reverse the moves
-    stepperCmd[6] = 90;
-    stepperCmd[7] = 1;
-    sendStepperCommand(stepperCmd); // D3
-    stepperCmd[6] = 0;
-    delay(50);
-
-    stepperCmd[0] = 90;
-    stepperCmd[1] = 0;
-    sendStepperCommand(stepperCmd); // U1
-    stepperCmd[0] = 0;
-    delay(50);
-
-    stepperCmd[2] = 90;
-    stepperCmd[3] = 1;
-    sendStepperCommand(stepperCmd); // R3
-    stepperCmd[2] = 0;
-    delay(50);
-  }
-  else if (i == 9)
+  case RUBIK_TURN_IN:
+    if (!runTurns())
+      break;
+    stateStartTime = millis();
+    rubikState = RUBIK_SETTLE;
+    break;
+
+  case RUBIK_SETTLE:
   {
-    stepperCmd[8] = 90;
-    stepperCmd[9] = 1;
-    sendStepperCommand(stepperCmd); // L3
-    stepperCmd[8] = 0;
-    delay(50);
-
-    stepperCmd[0] = 90;
-    stepperCmd[1] = 0;
-    sendStepperCommand(stepperCmd); // U1
-    stepperCmd[0] = 0;
-    delay(50);
-
-    stepperCmd[6] = 90;
-    stepperCmd[7] = 1;
-    sendStepperCommand(stepperCmd); // D3
-    stepperCmd[6] = 0;
-    delay(100);
-
-    sendFaceToServer();
-
-    stepperCmd[6] = 90;
-    stepperCmd[7] = 0;
-    sendStepperCommand(stepperCmd); // D1
-    stepperCmd[6] = 0;
-    delay(50);
-
-    stepperCmd[0] = 90;
-    stepperCmd[1] = 1;
-    sendStepperCommand(stepperCmd); // U3
-    stepperCmd[0] = 0;
-    delay(50);
-
-    stepperCmd[8] = 90;
-    stepperCmd[9] = 0;
-    sendStepperCommand(stepperCmd); // L1
-    stepperCmd[8] = 0;
-    delay(50);
+    if (millis() - stateStartTime < RUBIK_SETTLE_MS)
+      break;
+
+    uint8_t face = rescanFace >= 0 ? rescanFace : scanIndex;
+    char action[VISION_ACTION_MAX];
+    if (rubikIndexedFaces)
+      snprintf(action, sizeof(action), "rubikFace&face=%d", face);
+    else
+      snprintf(action, sizeof(action), "rubik");
+    // Only a frame taken after the turns. An indexed face may be sent again from the
+    // same frame; the old action counts every upload that arrives, so it goes once
+    scanReads[face] = startPythonData(action, VISION_DEFAULT_TIMEOUT_MS, millis(), rubikIndexedFaces ? VISION_RETRY_UPLOAD : 0);
+    if (scanReads[face] == VISION_FUTURE_INVALID)
+      stateStartTime = millis(); // queue full, try again shortly
+    else
+      rubikState = RUBIK_CAPTURE;
+    break;
   }
-  else if (i == 10)
+
+  case RUBIK_CAPTURE:
   {
+    uint8_t face = rescanFace >= 0 ? rescanFace : scanIndex;
+    if (!rubikIndexedFaces)
+    {
+      // The server counts the faces, the next one may only go once this one is in
+      if (scanStatus[face] == SCAN_PENDING)
+        break;
+      if (scanStatus[face] == SCAN_FAILED)
+      {
+        // The server may have counted it anyway, another frame could land on the wrong face
+        Serial.println("Face " + String(face) + " failed, giving up");
+        abortScan();
+        break;
+      }
+    }
+    else if (scanStatus[face] == SCAN_PENDING && !pythonDataCaptured(scanReads[face]))
+    {
+      break;
+    }
 
-    stepperCmd[6] = 90;
-    stepperCmd[7] = 0;
-    sendStepperCommand(stepperCmd); // D1
-    stepperCmd[6] = 0;
-    delay(50);
-
-    stepperCmd[8] = 90;
-    stepperCmd[9] = 0;
-    sendStepperCommand(stepperCmd); // L1
-    stepperCmd[8] = 0;
-    delay(50);
-
-    stepperCmd[2] = 90;
-    stepperCmd[3] = 1;
-    sendStepperCommand(stepperCmd); // R3
-    stepperCmd[2] = 0;
-    delay(100);
-
-    sendFaceToServer();
-
-    // Reverse the moves
-
-    stepperCmd[2] = 90;
-    stepperCmd[3] = 0;
-    sendStepperCommand(stepperCmd); // R1
-    stepperCmd[2] = 0;
-    delay(50);
-
-    stepperCmd[8] = 90;
-    stepperCmd[9] = 1;
-    sendStepperCommand(stepperCmd); // L3
-    stepperCmd[8] = 0;
-    delay(50);
-
-    stepperCmd[6] = 90;
-    stepperCmd[7] = 1;
-    sendStepperCommand(stepperCmd); // D3
-    stepperCmd[6] = 0;
-    delay(50);
+    if (rescanFace >= 0)
+      queueTurnsAfter(rescanFace, false); // back to where the scan ended
+    else
+      queueTurns(rubikScans[scanIndex].after);
+    rubikState = RUBIK_TURN_ON;
+    break;
   }
-  else if (i == 11)
+
+  case RUBIK_TURN_ON:
+    if (!runTurns())
+      break;
+    if (rescanFace >= 0)
+    {
+      rescanFace = -1;
+      rubikState = RUBIK_WAIT_UPLOADS;
+      break;
+    }
+    scanIndex++;
+    if (scanIndex < RUBIK_SCANS)
+    {
+      queueTurns(rubikScans[scanIndex].before);
+      rubikState = RUBIK_TURN_IN;
+    }
+    else
+    {
+      rubikState = RUBIK_WAIT_UPLOADS;
+    }
+    break;
+
+  case RUBIK_WAIT_UPLOADS:
   {
+    bool waiting = false;
+    for (int k = 0; k < RUBIK_SCANS; k++)
+    {
+      if (scanStatus[k] == SCAN_FAILED)
+      {
+        // Undo the turns since its frame, take it again, then turn on to where the scan ended
+        if (retakeFace(k))
+        {
+          rescanFace = k;
+          queueTurnsAfter(k, true);
+          rubikState = RUBIK_TURN_IN;
+        }
+        return;
+      }
+      waiting = waiting || scanStatus[k] == SCAN_PENDING;
+    }
+    if (waiting)
+      break;
 
-    stepperCmd[0] = 90;
-    stepperCmd[1] = 1;
-    sendStepperCommand(stepperCmd); // U3
-    stepperCmd[0] = 0;
-    delay(50);
-
-    stepperCmd[8] = 90;
-    stepperCmd[9] = 1;
-    sendStepperCommand(stepperCmd); // L3
-    stepperCmd[8] = 0;
-    delay(50);
-
-    stepperCmd[2] = 90;
-    stepperCmd[3] = 0;
-    sendStepperCommand(stepperCmd); // R1
-    stepperCmd[2] = 0;
-    delay(100);
-
-    sendLastFaceToServer(moves, movesCount);
-
-    stepperCmd[2] = 90;
-    stepperCmd[3] = 1;
-    sendStepperCommand(stepperCmd); // R3
-    stepperCmd[2] = 0;
-    delay(50);
-
-    stepperCmd[8] = 90;
-    stepperCmd[9] = 0;
-    sendStepperCommand(stepperCmd); // L1
-    stepperCmd[8] = 0;
-    delay(50);
-
-    stepperCmd[0] = 90;
-    stepperCmd[1] = 0;
-    sendStepperCommand(stepperCmd); // U1
-    stepperCmd[0] = 0;
-    delay(50);
+    Serial.println("Cube scanned in " + String(millis() - scanStartTime) + " ms");
+    if (!rubikIndexedFaces)
+    {
+      queueSolution();
+      rubikState = RUBIK_SOLUTION;
+      break;
+    }
+    solveRead = startPythonData("rubikSolve", VISION_DEFAULT_TIMEOUT_MS, 0, VISION_NO_FRAME | VISION_RETRY_UPLOAD);
+    if (solveRead != VISION_FUTURE_INVALID)
+      rubikState = RUBIK_SOLVE;
+    break;
   }
-  else if (i == 12)
+
+  case RUBIK_SOLVE:
   {
-    if (movesCount == 0)
-      return;
-    for (int k = 0; k < movesCount; k++)
+    VisionStatus status;
+    VisionReply reply;
+    if (!pollVisionReply(solveRead, status, reply))
+      break;
+    solveRead = VISION_FUTURE_INVALID;
+
+    if (status != VISION_DONE)
     {
-      // Moves array = {xy}, where x = motor, y = angle (1, 2, 3)
-      // Angle: 1: 90, 2: 180, 3: -90
-      parseStepperCommands(moves[k]);
-      delay(50);
+      movesCount = 0;
+      Serial.println("Failed to solve the cube");
+      printOnLCD("Cube solve failed");
+      rubikState = RUBIK_DONE;
+      break;
     }
-  }else return;
-  i++;
+
+    takeSolution(reply);
+    Serial.println("Scanned and solved in " + String(millis() - scanStartTime) + " ms");
+    queueSolution();
+    rubikState = RUBIK_SOLUTION;
+    break;
+  }
+
+  case RUBIK_SOLUTION:
+    if (runTurns())
+      rubikState = RUBIK_DONE;
+    break;
+
+  case RUBIK_DONE:
+    break;
+  }
 }
 
 void stopRubikGame()
 {
   Serial.println("Stopping Rubik's Cube Game");
   changeConfig("none");
-
-  //
-}
\ No newline at end of file
+  cancelRubikReads();
+  clearTurns();
+  rubikState = RUBIK_DONE;
+  PROFILE_STOP(gameProfile);
+}
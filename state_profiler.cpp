@@ -0,0 +1,45 @@
+#include "state_profiler.h"
+
+StateProfiler *StateProfiler::first = nullptr;
+
+StateProfiler::StateProfiler(const char *name)
+{
+  this->name = name;
+  resetRequested = false;
+  clear();
+  next = first;
+  first = this;
+}
+
+void StateProfiler::leave(uint32_t nowUs)
+{
+  if (current == STATE_PROFILER_NONE)
+    return;
+
+  uint32_t us = nowUs - enteredUs;
+  StateTiming &timing = states[current];
+  timing.count++;
+  timing.totalUs += us;
+  timing.lastUs = us;
+  if (us > timing.maxUs)
+    timing.maxUs = us;
+  current = STATE_PROFILER_NONE;
+}
+
+void StateProfiler::reset()
+{
+  resetRequested = true;
+}
+
+void StateProfiler::clear()
+{
+  for (int i = 0; i < STATE_PROFILER_MAX_STATES; i++)
+  {
+    states[i].count = 0;
+    states[i].totalUs = 0;
+    states[i].maxUs = 0;
+    states[i].lastUs = 0;
+  }
+  current = STATE_PROFILER_NONE;
+  resetRequested = false;
+}
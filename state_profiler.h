@@ -0,0 +1,80 @@
+#ifndef STATE_PROFILER_H
+#define STATE_PROFILER_H
+
+#include <stdint.h>
+
+/**
+ * Time spent in each state of a game state machine.
+ *
+ * The game loop reports its current state every iteration with
+ * PROFILE_STATE(). A change of state closes the time of the previous state
+ * into its accumulator (count, total, max, last), so the cost of an
+ * iteration that stays in its state is one compare. Times are in micros()
+ * and accurate to one loop iteration. With ENABLE_STATE_PROFILER 0 the
+ * macros compile to nothing. The class has no Arduino dependencies so it
+ * also builds on a host.
+ */
+
+#define ENABLE_STATE_PROFILER 1
+#define STATE_PROFILER_MAX_STATES 16
+#define STATE_PROFILER_NONE 0xFF
+
+struct StateTiming
+{
+  uint32_t count;
+  uint32_t totalUs;
+  uint32_t maxUs;
+  uint32_t lastUs;
+};
+
+class StateProfiler
+{
+public:
+  explicit StateProfiler(const char *name);
+
+  void enter(uint8_t state, uint32_t nowUs)
+  {
+    if (resetRequested)
+      clear();
+    if (state == current)
+      return;
+    leave(nowUs);
+    if (state < STATE_PROFILER_MAX_STATES)
+    {
+      current = state;
+      enteredUs = nowUs;
+    }
+  }
+
+  // Close the current state, e.g. when the game stops
+  void leave(uint32_t nowUs);
+  // Cleared by the game loop on its next enter(), so it is safe to call from another task
+  void reset();
+  // Current state, STATE_PROFILER_NONE when stopped
+  uint8_t state() const { return current; }
+
+  const char *name;
+  StateTiming states[STATE_PROFILER_MAX_STATES];
+  StateProfiler *next; // every profiler, for the report
+
+  static StateProfiler *first;
+
+private:
+  void clear();
+
+  uint8_t current;
+  uint32_t enteredUs;
+  volatile bool resetRequested;
+};
+
+#if ENABLE_STATE_PROFILER
+#define STATE_PROFILER(var, name) static StateProfiler var(name)
+#define PROFILE_STATE(var, state) (var).enter((uint8_t)(state), micros())
+#define PROFILE_STOP(var) (var).leave(micros())
+#else
+#define STATE_PROFILER(var, name)
+#define PROFILE_STATE(var, state) ((void)0)
+#define PROFILE_STOP(var) ((void)0)
+#endif
+
+#endif
@@ -1,9 +1,10 @@
 #include "threeCups_game.h"
 #include "game_utils.h"
+#include "move_script.h"
+#include "state_profiler.h"
 #include <Arduino.h>
 extern void changeConfig(String command);
 extern String getPythonData(String command);
-extern void parseCSV(const char *csv, int arr[], int &count);
 extern bool sendServoCommand(int a1, int a2, int a3);
 extern bool sendStepperCommand(const int cmds[]);
 extern void printOnLCD(const String &msg);
@@ -43,8 +44,8 @@ enum ArmMoveState
   MOVE_COMPLETE
 };
 
-// Cup position angles for the arm to point to
-const int cupAngleData[3][4] = {
+// Cup position angles for the arm to point to, see calibrateArmTable
+static int cupAngleData[3][4] = {
     {138, 46, 126, 66}, // Left cup
     {110, 58, 140, 72}, // Middle cup
     {80, 46, 124, 70},  // Right cup
@@ -54,11 +55,12 @@ const int cupAngleData[3][4] = {
 static GameState currentState = GAME_INIT;
 static ArmMoveState armState = MOVE_IDLE; // Current arm movement state
 static unsigned long stateStartTime = 0;
-static unsigned long lastActionTime = 0;
-static int servoMoveIndex = 0;
-static int currentMotor = 0;
-static int targetAngle = 0;
-static int overShootValue = 0;
+static RetryPolicy cupsRetry(RETRY_BASE_MS, RETRY_MAX_MS, RETRY_MAX_ATTEMPTS, linkStatsRetryHook, LINK_STATS_CTX(LINK_EXEC_CUPS));
+static MoveScriptRunner cupsMove(cupsRetry);
+STATE_PROFILER(gameProfile, "cups");
+static int hoverCup = NO_CUP;
+static bool reachPending = false; // PICK_CUP sets up the reach once the hover is done
+static VisionFuture cupsRead = VISION_FUTURE_INVALID;
 static String ballCup[3]; // Cup contents - can be "null" or a string like "red"
 static int moveAngles[4] = {0};
 static bool gameEnded = false;
@@ -84,147 +86,116 @@ void startCupsGame()
 
   currentState = GAME_INIT;
   armState = MOVE_IDLE; // Initialize arm state
+  calibrateArmTable("cups", cupAngleData, 1, 3);
+  cupsRetry.reset();
+  hoverCup = NO_CUP;
+  reachPending = false;
+  cupsRead = VISION_FUTURE_INVALID;
   stateStartTime = millis();
 
   printOnLCD("3 Cups Game Started");
 }
 
-bool cupsExecuteServoMove(ArmMotor motor, int angle)
+// Run the move started by one of the setup functions below, returns true once it is acknowledged
+bool cupsExecutePose()
 {
-  if (sendServoCommand(motor, angle, 0))
-  {
-    return true;
-  }
-
-  // Serial.println("Servo command failed, will retry...");
-  return false;
+  return cupsMove.update();
 }
 
-// State machine servo move sequence setup
-void setupCupsServoMoveSequence(int baseAngle, int shoulderAngle, int elbowAngle, int wristAngle, ArmMotor Currmotor, int angle)
+// Open the grip, reach the cup, grab it and lift it
+MOVE_SCRIPT(gripCupScript,
+            stepTo(ArmMotor::GRIP, GRIP_OPEN),
+            stepToTarget(ArmMotor::BASE),
+            stepToTarget(ArmMotor::WRIST),
+            stepToTarget(ArmMotor::ELBOW),
+            stepToTarget(ArmMotor::SHOULDER),
+            stepTo(ArmMotor::GRIP, GRIP_CLOSED),
+            stepToTarget(ArmMotor::SHOULDER, 40));
+
+// Put the cup back down and release it
+MOVE_SCRIPT(dropCupScript,
+            stepToTarget(ArmMotor::SHOULDER, 1),
+            stepTo(ArmMotor::GRIP, GRIP_OPEN));
+
+// Lift the shoulder and return to the retreat position
+MOVE_SCRIPT(retreatScript,
+            stepTo(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER),
+            stepToTarget(ArmMotor::BASE),
+            stepToTarget(ArmMotor::WRIST),
+            stepToTarget(ArmMotor::ELBOW),
+            stepTo(ArmMotor::GRIP, GRIP_OPEN));
+
+// Retreat posture turned towards a cup: nothing reaches over the cups the camera is watching
+MOVE_SCRIPT(hoverScript,
+            stepTo(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER),
+            stepToTarget(ArmMotor::BASE),
+            stepTo(ArmMotor::GRIP, GRIP_OPEN));
+
+// Target goal of a cup or the retreat position
+ArmGoal cupGoal(const int angles[4])
 {
-  servoMoveIndex = 0;
-  moveAngles[0] = baseAngle;
-  moveAngles[1] = shoulderAngle;
-  moveAngles[2] = elbowAngle;
-  moveAngles[3] = wristAngle;
-
-  currentMotor = Currmotor;
-  targetAngle = angle;
+  ArmGoal goal;
+  armGoalBegin(goal);
+  armGoalSet(goal, ArmMotor::BASE, angles[0]);
+  armGoalSet(goal, ArmMotor::SHOULDER, angles[1]);
+  armGoalSet(goal, ArmMotor::ELBOW, angles[2]);
+  armGoalSet(goal, ArmMotor::WRIST, angles[3]);
+  return goal;
 }
 
-// Process one servo move step in the sequence
-bool gripCups()
-{
-  if (millis() - lastActionTime < 200)
-  {
-    return false; // Wait a little between commands
-  }
-
-  lastActionTime = millis();
-
-  bool success = cupsExecuteServoMove((ArmMotor)currentMotor, targetAngle);
-  if (success)
-  {
-    servoMoveIndex++;
+// Reaching a cup: the shoulder goes down last with the grip open, the grip
+// closes only once the arm is in place
+static const ArmConstraint reachConstraints[] = {
+    {ARM_ORDER, ArmMotor::BASE, ArmMotor::SHOULDER, 0, 0, 0},
+    {ARM_ORDER, ArmMotor::WRIST, ArmMotor::SHOULDER, 0, 0, 0},
+    {ARM_ORDER, ArmMotor::ELBOW, ArmMotor::SHOULDER, 0, 0, 0},
+    {ARM_REQUIRE_MIN, ArmMotor::GRIP, ArmMotor::SHOULDER, GRIP_OPEN, 0, 0},
+    {ARM_ORDER, ArmMotor::SHOULDER, ArmMotor::GRIP, 0, 0, 0}};
 
-    switch (servoMoveIndex)
-    {
-    case 1:
-      currentMotor = ArmMotor::BASE;
-      targetAngle = moveAngles[0];
-      break;
-    case 2: // After base
-      currentMotor = ArmMotor::WRIST;
-      targetAngle = moveAngles[3];
-      break;
-    case 3: // After wrist
-      currentMotor = ArmMotor::ELBOW;
-      targetAngle = moveAngles[2];
-      break;
-    case 4: // After elbow
-      currentMotor = ArmMotor::SHOULDER;
-      targetAngle = moveAngles[1];
-      break;
-    case 5: // After shoulder
-      currentMotor = ArmMotor::GRIP;
-      targetAngle = GRIP_CLOSED;
-      break;
-    case 6:
-      currentMotor = ArmMotor::SHOULDER;
-      targetAngle = moveAngles[1] + 40;
-      break;
-    case 7:        // After grip
-      return true; // Sequence complete
-    }
-  }
-  return false; // Sequence not complete yet
-}
-bool retreatArm()
+void setupGripCupPose(int cup)
 {
-  if (millis() - lastActionTime < 200)
-  {
-    return false; // Wait a little between commands
-  }
+  ArmGoal goal = cupGoal(cupAngleData[cup]);
+  armGoalSet(goal, ArmMotor::GRIP, GRIP_CLOSED);
 
-  lastActionTime = millis();
-
-  bool success = cupsExecuteServoMove((ArmMotor)currentMotor, targetAngle);
-  if (success)
+  ArmPose pose;
+  if (planPose(pose, goal, reachConstraints, sizeof(reachConstraints) / sizeof(reachConstraints[0])))
   {
-    servoMoveIndex++;
-
-    switch (servoMoveIndex)
-    {
-    case 1: // After shoulder
-      currentMotor = ArmMotor::BASE;
-      targetAngle = moveAngles[0];
-      break;
-    case 2: // After base
-      currentMotor = ArmMotor::WRIST;
-      targetAngle = moveAngles[3];
-      break;
-    case 3: // After wrist
-      currentMotor = ArmMotor::ELBOW;
-      targetAngle = moveAngles[2];
-      break;
-    case 4: // After elbow
-      currentMotor = ArmMotor::GRIP;
-      targetAngle = GRIP_OPEN;
-      break;
-    case 5:        // After grip
-      return true; // Sequence complete
-    }
+    // Lifting waits for the grip to close
+    poseAdd(pose, ArmMotor::SHOULDER, cupAngleData[cup][1] + 40);
+    cupsMove.start(pose);
+    return;
   }
-  return false; // Sequence not complete yet
+
+  cupsMove.start(gripCupScript, goal);
 }
-// Process one servo move step in the sequence
-bool dropCups()
+
+void setupDropCupPose(int cup)
 {
-  if (millis() - lastActionTime < 200)
-  {
-    return false; // Wait a little between commands
-  }
+  cupsMove.start(dropCupScript, cupGoal(cupAngleData[cup]));
+}
 
-  lastActionTime = millis();
+void setupRetreatPose()
+{
+  cupsMove.start(retreatScript, cupGoal(retreatAngles));
+}
 
-  bool success = cupsExecuteServoMove((ArmMotor)currentMotor, targetAngle);
-  if (success)
+// Turn towards `cup` while waiting, the reach that follows starts from there.
+// Setting up the real move cancels it.
+void prepositionArm(int cup)
+{
+#if ENABLE_ARM_PREPOSITION
+  if (hoverCup != cup)
   {
-    servoMoveIndex++;
-
-    switch (servoMoveIndex)
-    {
-    case 1: // After shoulder default
-      currentMotor = ArmMotor::GRIP;
-      targetAngle = GRIP_OPEN;
-      break;
-    case 2:        // After grip
-      return true; // Sequence complete
-    }
+    ArmGoal goal;
+    armGoalBegin(goal);
+    armGoalSet(goal, ArmMotor::BASE, cupAngleData[cup][0]);
+    cupsMove.start(hoverScript, goal);
+    hoverCup = cup;
   }
-  return false; // Sequence not complete yet
+  cupsMove.update();
+#endif
 }
+
 void getAnglesForCup(int cupPosition, int angles[4])
 {
   for (int i = 0; i < 4; i++)
@@ -264,6 +235,20 @@ void cupsGameLoop()
   // Serial.println("ARM STATE : ");
   // Serial.println(armState);
 
+  PROFILE_STATE(gameProfile, currentState);
+
+  // The arm gave up on a move, the cups are no longer where the game thinks
+  if (cupsRetry.gaveUp() && !gameEnded)
+  {
+    Serial.println("Arm not responding, game over");
+    cupsMove.cancel();
+    cancelPythonData(cupsRead);
+    cupsRead = VISION_FUTURE_INVALID;
+    gameEnded = true;
+    currentState = GAME_OVER; // keeps the message on the LCD
+    armState = MOVE_COMPLETE;
+  }
+
   if (gameEnded)
   {
     if (currentState != GAME_OVER)
@@ -291,19 +276,34 @@ void cupsGameLoop()
     break;
 
   case WAITING_FOR_DETECTION:
-    // Wait for camera to detect cups
+    // Wait for camera to detect cups, the middle cup is the closest guess for any ball
+    prepositionArm(MIDDLE_CUP);
     if (currentTime - stateStartTime > 4000)
     {
       //   Serial.println("Looking for ball position...");
-      String res = getPythonData("cupsResult");
+      if (cupsRead == VISION_FUTURE_INVALID)
+      {
+        cupsRead = startPythonData("cupsResult", VISION_DEFAULT_TIMEOUT_MS, millis(), VISION_GATED);
+        if (cupsRead == VISION_FUTURE_INVALID)
+          break;
+      }
+
+      VisionStatus status;
+      VisionReply reply;
+      if (!pollVisionReply(cupsRead, status, reply))
+        break;
+      cupsRead = VISION_FUTURE_INVALID;
 
-      if (res != "ERROR")
+      if (status == VISION_UNCHANGED)
       {
-        int cameraData[3];
-        int count;
-        parseCSV(res.c_str(), cameraData, count);
+        // Same cups as the last read, look again in a second
+        stateStartTime = currentTime - 3000;
+        break;
+      }
 
-        if (extractBallCup(cameraData, count))
+      if (status == VISION_DONE)
+      {
+        if (extractBallCup(reply.values, reply.count))
         {
           // Serial.println("Balls detected in cups:");
 
@@ -354,13 +354,8 @@ void cupsGameLoop()
 
       // Setup angles for pointing to this cup
       getAnglesForCup(currentCupIndex, moveAngles);
-      setupCupsServoMoveSequence(
-          cupAngleData[currentCupIndex][0],
-          cupAngleData[currentCupIndex][1],
-          cupAngleData[currentCupIndex][2],
-          cupAngleData[currentCupIndex][3],
-          ArmMotor::GRIP,
-          GRIP_OPEN);
+      hoverCup = NO_CUP;
+      reachPending = true;
 
       // Move to the pointing state
       currentState = PICK_CUP;
@@ -384,17 +379,22 @@ void cupsGameLoop()
     }
     break;
   case PICK_CUP:
-    if (currentTime - stateStartTime > 1000)
+    if (currentTime - stateStartTime <= 1000)
     {
-      if (gripCups())
+      prepositionArm(currentCupIndex);
+    }
+    else
+    {
+      if (reachPending)
+      {
+        // Planned from wherever the hover left the arm
+        setupGripCupPose(currentCupIndex);
+        reachPending = false;
+        hoverCup = NO_CUP;
+      }
+      if (cupsExecutePose())
       {
-        setupCupsServoMoveSequence(
-            cupAngleData[currentCupIndex][0],
-            cupAngleData[currentCupIndex][1],
-            cupAngleData[currentCupIndex][2],
-            cupAngleData[currentCupIndex][3],
-            ArmMotor::SHOULDER,
-            cupAngleData[currentCupIndex][1] + 1);
+        setupDropCupPose(currentCupIndex);
 
         currentState = DROP_CUP;
         stateStartTime = currentTime;
@@ -404,15 +404,9 @@ void cupsGameLoop()
   case DROP_CUP:
     if (currentTime - stateStartTime > 5000)
     {
-      if (dropCups())
+      if (cupsExecutePose())
       {
-        setupCupsServoMoveSequence(
-            retreatAngles[0],
-            retreatAngles[1],
-            retreatAngles[2],
-            retreatAngles[3],
-            ArmMotor::SHOULDER,
-            DEFAULT_ANGLE_SHOULDER);
+        setupRetreatPose();
 
         currentState = ROBOT_RETREATING;
         stateStartTime = currentTime;
@@ -423,7 +417,7 @@ void cupsGameLoop()
     // Execute retreating sequence
     if (currentTime - stateStartTime > 1000)
     {
-      if (retreatArm())
+      if (cupsExecutePose())
       {
         currentCupIndex++;
         currentState = PROCESSING_MULTIPLE_CUPS;
@@ -444,6 +438,10 @@ void stopCupsGame()
   gameEnded = true;
   currentState = GAME_OVER;
   armState = MOVE_IDLE; // Reset arm state
+  cupsMove.cancel();
+  cancelPythonData(cupsRead);
+  cupsRead = VISION_FUTURE_INVALID;
+  PROFILE_STOP(gameProfile);
 
   // Final result
   String finalMessage = "Game completed";
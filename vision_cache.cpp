@@ -0,0 +1,163 @@
+#include "vision_cache.h"
+#include <math.h>
+#include <string.h>
+
+#define HASH_SIDE 8
+#define HASH_MARGIN 0.1f // of the mean distance of the coefficients from their median
+
+struct DctTables
+{
+  float rows[HASH_SIDE][CHANGE_THUMB_WIDTH];
+  float cols[HASH_SIDE][CHANGE_THUMB_HEIGHT];
+
+  DctTables()
+  {
+    for (int u = 0; u < HASH_SIDE; u++)
+    {
+      for (int x = 0; x < CHANGE_THUMB_WIDTH; x++)
+        rows[u][x] = cosf((2 * x + 1) * u * (float)M_PI / (2 * CHANGE_THUMB_WIDTH));
+      for (int y = 0; y < CHANGE_THUMB_HEIGHT; y++)
+        cols[u][y] = cosf((2 * y + 1) * u * (float)M_PI / (2 * CHANGE_THUMB_HEIGHT));
+    }
+  }
+};
+
+uint64_t perceptualHash(const uint8_t *thumbnail)
+{
+  static const DctTables dct;
+
+  // Separable DCT-II, only the 8 lowest frequencies in each direction
+  float rowCoefs[CHANGE_THUMB_HEIGHT][HASH_SIDE];
+  for (int y = 0; y < CHANGE_THUMB_HEIGHT; y++)
+  {
+    const uint8_t *row = thumbnail + y * CHANGE_THUMB_WIDTH;
+    for (int u = 0; u < HASH_SIDE; u++)
+    {
+      float sum = 0;
+      for (int x = 0; x < CHANGE_THUMB_WIDTH; x++)
+        sum += row[x] * dct.rows[u][x];
+      rowCoefs[y][u] = sum;
+    }
+  }
+
+  float coefs[HASH_SIDE * HASH_SIDE];
+  for (int v = 0; v < HASH_SIDE; v++)
+  {
+    for (int u = 0; u < HASH_SIDE; u++)
+    {
+      float sum = 0;
+      for (int y = 0; y < CHANGE_THUMB_HEIGHT; y++)
+        sum += rowCoefs[y][u] * dct.cols[v][y];
+      coefs[v * HASH_SIDE + u] = sum;
+    }
+  }
+
+  // Median of the AC coefficients, the DC term only says how bright the frame is
+  float sorted[HASH_SIDE * HASH_SIDE - 1];
+  memcpy(sorted, coefs + 1, sizeof(sorted));
+  const int count = HASH_SIDE * HASH_SIDE - 1;
+  for (int i = 1; i < count; i++)
+  {
+    float value = sorted[i];
+    int j = i - 1;
+    for (; j >= 0 && sorted[j] > value; j--)
+      sorted[j + 1] = sorted[j];
+    sorted[j + 1] = value;
+  }
+  float median = sorted[count / 2];
+
+  // A smooth scene has most coefficients near the median, where noise and rounding
+  // flip them: a bit is only set for a coefficient well above it
+  float spread = 0;
+  for (int i = 1; i < HASH_SIDE * HASH_SIDE; i++)
+    spread += fabsf(coefs[i] - median);
+  float threshold = median + spread / count * HASH_MARGIN;
+
+  uint64_t hash = 0;
+  for (int i = 1; i < HASH_SIDE * HASH_SIDE; i++)
+  {
+    if (coefs[i] > threshold)
+      hash |= 1ULL << i;
+  }
+  return hash;
+}
+
+int hammingDistance(uint64_t a, uint64_t b)
+{
+  uint64_t diff = a ^ b;
+  int bits = 0;
+  while (diff)
+  {
+    diff &= diff - 1;
+    bits++;
+  }
+  return bits;
+}
+
+VisionCache::VisionCache()
+  : hits(0), misses(0), invalidations(0), useClock(0), currentEpoch(1)
+{
+  for (int i = 0; i < VISION_CACHE_SIZE; i++)
+  {
+    entries[i].epoch = 0;
+    entries[i].lastUse = 0;
+  }
+}
+
+bool VisionCache::lookup(const char *action, uint64_t hash, const uint8_t *thumbnail, VisionReply &reply)
+{
+  uint32_t now = epoch();
+  for (int i = 0; i < VISION_CACHE_SIZE; i++)
+  {
+    Entry &entry = entries[i];
+    if (entry.epoch != now || strcmp(entry.action, action) != 0)
+      continue;
+    if (hammingDistance(entry.hash, hash) > VISION_CACHE_MAX_DISTANCE)
+      continue;
+    if (changedBlocks(entry.thumbnail, thumbnail, VISION_CACHE_BLOCK_SAD) > 0)
+      continue;
+
+    entry.lastUse = ++useClock;
+    reply = entry.reply;
+    hits++;
+    return true;
+  }
+  misses++;
+  return false;
+}
+
+void VisionCache::store(uint32_t frameEpoch, const char *action, uint64_t hash, const uint8_t *thumbnail, const VisionReply &reply)
+{
+  // The arm moved or the camera changed while the frame was uploaded
+  if (frameEpoch != epoch())
+    return;
+
+  Entry *oldest = &entries[0];
+  for (int i = 0; i < VISION_CACHE_SIZE; i++)
+  {
+    Entry &entry = entries[i];
+    if (entry.epoch != frameEpoch)
+    {
+      oldest = &entry;
+      break;
+    }
+    if (entry.lastUse < oldest->lastUse)
+      oldest = &entry;
+  }
+
+  oldest->epoch = frameEpoch;
+  oldest->lastUse = ++useClock;
+  oldest->hash = hash;
+  strncpy(oldest->action, action, sizeof(oldest->action) - 1);
+  oldest->action[sizeof(oldest->action) - 1] = '\0';
+  memcpy(oldest->thumbnail, thumbnail, sizeof(oldest->thumbnail));
+  oldest->reply = reply;
+}
+
+void VisionCache::invalidate()
+{
+  // 0 marks an empty entry
+  if (currentEpoch.fetch_add(1, std::memory_order_acq_rel) + 1 == 0)
+    currentEpoch.fetch_add(1, std::memory_order_acq_rel);
+  invalidations++;
+}
@@ -0,0 +1,65 @@
+#ifndef VISION_CACHE_H
+#define VISION_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "frame_change.h"
+#include "vision_queue.h"
+
+/**
+ * Server replies keyed by action and frame content.
+ *
+ * A frame is identified by a 64-bit perceptual hash: the 8x8 lowest
+ * frequencies of the DCT of its luminance thumbnail (see frame_change.h),
+ * one bit per AC coefficient well above their median, so camera noise on a
+ * smooth scene does not flip the ones close to it. Entries whose hash is
+ * within VISION_CACHE_MAX_DISTANCE bits are candidates. A pHash hardly
+ * moves when one piece appears in one cell, so a candidate only hits when
+ * no block of the stored thumbnail differs by more than
+ * VISION_CACHE_BLOCK_SAD either.
+ * The least recently used entry is replaced. invalidate() may be called
+ * from any task (arm motion, camera profile changes). It bumps an epoch, so
+ * a reply for a frame captured before the invalidation is not stored.
+ * No Arduino dependencies, so it also builds on a host.
+ */
+
+#define VISION_CACHE_SIZE 4
+#define VISION_CACHE_MAX_DISTANCE 10
+#define VISION_CACHE_BLOCK_SAD 160 // 10 gray levels per thumbnail pixel
+
+uint64_t perceptualHash(const uint8_t *thumbnail);
+int hammingDistance(uint64_t a, uint64_t b);
+
+class VisionCache
+{
+public:
+  VisionCache();
+
+  // Epoch of a frame about to be looked up, pass it to store()
+  uint32_t epoch() const { return currentEpoch.load(std::memory_order_acquire); }
+  bool lookup(const char *action, uint64_t hash, const uint8_t *thumbnail, VisionReply &reply);
+  void store(uint32_t frameEpoch, const char *action, uint64_t hash, const uint8_t *thumbnail, const VisionReply &reply);
+  void invalidate();
+
+  std::atomic<uint32_t> hits;
+  std::atomic<uint32_t> misses;
+  std::atomic<uint32_t> invalidations;
+
+private:
+  struct Entry
+  {
+    uint32_t epoch;
+    uint32_t lastUse;
+    uint64_t hash;
+    char action[VISION_ACTION_MAX];
+    uint8_t thumbnail[CHANGE_THUMB_WIDTH * CHANGE_THUMB_HEIGHT];
+    VisionReply reply;
+  };
+
+  Entry entries[VISION_CACHE_SIZE];
+  uint32_t useClock;
+  std::atomic<uint32_t> currentEpoch;
+};
+
+#endif
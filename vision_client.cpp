@@ -0,0 +1,208 @@
+#include "vision_client.h"
+#include "link_stats.h"
+#include "vision_reply.h"
+
+// Stream that fills a fixed buffer, for replies without a Content-Length
+class BufferStream : public Stream
+{
+public:
+  BufferStream(uint8_t *buffer, size_t size) : buffer(buffer), size(size), length(0), overflow(false) {}
+
+  size_t write(uint8_t byte) override
+  {
+    return write(&byte, 1);
+  }
+
+  size_t write(const uint8_t *data, size_t count) override
+  {
+    if (count > size - length)
+    {
+      overflow = true;
+      count = size - length;
+    }
+    memcpy(buffer + length, data, count);
+    length += count;
+    return count;
+  }
+
+  int available() override { return 0; }
+  int read() override { return -1; }
+  int peek() override { return -1; }
+  void flush() override {}
+
+  uint8_t *buffer;
+  size_t size;
+  size_t length;
+  bool overflow;
+};
+
+VisionClient::VisionClient()
+{
+  requests = 0;
+  reused = 0;
+  reconnects = 0;
+  port = 80;
+  cacheNext = 0;
+}
+
+bool VisionClient::begin(const char *endpoint)
+{
+  String url = endpoint;
+  if (url.startsWith("http://"))
+    url = url.substring(7);
+
+  int slash = url.indexOf('/');
+  String hostPort = slash < 0 ? url : url.substring(0, slash);
+  path = slash < 0 ? "/" : url.substring(slash);
+
+  int colon = hostPort.indexOf(':');
+  host = colon < 0 ? hostPort : hostPort.substring(0, colon);
+  port = colon < 0 ? 80 : hostPort.substring(colon + 1).toInt();
+
+  http.setReuse(true);
+  http.setTimeout(VISION_HTTP_TIMEOUT_MS);
+  return host.length() > 0 && port > 0;
+}
+
+const String &VisionClient::uriFor(const char *action)
+{
+  for (int i = 0; i < VISION_URI_CACHE; i++)
+  {
+    if (cachedUri[i].length() > 0 && cachedAction[i] == action)
+      return cachedUri[i];
+  }
+
+  uint8_t slot = cacheNext;
+  cacheNext = (cacheNext + 1) % VISION_URI_CACHE;
+  cachedAction[slot] = action;
+  cachedUri[slot] = path + "?action=" + action;
+  return cachedUri[slot];
+}
+
+int VisionClient::send(const String &uri, const uint8_t *body, size_t len, uint8_t *response, size_t size, size_t &length)
+{
+  if (!http.begin(client, host, port, uri))
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  // begin() and end() both clear the added headers, and end() is what hands the
+  // kept-alive socket back for the next request, so they are added every time
+  http.addHeader("Content-Type", "image/jpeg");
+  http.addHeader("Accept", VISION_REPLY_ACCEPT);
+
+  length = 0;
+  int code = http.POST((uint8_t *)body, len);
+  if (code > 0)
+    code = readReply(code, response, size, length);
+
+  // Keeps the socket open when the server agreed to keep-alive
+  http.end();
+  return code;
+}
+
+// Straight from the socket into the caller's buffer, no String in between
+int VisionClient::readReply(int code, uint8_t *response, size_t size, size_t &length)
+{
+  int expected = http.getSize();
+  if (expected < 0)
+  {
+    // Chunked reply, HTTPClient takes the chunks apart. A full buffer is a short
+    // write to it, which HTTPClient reports as HTTPC_ERROR_STREAM_WRITE
+    BufferStream sink(response, size);
+    int written = http.writeToStream(&sink);
+    if (sink.overflow)
+    {
+      disconnect();
+      return VISION_HTTP_TOO_LONG;
+    }
+    if (written < 0)
+      return written;
+    length = sink.length;
+    return code;
+  }
+
+  if ((size_t)expected > size)
+  {
+    // The rest of the reply would still be waiting on a kept-alive connection
+    disconnect();
+    return VISION_HTTP_TOO_LONG;
+  }
+
+  WiFiClient *stream = http.getStreamPtr();
+  unsigned long lastData = millis();
+  while (length < (size_t)expected)
+  {
+    int bytes = stream->read(response + length, expected - length);
+    if (bytes > 0)
+    {
+      length += bytes;
+      lastData = millis();
+      continue;
+    }
+    if (!stream->connected() && !stream->available())
+      return HTTPC_ERROR_CONNECTION_LOST;
+    if (millis() - lastData > VISION_HTTP_TIMEOUT_MS)
+      return HTTPC_ERROR_READ_TIMEOUT;
+    delay(1);
+  }
+  return code;
+}
+
+int VisionClient::post(const char *action, const uint8_t *body, size_t len, uint8_t *response, size_t size, size_t &length)
+{
+  const String &uri = uriFor(action);
+  length = 0;
+  requests++;
+
+  // A kept-alive connection the server closed while idle is seen here, HTTPClient
+  // then opens a new one before anything is written
+  bool wasConnected = client.connected();
+  unsigned long start = micros();
+  int code = send(uri, body, len, response, size, length);
+
+  if (code == HTTPC_ERROR_CONNECTION_REFUSED)
+  {
+    // Nothing of the request left, so once more is safe. Any later failure may have
+    // reached the server, VISION_RETRY_UPLOAD or the caller decides on a resend
+    reconnects++;
+    disconnect();
+    wasConnected = false;
+    start = micros();
+    code = send(uri, body, len, response, size, length);
+  }
+
+  if (code < 0)
+  {
+    disconnect();
+    length = 0;
+    return code;
+  }
+
+  uint32_t us = micros() - start;
+  if (wasConnected)
+  {
+    reused++;
+    reusedUs.record(us);
+  }
+  else
+  {
+    freshUs.record(us);
+  }
+  return code;
+}
+
+void VisionClient::disconnect()
+{
+  http.end();
+  client.stop();
+}
+
+String VisionClient::statsJson()
+{
+  String json = "{\"requests\":" + String(requests.load());
+  json += ",\"reused\":" + String(reused.load());
+  json += ",\"reconnects\":" + String(reconnects.load()) + ",";
+  appendHistogram(json, "freshUs", freshUs);
+  json += ",";
+  appendHistogram(json, "reusedUs", reusedUs);
+  json += "}";
+  return json;
+}
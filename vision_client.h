@@ -0,0 +1,63 @@
+#ifndef VISION_CLIENT_H
+#define VISION_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <HTTPClient.h>
+#include <atomic>
+#include "log_histogram.h"
+
+/**
+ * Long-lived HTTP client for the vision server.
+ *
+ * The connection is kept open between requests (Connection: keep-alive),
+ * so a board read no longer pays a TCP handshake and slow start every
+ * time. The endpoint is parsed once and the request URI of the last few
+ * actions is kept. A connection the server closed while idle is replaced
+ * before the request is written. A request is only sent again when the
+ * connect failed, any other error is returned as it may have reached the
+ * server.
+ * The reply is read from the socket into the caller's buffer, the binary
+ * format is asked for in the Accept header (see vision_reply.h).
+ * Not thread safe: only the vision worker task in esp32.ino uses it.
+ */
+
+#define VISION_HTTP_TIMEOUT_MS 5000
+#define VISION_URI_CACHE 6
+#define VISION_HTTP_TOO_LONG (-100) // the reply does not fit the caller's buffer
+
+class VisionClient
+{
+public:
+  VisionClient();
+
+  // "http://host:port/path"
+  bool begin(const char *endpoint);
+  // Returns the HTTP status code, or a negative HTTPC_ERROR_* code (or VISION_HTTP_TOO_LONG)
+  // with an empty response. length is the number of reply bytes in response.
+  int post(const char *action, const uint8_t *body, size_t len, uint8_t *response, size_t size, size_t &length);
+  void disconnect();
+  String statsJson();
+
+  std::atomic<uint32_t> requests;
+  std::atomic<uint32_t> reused;
+  std::atomic<uint32_t> reconnects; // connects that failed and were tried again
+  LogHistogram freshUs;  // request time on a new connection
+  LogHistogram reusedUs; // request time on a kept-alive connection
+
+private:
+  const String &uriFor(const char *action);
+  int send(const String &uri, const uint8_t *body, size_t len, uint8_t *response, size_t size, size_t &length);
+  int readReply(int code, uint8_t *response, size_t size, size_t &length);
+
+  WiFiClient client;
+  HTTPClient http;
+  String host;
+  uint16_t port;
+  String path;
+  String cachedAction[VISION_URI_CACHE];
+  String cachedUri[VISION_URI_CACHE];
+  uint8_t cacheNext;
+};
+
+#endif
@@ -0,0 +1,327 @@
+#include "vision_queue.h"
+#include <string.h>
+
+enum SlotState
+{
+  SLOT_FREE,
+  SLOT_QUEUED,
+  SLOT_RUNNING,
+  SLOT_CAPTURED,
+  SLOT_DONE,
+  SLOT_FAILED,
+  SLOT_EXPIRED,
+  SLOT_UNCHANGED
+};
+
+#define FUTURE_SLOT_BITS 3
+#define FUTURE_SLOT_MASK ((1 << FUTURE_SLOT_BITS) - 1)
+
+static void copyText(char *to, size_t size, const char *from)
+{
+  if (size == 0)
+    return;
+  strncpy(to, from ? from : "", size - 1);
+  to[size - 1] = '\0';
+}
+
+VisionQueue::VisionQueue()
+{
+  submitted = 0;
+  rejected = 0;
+  expired = 0;
+  cancelledCount = 0;
+  failed = 0;
+  skipped = 0;
+  nextOrder = 0;
+  nextGeneration = 0;
+  for (int i = 0; i < VISION_QUEUE_SIZE; i++)
+  {
+    slots[i].state = SLOT_FREE;
+    slots[i].cancelRequested = false;
+    slots[i].generation = 0;
+    slots[i].order = 0;
+    visionReplyClear(slots[i].reply);
+  }
+}
+
+VisionQueue::Slot *VisionQueue::find(VisionFuture future)
+{
+  int index = (future & FUTURE_SLOT_MASK) - 1;
+  if (index < 0 || index >= VISION_QUEUE_SIZE)
+    return nullptr;
+
+  Slot &slot = slots[index];
+  if (slot.state == SLOT_FREE || slot.generation != (future >> FUTURE_SLOT_BITS))
+    return nullptr;
+  return &slot;
+}
+
+void VisionQueue::expire(Slot &slot, uint32_t nowMs)
+{
+  // Only requests the worker has not picked up yet, a running one finishes
+  if (slot.state == SLOT_QUEUED && (int32_t)(nowMs - slot.request.deadlineMs) > 0)
+  {
+    slot.state = SLOT_EXPIRED;
+    expired++;
+  }
+}
+
+VisionStatus VisionQueue::statusOf(const Slot &slot) const
+{
+  switch (slot.state)
+  {
+  case SLOT_QUEUED:
+  case SLOT_RUNNING:
+    return VISION_PENDING;
+  case SLOT_CAPTURED:
+    return VISION_CAPTURED;
+  case SLOT_DONE:
+    return VISION_DONE;
+  case SLOT_FAILED:
+    return VISION_FAILED;
+  case SLOT_EXPIRED:
+    return VISION_EXPIRED;
+  case SLOT_UNCHANGED:
+    return VISION_UNCHANGED;
+  default:
+    return VISION_UNKNOWN;
+  }
+}
+
+VisionFuture VisionQueue::submit(const char *action, uint32_t nowMs, uint32_t timeoutMs, uint32_t freshAfterMs, uint8_t flags)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  for (int i = 0; i < VISION_QUEUE_SIZE; i++)
+  {
+    Slot &slot = slots[i];
+    if (slot.state != SLOT_FREE)
+      continue;
+
+    nextGeneration = (nextGeneration + 1) & (0xFFFF >> FUTURE_SLOT_BITS);
+    slot.generation = nextGeneration;
+    slot.order = nextOrder++;
+    slot.state = SLOT_QUEUED;
+    slot.cancelRequested = false;
+    visionReplyClear(slot.reply);
+    copyText(slot.request.action, sizeof(slot.request.action), action);
+    slot.request.deadlineMs = nowMs + timeoutMs;
+    slot.request.freshAfterMs = freshAfterMs;
+    slot.request.flags = flags;
+    submitted++;
+    return (VisionFuture)((slot.generation << FUTURE_SLOT_BITS) | (i + 1));
+  }
+
+  rejected++;
+  return VISION_FUTURE_INVALID;
+}
+
+VisionStatus VisionQueue::status(VisionFuture future, uint32_t nowMs)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Slot *slot = find(future);
+  if (!slot || slot->cancelRequested)
+    return VISION_UNKNOWN;
+  expire(*slot, nowMs);
+  return statusOf(*slot);
+}
+
+VisionStatus VisionQueue::collect(VisionFuture future, uint32_t nowMs, VisionReply &reply)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Slot *slot = find(future);
+  if (!slot || slot->cancelRequested)
+    return VISION_UNKNOWN;
+  expire(*slot, nowMs);
+
+  VisionStatus status = statusOf(*slot);
+  if (status == VISION_PENDING || status == VISION_CAPTURED)
+    return status;
+
+  if (status == VISION_DONE)
+    reply = slot->reply;
+  slot->state = SLOT_FREE;
+  return status;
+}
+
+void VisionQueue::cancel(VisionFuture future)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Slot *slot = find(future);
+  if (!slot || slot->cancelRequested)
+    return;
+
+  cancelledCount++;
+  if (slot->state == SLOT_RUNNING || slot->state == SLOT_CAPTURED)
+    slot->cancelRequested = true; // freed by complete()
+  else
+    slot->state = SLOT_FREE;
+}
+
+void VisionQueue::cancelAll()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  for (int i = 0; i < VISION_QUEUE_SIZE; i++)
+  {
+    Slot &slot = slots[i];
+    if (slot.state == SLOT_FREE || slot.cancelRequested)
+      continue;
+
+    cancelledCount++;
+    if (slot.state == SLOT_RUNNING || slot.state == SLOT_CAPTURED)
+      slot.cancelRequested = true;
+    else
+      slot.state = SLOT_FREE;
+  }
+}
+
+VisionFuture VisionQueue::take(uint32_t nowMs, VisionRequest &request)
+{
+  std::lock_guard<std::mutex> guard(lock);
+
+  int oldest = -1;
+  for (int i = 0; i < VISION_QUEUE_SIZE; i++)
+  {
+    Slot &slot = slots[i];
+    expire(slot, nowMs);
+    if (slot.state != SLOT_QUEUED)
+      continue;
+    if (oldest < 0 || (int32_t)(slot.order - slots[oldest].order) < 0)
+      oldest = i;
+  }
+  if (oldest < 0)
+    return VISION_FUTURE_INVALID;
+
+  Slot &slot = slots[oldest];
+  slot.state = SLOT_RUNNING;
+  request = slot.request;
+  return (VisionFuture)((slot.generation << FUTURE_SLOT_BITS) | (oldest + 1));
+}
+
+void VisionQueue::captured(VisionFuture future)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Slot *slot = find(future);
+  if (slot && slot->state == SLOT_RUNNING)
+    slot->state = SLOT_CAPTURED;
+}
+
+bool VisionQueue::cancelled(VisionFuture future)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Slot *slot = find(future);
+  return !slot || slot->cancelRequested;
+}
+
+void VisionQueue::complete(VisionFuture future, bool ok, const VisionReply *reply)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Slot *slot = find(future);
+  if (!slot)
+    return;
+
+  if (slot->cancelRequested)
+  {
+    slot->state = SLOT_FREE;
+    slot->cancelRequested = false;
+    return;
+  }
+
+  if (!ok)
+    failed++;
+  if (ok)
+    slot->reply = *reply;
+  else
+    visionReplyClear(slot->reply);
+  slot->state = ok ? SLOT_DONE : SLOT_FAILED;
+}
+
+void VisionQueue::unchanged(VisionFuture future)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  Slot *slot = find(future);
+  if (!slot)
+    return;
+
+  if (slot->cancelRequested)
+  {
+    slot->state = SLOT_FREE;
+    slot->cancelRequested = false;
+    return;
+  }
+  skipped++;
+  slot->state = SLOT_UNCHANGED;
+}
+
+// A frame buffered before the request may show the arm still moving, so when
+// none is new enough the request fails like a capture that did not work
+static bool captureFresh(VisionTransport &transport, const VisionRequest &request)
+{
+  uint32_t frameMs = 0;
+  for (int attempt = 0; attempt <= VISION_FRESH_RETRIES; attempt++)
+  {
+    if (!transport.capture(frameMs))
+      return false;
+    if (request.freshAfterMs == 0 || (int32_t)(frameMs - request.freshAfterMs) >= 0)
+      return true;
+    transport.release();
+  }
+  return false;
+}
+
+bool visionServe(VisionQueue &queue, VisionTransport &transport, uint32_t (*clockMs)())
+{
+  VisionRequest request;
+  VisionFuture future = queue.take(clockMs(), request);
+  if (future == VISION_FUTURE_INVALID)
+    return false;
+
+  bool withFrame = !(request.flags & VISION_NO_FRAME);
+  bool gated = withFrame && (request.flags & VISION_GATED);
+
+  if (withFrame && !captureFresh(transport, request))
+  {
+    queue.complete(future, false, nullptr);
+    return true;
+  }
+
+  queue.captured(future);
+  if (queue.cancelled(future))
+  {
+    transport.release();
+    queue.complete(future, false, nullptr);
+    return true;
+  }
+
+  if (gated && !transport.changed())
+  {
+    transport.release();
+    queue.unchanged(future);
+    return true;
+  }
+
+  VisionReply reply;
+  if (withFrame && transport.answer(request.action, reply))
+  {
+    transport.release();
+    if (gated)
+      transport.gateDone(true);
+    queue.complete(future, true, &reply);
+    return true;
+  }
+
+  // The frame is still held, so a failed upload is retried without capturing again
+  int attempts = (request.flags & VISION_RETRY_UPLOAD) ? VISION_UPLOAD_ATTEMPTS : 1;
+  bool ok = false;
+  for (int attempt = 0; attempt < attempts && !ok; attempt++)
+  {
+    if (attempt > 0 && queue.cancelled(future))
+      break;
+    ok = transport.upload(request.action, reply);
+  }
+  transport.release();
+  if (gated)
+    transport.gateDone(ok);
+  queue.complete(future, ok, &reply);
+  return true;
+}
@@ -0,0 +1,126 @@
+#ifndef VISION_QUEUE_H
+#define VISION_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+#include "vision_reply.h"
+
+/**
+ * Bounded queue of vision requests between the game loop and the vision
+ * worker task.
+ *
+ * A request carries its action, a deadline and optionally the time its
+ * frame must be newer than. submit() returns a future the game polls
+ * without blocking; a future is a slot index plus a generation, so a stale
+ * one is detected instead of reading somebody else's result. A gated request
+ * is only uploaded when the transport reports a changed scene and otherwise
+ * finishes as VISION_UNCHANGED, and the transport may answer a request
+ * from the frame itself instead of uploading it. Requests still
+ * queued at their deadline expire, cancelled ones are dropped as soon as the
+ * worker is done with them. visionServe() runs one request against a
+ * VisionTransport, so everything here builds on a host with a fake one.
+ */
+
+#define VISION_QUEUE_SIZE 4   // at most 7, the slot is stored in 3 bits of the future
+#define VISION_ACTION_MAX 24
+#define VISION_FRESH_RETRIES 3 // frames dropped while looking for one that is new enough
+#define VISION_FUTURE_INVALID 0
+#define VISION_UPLOAD_ATTEMPTS 3 // for VISION_RETRY_UPLOAD, all on the same frame
+
+// Request flags
+#define VISION_GATED 0x01        // upload only when the scene changed
+#define VISION_NO_FRAME 0x02     // no capture, the request is sent with an empty body
+#define VISION_RETRY_UPLOAD 0x04 // upload the same frame again when it fails
+
+typedef uint16_t VisionFuture;
+
+enum VisionStatus
+{
+  VISION_PENDING,  // queued or running
+  VISION_CAPTURED, // frame taken, upload running
+  VISION_DONE,
+  VISION_FAILED, // capture or upload failed
+  VISION_EXPIRED,
+  VISION_CANCELLED,
+  VISION_UNCHANGED, // gated request, the scene did not change
+  VISION_UNKNOWN // invalid or already collected future
+};
+
+struct VisionRequest
+{
+  char action[VISION_ACTION_MAX];
+  uint32_t deadlineMs;
+  uint32_t freshAfterMs; // 0 = any frame
+  uint8_t flags;         // VISION_GATED, ...
+};
+
+class VisionTransport
+{
+public:
+  virtual ~VisionTransport() {}
+  // Take a frame and report when it was captured
+  virtual bool capture(uint32_t &frameMs) = 0;
+  virtual void release() = 0;
+  // Send the frame taken last (none for VISION_NO_FRAME) and read the server's reply
+  virtual bool upload(const char *action, VisionReply &reply) = 0;
+  // Answer from the frame taken last without the server, false to upload it
+  virtual bool answer(const char *, VisionReply &) { return false; }
+  // Gated requests: false when the frame taken last shows nothing new
+  virtual bool changed() { return true; }
+  // Gated requests: the changed frame was uploaded or not
+  virtual void gateDone(bool) {}
+};
+
+class VisionQueue
+{
+public:
+  VisionQueue();
+
+  // Game side. submit returns VISION_FUTURE_INVALID when the queue is full.
+  VisionFuture submit(const char *action, uint32_t nowMs, uint32_t timeoutMs, uint32_t freshAfterMs = 0, uint8_t flags = 0);
+  VisionStatus status(VisionFuture future, uint32_t nowMs);
+  // Once the request is finished: copies the reply (DONE only) and frees the slot
+  VisionStatus collect(VisionFuture future, uint32_t nowMs, VisionReply &reply);
+  void cancel(VisionFuture future);
+  void cancelAll();
+
+  // Worker side
+  VisionFuture take(uint32_t nowMs, VisionRequest &request);
+  void captured(VisionFuture future);
+  bool cancelled(VisionFuture future);
+  void complete(VisionFuture future, bool ok, const VisionReply *reply);
+  void unchanged(VisionFuture future);
+
+  uint32_t submitted;
+  uint32_t rejected; // queue full
+  uint32_t expired;
+  uint32_t cancelledCount;
+  uint32_t failed;
+  uint32_t skipped; // gated requests that were not uploaded
+
+private:
+  struct Slot
+  {
+    uint8_t state;
+    bool cancelRequested;
+    uint16_t generation;
+    uint32_t order;
+    VisionRequest request;
+    VisionReply reply;
+  };
+
+  Slot *find(VisionFuture future);
+  void expire(Slot &slot, uint32_t nowMs);
+  VisionStatus statusOf(const Slot &slot) const;
+
+  Slot slots[VISION_QUEUE_SIZE];
+  uint32_t nextOrder;
+  uint16_t nextGeneration;
+  std::mutex lock;
+};
+
+// Serve the oldest request, returns false when nothing was queued
+bool visionServe(VisionQueue &queue, VisionTransport &transport, uint32_t (*clockMs)());
+
+#endif
@@ -0,0 +1,146 @@
+#include "vision_reply.h"
+#include <stdio.h>
+#include <string.h>
+
+static const char *const actionNames[] = {nullptr, "xo", "memory", "cupsResult", "rubikReset", "rubikFace", "rubikSolve"};
+
+uint8_t visionActionId(const char *action)
+{
+  size_t length = strcspn(action, "&");
+  for (uint8_t id = 1; id < sizeof(actionNames) / sizeof(actionNames[0]); id++)
+  {
+    if (strlen(actionNames[id]) == length && strncmp(actionNames[id], action, length) == 0)
+      return id;
+  }
+  return VISION_ACTION_UNKNOWN;
+}
+
+void visionReplyClear(VisionReply &reply)
+{
+  reply.action = VISION_ACTION_UNKNOWN;
+  reply.count = 0;
+  reply.hasConfidence = false;
+}
+
+bool visionReplyIsBinary(const uint8_t *body, size_t length)
+{
+  return length > 0 && body[0] == VISION_REPLY_MAGIC;
+}
+
+static bool parseBinary(const uint8_t *body, size_t length, uint8_t action, VisionReply &reply)
+{
+  if (length < VISION_REPLY_HEADER || body[1] != VISION_REPLY_VERSION)
+    return false;
+
+  uint8_t id = body[2];
+  uint8_t type = body[3] & 0x0F;
+  bool hasConfidence = body[3] & VISION_REPLY_CONFIDENCE;
+  uint8_t count = body[4];
+  if (id != action && id != VISION_ACTION_UNKNOWN && action != VISION_ACTION_UNKNOWN)
+    return false;
+  if ((type != VISION_REPLY_INT8 && type != VISION_REPLY_INT16) || count > VISION_REPLY_MAX_VALUES)
+    return false;
+  if (length != VISION_REPLY_HEADER + (size_t)count * (type + (hasConfidence ? 1 : 0)))
+    return false;
+
+  const uint8_t *data = body + VISION_REPLY_HEADER;
+  for (uint8_t i = 0; i < count; i++, data += type)
+    reply.values[i] = type == VISION_REPLY_INT8 ? (int8_t)data[0] : (int16_t)(data[0] | data[1] << 8);
+  if (hasConfidence)
+    memcpy(reply.confidence, data, count);
+
+  reply.action = id;
+  reply.count = count;
+  reply.hasConfidence = hasConfidence;
+  return true;
+}
+
+// Leading comma separated numbers, the text after the last one is ignored
+static bool parseCsv(const uint8_t *body, size_t length, VisionReply &reply)
+{
+  const char *text = (const char *)body;
+  size_t pos = 0;
+  while (pos < length && (text[pos] == ' ' || text[pos] == '\r' || text[pos] == '\n'))
+    pos++;
+  if (length - pos >= 5 && strncmp(text + pos, "error", 5) == 0)
+    return false;
+
+  while (pos < length && reply.count < VISION_REPLY_MAX_VALUES)
+  {
+    while (pos < length && text[pos] == ' ')
+      pos++;
+    bool negative = pos < length && text[pos] == '-';
+    size_t digits = pos + (negative ? 1 : 0);
+    if (digits >= length || text[digits] < '0' || text[digits] > '9')
+      break;
+
+    int value = 0;
+    for (pos = digits; pos < length && text[pos] >= '0' && text[pos] <= '9'; pos++)
+      value = value * 10 + (text[pos] - '0');
+    reply.values[reply.count++] = negative ? -value : value;
+
+    if (pos < length && text[pos] == ' ')
+      pos++;
+    if (pos >= length || text[pos] != ',')
+      break;
+    pos++;
+  }
+  return true;
+}
+
+bool visionReplyParse(const uint8_t *body, size_t length, uint8_t action, VisionReply &reply)
+{
+  visionReplyClear(reply);
+  if (visionReplyIsBinary(body, length))
+    return parseBinary(body, length, action, reply);
+  return parseCsv(body, length, reply);
+}
+
+int visionReplyEncode(const VisionReply &reply, uint8_t *out, size_t size)
+{
+  if (reply.count > VISION_REPLY_MAX_VALUES)
+    return -1;
+
+  uint8_t type = VISION_REPLY_INT8;
+  for (uint8_t i = 0; i < reply.count; i++)
+  {
+    if (reply.values[i] < -32768 || reply.values[i] > 32767)
+      return -1;
+    if (reply.values[i] < -128 || reply.values[i] > 127)
+      type = VISION_REPLY_INT16;
+  }
+
+  size_t length = VISION_REPLY_HEADER + (size_t)reply.count * (type + (reply.hasConfidence ? 1 : 0));
+  if (length > size)
+    return -1;
+
+  out[0] = VISION_REPLY_MAGIC;
+  out[1] = VISION_REPLY_VERSION;
+  out[2] = reply.action;
+  out[3] = type | (reply.hasConfidence ? VISION_REPLY_CONFIDENCE : 0);
+  out[4] = reply.count;
+
+  uint8_t *data = out + VISION_REPLY_HEADER;
+  for (uint8_t i = 0; i < reply.count; i++)
+  {
+    *data++ = reply.values[i] & 0xFF;
+    if (type == VISION_REPLY_INT16)
+      *data++ = (reply.values[i] >> 8) & 0xFF;
+  }
+  if (reply.hasConfidence)
+    memcpy(data, reply.confidence, reply.count);
+  return length;
+}
+
+int visionReplyFormatCsv(const VisionReply &reply, char *out, size_t size)
+{
+  int length = 0;
+  if (size > 0)
+    out[0] = '\0';
+  for (uint8_t i = 0; i < reply.count; i++)
+  {
+    size_t used = (size_t)length < size ? length : size;
+    length += snprintf(out + used, size - used, i ? ",%d" : "%d", reply.values[i]);
+  }
+  return length;
+}
@@ -0,0 +1,65 @@
+#ifndef VISION_REPLY_H
+#define VISION_REPLY_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Vision server replies, binary or CSV.
+ *
+ * The device asks for the binary format in its Accept header
+ * (VISION_REPLY_ACCEPT). A server that knows it answers with
+ * (multi-byte fields are little-endian):
+ *   [magic 0xA6][version][action:u8][type:u8][count:u8]
+ *   [values: count x i8 or i16][confidence: count x u8, 0-100]
+ * The low nibble of type is VISION_REPLY_INT8 or VISION_REPLY_INT16, the
+ * confidence bytes are only there with VISION_REPLY_CONFIDENCE set. The
+ * action id must be the one of the request, or VISION_ACTION_UNKNOWN.
+ * Anything else is read as the old comma separated text, whose leading
+ * numbers become the values. Both end up in a fixed VisionReply, nothing
+ * is allocated. No Arduino dependencies, so it also builds on a host.
+ */
+
+#define VISION_REPLY_MAGIC 0xA6
+#define VISION_REPLY_VERSION 1
+#define VISION_REPLY_HEADER 5
+#define VISION_REPLY_MAX_VALUES 40
+#define VISION_REPLY_INT8 0x01
+#define VISION_REPLY_INT16 0x02
+#define VISION_REPLY_CONFIDENCE 0x80 // | type
+#define VISION_REPLY_ACCEPT "application/x-vision-reply;v=1, text/csv;q=0.5"
+// Largest body: 40 CSV values of up to 6 characters plus their commas
+#define VISION_REPLY_BODY_MAX 288
+
+// Actions known to the binary format, the part of the action before any '&'
+enum VisionActionId
+{
+  VISION_ACTION_UNKNOWN = 0,
+  VISION_ACTION_XO = 1,
+  VISION_ACTION_MEMORY = 2,
+  VISION_ACTION_CUPS = 3,
+  VISION_ACTION_RUBIK_RESET = 4,
+  VISION_ACTION_RUBIK_FACE = 5,
+  VISION_ACTION_RUBIK_SOLVE = 6
+};
+
+struct VisionReply
+{
+  uint8_t action; // VisionActionId, VISION_ACTION_UNKNOWN for CSV replies
+  uint8_t count;
+  bool hasConfidence;
+  int values[VISION_REPLY_MAX_VALUES];
+  uint8_t confidence[VISION_REPLY_MAX_VALUES]; // 0-100, when hasConfidence
+};
+
+uint8_t visionActionId(const char *action);
+void visionReplyClear(VisionReply &reply);
+bool visionReplyIsBinary(const uint8_t *body, size_t length);
+// False for a malformed body, a binary reply to another action or the server's "error"
+bool visionReplyParse(const uint8_t *body, size_t length, uint8_t action, VisionReply &reply);
+// Binary form of the reply, int8 values when they all fit. Returns its length, -1 when it does not fit.
+int visionReplyEncode(const VisionReply &reply, uint8_t *out, size_t size);
+// The values as CSV, returns the length snprintf would
+int visionReplyFormatCsv(const VisionReply &reply, char *out, size_t size);
+
+#endif
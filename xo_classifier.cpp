@@ -0,0 +1,181 @@
+#include "xo_classifier.h"
+
+struct CellRect
+{
+  uint16_t x0;
+  uint16_t y0;
+  uint16_t x1; // exclusive
+  uint16_t y1;
+};
+
+static uint8_t clampPercent(int value)
+{
+  return value < 0 ? 0 : value > 100 ? 100 : value;
+}
+
+// 0 at `low`, 100 at `high`
+static int scale(int value, int low, int high)
+{
+  if (high <= low)
+    return value >= high ? 100 : 0;
+  return clampPercent((value - low) * 100 / (high - low));
+}
+
+static uint8_t boardMedian(const uint8_t *gray, uint16_t width, const CellRect &board)
+{
+  uint32_t histogram[256] = {0};
+  uint32_t total = 0;
+  for (uint16_t y = board.y0; y < board.y1; y++)
+  {
+    const uint8_t *row = gray + (uint32_t)y * width;
+    for (uint16_t x = board.x0; x < board.x1; x++)
+      histogram[row[x]]++;
+    total += board.x1 - board.x0;
+  }
+
+  uint32_t seen = 0;
+  for (int level = 0; level < 256; level++)
+  {
+    seen += histogram[level];
+    if (seen * 2 >= total)
+      return level;
+  }
+  return 255;
+}
+
+static uint32_t countInk(const uint8_t *gray, uint16_t width, const CellRect &rect, uint8_t background, uint8_t delta)
+{
+  uint32_t ink = 0;
+  for (uint16_t y = rect.y0; y < rect.y1; y++)
+  {
+    const uint8_t *row = gray + (uint32_t)y * width;
+    for (uint16_t x = rect.x0; x < rect.x1; x++)
+    {
+      int diff = (int)row[x] - background;
+      if (diff > delta || -diff > delta)
+        ink++;
+    }
+  }
+  return ink;
+}
+
+static uint32_t area(const CellRect &rect)
+{
+  return (uint32_t)(rect.x1 - rect.x0) * (rect.y1 - rect.y0);
+}
+
+// A grid line creeps into the cell when the board is off its calibration. It runs along
+// the whole edge, where an O only touches it: edge rows and columns that are mostly ink
+// are cut off, up to a quarter of the cell on each side.
+static void trimGridLines(const uint8_t *gray, uint16_t width, CellRect &cell, uint8_t background, uint8_t delta)
+{
+  uint16_t maxX = (cell.x1 - cell.x0) / 4;
+  uint16_t maxY = (cell.y1 - cell.y0) / 4;
+  for (uint16_t n = 0; n < maxX; n++)
+  {
+    CellRect left = {cell.x0, cell.y0, (uint16_t)(cell.x0 + 1), cell.y1};
+    if (countInk(gray, width, left, background, delta) * 4 < area(left) * 3)
+      break;
+    cell.x0++;
+  }
+  for (uint16_t n = 0; n < maxX; n++)
+  {
+    CellRect right = {(uint16_t)(cell.x1 - 1), cell.y0, cell.x1, cell.y1};
+    if (countInk(gray, width, right, background, delta) * 4 < area(right) * 3)
+      break;
+    cell.x1--;
+  }
+  for (uint16_t n = 0; n < maxY; n++)
+  {
+    CellRect top = {cell.x0, cell.y0, cell.x1, (uint16_t)(cell.y0 + 1)};
+    if (countInk(gray, width, top, background, delta) * 4 < area(top) * 3)
+      break;
+    cell.y0++;
+  }
+  for (uint16_t n = 0; n < maxY; n++)
+  {
+    CellRect bottom = {cell.x0, (uint16_t)(cell.y1 - 1), cell.x1, cell.y1};
+    if (countInk(gray, width, bottom, background, delta) * 4 < area(bottom) * 3)
+      break;
+    cell.y1--;
+  }
+}
+
+bool xoBoardCalibrated(const XoBoardRect &board)
+{
+  return board.x1 > board.x0 && board.y1 > board.y0 && board.x1 <= 1000 && board.y1 <= 1000;
+}
+
+bool xoClassify(const uint8_t *gray, uint16_t width, uint16_t height, const XoBoardRect &board,
+                const XoClassifierLimits &limits, XoReading &reading)
+{
+  if (!gray || !xoBoardCalibrated(board))
+    return false;
+
+  CellRect pixels = {(uint16_t)((uint32_t)board.x0 * width / 1000), (uint16_t)((uint32_t)board.y0 * height / 1000),
+                     (uint16_t)((uint32_t)board.x1 * width / 1000), (uint16_t)((uint32_t)board.y1 * height / 1000)};
+  uint16_t cellWidth = (pixels.x1 - pixels.x0) / 3;
+  uint16_t cellHeight = (pixels.y1 - pixels.y0) / 3;
+  uint16_t insetX = cellWidth * XO_CELL_INSET_PCT / 100;
+  uint16_t insetY = cellHeight * XO_CELL_INSET_PCT / 100;
+  if (cellWidth - 2 * insetX < XO_CELL_MIN_PIXELS || cellHeight - 2 * insetY < XO_CELL_MIN_PIXELS)
+    return false;
+
+  uint8_t background = boardMedian(gray, width, pixels);
+  reading.boardConfidence = 100;
+
+  for (int i = 0; i < 9; i++)
+  {
+    CellRect cell;
+    cell.x0 = pixels.x0 + (i % 3) * cellWidth + insetX;
+    cell.y0 = pixels.y0 + (i / 3) * cellHeight + insetY;
+    cell.x1 = pixels.x0 + (i % 3 + 1) * cellWidth - insetX;
+    cell.y1 = pixels.y0 + (i / 3 + 1) * cellHeight - insetY;
+    trimGridLines(gray, width, cell, background, limits.inkDelta);
+
+    uint16_t thirdX = (cell.x1 - cell.x0) / 3;
+    uint16_t thirdY = (cell.y1 - cell.y0) / 3;
+    CellRect middle = {(uint16_t)(cell.x0 + thirdX), (uint16_t)(cell.y0 + thirdY),
+                       (uint16_t)(cell.x1 - thirdX), (uint16_t)(cell.y1 - thirdY)};
+
+    int ink = countInk(gray, width, cell, background, limits.inkDelta) * 100 / area(cell);
+    int occupied = scale(ink, limits.emptyInk, limits.occupiedInk);
+
+    uint8_t confidence;
+    if (occupied < 50)
+    {
+      reading.cells[i] = XO_CELL_EMPTY;
+      confidence = (50 - occupied) * 2;
+    }
+    else
+    {
+      int center = countInk(gray, width, middle, background, limits.inkDelta) * 100 / area(middle);
+      int cross = scale(center, limits.oCenter, limits.xCenter);
+      reading.cells[i] = cross >= 50 ? XO_CELL_X : XO_CELL_O;
+
+      uint8_t occupancy = (occupied - 50) * 2;
+      uint8_t shape = cross >= 50 ? (cross - 50) * 2 : (50 - cross) * 2;
+      confidence = occupancy < shape ? occupancy : shape;
+    }
+
+    reading.confidence[i] = confidence;
+    if (confidence < reading.boardConfidence)
+      reading.boardConfidence = confidence;
+  }
+  return true;
+}
+
+void xoFormatReply(const XoReading &reading, VisionReply &reply)
+{
+  reply.action = VISION_ACTION_XO;
+  reply.count = 15;
+  reply.hasConfidence = true;
+  for (int i = 0; i < 15; i++)
+  {
+    int col = i % 5;
+    bool stack = col == 0 || col == 4;
+    int cell = (i / 5) * 3 + col - 1;
+    reply.values[i] = stack ? 0 : reading.cells[cell];
+    reply.confidence[i] = stack ? 100 : reading.confidence[cell];
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef XO_CLASSIFIER_H
+#define XO_CLASSIFIER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "vision_reply.h"
+
+/**
+ * Tic-tac-toe board reader that runs on the device.
+ *
+ * Works on a small grayscale frame (the 1:8 JPEG decode, 128x96 for XGA).
+ * The board is a calibrated rectangle of the image, split into 3x3 cells
+ * that are shrunk by XO_CELL_INSET_PCT to stay clear of the grid lines;
+ * edge rows and columns of a cell that are mostly ink are a grid line of a
+ * board a little off its calibration and are cut off as well.
+ * A pixel is ink when it differs from the board background (the median of
+ * the board) by more than inkDelta. A cell with little ink is empty; an
+ * occupied cell is an X when the middle third of the cell, where the
+ * strokes cross, holds ink and an O when that middle is clear. Every cell
+ * gets a confidence from how far its ink ratios are from the decision
+ * limits, the board confidence is that of its least certain cell. No
+ * Arduino dependencies, so it can be run on recorded frames on a host.
+ */
+
+#define XO_CELL_EMPTY 0
+#define XO_CELL_X 1
+#define XO_CELL_O 2
+#define XO_CELL_INSET_PCT 15
+#define XO_CELL_MIN_PIXELS 6 // smaller cells (after the inset) cannot be read
+
+// Board corners in permille of the image width and height, all 0 = not calibrated
+struct XoBoardRect
+{
+  uint16_t x0;
+  uint16_t y0;
+  uint16_t x1;
+  uint16_t y1;
+};
+
+// Ratios in percent of the cell (or of its middle third)
+struct XoClassifierLimits
+{
+  uint8_t inkDelta;    // gray levels from the background that count as ink
+  uint8_t emptyInk;    // at most this much ink: surely empty
+  uint8_t occupiedInk; // at least this much ink: surely occupied
+  uint8_t oCenter;     // at most this much ink in the middle: surely an O
+  uint8_t xCenter;     // at least this much ink in the middle: surely an X
+};
+
+struct XoReading
+{
+  uint8_t cells[9];      // row major, XO_CELL_*
+  uint8_t confidence[9]; // 0-100
+  uint8_t boardConfidence;
+};
+
+bool xoBoardCalibrated(const XoBoardRect &board);
+// False when the board does not fit the image or its cells are too small
+bool xoClassify(const uint8_t *gray, uint16_t width, uint16_t height, const XoBoardRect &board,
+                const XoClassifierLimits &limits, XoReading &reading);
+// The 15 values of the vision server reply: 3 rows of (stack, 3 cells, stack), stacks as 0,
+// with the cell confidences (100 for the stacks)
+void xoFormatReply(const XoReading &reading, VisionReply &reply);
+
+#endif
@@ -1,10 +1,11 @@
 #include "xo_o_game.h"
 #include "game_utils.h"
+#include "move_script.h"
+#include "state_profiler.h"
 #include <Arduino.h>
 
 extern void changeConfig(String command);
 extern String getPythonData(String command);
-extern void parseCSV(const char *csv, int arr[], int &count);
 extern bool sendServoCommand(int a1, int a2, int a3);
 extern bool sendStepperCommand(const int cmds[]);
 extern void printOnLCD(const String &msg);
@@ -42,12 +43,13 @@ static int lastBoard[3][3] = {
     {EMPTY, EMPTY, EMPTY},
     {EMPTY, EMPTY, EMPTY}};
 
-static const int angleData[3][3][4] = {
+// Hand-tuned cell angles, see calibrateArmTable
+static int angleData[3][3][4] = {
     {{119, 12, 68, 46}, {108, 18, 77, 53}, {95, 16, 73, 54}},
     {{124, 35, 110, 59}, {110, 43, 124, 73}, {94, 38, 114, 64}},
     {{130, 60, 148, 79}, {110, 60, 148, 75}, {90, 61, 148, 84}}};
 
-static const int stackAngleData[5][4] = {
+static int stackAngleData[5][4] = {
     {79, 22, 85, 41},
     {79, 26, 85, 38},
     {79, 29, 85, 38},
@@ -70,25 +72,14 @@ static int turn = PLAYER_X; // This will still start as X, but now X is human
 // State machine variables
 static GameState currentState = GAME_INIT;
 static unsigned long stateStartTime = 0;
-static unsigned long lastActionTime = 0;
-static int servoMoveIndex = 0;
-static int currentMotor = 0;
-static int targetAngle = 0;
-static int overShootValue = 0;
+static RetryPolicy moveRetry(RETRY_BASE_MS, RETRY_MAX_MS, RETRY_MAX_ATTEMPTS, linkStatsRetryHook, LINK_STATS_CTX(LINK_EXEC_XO_O));
+static MoveScriptRunner armMove(moveRetry);
+static bool hoverStarted = false;
+static VisionFuture boardRead = VISION_FUTURE_INVALID;
+STATE_PROFILER(gameProfile, "xoO");
 static Move robotMove = {-1, -1, 0};
 static int moveAngles[4] = {0};
 
-bool xoOExecuteServoMove(ArmMotor motor, int angle, int overShoot)
-{
-  if (sendServoCommand(motor, angle, overShoot))
-  {
-    return true;
-  }
-
-  Serial.println("Servo command failed, will retry...");
-  return false;
-}
-
 void startXOOGame()
 {
   Serial.println("Starting XO Game");
@@ -104,67 +95,94 @@ void startXOOGame()
     for (int j = 0; j < 3; j++)
       lastBoard[i][j] = EMPTY;
 
+  calibrateArmTable("xo board", angleData[0], 3, 3);
+  calibrateArmTable("xo stack", stackAngleData, 5, 1);
+
+  moveRetry.reset();
+  hoverStarted = false;
+  boardRead = VISION_FUTURE_INVALID;
   currentState = GAME_INIT;
   stateStartTime = millis();
 }
 
-// State machine servo move sequence setup
-void setupServoMoveSequenceO(int baseAngle, int shoulderAngle, int elbowAngle, int wristAngle)
+// Moving over the board: the shoulder stays up while the other joints swing,
+// the grip acts only once the arm is in place
+static const ArmConstraint moveConstraints[] = {
+    {ARM_REQUIRE_MIN, ArmMotor::SHOULDER, ArmMotor::BASE, DEFAULT_ANGLE_SHOULDER, 2, 10},
+    {ARM_REQUIRE_MIN, ArmMotor::SHOULDER, ArmMotor::WRIST, DEFAULT_ANGLE_SHOULDER, 2, 10},
+    {ARM_REQUIRE_MIN, ArmMotor::SHOULDER, ArmMotor::ELBOW, DEFAULT_ANGLE_SHOULDER, 2, 10},
+    {ARM_ORDER, ArmMotor::BASE, ArmMotor::GRIP, 0, 0, 0},
+    {ARM_ORDER, ArmMotor::WRIST, ArmMotor::GRIP, 0, 0, 0},
+    {ARM_ORDER, ArmMotor::ELBOW, ArmMotor::GRIP, 0, 0, 0},
+    {ARM_ORDER, ArmMotor::SHOULDER, ArmMotor::GRIP, 0, 0, 0}};
+
+// Lift the shoulder, swing to the target, lower it and set the grip
+MOVE_SCRIPT(moveScript,
+            stepTo(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER, 10),
+            stepToTarget(ArmMotor::BASE),
+            stepToTarget(ArmMotor::WRIST),
+            stepToTarget(ArmMotor::ELBOW),
+            stepToTarget(ArmMotor::SHOULDER),
+            stepToTarget(ArmMotor::GRIP));
+
+// Pre-grasp hover over a stack piece: shoulder up, everything else already in place,
+// so the arm stays out of the board camera view
+MOVE_SCRIPT(hoverScript,
+            stepTo(ArmMotor::SHOULDER, DEFAULT_ANGLE_SHOULDER),
+            stepToTarget(ArmMotor::BASE),
+            stepToTarget(ArmMotor::WRIST),
+            stepToTarget(ArmMotor::ELBOW),
+            stepTo(ArmMotor::GRIP, GRIP_OPEN));
+
+// State machine servo move sequence setup, the whole sequence is sent as one pose
+void setupServoMoveSequenceO(int baseAngle, int shoulderAngle, int elbowAngle, int wristAngle, int gripAngle)
 {
-  servoMoveIndex = 0;
   moveAngles[0] = baseAngle;
   moveAngles[1] = shoulderAngle;
   moveAngles[2] = elbowAngle;
   moveAngles[3] = wristAngle;
 
-  currentMotor = ArmMotor::SHOULDER;
-  targetAngle = DEFAULT_ANGLE_SHOULDER;
-  overShootValue = 10;
+  ArmGoal goal;
+  armGoalBegin(goal);
+  armGoalSet(goal, ArmMotor::BASE, baseAngle);
+  armGoalSet(goal, ArmMotor::SHOULDER, shoulderAngle);
+  armGoalSet(goal, ArmMotor::ELBOW, elbowAngle);
+  armGoalSet(goal, ArmMotor::WRIST, wristAngle);
+  armGoalSet(goal, ArmMotor::GRIP, gripAngle);
+
+  ArmPose pose;
+  if (planPose(pose, goal, moveConstraints, sizeof(moveConstraints) / sizeof(moveConstraints[0])))
+    armMove.start(pose);
+  else
+    armMove.start(moveScript, goal);
 }
 
-// Process one servo move step in the sequence
+// Run the pose set up by setupServoMoveSequenceO, returns true once it is acknowledged
 bool processServoMoveStepO()
 {
-  if (millis() - lastActionTime < 200)
-  {
-    return false; // Wait a little between commands
-  }
+  return armMove.update();
+}
 
-  lastActionTime = millis();
+// Runs the hover move while the player thinks and while the board is read, the grab
+// that follows only has to lower the shoulder. Any other move started meanwhile cancels it.
+void prepositionArmO()
+{
+#if ENABLE_ARM_PREPOSITION
+  if (stackCounter < 0)
+    return;
 
-  bool success = xoOExecuteServoMove((ArmMotor)currentMotor, targetAngle, overShootValue);
-  if (success)
+  if (!hoverStarted)
   {
-    servoMoveIndex++;
-
-    switch (servoMoveIndex)
-    {
-    case 1: // After shoulder default
-      currentMotor = ArmMotor::BASE;
-      targetAngle = moveAngles[0];
-      overShootValue = 0; // No overshoot to any other servo
-      break;
-    case 2: // After base
-      currentMotor = ArmMotor::WRIST;
-      targetAngle = moveAngles[3];
-      break;
-    case 3: // After wrist
-      currentMotor = ArmMotor::ELBOW;
-      targetAngle = moveAngles[2];
-      break;
-    case 4: // After elbow
-      currentMotor = ArmMotor::SHOULDER;
-      targetAngle = moveAngles[1];
-      break;
-    case 5: // After shoulder
-      currentMotor = ArmMotor::GRIP;
-      targetAngle = currentState == ROBOT_GRABBING ? GRIP_CLOSED : GRIP_OPEN;
-      break;
-    case 6:        // After grip
-      return true; // Sequence complete
-    }
+    ArmGoal goal;
+    armGoalBegin(goal);
+    armGoalSet(goal, ArmMotor::BASE, stackAngleData[stackCounter][0]);
+    armGoalSet(goal, ArmMotor::ELBOW, stackAngleData[stackCounter][2]);
+    armGoalSet(goal, ArmMotor::WRIST, stackAngleData[stackCounter][3]);
+    armMove.start(hoverScript, goal);
+    hoverStarted = true;
   }
-  return false; // Sequence not complete yet
+  armMove.update();
+#endif
 }
 
 void getAnglesForCellO(int x, int y, int angles[4])
@@ -374,8 +392,19 @@ bool extractPlayableGridO(int cameraData[], uint8_t count)
 
 void xoOGameLoop()
 {
+  PROFILE_STATE(gameProfile, currentState);
   unsigned long currentTime = millis();
 
+  // The arm gave up on a move, the board no longer matches the game
+  if (moveRetry.gaveUp() && currentState != GAME_OVER)
+  {
+    Serial.println("Arm not responding, game over");
+    armMove.cancel();
+    cancelPythonData(boardRead);
+    boardRead = VISION_FUTURE_INVALID;
+    currentState = GAME_OVER;
+  }
+
   switch (currentState)
   {
   case GAME_OVER:
@@ -390,7 +419,8 @@ void xoOGameLoop()
       setupServoMoveSequenceO(defaultAngles[0],
                               defaultAngles[1],
                               defaultAngles[2],
-                              defaultAngles[3]);
+                              defaultAngles[3],
+                              GRIP_OPEN);
       currentState = ROBOT_INIT;
       stateStartTime = currentTime;
     }
@@ -408,6 +438,7 @@ void xoOGameLoop()
 
   case ROBOT_THINKING:
     // Calculate robot's move
+    hoverStarted = false;
     robotMove = findBestMoveO();
     board[robotMove.row][robotMove.col] = PLAYER_O; // Robot places O
     lastBoard[robotMove.row][robotMove.col] = PLAYER_O;
@@ -425,7 +456,8 @@ void xoOGameLoop()
         stackAngleData[stackCounter][0],
         stackAngleData[stackCounter][1],
         stackAngleData[stackCounter][2],
-        stackAngleData[stackCounter][3]);
+        stackAngleData[stackCounter][3],
+        GRIP_CLOSED);
 
     currentState = ROBOT_GRABBING;
     stateStartTime = currentTime;
@@ -443,7 +475,8 @@ void xoOGameLoop()
           moveAngles[0],
           moveAngles[1],
           moveAngles[2],
-          moveAngles[3]);
+          moveAngles[3],
+          GRIP_OPEN);
 
       currentState = ROBOT_PLACING;
       stateStartTime = currentTime;
@@ -469,7 +502,8 @@ void xoOGameLoop()
             defaultAngles[0],
             defaultAngles[1],
             defaultAngles[2],
-            defaultAngles[3]);
+            defaultAngles[3],
+            GRIP_OPEN);
 
         currentState = ROBOT_RETREATING;
         stateStartTime = currentTime;
@@ -492,6 +526,7 @@ void xoOGameLoop()
 
   case WAITING_FOR_PLAYER:
     // Wait for player to make a move
+    prepositionArmO();
     if (currentTime - stateStartTime > 4000)
     { // Wait a bit before checking camera
       currentState = CAPTURING_BOARD;
@@ -502,17 +537,36 @@ void xoOGameLoop()
   case CAPTURING_BOARD:
   {
     // Enclose this case block in braces to scope the variable
-    Serial.println("Player X Move: ");
-    printOnLCD("Reading board...");
-    String res = getPythonData("xo");
+    // The hover goes on while the camera reads the board, it would stall until the next wait otherwise
+    prepositionArmO();
+    if (boardRead == VISION_FUTURE_INVALID)
+    {
+      Serial.println("Player X Move: ");
+      printOnLCD("Reading board...");
+      // Only a frame taken after the wait can show the player's move, and
+      // only a board that changed since the last read is uploaded
+      boardRead = startPythonData("xo", VISION_DEFAULT_TIMEOUT_MS, millis(), VISION_GATED);
+      if (boardRead == VISION_FUTURE_INVALID)
+        break;
+    }
+
+    VisionStatus status;
+    VisionReply reply;
+    if (!pollVisionReply(boardRead, status, reply))
+      break;
+    boardRead = VISION_FUTURE_INVALID;
 
-    if (res != "ERROR")
+    if (status == VISION_UNCHANGED)
     {
-      int cam[20];
-      int cnt;
-      parseCSV(res.c_str(), cam, cnt);
+      // Nothing moved on the board, look again in a second
+      currentState = WAITING_FOR_PLAYER;
+      stateStartTime = currentTime - 3000;
+      break;
+    }
 
-      if (extractPlayableGridO(cam, cnt))
+    if (status == VISION_DONE)
+    {
+      if (extractPlayableGridO(reply.values, reply.count))
       {
         Serial.println("Grid extracted correctly");
 
@@ -568,7 +622,8 @@ void xoOGameLoop()
           defaultAngles[0],
           defaultAngles[1],
           defaultAngles[2],
-          defaultAngles[3]);
+          defaultAngles[3],
+          GRIP_OPEN);
       currentState = ROBOT_FINAL_RETREAT;
     }
     if (res == 10)
@@ -594,4 +649,8 @@ void stopXOOGame()
   Serial.println("Stopping XO Game");
   changeConfig("none");
   currentState = GAME_OVER;
+  armMove.cancel();
+  cancelPythonData(boardRead);
+  boardRead = VISION_FUTURE_INVALID;
+  PROFILE_STOP(gameProfile);
 }
\ No newline at end of file